@@ -0,0 +1,73 @@
+#include "arena.h"
+
+static const int kArenaBlockSize = 4096;
+
+Arena::Arena()
+	: allocptr(nullptr),
+	allocbytesremaining(0),
+	memoryusage(0) {
+
+}
+
+Arena::~Arena() {
+	for (size_t i = 0; i < blocks.size(); i++) {
+		delete[] blocks[i];
+	}
+}
+
+char* Arena::allocateFallback(size_t bytes) {
+	if (bytes > kArenaBlockSize / 4) {
+		// Object is more than a quarter of our block size.  Allocate it separately
+		// to avoid wasting too much space in leftover bytes.
+		char* result = allocateNewBlock(bytes);
+		return result;
+	}
+
+	// We waste the remaining space in the current block.
+	allocptr = allocateNewBlock(kArenaBlockSize);
+	allocbytesremaining = kArenaBlockSize;
+
+	char* result = allocptr;
+	allocptr += bytes;
+	allocbytesremaining -= bytes;
+	return result;
+}
+
+char* Arena::allocateAligned(size_t bytes) {
+	const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+	static_assert((align & (align - 1)) == 0,
+		"Pointer size should be a power of 2");
+	size_t currentmod = reinterpret_cast<uintptr_t>(allocptr) & (align - 1);
+	size_t slop = (currentmod == 0 ? 0 : align - currentmod);
+	size_t needed = bytes + slop;
+	char* result;
+	if (needed <= allocbytesremaining) {
+		result = allocptr + slop;
+		allocptr += needed;
+		allocbytesremaining -= needed;
+	}
+	else {
+		// AllocateFallback always returned aligned memory
+		result = allocateFallback(bytes);
+	}
+	assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+	return result;
+}
+
+char* Arena::allocateConcurrently(size_t bytes) {
+	std::unique_lock<std::mutex> lk(mutex);
+	return allocate(bytes);
+}
+
+char* Arena::allocateAlignedConcurrently(size_t bytes) {
+	std::unique_lock<std::mutex> lk(mutex);
+	return allocateAligned(bytes);
+}
+
+char* Arena::allocateNewBlock(size_t blockbytes) {
+	char* result = new char[blockbytes];
+	blocks.push_back(result);
+	memoryusage.fetch_add(blockbytes + sizeof(char*),
+		std::memory_order_relaxed);
+	return result;
+}
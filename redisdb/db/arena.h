@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+class Arena {
+public:
+	Arena();
+
+	~Arena();
+
+	// Return a pointer to a newly allocated memory block of "bytes" bytes.
+	char* allocate(size_t bytes);
+
+	// Allocate memory with the normal alignment guarantees provided by malloc.
+	char* allocateAligned(size_t bytes);
+
+	// Thread-safe variants of the above, for several writers filling the
+	// same arena at once.  They must not race with the unsynchronized ones.
+	char* allocateConcurrently(size_t bytes);
+
+	char* allocateAlignedConcurrently(size_t bytes);
+
+	// Returns an estimate of the total memory usage of data allocated
+	// by the arena.
+	size_t getMemoryUsage() const {
+		return memoryusage.load(std::memory_order_relaxed);
+	}
+
+private:
+	char* allocateFallback(size_t bytes);
+
+	char* allocateNewBlock(size_t blockbytes);
+
+	// Allocation state
+	char* allocptr;
+	size_t allocbytesremaining;
+
+	// Array of new[] allocated memory blocks
+	std::vector<char*> blocks;
+
+	// Serializes the *Concurrently() allocation paths.
+	std::mutex mutex;
+
+	// Total memory usage of the arena.  Read without holding any lock by
+	// DB::MakeRoomForWrite(), hence atomic.
+	std::atomic<size_t> memoryusage;
+
+	// No copying allowed
+	Arena(const Arena&);
+
+	void operator=(const Arena&);
+};
+
+inline char* Arena::allocate(size_t bytes) {
+	// The semantics of what to return are a bit messy if we allow
+	// 0-byte allocations, so we disallow them here (we don't need
+	// them for our internal use).
+	assert(bytes > 0);
+	if (bytes <= allocbytesremaining) {
+		char* result = allocptr;
+		allocptr += bytes;
+		allocbytesremaining -= bytes;
+		return result;
+	}
+	return allocateFallback(bytes);
+}
@@ -0,0 +1,99 @@
+#include "blobfile.h"
+#include "coding.h"
+#include "crc32c.h"
+#include "env.h"
+#include "filename.h"
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+	PutVarint64(dst, filenumber);
+	PutVarint64(dst, offset);
+	PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(const std::string_view& input) {
+	std::string_view in = input;
+	if (GetVarint64(&in, &filenumber) &&
+		GetVarint64(&in, &offset) &&
+		GetVarint64(&in, &size) &&
+		in.empty()) {
+		return Status::OK();
+	}
+	else {
+		return Status::Corruption("bad blob index");
+	}
+}
+
+BlobFileBuilder::BlobFileBuilder(const Options& options, const std::string& dbname,
+	const std::function<uint64_t()>& newfilenumber, IOPriority pri)
+	: options(options),
+	dbname(dbname),
+	newfilenumber(newfilenumber),
+	iopriority(pri) {
+
+}
+
+Status BlobFileBuilder::OpenFile() {
+	FileInfo info;
+	info.number = newfilenumber();
+	info.count = 0;
+	info.bytes = 0;
+	files.push_back(info);
+
+	Status s = options.env->NewWritableFile(BlobFileName(dbname, info.number), file);
+	if (s.ok() && options.ratelimiter != nullptr) {
+		file->SetRateLimiter(options.ratelimiter, iopriority);
+	}
+	return s;
+}
+
+Status BlobFileBuilder::CloseFile() {
+	Status s = file->sync();
+	if (s.ok()) {
+		s = file->close();
+	}
+	file.reset();
+	return s;
+}
+
+Status BlobFileBuilder::Add(const std::string_view& value, std::string* index) {
+	Status s;
+	if (file == nullptr) {
+		s = OpenFile();
+		if (!s.ok()) {
+			return s;
+		}
+	}
+
+	FileInfo& info = files.back();
+	char header[kBlobRecordHeaderSize];
+	EncodeFixed32(header, crc32c::Mask(crc32c::Value(value.data(), value.size())));
+	s = file->append(std::string_view(header, sizeof(header)));
+	if (s.ok()) {
+		s = file->append(value);
+	}
+
+	if (!s.ok()) {
+		return s;
+	}
+
+	BlobIndex blobindex;
+	blobindex.filenumber = info.number;
+	blobindex.offset = info.bytes + kBlobRecordHeaderSize;
+	blobindex.size = value.size();
+	index->clear();
+	blobindex.EncodeTo(index);
+
+	info.count++;
+	info.bytes += blobindex.RecordSize();
+	if (info.bytes >= options.blobfilesize) {
+		s = CloseFile();
+	}
+	return s;
+}
+
+Status BlobFileBuilder::Finish() {
+	if (file == nullptr) {
+		return Status::OK();
+	}
+	return CloseFile();
+}
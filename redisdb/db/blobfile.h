@@ -0,0 +1,94 @@
+#pragma once
+
+// Blob files hold the large values of a DB that has
+// Options::enableblobfiles set.  When a memtable is flushed or tables
+// are compacted, each value of at least Options::minblobsize bytes is
+// appended to a blob file, and the table keeps a BlobIndex that points
+// at it under the kTypeBlobIndex value type.  Compactions then only
+// move the small index around; the value is written once.
+//
+// A blob file is a sequence of records, with no header or footer:
+//    checksum: fixed32   // masked crc32c of the value
+//    value: char[size]
+// The BlobIndex records the file, the offset of the value and its
+// size, so a value is read back with a single read.
+//
+// The manifest lists every live blob file with the number and bytes of
+// records written to it, and the garbage: records whose key has since
+// been dropped by a compaction.  A blob file is deleted once all of its
+// records are garbage.  See VersionSet for how compactions are made to
+// relocate the live records of old files.
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "option.h"
+#include "status.h"
+
+class WritableFile;
+
+// checksum: fixed32
+static const size_t kBlobRecordHeaderSize = 4;
+
+struct BlobIndex {
+	uint64_t filenumber;
+	uint64_t offset;     // Offset of the value, past the record header
+	uint64_t size;       // Size of the value
+
+	BlobIndex() : filenumber(0), offset(0), size(0) {}
+
+	void EncodeTo(std::string* dst) const;
+
+	Status DecodeFrom(const std::string_view& input);
+
+	// Bytes the record takes up in the blob file.
+	uint64_t RecordSize() const { return kBlobRecordHeaderSize + size; }
+};
+
+// Appends values to a sequence of blob files, starting a new one once
+// the current one reaches Options::blobfilesize.  File numbers are
+// handed out by "newfilenumber", which must keep them from being
+// deleted as obsolete until the files are installed in a version.
+//
+// Not thread safe.
+class BlobFileBuilder {
+public:
+	struct FileInfo {
+		uint64_t number;
+		uint64_t count;      // Records written
+		uint64_t bytes;      // Bytes written, headers included
+	};
+
+	BlobFileBuilder(const Options& options, const std::string& dbname,
+		const std::function<uint64_t()>& newfilenumber, IOPriority pri);
+
+	BlobFileBuilder(const BlobFileBuilder&) = delete;
+
+	void operator=(const BlobFileBuilder&) = delete;
+
+	// Append "value" and store its encoded BlobIndex in "*index".
+	Status Add(const std::string_view& value, std::string* index);
+
+	// Sync and close the current file.  No Add() may follow.
+	Status Finish();
+
+	// Files written so far, including one that failed part way.  A file
+	// is listed as soon as it is created, so that the caller can delete
+	// every file if the output is abandoned.
+	const std::vector<FileInfo>& GetFiles() const { return files; }
+
+private:
+	Status OpenFile();
+
+	Status CloseFile();
+
+	const Options options;
+	const std::string dbname;
+	const std::function<uint64_t()> newfilenumber;
+	const IOPriority iopriority;
+	std::shared_ptr<WritableFile> file;
+	std::vector<FileInfo> files;
+};
@@ -1,12 +1,9 @@
 #include "block.h"
+#include "blockbuilder.h"
+#include "hash.h"
 #include <vector>
 #include <algorithm>
 
-inline uint32_t Block::numrestarts() const {
-	assert(size >= sizeof(uint32_t));
-	return DecodeFixed32(data + size - sizeof(uint32_t));
-}
-
 // Helper routine: decode the Next block entry starting at "p",
 // storing the number of shared key bytes, non_shared key bytes,
 // and the length of the value in "*shared", "*non_shared", and
@@ -170,8 +167,13 @@ public:
 			}
 		}
 
-		// Linear search (within restart block) for first key >= target
-		seekToRestartPoint(left);
+		SeekFromRestart(left, target);
+	}
+
+	// Linear search, starting at restart point "index", for the first
+	// key >= target.
+	void SeekFromRestart(uint32_t index, const std::string_view& target) {
+		seekToRestartPoint(index);
 		while (true) {
 			if (!parseNextKey()) {
 				return;
@@ -237,19 +239,43 @@ public:
 Block::Block(const BlockContents& contents)
 	: data(contents.data.data()),
 	size(contents.data.size()),
+	restartoffset(0),
+	numrestarts(0),
+	buckets(nullptr),
+	numbuckets(0),
 	owned(contents.heapallocated) {
 	if (size< sizeof(uint32_t)) {
 		size = 0;  // Error marker
+		return;
 	}
-	else {
-		size_t maxRestartsAllowed = (size - sizeof(uint32_t)) / sizeof(uint32_t);
-		if (numrestarts() > maxRestartsAllowed) {
-			// The size is too small for numrestarts()
+
+	size_t limit = size - sizeof(uint32_t);
+	numrestarts = DecodeFixed32(data + limit);
+	if (numrestarts & kBlockHashIndexFlag) {
+		numrestarts &= ~kBlockHashIndexFlag;
+		if (limit< sizeof(uint32_t)) {
 			size = 0;
+			return;
 		}
-		else {
-			restartoffset = size - (1 + numrestarts()) * sizeof(uint32_t);
+
+		limit -= sizeof(uint32_t);
+		numbuckets = DecodeFixed32(data + limit);
+		if (numbuckets == 0 || numbuckets > limit) {
+			size = 0;
+			return;
 		}
+
+		limit -= numbuckets;
+		buckets = reinterpret_cast<const uint8_t*>(data + limit);
+	}
+
+	size_t maxRestartsAllowed = limit / sizeof(uint32_t);
+	if (numrestarts > maxRestartsAllowed) {
+		// The size is too small for numrestarts
+		size = 0;
+	}
+	else {
+		restartoffset = limit - numrestarts * sizeof(uint32_t);
 	}
 }
 
@@ -264,14 +290,50 @@ std::shared_ptr<Iterator> Block::NewIterator(const Comparator* cmp) {
 		return NewErrorIterator(Status::Corruption("bad block contents"));
 	}
 
-	const uint32_t restarts = numrestarts();
-	if (restarts == 0) {
+	if (numrestarts == 0) {
 		return NewEmptyIterator();
 	}
 	else {
-		std::shared_ptr<Iterator> iter(new BlockIterator(cmp, data, restartoffset, restarts));
+		std::shared_ptr<Iterator> iter(new BlockIterator(cmp, data, restartoffset, numrestarts));
 		return iter;
 	}
 }
 
+Status Block::InternalGet(const Comparator* cmp,
+	const std::string_view& key,
+	const std::any& arg,
+	std::function<void(const std::any& arg,
+		const std::string_view& k, const std::string_view& v)>& callback) {
+	if (size< sizeof(uint32_t)) {
+		return Status::Corruption("bad block contents");
+	}
+
+	if (numrestarts == 0) {
+		return Status::OK();
+	}
+
+	BlockIterator iter(cmp, data, restartoffset, numrestarts);
+	uint8_t bucket = kBlockHashCollision;
+	if (buckets != nullptr) {
+		std::string_view userkey = ExtractUserKey(key);
+		bucket = buckets[Hash(userkey.data(), userkey.size(), kBlockHashSeed) % numbuckets];
+	}
+
+	if (bucket == kBlockHashNoEntry) {
+		return Status::OK();
+	}
+	else if (bucket < numrestarts) {
+		// Every version of the user key starts in this restart interval.
+		iter.SeekFromRestart(bucket, key);
+	}
+	else {
+		iter.Seek(key);
+	}
+
+	if (iter.Valid()) {
+		callback(arg, iter.key(), iter.value());
+	}
+	return iter.status();
+}
+
 
@@ -6,6 +6,7 @@
 #include <any>
 #include <list>
 #include <memory>
+#include <functional>
 #include <assert.h>
 #include "coding.h"
 #include "format.h"
@@ -21,14 +22,30 @@ public:
 
 	size_t GetSize() const { return size; }
 
+	// Returns true iff the block owns its contents, which then stay valid
+	// for as long as the block lives.  Otherwise they belong to the file
+	// the block was read from.
+	bool IsOwned() const { return owned; }
+
 	std::shared_ptr<Iterator> NewIterator(const Comparator* comparator);
 
-private:
-	uint32_t numrestarts() const;
+	// Calls callback(arg, ...) with the first entry >= the internal key
+	// "key", if any.  Uses the hash index of the block when it has one,
+	// and does not call callback at all when the index shows that no
+	// entry has the user key of "key".
+	Status InternalGet(const Comparator* comparator,
+		const std::string_view& key,
+		const std::any& arg,
+		std::function<void(const std::any& arg,
+			const std::string_view& k, const std::string_view& v)>& callback);
 
+private:
 	const char* data;
 	size_t size;
 	uint32_t restartoffset;     // Offset in data_ of restart array
+	uint32_t numrestarts;
+	const uint8_t* buckets;      // Hash index, or nullptr if there is none
+	uint32_t numbuckets;
 	bool owned;                  // Block owns data_[]
 
 	// No copying allowed
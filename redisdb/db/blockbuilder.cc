@@ -2,12 +2,18 @@
 #include <algorithm>
 #include <assert.h>
 #include "blockbuilder.h"
+#include "dbformat.h"
+#include "hash.h"
 
-BlockBuilder::BlockBuilder(const Options* options)
+// Average number of keys per bucket of the hash index.
+static const double kBlockHashUtilRatio = 0.75;
+
+BlockBuilder::BlockBuilder(const Options* options, bool hashindex)
 	: options(options),
 	restarts(),
 	counter(0),
-	finished(false) {
+	finished(false),
+	hashindex(hashindex) {
 	assert(options->blockrestartinterval >= 1);
 	restarts.push_back(0);       // First restart point is at offset 0
 }
@@ -19,12 +25,18 @@ void BlockBuilder::reset() {
 	counter = 0;
 	finished = false;
 	lastkey.clear();
+	hashes.clear();
+	hashrestarts.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-	return (buffer.size() +                        // Raw data buffer
+	size_t estimate = (buffer.size() +             // Raw data buffer
 		restarts.size() * sizeof(uint32_t) +   // Restart array
 		sizeof(uint32_t));                      // Restart array length
+	if (hashindex) {
+		estimate += hashes.size() / kBlockHashUtilRatio + sizeof(uint32_t);
+	}
+	return estimate;
 }
 
 std::string_view BlockBuilder::Finish() {
@@ -33,11 +45,41 @@ std::string_view BlockBuilder::Finish() {
 		PutFixed32(&buffer, restarts[i]);
 	}
 
-	PutFixed32(&buffer, restarts.size());
+	if (hashindex && !hashes.empty() && restarts.size() <= kBlockHashMaxRestarts) {
+		AppendHashIndex();
+		PutFixed32(&buffer, restarts.size() | kBlockHashIndexFlag);
+	}
+	else {
+		PutFixed32(&buffer, restarts.size());
+	}
+
 	finished = true;
 	return std::string_view(buffer);
 }
 
+void BlockBuilder::AppendHashIndex() {
+	uint32_t numbuckets = static_cast<uint32_t>(hashes.size() / kBlockHashUtilRatio);
+	if (numbuckets == 0) {
+		numbuckets = 1;
+	}
+
+	// A bucket shared by keys of different restart intervals is marked
+	// as a collision and readers fall back to binary search.
+	std::vector<uint8_t> buckets(numbuckets, kBlockHashNoEntry);
+	for (size_t i = 0; i < hashes.size(); i++) {
+		uint8_t& bucket = buckets[hashes[i] % numbuckets];
+		if (bucket == kBlockHashNoEntry) {
+			bucket = hashrestarts[i];
+		}
+		else if (bucket != hashrestarts[i]) {
+			bucket = kBlockHashCollision;
+		}
+	}
+
+	buffer.append(reinterpret_cast<const char*>(buckets.data()), buckets.size());
+	PutFixed32(&buffer, numbuckets);
+}
+
 void BlockBuilder::Add(const std::string_view& key, const std::string_view& value) {
 	std::string_view lastKeyPiece(lastkey);
 	assert(!finished);
@@ -80,4 +122,17 @@ void BlockBuilder::Add(const std::string_view& key, const std::string_view& valu
 	lastkey.append(key.data() + shared, nonShared);
 	assert(std::string_view(lastkey) == key);
 	counter++;
+
+	if (hashindex) {
+		// Versions of one user key are adjacent, so only record the
+		// first of a run within a restart interval.
+		std::string_view userkey = ExtractUserKey(key);
+		uint32_t h = Hash(userkey.data(), userkey.size(), kBlockHashSeed);
+		uint8_t restart = static_cast<uint8_t>(std::min<size_t>(restarts.size() - 1,
+			kBlockHashMaxRestarts));
+		if (hashes.empty() || hashes.back() != h || hashrestarts.back() != restart) {
+			hashes.push_back(h);
+			hashrestarts.push_back(restart);
+		}
+	}
 }
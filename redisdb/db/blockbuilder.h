@@ -5,9 +5,27 @@
 #include <string_view>
 #include "option.h"
 
+// Restart counts with this bit set mark a block that ends with a hash
+// index: one byte per bucket holding the restart interval of the user
+// keys that hash to it, followed by the fixed32 bucket count, just
+// before the restart count.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// Bucket values that are not a restart index.
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+
+// Restart indices must fit below kBlockHashCollision for a block to get
+// an index.
+static const uint32_t kBlockHashMaxRestarts = 253;
+
+static const uint32_t kBlockHashSeed = 0x5f1d2c3b;
+
 class BlockBuilder {
 public:
-	BlockBuilder(const Options* options);
+	// If "hashindex" is true, keys are internal keys and Finish() appends
+	// a hash index over their user keys.
+	BlockBuilder(const Options* options, bool hashindex = false);
 
 	// Reset the Contents as if the BlockBuilder was just constructed.
 	void reset();
@@ -35,6 +53,11 @@ private:
 	int counter;     // Number of entries emitted since restart
 	bool finished;    // Has Finish() been called?
 	std::string lastkey;
+	bool hashindex;
+	std::vector<uint32_t> hashes;      // User key hashes, for the hash index
+	std::vector<uint8_t> hashrestarts; // Restart index of each hash
+
+	void AppendHashIndex();
 
 	// No copying allowed
 	BlockBuilder(const BlockBuilder&);
@@ -0,0 +1,81 @@
+#include "filterpolicy.h"
+#include "hash.h"
+
+static uint32_t BloomHash(const std::string_view& key) {
+	return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+class BloomFilterPolicy : public FilterPolicy {
+public:
+	explicit BloomFilterPolicy(int bitsperkey) 
+		: bitsperkey(bitsperkey) {
+		// We intentionally round down to reduce probing cost a little bit
+		k = static_cast<size_t>(bitsperkey * 0.69);  // 0.69 =~ ln(2)
+		if (k < 1) k = 1;
+		if (k > 30) k = 30;
+	}
+
+	const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+	void CreateFilter(const std::string_view* keys, int n, std::string* dst) const override {
+		// Compute bloom filter size (in both bits and bytes)
+		size_t bits = n * bitsperkey;
+
+		// For small n, we can see a very high false positive rate.  Fix it
+		// by enforcing a minimum bloom filter length.
+		if (bits < 64) bits = 64;
+
+		size_t bytes = (bits + 7) / 8;
+		bits = bytes * 8;
+
+		const size_t initsize = dst->size();
+		dst->resize(initsize + bytes, 0);
+		dst->push_back(static_cast<char>(k));  // Remember # of probes in filter
+		char* array = &(*dst)[initsize];
+		for (int i = 0; i < n; i++) {
+			// Use double-hashing to generate a sequence of hash values.
+			// See analysis in [Kirsch,Mitzenmacher 2006].
+			uint32_t h = BloomHash(keys[i]);
+			const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+			for (size_t j = 0; j < k; j++) {
+				const uint32_t bitpos = h % bits;
+				array[bitpos / 8] |= (1 << (bitpos % 8));
+				h += delta;
+			}
+		}
+	}
+
+	bool KeyMayMatch(const std::string_view& key, const std::string_view& bloomfilter) const override {
+		const size_t len = bloomfilter.size();
+		if (len < 2) return false;
+
+		const char* array = bloomfilter.data();
+		const size_t bits = (len - 1) * 8;
+
+		// Use the encoded k so that we can read filters generated by
+		// bloom filters created using different parameters.
+		const size_t k = array[len - 1];
+		if (k > 30) {
+			// Reserved for potentially new encodings for short bloom filters.
+			// Consider it a match.
+			return true;
+		}
+
+		uint32_t h = BloomHash(key);
+		const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+		for (size_t j = 0; j < k; j++) {
+			const uint32_t bitpos = h % bits;
+			if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+			h += delta;
+		}
+		return true;
+	}
+
+private:
+	size_t bitsperkey;
+	size_t k;
+};
+
+std::shared_ptr<FilterPolicy> NewBloomFilterPolicy(int bitsperkey) {
+	return std::shared_ptr<FilterPolicy>(new BloomFilterPolicy(bitsperkey));
+}
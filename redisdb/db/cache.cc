@@ -1,5 +1,9 @@
 #include "cache.h"
 
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
 // LRU cache implementation
 //
 // Cache entries have an "in_cache" boolean indicating whether the cache has a
@@ -7,139 +11,331 @@
 // entry being passed to its "deleter" are via Erase(), via Insert() when
 // an element with a duplicate key is inserted, or on destruction of the cache.
 //
-// The cache keeps two linked lists of items in the cache.  All items in the
-// cache are in one list or the other, and never both.  Items still referenced
-// by clients but erased from the cache are in neither list.  The lists are:
+// The cache keeps three linked lists of items in the cache.  All items in the
+// cache are in exactly one list.  Items still referenced by clients but erased
+// from the cache are in none.  The lists are:
 // - in-use:  Contains the items currently referenced by clients, in no
 //   particular order.  (This list is used for invariant checking.  If we
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
-// - LRU:  Contains the items not currently referenced by clients, in LRU order
+// - hot:  Items not currently referenced by clients that were looked up at
+//   least once since they were inserted, in LRU order.
+// - cold:  All other items not currently referenced by clients, in LRU order.
+//   New items enter here, in the middle of the overall LRU order.
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
 
-LRUHandle::LRUHandle()
-	: keydata(nullptr) {
+// Share of a shard's capacity that the hot list may hold; the rest is
+// the cold list that absorbs scans.
+static const size_t kHotPercent = 60;
+
+// Marks a table slot whose entry was removed; probing continues past it.
+static LRUHandle kTombstone;
 
+static const size_t kInitialSlots = 16;
+
+static LRUHandle* NewHandle(const std::string_view& key, uint32_t hash,
+	const std::any& value, size_t charge, CacheDeleter deleter) {
+	void* mem = malloc(sizeof(LRUHandle) - 1 + key.size());
+	LRUHandle* e = new (mem) LRUHandle;
+	e->value = value;
+	e->deleter = deleter;
+	e->next = e->prev = nullptr;
+	e->charge = charge;
+	e->keylength = key.size();
+	e->refs = 1;  // for the returned handle.
+	e->hash = hash;
+	e->incache = false;
+	e->hot = false;
+	memcpy(e->keydata, key.data(), key.size());
+	return e;
 }
 
-LRUHandle::~LRUHandle() {
-	if (keydata != nullptr) {
-		free(keydata);
+static void FreeHandle(LRUHandle* e) {
+	if (e->deleter != nullptr) {
+		(*e->deleter)(e->key(), e->value);
 	}
+
+	e->~LRUHandle();
+	free(e);
 }
 
 LRUCache::LRUCache()
-	: usage(0) {
-
+	: capacity(0),
+	hotcapacity(0),
+	usage(0),
+	hotusage(0),
+	slots(kInitialSlots, nullptr),
+	elems(0),
+	tombstones(0) {
+	// Make empty circular linked lists.
+	hot.next = hot.prev = &hot;
+	cold.next = cold.prev = &cold;
+	inuse.next = inuse.prev = &inuse;
 }
 
 LRUCache::~LRUCache() {
+	assert(inuse.next == &inuse);  // Error if caller has an unreleased handle
+	LRUHandle* lists[] = { &hot, &cold };
+	for (LRUHandle* list : lists) {
+		for (LRUHandle* e = list->next; e != list;) {
+			LRUHandle* next = e->next;
+			assert(e->incache);
+			e->incache = false;
+			assert(e->refs == 1);  // Invariant of the lru lists.
+			Unref(e);
+			e = next;
+		}
+	}
+}
 
+void LRUCache::SetCapacity(size_t capacity) {
+	this->capacity = capacity;
+	this->hotcapacity = capacity * kHotPercent / 100;
 }
 
-std::shared_ptr<LRUHandle> LRUCache::Lookup(const std::string_view& key, size_t hash) {
-	std::unique_lock<std::mutex> lk(mutex);
-	std::shared_ptr<LRUHandle> e(new LRUHandle);
-	e->keydata = (char*)malloc(key.size());
-	e->keylength = key.size();
-	memcpy(e->keydata, key.data(), key.size());
-	e->hash = hash;
-	auto it = tables.find(e);
-	if (it == tables.end()) {
-		return nullptr;
+void LRUCache::ListRemove(LRUHandle* e) {
+	e->next->prev = e->prev;
+	e->prev->next = e->next;
+}
+
+void LRUCache::ListAppend(LRUHandle* list, LRUHandle* e) {
+	// Make "e" newest entry by inserting just before *list
+	e->next = list;
+	e->prev = list->prev;
+	e->prev->next = e;
+	e->next->prev = e;
+}
+
+void LRUCache::Ref(LRUHandle* e) {
+	if (e->refs == 1 && e->incache) {  // If on an lru list, move to inuse list.
+		ListRemove(e);
+		if (e->hot) {
+			hotusage -= e->charge;
+		}
+		ListAppend(&inuse, e);
 	}
-	else {
-		return *it;
+	e->refs++;
+}
+
+void LRUCache::Unref(LRUHandle* e) {
+	assert(e->refs > 0);
+	e->refs--;
+	if (e->refs == 0) {  // Deallocate.
+		assert(!e->incache);
+		FreeHandle(e);
+	}
+	else if (e->incache && e->refs == 1) {
+		// No longer in use; move to an lru list.
+		ListRemove(e);
+		if (e->hot) {
+			ListAppend(&hot, e);
+			hotusage += e->charge;
+			DemoteHot();
+		}
+		else {
+			ListAppend(&cold, e);
+		}
 	}
 }
 
-std::shared_ptr<LRUHandle> LRUCache::Insert(const std::string_view& key, size_t hash,
-	const std::any& value, size_t charge, 
-	std::function<void(const std::string_view& k, const std::any& value)>& deleter) {
-	std::unique_lock<std::mutex> lk(mutex);
-	assert(tables.size() == lru.size());
+// Move the oldest hot entries to the cold list while the hot list is
+// over its share of the capacity.
+void LRUCache::DemoteHot() {
+	while (hotusage > hotcapacity && hot.next != &hot) {
+		LRUHandle* old = hot.next;
+		ListRemove(old);
+		hotusage -= old->charge;
+		old->hot = false;
+		ListAppend(&cold, old);
+	}
+}
 
-	assert(value.has_value());
-	std::shared_ptr<LRUHandle> e(new LRUHandle);
-	e->hash = hash;
-	e->value = value;
-	e->deleter = deleter;
-	e->charge = charge;
-	e->keylength = key.size();
-	e->incache = false;
-	e->keydata = (char*)malloc(key.size());
-	memcpy(e->keydata, key.data(), key.size());
+// Finish removing *e from the cache; it has already been removed from the
+// hash table.
+void LRUCache::FinishErase(LRUHandle* e) {
+	if (e != nullptr) {
+		assert(e->incache);
+		ListRemove(e);
+		if (e->refs == 1 && e->hot) {
+			hotusage -= e->charge;
+		}
+
+		e->incache = false;
+		usage -= e->charge;
+		Unref(e);
+	}
+}
+
+size_t LRUCache::FindSlot(const std::string_view& key, uint32_t hash, bool* found) const {
+	const size_t mask = slots.size() - 1;
+	size_t firstfree = slots.size();
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		LRUHandle* e = slots[i];
+		if (e == nullptr) {
+			*found = false;
+			return (firstfree != slots.size()) ? firstfree : i;
+		}
+		else if (e == &kTombstone) {
+			if (firstfree == slots.size()) {
+				firstfree = i;
+			}
+		}
+		else if (e->hash == hash && e->key() == key) {
+			*found = true;
+			return i;
+		}
+	}
+}
 
-	e->incache = true;
-	usage += charge;
-	tables.insert(e);
-	lru.push_back(e);
-	assert(tables.size() == lru.size());
+// Insert "e" into the table; returns the entry it replaced, if any.
+LRUHandle* LRUCache::TableInsert(LRUHandle* e) {
+	// Keep at least a quarter of the slots empty so that probes stay short
+	// and always terminate.
+	if ((elems + tombstones + 1) * 4 > slots.size() * 3) {
+		Resize();
+	}
 
-	while (usage > capacity && !lru.empty()) {
-		auto front = lru.front();
-		lru.pop_front();
-		usage -= front->charge;
-		size_t n = tables.erase(front);
-		assert(n == 1);
-		break;
+	bool found;
+	const size_t i = FindSlot(e->key(), e->hash, &found);
+	LRUHandle* old = nullptr;
+	if (found) {
+		old = slots[i];
+	}
+	else {
+		if (slots[i] == &kTombstone) {
+			tombstones--;
+		}
+		elems++;
+	}
+
+	slots[i] = e;
+	return old;
+}
+
+LRUHandle* LRUCache::TableRemove(const std::string_view& key, uint32_t hash) {
+	bool found;
+	const size_t i = FindSlot(key, hash, &found);
+	if (!found) {
+		return nullptr;
 	}
 
-	assert(tables.size() == lru.size());
+	LRUHandle* e = slots[i];
+	slots[i] = &kTombstone;
+	elems--;
+	tombstones++;
 	return e;
 }
 
-void LRUCache::Release(const std::shared_ptr<LRUHandle>& handle) {
-	std::unique_lock<std::mutex> lk(mutex);
-	assert(tables.size() == lru.size());
-	for (auto it = lru.begin(); it != lru.end(); ) {
-		if ((*it)->key() == handle->key()) {
-			usage -= (*it)->charge;
-			auto iter = tables.find((*it));
-			assert(iter != tables.end());
-			if ((*iter)->deleter) {
-				(*iter)->deleter(std::string_view((*iter)->keydata,
-					(*iter)->keylength), (*iter)->value);
-			}
+void LRUCache::Resize() {
+	size_t newlength = kInitialSlots;
+	while (newlength < (elems + 1) * 2) {
+		newlength *= 2;
+	}
 
-			lru.erase(it);
-			tables.erase(iter);
-			break;
-		}
-		else {
-			++it;
+	std::vector<LRUHandle*> old(newlength, nullptr);
+	old.swap(slots);
+	tombstones = 0;
+	const size_t mask = slots.size() - 1;
+	for (LRUHandle* e : old) {
+		if (e != nullptr && e != &kTombstone) {
+			size_t i = e->hash & mask;
+			while (slots[i] != nullptr) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = e;
 		}
 	}
-	assert(tables.size() == lru.size());
 }
 
-void LRUCache::Erase(const std::string_view& key, size_t hash) {
+LRUHandle* LRUCache::Lookup(const std::string_view& key, uint32_t hash) {
 	std::unique_lock<std::mutex> lk(mutex);
-	assert(tables.size() == lru.size());
-	for (auto it = lru.begin(); it != lru.end(); ) {
-		if ((*it)->key() == key) {
-			usage -= (*it)->charge;
-			auto iter = tables.find((*it));
-			assert(iter != tables.end());
-			if ((*iter)->deleter) {
-				(*iter)->deleter(std::string_view((*iter)->keydata,
-					(*iter)->keylength), (*iter)->value);
-			}
+	bool found;
+	const size_t i = FindSlot(key, hash, &found);
+	if (!found) {
+		return nullptr;
+	}
 
-			lru.erase(it);
-			tables.erase(iter);
-			break;
-		}
-		else {
-			++it;
+	LRUHandle* e = slots[i];
+	Ref(e);
+	// Second access: promote to the hot list once released.
+	e->hot = true;
+	return e;
+}
+
+LRUHandle* LRUCache::Insert(const std::string_view& key, uint32_t hash,
+	const std::any& value, size_t charge, CacheDeleter deleter) {
+	std::unique_lock<std::mutex> lk(mutex);
+	assert(value.has_value());
+	LRUHandle* e = NewHandle(key, hash, value, charge, deleter);
+	if (capacity > 0) {
+		e->refs++;  // for the cache's reference.
+		e->incache = true;
+		ListAppend(&inuse, e);
+		usage += charge;
+		// Two threads that both missed in Lookup() may Insert the same key;
+		// the newer entry replaces the older one.
+		FinishErase(TableInsert(e));
+	}
+	else {
+		// capacity == 0 is supported and turns off caching; the entry
+		// is freed when the caller releases it.
+		e->next = nullptr;
+	}
+
+	// Evict unreferenced entries, cold ones first.
+	while (usage > capacity) {
+		LRUHandle* old = (cold.next != &cold) ? cold.next : hot.next;
+		if (old == &hot) {
+			break;   // Everything left is in use
 		}
+
+		assert(old->refs == 1);
+		FinishErase(TableRemove(old->key(), old->hash));
 	}
-	assert(tables.size() == lru.size());
+	return e;
+}
+
+void LRUCache::Release(LRUHandle* handle) {
+	std::unique_lock<std::mutex> lk(mutex);
+	Unref(handle);
+}
+
+void LRUCache::Erase(const std::string_view& key, uint32_t hash) {
+	std::unique_lock<std::mutex> lk(mutex);
+	FinishErase(TableRemove(key, hash));
 }
 
 std::shared_ptr<ShardedLRUCache> NewLRUCache(size_t capacity) {
 	std::shared_ptr<ShardedLRUCache> cache(new ShardedLRUCache(capacity));
 	return cache;
 }
+
+CacheReservation::CacheReservation(const std::shared_ptr<ShardedLRUCache>& cache, size_t unit)
+	: cache(cache),
+	unit(unit > 0 ? unit : 1),
+	id(cache->NewId()) {
+
+}
+
+CacheReservation::~CacheReservation() {
+	Update(0);
+}
+
+void CacheReservation::Update(size_t mem) {
+	const size_t target = (mem + unit - 1) / unit;
+	char buf[16];
+	EncodeFixed64(buf, id);
+	while (handles.size() < target) {
+		EncodeFixed64(buf + 8, handles.size());
+		handles.push_back(cache->Insert(std::string_view(buf, sizeof(buf)), unit, unit, nullptr));
+	}
+
+	while (handles.size() > target) {
+		EncodeFixed64(buf + 8, handles.size() - 1);
+		cache->Erase(std::string_view(buf, sizeof(buf)));
+		cache->Release(handles.back());
+		handles.pop_back();
+	}
+}
@@ -3,44 +3,53 @@
 #include <stdint.h>
 #include <string_view>
 #include <any>
-#include <list>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <assert.h>
-#include <functional>
-#include <unordered_set>
 
 #include "filename.h"
 #include "table.h"
 #include "coding.h"
-
-class LRUCache;
-
-// An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
-class LRUHandle {
-public:
-	LRUHandle();
-
-	~LRUHandle();
-
+#include "hash.h"
+
+// Called with the key and value of an entry once it has been removed
+// from the cache and its last reference has been released.
+typedef void (*CacheDeleter)(const std::string_view& key, const std::any& value);
+
+// An entry is a variable length heap-allocated structure: the key is
+// stored inline after the handle, so an entry costs a single allocation.
+// Entries that no client references are kept on one of the two LRU lists
+// of their shard, ordered by access time.  Entries in use are kept on
+// the in-use list instead.
+struct LRUHandle {
 	std::any value;
-	std::function<void(const std::string_view& k,
-		const std::any& value)> deleter;
-
+	CacheDeleter deleter;
+	LRUHandle* next;
+	LRUHandle* prev;
 	size_t charge;      // TODO(opt): Only allow uint32_t?
 	size_t keylength;
-	bool incache;      // Whether entry is in the cache.
-	size_t hash;      // Hash of key(); used for fast sharding and comparisons
-	char* keydata;   // Beginning of key
+	uint32_t refs;      // References, including the cache's own
+	uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+	bool incache;       // Whether entry is in the cache.
+	bool hot;           // Looked up since insertion; lives in the hot list
+	char keydata[1];    // Beginning of key
 
 	std::string_view key() const {
-		// next_ is only Equal to this if the LRU handle is the list head of an
-		// empty list. List heads never have meaningful keys.
 		return std::string_view(keydata, keylength);
 	}
 };
 
 // A single Shard of sharded cache.
+//
+// Keys are found through an open-addressing table with linear probing,
+// so a hit allocates nothing.  Replacement is LRU with mid-point
+// insertion: a new entry starts at the head of the cold list and is
+// promoted to the hot list only when it is looked up again.  The cold
+// list is evicted first and the hot list is capped at a fraction of the
+// capacity, so a scan that touches every block once cannot flush the
+// working set.
 class LRUCache {
 public:
 	LRUCache();
@@ -48,46 +57,63 @@ public:
 	~LRUCache();
 
 	// Separate from constructor so caller can easily make an array of LRUCache
-	void SetCapacity(size_t capacity) { this->capacity = capacity; }
+	void SetCapacity(size_t capacity);
 
 	// Like Cache methods, but with an extra "hash" parameter.
-	std::shared_ptr<LRUHandle> Insert(const std::string_view& key, size_t hash,
-		const std::any& value, size_t charge,
-		std::function<void(const std::string_view& k, const std::any& value)>& deleter);
+	LRUHandle* Insert(const std::string_view& key, uint32_t hash,
+		const std::any& value, size_t charge, CacheDeleter deleter);
 
-	std::shared_ptr<LRUHandle> Lookup(const std::string_view& key, size_t hash);
+	LRUHandle* Lookup(const std::string_view& key, uint32_t hash);
 
-	void Release(const std::shared_ptr<LRUHandle>& handle);
+	void Release(LRUHandle* handle);
 
-	void Erase(const std::string_view& key, size_t hash);
+	void Erase(const std::string_view& key, uint32_t hash);
 
 	size_t TotalCharge() const {
 		std::unique_lock<std::mutex> lk(mutex);
 		return usage;
 	}
 
-	struct Hash {
-		size_t operator()(const std::shared_ptr<LRUHandle>& x) const {
-			return x->hash;
-		}
-	};
+private:
+	void Ref(LRUHandle* e);
 
-	struct Equal {
-		bool operator()(const std::shared_ptr<LRUHandle>& x,
-			const std::shared_ptr<LRUHandle>& y) const {
-			return memcmp(x->key().data(),
-				y->key().data(), y->key().size()) == 0;
-		}
-	};
+	void Unref(LRUHandle* e);
+
+	void FinishErase(LRUHandle* e);
+
+	void DemoteHot();
+
+	static void ListRemove(LRUHandle* e);
+
+	static void ListAppend(LRUHandle* list, LRUHandle* e);
+
+	// Open-addressing table
+	size_t FindSlot(const std::string_view& key, uint32_t hash, bool* found) const;
+
+	LRUHandle* TableInsert(LRUHandle* e);
+
+	LRUHandle* TableRemove(const std::string_view& key, uint32_t hash);
+
+	void Resize();
 
-private:
 	// Initialized before use.
 	size_t capacity;
-	size_t usage;
+	size_t hotcapacity;
+
+	// mutex protects the following state.
 	mutable std::mutex mutex;
-	std::list<std::shared_ptr<LRUHandle>> lru;
-	std::list<std::shared_ptr<LRUHandle>> uselru;
-	std::unordered_set<std::shared_ptr<LRUHandle>, Hash, Equal> tables;
+	size_t usage;
+	size_t hotusage;
+
+	// Dummy heads of the lists.  list.prev is the newest entry, list.next
+	// the oldest.
+	LRUHandle hot;      // Unreferenced entries that have been looked up
+	LRUHandle cold;     // Unreferenced entries not looked up since insertion
+	LRUHandle inuse;    // Entries referenced by clients
+
+	std::vector<LRUHandle*> slots;
+	size_t elems;
+	size_t tombstones;
 };
 
 static const int kNumShardBits = 4;
@@ -96,10 +122,10 @@ static const int kNumShards = 1<< kNumShardBits;
 class ShardedLRUCache {
 private:
 	LRUCache shards[kNumShards];
-	uint64_t lastId;
+	std::atomic<uint64_t> lastId;
 
 	static inline uint32_t HashView(const std::string_view& s) {
-		return std::hash<std::string>{}(std::string(s.data(),s.size()));
+		return Hash(s.data(), s.size(), 0);
 	}
 
 	static uint32_t Shard(uint32_t hash) {
@@ -119,33 +145,48 @@ public:
 
 	}
 
-	std::shared_ptr<LRUHandle> Insert(const std::string_view& key, const std::any& value, size_t charge,
-		std::function<void(const std::string_view& k,
-			const std::any& value)>&& deleter) {
+	// Insert a mapping from key->value into the cache and assign it
+	// the specified charge against the total cache capacity.  A mapping
+	// already present for key is replaced.
+	//
+	// Returns a handle that corresponds to the mapping.  The caller
+	// must call Release(handle) when the returned mapping is no
+	// longer needed.
+	LRUHandle* Insert(const std::string_view& key, const std::any& value, size_t charge,
+		CacheDeleter deleter) {
 		const uint32_t hash = HashView(key);
 		return shards[Shard(hash)].Insert(key, hash, value, charge, deleter);
 	}
 
-	std::shared_ptr<LRUHandle> Lookup(const std::string_view& key) {
+	// If the cache has no mapping for "key", returns nullptr.  Else
+	// returns a handle that corresponds to the mapping; the caller must
+	// call Release(handle) when it is no longer needed.
+	LRUHandle* Lookup(const std::string_view& key) {
 		const uint32_t hash = HashView(key);
 		return shards[Shard(hash)].Lookup(key, hash);
 	}
 
+	// If the cache contains an entry for key, erase it.  The underlying
+	// entry is kept around until all existing handles to it have been
+	// released.
 	void Erase(const std::string_view& key) {
 		const uint32_t hash = HashView(key);
 		shards[Shard(hash)].Erase(key, hash);
 	}
 
-	const std::any& Value(const std::shared_ptr<LRUHandle>& handle) {
+	const std::any& Value(LRUHandle* handle) {
 		return handle->value;
 	}
 
-	void Release(const std::shared_ptr<LRUHandle>& handle) {
+	// Release a mapping returned by a previous Lookup() or Insert().
+	void Release(LRUHandle* handle) {
 		shards[Shard(handle->hash)].Release(handle);
 	}
 
+	// Return a new numeric id.  May be used by multiple clients who are
+	// sharing the same cache to partition the key space.
 	uint64_t NewId() {
-		return ++(lastId);
+		return lastId.fetch_add(1, std::memory_order_relaxed) + 1;
 	}
 
 	size_t TotalCharge() const {
@@ -157,4 +198,34 @@ public:
 	}
 };
 
-std::shared_ptr<ShardedLRUCache> NewLRUCache(size_t capacity);
\ No newline at end of file
+std::shared_ptr<ShardedLRUCache> NewLRUCache(size_t capacity);
+
+// Charges memory that lives outside of a cache, such as memtables or
+// open tables, against the capacity of the cache, so that one budget
+// covers both.  The memory is represented by dummy entries of "unit"
+// bytes that stay referenced, and so are never evicted, until the
+// reservation shrinks; the cache evicts blocks to make room for them.
+//
+// Not thread safe.
+class CacheReservation {
+public:
+	CacheReservation(const std::shared_ptr<ShardedLRUCache>& cache, size_t unit);
+
+	~CacheReservation();
+
+	CacheReservation(const CacheReservation&) = delete;
+
+	void operator=(const CacheReservation&) = delete;
+
+	// Grow or shrink the reservation to cover "mem" bytes, rounded up
+	// to a multiple of the unit.
+	void Update(size_t mem);
+
+	size_t GetReserved() const { return handles.size() * unit; }
+
+private:
+	const std::shared_ptr<ShardedLRUCache> cache;
+	const size_t unit;
+	const uint64_t id;
+	std::vector<LRUHandle*> handles;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+// A database can be configured with a CompactionFilterFactory.  Every
+// compaction asks it for a CompactionFilter and offers that filter each
+// value it is about to write out.  A filter that rejects a value turns
+// it into a deletion, so applications can reclaim entries that became
+// unreachable through their own encoding, such as data that belongs to
+// an old version of a key or that has expired.  A filter may also keep
+// the entry but write a smaller value in its place.
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <stdint.h>
+
+class CompactionFilter {
+public:
+	virtual ~CompactionFilter() {}
+
+	// Return the name of this filter.  Used for logging only.
+	virtual const char* Name() const = 0;
+
+	// Called for each value of a compaction that is visible at the
+	// smallest snapshot the filter was created for.  Return true to
+	// replace the entry with a deletion marker, false to keep it.  To
+	// keep it with another value, store that in *newvalue, set
+	// *valuechanged and return false.
+	//
+	// A single filter is only ever used by one thread, so it may cache
+	// state between calls.
+	virtual bool Filter(int level, const std::string_view& key,
+		const std::string_view& value, std::string* newvalue,
+		bool* valuechanged) = 0;
+};
+
+class CompactionFilterFactory {
+public:
+	virtual ~CompactionFilterFactory() {}
+
+	virtual const char* Name() const = 0;
+
+	// Return a filter for one compaction.  "smallestsnapshot" is the
+	// sequence number of the oldest snapshot still in use; a filter that
+	// reads the database to make its decision must read at that
+	// snapshot, or a reader of an older view might lose data it can
+	// still see.
+	virtual std::shared_ptr<CompactionFilter> CreateCompactionFilter(
+		uint64_t smallestsnapshot) = 0;
+};
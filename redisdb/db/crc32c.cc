@@ -1,8 +1,15 @@
 #include "crc32c.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include "coding.h"
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
 namespace crc32c {
 	namespace {
 		const uint32_t kByteExtensionTable[256] =
@@ -251,7 +258,7 @@ namespace crc32c {
 
 	}  // namespace
 
-	uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+	uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
 		const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
 		const uint8_t* e = p + size;
 		uint32_t l = crc ^ kCRC32Xor;
@@ -312,7 +319,8 @@ namespace crc32c {
 
 			// It is possible to get better speeds (at least on x86) by interleaving
 			// prefetching 256 bytes ahead with processing 64 bytes at a time. See the
-			// portable implementation in https://github.com/google/crc32c/.
+			// portable implementation in https://github.com/google/crc32c/. Extend()
+			// uses the SSE4.2 instruction instead when the CPU supports it.
 
 			// Process one 16-byte swath at a time.
 			while ((e - p) >= 16) {
@@ -349,5 +357,191 @@ namespace crc32c {
 		return l ^ kCRC32Xor;
 	}
 
-}  // namespace crc32c
+#ifdef CRC32C_HAVE_SSE42
+	namespace {
+		// The hardware path runs three independent crc32 chains over
+		// adjacent blocks, which hides the latency of the instruction,
+		// then joins them with crc(A||B) = shift(crc(A), |B|) ^ crc(B).
+		// Shifting by a fixed block length is a table lookup per byte.
+		// Large buffers use long blocks, the tail short ones.
+		static const size_t kLongBlock = 8192;
+		static const size_t kShortBlock = 256;
+
+		// CRC-32C (Castagnoli) polynomial, reversed
+		static const uint32_t kPoly = 0x82f63b78;
+
+		uint32_t MatrixTimes(const uint32_t* mat, uint32_t vec) {
+			uint32_t sum = 0;
+			while (vec) {
+				if (vec & 1) {
+					sum ^= *mat;
+				}
+				vec >>= 1;
+				mat++;
+			}
+			return sum;
+		}
+
+		void MatrixSquare(uint32_t* square, const uint32_t* mat) {
+			for (int n = 0; n < 32; n++) {
+				square[n] = MatrixTimes(mat, mat[n]);
+			}
+		}
+
+		// Build the operator that appends "len" zero bytes to a crc.
+		void ZerosOperator(uint32_t* even, size_t len) {
+			uint32_t odd[32];
+			odd[0] = kPoly;  // Operator for one zero bit
+			uint32_t row = 1;
+			for (int n = 1; n < 32; n++) {
+				odd[n] = row;
+				row <<= 1;
+			}
+
+			MatrixSquare(even, odd);  // Two zero bits
+			MatrixSquare(odd, even);  // Four zero bits
+			// Each square doubles the length; the first one below gives
+			// one zero byte.
+			while (true) {
+				MatrixSquare(even, odd);
+				len >>= 1;
+				if (len == 0) {
+					return;
+				}
+
+				MatrixSquare(odd, even);
+				len >>= 1;
+				if (len == 0) {
+					memcpy(even, odd, sizeof(odd));
+					return;
+				}
+			}
+		}
+
+		struct ShiftTable {
+			uint32_t zeros[4][256];
+
+			// "len" must be a power of two.
+			explicit ShiftTable(size_t len) {
+				uint32_t op[32];
+				ZerosOperator(op, len);
+				for (uint32_t n = 0; n < 256; n++) {
+					zeros[0][n] = MatrixTimes(op, n);
+					zeros[1][n] = MatrixTimes(op, n << 8);
+					zeros[2][n] = MatrixTimes(op, n << 16);
+					zeros[3][n] = MatrixTimes(op, n << 24);
+				}
+			}
+
+			uint32_t Shift(uint32_t crc) const {
+				return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+					zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+			}
+		};
+
+		const ShiftTable& LongShift() {
+			static const ShiftTable table(kLongBlock);
+			return table;
+		}
+
+		const ShiftTable& ShortShift() {
+			static const ShiftTable table(kShortBlock);
+			return table;
+		}
+
+		inline uint64_t LoadUint64(const uint8_t* p) {
+			uint64_t v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		__attribute__((target("sse4.2")))
+		const uint8_t* ExtendInterleaved(uint64_t* crc, const uint8_t* p,
+			size_t* size, size_t block, const ShiftTable& shift) {
+			uint64_t crc0 = *crc;
+			while (*size >= block * 3) {
+				uint64_t crc1 = 0;
+				uint64_t crc2 = 0;
+				const uint8_t* end = p + block;
+				do {
+					crc0 = _mm_crc32_u64(crc0, LoadUint64(p));
+					crc1 = _mm_crc32_u64(crc1, LoadUint64(p + block));
+					crc2 = _mm_crc32_u64(crc2, LoadUint64(p + block * 2));
+					p += 8;
+				} while (p < end);
 
+				crc0 = shift.Shift(static_cast<uint32_t>(crc0)) ^ crc1;
+				crc0 = shift.Shift(static_cast<uint32_t>(crc0)) ^ crc2;
+				p += block * 2;
+				*size -= block * 3;
+			}
+
+			*crc = crc0;
+			return p;
+		}
+
+		__attribute__((target("sse4.2")))
+		uint32_t ExtendSse42(uint32_t crc, const char* buf, size_t size) {
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+			uint64_t l = crc ^ kCRC32Xor;
+
+			// Bring p to an 8-byte boundary.
+			while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+				l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+				size--;
+			}
+
+			p = ExtendInterleaved(&l, p, &size, kLongBlock, LongShift());
+			p = ExtendInterleaved(&l, p, &size, kShortBlock, ShortShift());
+
+			while (size >= 8) {
+				l = _mm_crc32_u64(l, LoadUint64(p));
+				p += 8;
+				size -= 8;
+			}
+
+			while (size > 0) {
+				l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+				size--;
+			}
+			return static_cast<uint32_t>(l) ^ kCRC32Xor;
+		}
+
+		bool HasSse42() {
+			unsigned int eax, ebx, ecx, edx;
+			if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+				return false;
+			}
+			return (ecx & bit_SSE4_2) != 0;
+		}
+	}  // namespace
+#endif
+
+	typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+	static ExtendFunction ChooseExtend() {
+#ifdef CRC32C_HAVE_SSE42
+		if (HasSse42()) {
+			// Build the shift tables now rather than on a hot path.
+			LongShift();
+			ShortShift();
+			return ExtendSse42;
+		}
+#endif
+		return ExtendPortable;
+	}
+
+	static ExtendFunction SelectedExtend() {
+		static const ExtendFunction func = ChooseExtend();
+		return func;
+	}
+
+	uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+		return SelectedExtend()(crc, buf, size);
+	}
+
+	bool CanAccelerate() {
+		return SelectedExtend() != ExtendPortable;
+	}
+
+}  // namespace crc32c
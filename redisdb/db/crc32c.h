@@ -8,8 +8,16 @@ namespace crc32c {
 	// Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
 	// crc32c of some string A.  Extend() is often used to maintain the
 	// crc32c of a stream of data.
+	// Uses the SSE4.2 crc32 instruction when the CPU has it (checked once
+	// with cpuid), the portable table-driven code otherwise.
 	uint32_t Extend(uint32_t initcrc, const char* data, size_t n);
 
+	// The table-driven implementation that Extend() falls back to.
+	uint32_t ExtendPortable(uint32_t initcrc, const char* data, size_t n);
+
+	// Returns true if Extend() uses the hardware crc32 instruction.
+	bool CanAccelerate();
+
 	// Return the crc32c of data[0,n-1]
 	inline uint32_t Value(const char* data, size_t n) {
 		return Extend(0, data, n);
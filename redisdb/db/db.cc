@@ -6,12 +6,21 @@
 #include "merger.h"
 #include "dbiter.h"
 #include "logging.h"
+#include "compactionfilter.h"
+#include "mergeoperator.h"
+#include "perfcontext.h"
+#include "sharedlog.h"
 
 const int kNumNonTableCacheFiles = 10;
 
 static int tableCacheSize(const Options& options) {
+	if (options.maxopenfiles < 0) {
+		// Never evict: tables leave the cache only when they are deleted.
+		return std::numeric_limits<int>::max();
+	}
+
 	// Reserve ten files or so for other uses and give the rest to TableCache.
-	return kNumNonTableCacheFiles * kNumNonTableCacheFiles;
+	return std::max(options.maxopenfiles - kNumNonTableCacheFiles, kNumNonTableCacheFiles);
 }
 
 // Information kept for every waiting writer
@@ -20,7 +29,56 @@ struct DB::Writer {
 	WriteBatch* batch;
 	bool sync;
 	bool done;
+	bool exclusive;                    // Written by AtomicWrite(); never joins a group
+	MemTableInsertGroup* insertgroup;  // Set by the leader to hand back our memtable insert
+	std::condition_variable cv;
+};
+
+// Writers of one group that apply their own batches to the memtable in
+// parallel (Options::allowconcurrentmemtablewrite).  Lives on the leader's
+// stack; the leader waits for "pending" to drop to zero before returning.
+struct DB::MemTableInsertGroup {
+	std::shared_ptr<MemTable> mem;
+	std::mutex mutex;
 	std::condition_variable cv;
+	int pending;
+	Status status;
+
+	MemTableInsertGroup()
+		: pending(0) {
+
+	}
+
+	void Finish(const Status& s) {
+		std::unique_lock<std::mutex> lk(mutex);
+		if (status.ok() && !s.ok()) {
+			status = s;
+		}
+
+		if (--pending == 0) {
+			cv.notify_one();
+		}
+	}
+};
+
+// A group of writers that has been appended to the log and waits in
+// memtablegroups for its turn to insert into the memtable.  Lives on the
+// leader's stack.
+struct DB::WriteGroup {
+	std::vector<Writer*> members;     // The leader comes first
+	std::shared_ptr<MemTable> mem;
+	uint64_t lastsequence;            // Published once the group is inserted
+	Status status;
+};
+
+// The memtables and version a read needs, bundled so that a reader can
+// grab all of them with one atomic load instead of taking the mutex.
+// Never modified once installed.  Holding one keeps its version, and so
+// its table files, alive (see VersionSet::AddLiveFiles()).
+struct DB::SuperVersion {
+	std::shared_ptr<MemTable> mem;
+	std::shared_ptr<MemTable> imm;
+	std::shared_ptr<Version> current;
 };
 
 struct DB::CompactionState {
@@ -37,6 +95,7 @@ struct DB::CompactionState {
 		uint64_t number;
 		uint64_t filesize;
 		InternalKey smallest, largest;
+		uint64_t oldestblobfile;
 	};
 	std::vector<Output> outputs;
 
@@ -46,13 +105,33 @@ struct DB::CompactionState {
 
 	uint64_t totalbytes;
 
+	// Live records of blob files numbered below blobgccutoff are moved
+	// to the blob files written by blobbuilder.  Records whose key is
+	// dropped are added to blobgarbage as file -> (count, bytes).
+	uint64_t blobgccutoff;
+	std::shared_ptr<BlobFileBuilder> blobbuilder;
+	std::vector<BlobFileBuilder::FileInfo> blobfiles;
+	std::map<uint64_t, std::pair<uint64_t, uint64_t>> blobgarbage;
+
+	// User-key range [start, end) of a subcompaction.  A missing bound
+	// means the range is open on that side.
+	bool hasstart;
+	bool hasend;
+	std::string start;
+	std::string end;
+	CompactionCursor cursor;
+	Status status;
+
 	Output* currentOutput() { return &outputs[outputs.size() - 1]; }
 
 	explicit CompactionState(Compaction* c)
 		: compaction(c),
 		outfile(nullptr),
 		builder(nullptr),
-		totalbytes(0) {
+		totalbytes(0),
+		blobgccutoff(0),
+		hasstart(false),
+		hasend(false) {
 
 	}
 };
@@ -109,6 +188,10 @@ Options DB::SanitizeOptions(const std::string& dbname,
 	const Options& src) {
 	Options result = src;
 	result.comparator = icmp;
+	if (src.filterpolicy != nullptr) {
+		result.filterpolicy.reset(new InternalFilterPolicy(src.filterpolicy));
+	}
+
 	if (result.blockcache == nullptr) {
 		result.blockcache = NewLRUCache(8 << 20);
 	}
@@ -135,27 +218,54 @@ DB::DB(const Options& op, const std::string& dbname)
 	seed(0),
 	hasimm(false),
 	shuttingdown(false),
-	bgcompactionscheduled(false) {
+	bgcompactionscheduled(false),
+	bgflushscheduled(false),
+	writebufferusage(0),
+	immwritebufferusage(0),
+	tmpbatch(new WriteBatch) {
 	tablecache.reset(new TableCache(dbname, options, tableCacheSize(options)));
 	versions.reset(new VersionSet(dbname, options, tablecache, &internalcomparator));
 	snapshots.reset(new SnapshotList());
+	writecontroller.reset(new WriteController(options.delayedwriterate,
+		options.softpendingcompactionbyteslimit, options.hardpendingcompactionbyteslimit));
+	if (options.writebuffermanager != nullptr) {
+		options.writebuffermanager->AddMember(this);
+	}
 }
 
 DB::~DB() {
+	// Once removed, the write buffer manager no longer flushes us.
+	if (options.writebuffermanager != nullptr) {
+		options.writebuffermanager->RemoveMember(this);
+	}
+
 	// Wait for background work to Finish.
 	std::unique_lock<std::mutex> lck(mutex);
 	shuttingdown.store(true, std::memory_order_release);
 
-	while (bgcompactionscheduled) {
+	if (scrubber.joinable()) {
+		scrubsignal.notify_all();
+		lck.unlock();
+		scrubber.join();
+		lck.lock();
+	}
+
+	while (bgcompactionscheduled || bgflushscheduled) {
 		bgfinishedsignal.wait(lck);
 	}
 
+	if (options.writebuffermanager != nullptr) {
+		options.writebuffermanager->ScheduleFreeMem(writebufferusage);
+		options.writebuffermanager->FreeMem(writebufferusage + immwritebufferusage);
+	}
+
 	lck.unlock();
 	if (dblock != nullptr) {
 		options.env->UnlockFile(dblock);
 	}
 
-	options.env->ExitSchedule();
+	// The env and its background threads may be shared with other DBs,
+	// so they are left running; our own work has finished above.
 	versions.reset();
 	log.reset();
 	logfile.reset();
@@ -163,11 +273,21 @@ DB::~DB() {
 }
 
 Status DB::Open() {
+	options.env->IncBackgroundThreadsIfNeeded(options.maxbackgroundcompactions, Env::LOW);
+	options.env->IncBackgroundThreadsIfNeeded(options.maxbackgroundflushes, Env::HIGH);
+
 	std::unique_lock<std::mutex> lk(mutex);
 	VersionEdit edit;
 	bool savemanifest = false;
 	Status s = Recover(&edit, &savemanifest);
-	if (s.ok() && mem == nullptr) {
+	if (s.ok() && mem == nullptr && options.sharedlog != nullptr) {
+		// Everything recovered has been flushed; new writes go to the
+		// shared log from its current file on.
+		logfilenumber = options.sharedlog->GetLogNumber();
+		mem.reset(new MemTable(internalcomparator));
+		savemanifest = savemanifest || versions->GetSharedLogNumber() < logfilenumber;
+	}
+	else if (s.ok() && mem == nullptr) {
 		uint64_t newLogNumber = versions->NewFileNumber();
 		s = options.env->NewWritableFile(LogFileName(dbname, newLogNumber), logfile);
 		if (s.ok()) {
@@ -179,17 +299,213 @@ Status DB::Open() {
 
 	if (s.ok() && savemanifest) {
 		edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
-		edit.SetLogNumber(logfilenumber);
+		if (options.sharedlog != nullptr) {
+			// Logs of our own, from before the DB used the shared log,
+			// have been recovered as well.
+			edit.SetLogNumber(versions->NewFileNumber());
+			edit.SetSharedLogNumber(logfilenumber);
+		}
+		else {
+			edit.SetLogNumber(logfilenumber);
+		}
 		s = versions->LogAndApply(&edit, &mutex);
 	}
 
 	if (s.ok()) {
+		InstallSuperVersion();
+		UpdateWriteBufferUsage();
 		DeleteObsoleteFiles();
+		if (options.sharedlog != nullptr) {
+			options.sharedlog->SetMinLogNumber(options.sharedlogid, versions->GetSharedLogNumber());
+		}
+	}
+
+	if (s.ok() && (options.preopentables || options.maxopenfiles < 0)) {
+		// Before any compaction can delete one of the tables.
+		s = PreopenTables();
+	}
+
+	if (s.ok()) {
 		MaybeScheduleCompaction();
+		if (options.scrubbytespersec > 0) {
+			scrubber = std::thread(std::bind(&DB::BackgroundScrub, this));
+		}
 	}
 	return s;
 }
 
+void DB::BackgroundScrub() {
+	// Tables found to be corrupt are reported once and not read again.
+	std::set<uint64_t> corrupt;
+	std::unique_lock<std::mutex> lk(mutex);
+	while (!shuttingdown.load(std::memory_order_acquire)) {
+		// Holding on to the version keeps its tables from being deleted
+		// while they are read.
+		std::shared_ptr<Version> current = versions->current();
+		lk.unlock();
+
+		const uint64_t startmicros = options.env->NowMicros();
+		uint64_t scrubbed = 0;
+		int numfiles = 0;
+		bool stopped = false;
+		std::function<bool(uint64_t)> pace = std::bind(&DB::PaceScrub, this,
+			startmicros, &scrubbed, std::placeholders::_1);
+		for (int level = 0; level < kNumLevels && !stopped; level++) {
+			const std::vector<std::shared_ptr<FileMetaData>>& files = current->files[level];
+			for (size_t i = 0; i < files.size() && !stopped; i++) {
+				if (corrupt.count(files[i]->number) > 0) {
+					continue;
+				}
+
+				Status s = tablecache->VerifyChecksums(files[i]->number, files[i]->filesize, pace);
+				numfiles++;
+				stopped = shuttingdown.load(std::memory_order_acquire);
+				if (!s.ok()) {
+					Warn(options.infolog, "Scrubbing table #%llu at level %d: %s\n",
+						(unsigned long long) files[i]->number, level, s.ToString().c_str());
+					if (s.IsCorruption()) {
+						corrupt.insert(files[i]->number);
+						lk.lock();
+						RecordBackgroundError(s);
+						lk.unlock();
+					}
+				}
+			}
+		}
+
+		current.reset();
+		if (!stopped && numfiles > 0) {
+			Info(options.infolog, "Scrubbed %d tables, %llu bytes in %.3f s\n",
+				numfiles, (unsigned long long) scrubbed,
+				(options.env->NowMicros() - startmicros) / 1e6);
+		}
+
+		lk.lock();
+		if (numfiles == 0) {
+			// Nothing to read yet; look again in a while.
+			scrubsignal.wait_for(lk, std::chrono::seconds(1));
+		}
+	}
+}
+
+bool DB::PaceScrub(uint64_t startmicros, uint64_t* scrubbed, uint64_t n) {
+	*scrubbed += n;
+	const uint64_t due = startmicros + static_cast<uint64_t>(
+		*scrubbed * 1e6 / options.scrubbytespersec);
+	uint64_t now = options.env->NowMicros();
+	if (now < due) {
+		// Only take the mutex to wait, so that a scrubber behind its rate
+		// does not contend with writers for every block.
+		std::unique_lock<std::mutex> lk(mutex);
+		while (now < due && !shuttingdown.load(std::memory_order_acquire)) {
+			scrubsignal.wait_for(lk, std::chrono::microseconds(due - now));
+			now = options.env->NowMicros();
+		}
+	}
+	return !shuttingdown.load(std::memory_order_acquire);
+}
+
+// Shared by the threads of DB::PreopenTables().
+struct PreopenState {
+	std::shared_ptr<TableCache> tablecache;
+	std::shared_ptr<Logger> infolog;
+	std::shared_ptr<Env> env;
+	std::vector<std::shared_ptr<FileMetaData>> files;
+	std::atomic<size_t> next;
+	std::atomic<size_t> done;
+	uint64_t startmicros;
+
+	std::mutex mutex;
+	Status status;          // First error met
+	int failed;
+};
+
+static void PreopenTableFiles(PreopenState* state) {
+	const size_t total = state->files.size();
+	for (;;) {
+		const size_t i = state->next.fetch_add(1, std::memory_order_relaxed);
+		if (i >= total) {
+			break;
+		}
+
+		const std::shared_ptr<FileMetaData>& f = state->files[i];
+		LRUHandle* handle = nullptr;
+		Status s = state->tablecache->FindTable(f->number, f->filesize, &handle);
+		if (s.ok()) {
+			state->tablecache->GetCache()->Release(handle);
+		}
+		else {
+			std::unique_lock<std::mutex> lk(state->mutex);
+			Warn(state->infolog, "Pre-opening table #%llu: %s\n",
+				(unsigned long long) f->number, s.ToString().c_str());
+			if (state->status.ok()) {
+				state->status = s;
+			}
+			state->failed++;
+		}
+
+		// Report every tenth of the way.
+		const size_t n = state->done.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (n * 10 / total != (n - 1) * 10 / total && n != total) {
+			Info(state->infolog, "Pre-opened %llu of %llu tables in %.3f s\n",
+				(unsigned long long) n, (unsigned long long) total,
+				(state->env->NowMicros() - state->startmicros) / 1e6);
+		}
+	}
+}
+
+Status DB::PreopenTables() {
+	PreopenState state;
+	state.tablecache = tablecache;
+	state.infolog = options.infolog;
+	state.env = options.env;
+	state.next = 0;
+	state.done = 0;
+	state.startmicros = options.env->NowMicros();
+	state.failed = 0;
+
+	// Lower levels are read more often, so they go first if not all
+	// tables fit into the table cache.
+	std::shared_ptr<Version> current = versions->current();
+	const size_t capacity = static_cast<size_t>(tableCacheSize(options));
+	for (int level = 0; level < kNumLevels; level++) {
+		const std::vector<std::shared_ptr<FileMetaData>>& files = current->files[level];
+		for (size_t i = 0; i < files.size() && state.files.size() < capacity; i++) {
+			state.files.push_back(files[i]);
+		}
+	}
+
+	if (state.files.empty()) {
+		return Status::OK();
+	}
+
+	const int numthreads = static_cast<int>(std::min<size_t>(
+		std::max(options.maxfileopeningthreads, 1), state.files.size()));
+	Info(options.infolog, "Pre-opening %llu tables with %d threads\n",
+		(unsigned long long) state.files.size(), numthreads);
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numthreads; i++) {
+		threads.emplace_back(std::bind(PreopenTableFiles, &state));
+	}
+
+	PreopenTableFiles(&state);
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	Info(options.infolog, "Pre-opened %llu tables in %.3f s, %d failed\n",
+		(unsigned long long) state.files.size(),
+		(options.env->NowMicros() - state.startmicros) / 1e6, state.failed);
+
+	// A table that cannot be opened now is retried by the first read of
+	// it, as without pre-opening, unless errors are not to be ignored.
+	if (options.paranoidchecks) {
+		return state.status;
+	}
+	return Status::OK();
+}
+
 const std::shared_ptr<Snapshot> DB::GetSnapshot() {
 	std::unique_lock<std::mutex> lk(mutex);
 	return snapshots->NewSnapshot(versions->GetLastSequence());
@@ -223,6 +539,7 @@ void DB::DeleteObsoleteFiles() {
 				keep = (number >= versions->GetManifestFileNumber());
 				break;
 			case kTableFile:
+			case kBlobFile:
 				keep = (live.find(number) != live.end());
 				break;
 			case kTempFile:
@@ -238,7 +555,7 @@ void DB::DeleteObsoleteFiles() {
 			}
 
 			if (!keep) {
-				if (type == kTableFile) {
+				if (type == kTableFile || type == kBlobFile) {
 					tablecache->evict(number);
 				}
 
@@ -361,6 +678,13 @@ Status DB::Recover(VersionEdit* edit, bool* savemanifest) {
 		versions->MarkFileNumberUsed(logs[i]);
 	}
 
+	if (options.sharedlog != nullptr) {
+		s = RecoverSharedLog(savemanifest, edit, &maxsequence);
+		if (!s.ok()) {
+			return s;
+		}
+	}
+
 	if (versions->GetLastSequence()< maxsequence) {
 		versions->SetLastSequence(maxsequence);
 	}
@@ -377,6 +701,294 @@ void DB::MaybeIgnoreError(Status* s) const {
 	}
 }
 
+// Concurrent inserts cost more than plain ones, so threads beyond the
+// number of cores only slow the replay down.
+static int RecoveryThreads(const Options& options) {
+	const int cores = static_cast<int>(std::thread::hardware_concurrency());
+	if (cores > 0 && options.recoverythreads > cores) {
+		return cores;
+	}
+	return options.recoverythreads;
+}
+
+// Replays logged batches into memtables for recovery.  With
+// Options::recoverythreads > 1, the thread reading the log only hands
+// the batches over, in chunks: inserter threads decode them and insert
+// them into the current memtable concurrently, which is safe as every
+// entry has its own sequence number, and a flusher thread writes the
+// memtables that fill up to level-0 tables, one after another and so in
+// sequence order, while the replay goes on.  The DB mutex is released
+// from construction to Finish() for the flusher to take.
+class DB::LogReplayer {
+public:
+	// REQUIRES: db->mutex is held
+	LogReplayer(DB* db, VersionEdit* edit, bool* savemanifest, uint64_t* maxsequence);
+
+	~LogReplayer();
+
+	// Replay the batch logged as "contents".  Returns the first error met
+	// so far, after which nothing more is replayed.
+	Status Add(const std::string_view& contents);
+
+	// Wait until every batch has been inserted and every full memtable
+	// written, and store the memtable being filled, or nullptr, in *mem.
+	// Re-acquires db->mutex.
+	Status Finish(std::shared_ptr<MemTable>* mem);
+
+	// Number of memtables written to level-0 tables.
+	int GetFlushes() const { return flushes; }
+
+private:
+	// Batches handed to an inserter at once, so that the threads meet
+	// once per chunk rather than once per batch.
+	struct Chunk {
+		std::vector<std::shared_ptr<WriteBatch>> batches;
+		std::shared_ptr<MemTable> mem;
+		size_t bytes;
+	};
+
+	static const size_t kChunkBytes = 64 * 1024;
+
+	// Queue "pending" for the inserters.
+	// REQUIRES: mutex is held
+	void Dispatch(std::unique_lock<std::mutex>& lk);
+
+	// Body of the inserter threads.
+	void Insert();
+
+	// Body of the flusher thread.
+	void Flush();
+
+	DB* const db;
+	VersionEdit* const edit;
+	bool* const savemanifest;
+	uint64_t* const maxsequence;
+	const int numthreads;
+	std::shared_ptr<MemTable> mem;
+	int flushes;
+	bool finished;
+	Chunk pending;
+
+	// Chunks that may wait for an inserter.  Bounds the memory held by
+	// the queue.
+	const size_t maxqueued;
+
+	std::mutex mutex;
+	std::condition_variable inserterscv;
+	std::condition_variable flushercv;
+	std::condition_variable replayercv;
+	std::deque<Chunk> queue;
+	int inserting;              // Chunks taken by an inserter but not inserted yet
+	size_t inflightbytes;       // Bytes of the batches queued or being inserted
+	std::deque<std::shared_ptr<MemTable>> full;     // Front is being written
+	bool stopping;
+	Status status;              // First error of an inserter or the flusher
+	std::vector<std::thread> threads;
+};
+
+DB::LogReplayer::LogReplayer(DB* db, VersionEdit* edit, bool* savemanifest, uint64_t* maxsequence)
+	: db(db),
+	edit(edit),
+	savemanifest(savemanifest),
+	maxsequence(maxsequence),
+	numthreads(RecoveryThreads(db->options)),
+	mem(nullptr),
+	flushes(0),
+	finished(false),
+	maxqueued(2 * static_cast<size_t>(std::max(numthreads, 1))),
+	inserting(0),
+	inflightbytes(0),
+	stopping(false) {
+	pending.bytes = 0;
+	if (numthreads > 1) {
+		db->mutex.unlock();
+		for (int i = 0; i < numthreads; i++) {
+			threads.emplace_back(std::bind(&LogReplayer::Insert, this));
+		}
+		threads.emplace_back(std::bind(&LogReplayer::Flush, this));
+	}
+}
+
+DB::LogReplayer::~LogReplayer() {
+	if (!finished) {
+		std::shared_ptr<MemTable> unused;
+		Finish(&unused);
+	}
+}
+
+Status DB::LogReplayer::Add(const std::string_view& contents) {
+	if (mem == nullptr) {
+		mem.reset(new MemTable(db->internalcomparator));
+	}
+
+	std::shared_ptr<WriteBatch> batch(new WriteBatch);
+	WriteBatchInternal::SetContents(batch.get(), contents);
+	const uint64_t lastseq = WriteBatchInternal::GetSequence(batch.get()) +
+		WriteBatchInternal::Count(batch.get()) - 1;
+
+	if (numthreads <= 1) {
+		Status s = WriteBatchInternal::InsertInto(batch.get(), mem);
+		db->MaybeIgnoreError(&s);
+		if (!s.ok()) {
+			return s;
+		}
+
+		if (lastseq > *maxsequence) {
+			*maxsequence = lastseq;
+		}
+
+		if (mem->GetMemoryUsage() > db->options.writebuffersize) {
+			flushes++;
+			*savemanifest = true;
+			// Errors are reflected immediately so that conditions like full
+			// file-systems cause the DB::Open() to fail.
+			s = db->WriteLevel0Table(mem, edit, nullptr);
+			mem.reset();
+		}
+		return s;
+	}
+
+	if (lastseq > *maxsequence) {
+		*maxsequence = lastseq;
+	}
+
+	pending.batches.push_back(batch);
+	pending.bytes += contents.size();
+	std::unique_lock<std::mutex> lk(mutex);
+	// The batches not inserted yet count with their encoded size, which
+	// is a little less than they take in the memtable.
+	const bool isfull = mem->GetMemoryUsage() + inflightbytes + pending.bytes >
+		db->options.writebuffersize;
+	if (isfull || pending.bytes >= kChunkBytes) {
+		Dispatch(lk);
+	}
+
+	if (isfull && status.ok()) {
+		// Only whole memtables are written: wait for the batches queued
+		// for mem to be in it.  At most one more memtable waits for the
+		// flusher.
+		while (status.ok() && (!queue.empty() || inserting > 0 || full.size() > 1)) {
+			replayercv.wait(lk);
+		}
+
+		if (status.ok()) {
+			flushes++;
+			*savemanifest = true;
+			full.push_back(mem);
+			flushercv.notify_one();
+			mem.reset();
+		}
+	}
+	return status;
+}
+
+void DB::LogReplayer::Dispatch(std::unique_lock<std::mutex>& lk) {
+	while (status.ok() && queue.size() >= maxqueued) {
+		replayercv.wait(lk);
+	}
+
+	if (status.ok() && !pending.batches.empty()) {
+		pending.mem = mem;
+		inflightbytes += pending.bytes;
+		queue.push_back(pending);
+		inserterscv.notify_one();
+	}
+
+	pending.batches.clear();
+	pending.mem.reset();
+	pending.bytes = 0;
+}
+
+void DB::LogReplayer::Insert() {
+	std::unique_lock<std::mutex> lk(mutex);
+	for (;;) {
+		while (queue.empty() && !stopping) {
+			inserterscv.wait(lk);
+		}
+
+		if (queue.empty()) {
+			break;
+		}
+
+		Chunk c = queue.front();
+		queue.pop_front();
+		inserting++;
+		replayercv.notify_one();
+		lk.unlock();
+
+		Status s;
+		for (size_t i = 0; i < c.batches.size() && s.ok(); i++) {
+			s = WriteBatchInternal::InsertInto(c.batches[i].get(), c.mem, true);
+			db->MaybeIgnoreError(&s);
+		}
+
+		lk.lock();
+		inserting--;
+		inflightbytes -= c.bytes;
+		if (!s.ok() && status.ok()) {
+			status = s;
+		}
+
+		if (queue.empty() && inserting == 0) {
+			replayercv.notify_all();
+		}
+	}
+}
+
+void DB::LogReplayer::Flush() {
+	std::unique_lock<std::mutex> lk(mutex);
+	for (;;) {
+		while (full.empty() && !stopping) {
+			flushercv.wait(lk);
+		}
+
+		if (full.empty()) {
+			break;
+		}
+
+		std::shared_ptr<MemTable> m = full.front();
+		const bool failed = !status.ok();
+		lk.unlock();
+
+		Status s;
+		if (!failed) {
+			std::unique_lock<std::mutex> dblk(db->mutex);
+			s = db->WriteLevel0Table(m, edit, nullptr);
+		}
+
+		lk.lock();
+		full.pop_front();
+		if (!s.ok() && status.ok()) {
+			status = s;
+		}
+		replayercv.notify_all();
+	}
+}
+
+Status DB::LogReplayer::Finish(std::shared_ptr<MemTable>* result) {
+	assert(!finished);
+	finished = true;
+	if (numthreads > 1) {
+		{
+			std::unique_lock<std::mutex> lk(mutex);
+			Dispatch(lk);
+			stopping = true;
+			inserterscv.notify_all();
+			flushercv.notify_all();
+		}
+
+		// Both kinds of threads drain their queues before they stop.
+		for (auto& t : threads) {
+			t.join();
+		}
+		db->mutex.lock();
+	}
+
+	*result = mem;
+	mem.reset();
+	return status;
+}
+
 Status DB::RecoverLogFile(uint64_t lognumber, bool lastLog,
 	bool* savemanifest, VersionEdit* edit, uint64_t* maxsequence) {
 	// Open the log file
@@ -396,48 +1008,27 @@ Status DB::RecoverLogFile(uint64_t lognumber, bool lastLog,
 	LogReader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
 	std::string scratch;
 	std::string_view record;
-	WriteBatch batch;
-	int compactions = 0;
 
 	std::shared_ptr<MemTable> mem = nullptr;
+	LogReplayer replayer(this, edit, savemanifest, maxsequence);
 	while (reader.ReadRecord(&record, &scratch) && status.ok()) {
 		if (record.size()< 12) {
 			reporter.Corruption(record.size(), Status::Corruption("log record too small"));
 			continue;
 		}
 
-		if (mem == nullptr) {
-			mem.reset(new MemTable(internalcomparator));
-		}
-
-		WriteBatchInternal::SetContents(&batch, record);
-		status = WriteBatchInternal::InsertInto(&batch, mem);
-		MaybeIgnoreError(&status);
-
-		if (!status.ok()) {
-			break;
-		}
-
-		const uint64_t lastseq = WriteBatchInternal::GetSequence(&batch) + WriteBatchInternal::Count(&batch) - 1;
-		if (lastseq > * maxsequence) {
-			*maxsequence = lastseq;
-		}
+		status = replayer.Add(record);
+	}
 
-		if (mem->GetMemoryUsage() > options.writebuffersize) {
-			compactions++;
-			*savemanifest = true;
-			status = WriteLevel0Table(mem, edit, nullptr);
-			mem.reset();
-			if (!status.ok()) {
-				// Reflect errors immediately so that conditions like full
-				// file-systems cause the DB::Open() to fail.
-				break;
-			}
-		}
+	Status s = replayer.Finish(&mem);
+	if (status.ok()) {
+		status = s;
 	}
 
-	// See if we should keep reusing the last log file.
-	if (status.ok() && options.reuselogs && lastLog && compactions == 0) {
+	// See if we should keep reusing the last log file.  A DB on a
+	// shared log has no log of its own to append to.
+	if (status.ok() && options.reuselogs && options.sharedlog == nullptr &&
+		lastLog && replayer.GetFlushes() == 0) {
 		uint64_t lfileSize;
 
 		if (options.env->GetFileSize(fname, &lfileSize).ok() &&
@@ -467,6 +1058,58 @@ Status DB::RecoverLogFile(uint64_t lognumber, bool lastLog,
 	return status;
 }
 
+// Entries of the other DBs on the log are skipped.  What is replayed is
+// always flushed, since the next log file is not ours to reuse.
+Status DB::RecoverSharedLog(bool* savemanifest, VersionEdit* edit, uint64_t* maxsequence) {
+	std::vector<uint64_t> logs;
+	options.sharedlog->GetRecoveryLogs(versions->GetSharedLogNumber(), &logs);
+
+	Status status;
+	std::shared_ptr<MemTable> mem = nullptr;
+	LogReplayer replayer(this, edit, savemanifest, maxsequence);
+	for (size_t i = 0; i < logs.size() && status.ok(); i++) {
+		std::string fname = LogFileName(options.sharedlog->GetDirName(), logs[i]);
+		std::shared_ptr<SequentialFile> file;
+		status = options.env->NewSequentialFile(fname, file);
+		if (!status.ok()) {
+			MaybeIgnoreError(&status);
+			continue;
+		}
+
+		LogReporter reporter;
+		LogReader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+		std::string scratch;
+		std::string_view record;
+		while (reader.ReadRecord(&record, &scratch) && status.ok()) {
+			uint32_t id;
+			std::string_view contents;
+			while (status.ok() && SharedLog::GetEntry(&record, &id, &contents)) {
+				if (id != options.sharedlogid) {
+					continue;
+				}
+
+				if (contents.size()< 12) {
+					reporter.Corruption(contents.size(), Status::Corruption("log record too small"));
+					continue;
+				}
+
+				status = replayer.Add(contents);
+			}
+		}
+	}
+
+	Status s = replayer.Finish(&mem);
+	if (status.ok()) {
+		status = s;
+	}
+
+	if (status.ok() && mem != nullptr) {
+		*savemanifest = true;
+		status = WriteLevel0Table(mem, edit, nullptr);
+	}
+	return status;
+}
+
 Status DB::Put(const WriteOptions& opt, const std::string_view& key, const std::string_view& value) {
 	WriteBatch batch;
 	batch.Put(key, value);
@@ -479,6 +1122,16 @@ Status DB::Delete(const WriteOptions& opt, const std::string_view& key) {
 	return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const std::string_view& key, const std::string_view& value) {
+	if (options.mergeoperator == nullptr) {
+		return Status::NotSupported("no merge operator set");
+	}
+
+	WriteBatch batch;
+	batch.Merge(key, value);
+	return Write(opt, &batch);
+}
+
 Status DB::MakeRoomForWrite(std::unique_lock<std::mutex>& lk, bool force) {
 	assert(!writers.empty());
 	bool allowdelay = !force;
@@ -489,55 +1142,95 @@ Status DB::MakeRoomForWrite(std::unique_lock<std::mutex>& lk, bool force) {
 			s = bgerror;
 			break;
 		}
-		else if (allowdelay && versions->NumLevelFiles(0) >= kL0_SlowdownWritesTrigger) {
-			// We are getting close to hitting a hard limit on the number of
-			// L0 files.  Rather than delaying a single Write by several
-			// seconds when we hit the hard limit, start delaying each
-			// individual Write by 1ms to reduce latency variance.  Also,
-			// this delay hands over some CPU to the compaction thread in
-			// case it is sharing the same core as the writer.
-
-			lk.unlock();
-			options.env->SleepForMicroseconds(1000);
+		else if (allowdelay && writecontroller->IsDelayed()) {
+			// Compactions are falling behind.  Rather than stalling a
+			// single write for seconds once the hard limit is reached,
+			// pace every write to the controller's current rate.  This
+			// also hands some CPU to the compaction thread in case it
+			// shares a core with the writer.
+			const uint64_t delay = writecontroller->GetDelay(options.env->NowMicros());
+			if (delay > 0) {
+				writecontroller->RecordDelay(delay);
+				const uint64_t start = options.env->NowMicros();
+				lk.unlock();
+				options.env->SleepForMicroseconds(static_cast<int>(delay));
+				lk.lock();
+				RecordStall(options.env->NowMicros() - start);
+			}
 			allowdelay = false;  // Do not delay a single Write more than once
-			lk.lock();
 		}
 		else if (!force && mem->GetMemoryUsage() <= options.writebuffersize) {
 			// There is room in current memtable
 			break;
 		}
+		else if (!memtablegroups.empty()) {
+			// Pipelined writes are still inserting into the current
+			// memtable; it cannot become immutable until they are done.
+			const uint64_t start = options.env->NowMicros();
+			memtablesignal.wait(lk);
+			RecordStall(options.env->NowMicros() - start);
+		}
 		else if (imm != nullptr) {
 			// We have filled up the current memtable, but the previous
 			// one is still being compacted, so we wait.
 			Debug(options.infolog, "Current memtable full; waiting...\n");
+			const uint64_t start = options.env->NowMicros();
 			bgfinishedsignal.wait(lk);
+			RecordStall(options.env->NowMicros() - start);
 		}
-		else if (versions->NumLevelFiles(0) >= kL0_StopWritesTrigger) {
-			// There are too many level-0 files.
-			Debug(options.infolog, "Too many L0 files; waiting...\n");
+		else if (writecontroller->IsStopped()) {
+			// There are too many level-0 files, or too much data waiting
+			// to be compacted.
+			Debug(options.infolog, "Too much compaction debt; waiting...\n");
+			const uint64_t start = options.env->NowMicros();
 			bgfinishedsignal.wait(lk);
+			RecordStall(options.env->NowMicros() - start);
 		}
 		else {
-			if (mem->GetMemoryUsage() == 0) {
+			if (mem->Empty()) {
 				return s;
 			}
 			// Attempt to switch to a new memtable and trigger compaction of old
 			assert(versions->GetPrevLogNumber() == 0);
-			uint64_t newLogNumber = versions->NewFileNumber();
-			std::shared_ptr<WritableFile> lfile;
-			s = options.env->NewWritableFile(LogFileName(dbname, newLogNumber), lfile);
-			if (!s.ok()) {
-				// Avoid chewing through file number space in a tight loop.
-				versions->ReuseFileNumber(newLogNumber);
-				break;
+			uint64_t newLogNumber;
+			if (options.sharedlog != nullptr) {
+				// The shared log starts a new file for everyone; the
+				// other DBs on it keep their memtables.
+				lk.unlock();
+				s = options.sharedlog->NewLogFile(&newLogNumber);
+				lk.lock();
+				if (!s.ok()) {
+					break;
+				}
+			}
+			else {
+				newLogNumber = versions->NewFileNumber();
+				std::shared_ptr<WritableFile> lfile;
+				s = options.env->NewWritableFile(LogFileName(dbname, newLogNumber), lfile);
+				if (!s.ok()) {
+					// Avoid chewing through file number space in a tight loop.
+					versions->ReuseFileNumber(newLogNumber);
+					break;
+				}
+
+				logfile = lfile;
+				log.reset(new LogWriter(lfile.get()));
 			}
 
-			logfile = lfile;
 			logfilenumber = newLogNumber;
-			log.reset(new LogWriter(lfile.get()));
+			if (options.writebuffermanager != nullptr) {
+				// The memory of mem is freed once imm has been flushed.
+				UpdateWriteBufferUsage();
+				immwritebufferusage = writebufferusage;
+				options.writebuffermanager->ScheduleFreeMem(writebufferusage);
+				writebufferusage = 0;
+			}
+
 			imm = mem;
 			hasimm.store(true, std::memory_order_release);
 			mem.reset(new MemTable(internalcomparator));
+			UpdateWriteBufferUsage();
+			InstallSuperVersion();
 			force = false;   // Do not force another compaction if have room
 			MaybeScheduleCompaction();
 		}
@@ -545,7 +1238,38 @@ Status DB::MakeRoomForWrite(std::unique_lock<std::mutex>& lk, bool force) {
 	return s;
 }
 
-WriteBatch* DB::BuildBatchGroup(Writer** lastWriter) {
+// REQUIRES: lk is not held; called by the group leader after the group's
+// record has been appended to the log.  members[0] is the leader.
+Status DB::ParallelInsertInto(std::unique_lock<std::mutex>& lk,
+	const std::vector<Writer*>& members, const std::shared_ptr<MemTable>& mem) {
+	MemTableInsertGroup group;
+	group.mem = mem;
+
+	lk.lock();
+	for (size_t i = 1; i < members.size(); i++) {
+		Writer* x = members[i];
+		if (x->batch != nullptr) {
+			group.pending++;
+			x->insertgroup = &group;
+			x->cv.notify_one();
+		}
+	}
+	lk.unlock();
+
+	Status s = WriteBatchInternal::InsertInto(members[0]->batch, group.mem, true);
+
+	std::unique_lock<std::mutex> glk(group.mutex);
+	while (group.pending > 0) {
+		group.cv.wait(glk);
+	}
+
+	if (s.ok()) {
+		s = group.status;
+	}
+	return s;
+}
+
+WriteBatch* DB::BuildBatchGroup(Writer** lastWriter) {
 	assert(!writers.empty());
 	Writer* first = writers.front();
 	WriteBatch* result = first->batch;
@@ -562,27 +1286,35 @@ WriteBatch* DB::BuildBatchGroup(Writer** lastWriter) {
 
 	for (; iter != writers.end(); ++iter) {
 		Writer* w = *iter;
+		if (w->exclusive) {
+			// An atomic write goes into the log on its own.
+			break;
+		}
+
+		if (w->batch == nullptr) {
+			// A forced flush must lead its own group to switch memtables.
+			break;
+		}
+
 		if (w->sync && !first->sync) {
 			// Do not include a sync Write into a batch handled by a non-sync Write.
 			break;
 		}
 
-		if (w->batch != nullptr) {
-			size += WriteBatchInternal::ByteSize(w->batch);
-			if (size > maxSize) {
-				// Do not make batch too big
-				break;
-			}
+		size += WriteBatchInternal::ByteSize(w->batch);
+		if (size > maxSize) {
+			// Do not make batch too big
+			break;
+		}
 
-			// Append to *result
-			if (result == first->batch) {
-				// Switch to temporary batch instead of disturbing caller's batch
-				result = tmpbatch.get();
-				assert(WriteBatchInternal::Count(result) == 0);
-				WriteBatchInternal::append(result, first->batch);
-			}
-			WriteBatchInternal::append(result, w->batch);
+		// Append to *result
+		if (result == first->batch) {
+			// Switch to temporary batch instead of disturbing caller's batch
+			result = tmpbatch.get();
+			assert(WriteBatchInternal::Count(result) == 0);
+			WriteBatchInternal::append(result, first->batch);
 		}
+		WriteBatchInternal::append(result, w->batch);
 		*lastWriter = w;
 	}
 	return result;
@@ -616,16 +1348,61 @@ Status DB::DestroyDB(const std::string& dbname, const Options& options) {
 	return result;
 }
 
+void DB::UpdateWriteBufferUsage() {
+	if (options.writebuffermanager != nullptr) {
+		const size_t usage = mem->GetMemoryUsage();
+		const size_t reported = writebufferusage.load(std::memory_order_relaxed);
+		if (usage > reported) {
+			options.writebuffermanager->ReserveMem(usage - reported);
+			writebufferusage.store(usage, std::memory_order_relaxed);
+		}
+	}
+}
+
+void DB::FlushWriteBuffer() {
+	{
+		std::unique_lock<std::mutex> lk(mutex);
+		if (mem == nullptr || mem->Empty() || imm != nullptr) {
+			return;
+		}
+	}
+
+	// A nullptr batch forces a new memtable; see MakeRoomForWrite().
+	Write(WriteOptions(), nullptr);
+}
+
 Status DB::Write(const WriteOptions& opt, WriteBatch* mybatch) {
+	// Before we queue up and while we hold no lock, free memory for
+	// the write if the memtables of all DBs are over their limit.
+	if (mybatch != nullptr && options.writebuffermanager != nullptr &&
+		options.writebuffermanager->ShouldFlush()) {
+		options.writebuffermanager->FlushLargest();
+	}
+
+	StopWatch sw(options.statistics.get(), kDBWriteMicros);
 	Writer w;
 	w.batch = mybatch;
 	w.sync = opt.sync;
 	w.done = false;
+	w.exclusive = false;
+	w.insertgroup = nullptr;
 
 	std::unique_lock<std::mutex> lk(mutex);
 	writers.push_back(&w);
 
-	while (!w.done && &w != writers.front()) {
+	// A pipelined group leaves the queue once it is logged, so a member
+	// may wait here after it is no longer in writers.
+	while (!w.done && (writers.empty() || &w != writers.front())) {
+		if (w.insertgroup != nullptr) {
+			// The leader has logged our batch as part of its group; apply
+			// it to the memtable alongside the other members.
+			MemTableInsertGroup* group = w.insertgroup;
+			w.insertgroup = nullptr;
+			lk.unlock();
+			group->Finish(WriteBatchInternal::InsertInto(w.batch, group->mem, true));
+			lk.lock();
+			continue;
+		}
 		w.cv.wait(lk);
 	}
 
@@ -635,11 +1412,35 @@ Status DB::Write(const WriteOptions& opt, WriteBatch* mybatch) {
 
 	// May temporarily unlock and wait.
 	Status status = MakeRoomForWrite(lk, mybatch == nullptr);
+	if (status.ok() && mybatch != nullptr && options.enablepipelinedwrite) {
+		return PipelinedWrite(lk, opt, &w);
+	}
+
 	uint64_t lastsequence = versions->GetLastSequence();
 	Writer* lastwriter = &w;
 	if (status.ok() && mybatch != nullptr) {
 		WriteBatch* updates = BuildBatchGroup(&lastwriter);
 		WriteBatchInternal::SetSequence(updates, lastsequence + 1);
+		writecontroller->Consume(WriteBatchInternal::ByteSize(updates));
+		RecordTick(options.statistics, kNumberKeysWritten, WriteBatchInternal::Count(updates));
+		RecordTick(options.statistics, kBytesWritten, WriteBatchInternal::ByteSize(updates));
+
+		// With more than one writer in the group, each member can insert
+		// its own batch; give every batch its slice of the sequence space.
+		const bool parallel = options.allowconcurrentmemtablewrite && lastwriter != &w;
+		std::vector<Writer*> members;
+		if (parallel) {
+			uint64_t seq = lastsequence + 1;
+			for (Writer* x : writers) {
+				members.push_back(x);
+				if (x->batch != nullptr) {
+					WriteBatchInternal::SetSequence(x->batch, seq);
+					seq += WriteBatchInternal::Count(x->batch);
+				}
+
+				if (x == lastwriter) break;
+			}
+		}
 		lastsequence += WriteBatchInternal::Count(updates);
 
 		// Add to log and Apply to memtable.  We can Release the lock
@@ -649,18 +1450,17 @@ Status DB::Write(const WriteOptions& opt, WriteBatch* mybatch) {
 
 		{
 			lk.unlock();
-			status = log->AddRecord(WriteBatchInternal::Contents(updates));
-			bool syncerror = false;
-			if (status.ok() && opt.sync) {
-				status = logfile->sync();
-				if (!status.ok()) {
-					syncerror = true;
-				}
-			}
+			bool syncerror;
+			status = AppendToLog(opt, updates, &syncerror);
 
-			if (status.ok()) {
+			PerfTimer memtimer(&GetPerfContext()->writememtabletime);
+			if (status.ok() && parallel) {
+				status = ParallelInsertInto(lk, members, mem);
+			}
+			else if (status.ok()) {
 				status = WriteBatchInternal::InsertInto(updates, mem);
 			}
+			memtimer.Stop();
 
 			lk.lock();
 			if (syncerror) {
@@ -675,6 +1475,7 @@ Status DB::Write(const WriteOptions& opt, WriteBatch* mybatch) {
 			 tmpbatch->clear(); 
 		}
 		versions->SetLastSequence(lastsequence);
+		UpdateWriteBufferUsage();
 	}
 
 	while (true) {
@@ -696,11 +1497,307 @@ Status DB::Write(const WriteOptions& opt, WriteBatch* mybatch) {
 	return status;
 }
 
+// Each DB's writer queue is entered in turn, in address order so that
+// two atomic writes never wait for each other, and the writer stays at
+// its head until the record is in the shared log and every batch is in
+// its memtable.  Writers of a DB that queue up meanwhile wait, as they
+// would for any other group.
+Status DB::AtomicWrite(const WriteOptions& opt,
+	const std::vector<std::pair<DB*, WriteBatch*>>& updates) {
+	for (const auto& u : updates) {
+		const std::shared_ptr<WriteBufferManager>& wbm = u.first->options.writebuffermanager;
+		if (wbm != nullptr && wbm->ShouldFlush()) {
+			wbm->FlushLargest();
+		}
+	}
+
+	std::vector<std::pair<DB*, WriteBatch*>> sorted(updates);
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t i = 0; i < sorted.size(); i++) {
+		if (sorted[i].first->options.sharedlog == nullptr ||
+			sorted[i].first->options.sharedlog != sorted[0].first->options.sharedlog) {
+			return Status::InvalidArgument("atomic write across DBs without a shared log");
+		}
+
+		if (i > 0 && sorted[i].first == sorted[i - 1].first) {
+			return Status::InvalidArgument("atomic write to the same DB twice");
+		}
+	}
+
+	Status status;
+	std::vector<std::shared_ptr<Writer>> ws;
+	for (size_t i = 0; i < sorted.size() && status.ok(); i++) {
+		DB* db = sorted[i].first;
+		WriteBatch* batch = sorted[i].second;
+		std::shared_ptr<Writer> w(new Writer);
+		w->batch = batch;
+		w->sync = opt.sync;
+		w->done = false;
+		w->exclusive = true;
+		w->insertgroup = nullptr;
+		ws.push_back(w);
+
+		std::unique_lock<std::mutex> lk(db->mutex);
+		db->writers.push_back(w.get());
+		while (w.get() != db->writers.front()) {
+			w->cv.wait(lk);
+		}
+
+		status = db->MakeRoomForWrite(lk, false);
+		// Pipelined groups ahead of us must publish their sequence
+		// numbers first.
+		while (status.ok() && !db->memtablegroups.empty()) {
+			db->memtablesignal.wait(lk);
+		}
+
+		if (status.ok()) {
+			WriteBatchInternal::SetSequence(batch, db->versions->GetLastSequence() + 1);
+			db->writecontroller->Consume(WriteBatchInternal::ByteSize(batch));
+			RecordTick(db->options.statistics, kNumberKeysWritten, WriteBatchInternal::Count(batch));
+			RecordTick(db->options.statistics, kBytesWritten, WriteBatchInternal::ByteSize(batch));
+		}
+	}
+
+	// We head every queue, so the memtables are ours to insert into.
+	bool syncerror = false;
+	if (status.ok()) {
+		std::string record;
+		for (const auto& u : sorted) {
+			SharedLog::AppendEntry(&record, u.first->options.sharedlogid,
+				WriteBatchInternal::Contents(u.second));
+		}
+
+		status = sorted[0].first->options.sharedlog->AddRecord(record, opt.sync, &syncerror);
+		for (size_t i = 0; i < sorted.size() && status.ok(); i++) {
+			status = WriteBatchInternal::InsertInto(sorted[i].second, sorted[i].first->mem);
+		}
+	}
+
+	for (size_t i = 0; i < ws.size(); i++) {
+		DB* db = sorted[i].first;
+		WriteBatch* batch = sorted[i].second;
+		std::unique_lock<std::mutex> lk(db->mutex);
+		if (status.ok()) {
+			db->versions->SetLastSequence(WriteBatchInternal::GetSequence(batch) +
+				WriteBatchInternal::Count(batch) - 1);
+			db->UpdateWriteBufferUsage();
+		}
+
+		if (syncerror) {
+			// See Write(): all future writes fail.
+			db->RecordBackgroundError(status);
+		}
+
+		assert(db->writers.front() == ws[i].get());
+		db->writers.pop_front();
+		if (!db->writers.empty()) {
+			db->writers.front()->cv.notify_one();
+		}
+	}
+	return status;
+}
+
+void DB::RecordStall(uint64_t micros) {
+	GetPerfContext()->writedelaytime += micros * 1000;
+	if (options.statistics != nullptr) {
+		options.statistics->RecordTick(kStallMicros, micros);
+		options.statistics->MeasureTime(kStallHistogramMicros, micros);
+	}
+}
+
+// REQUIRES: lk is not held; called by the head of writers.
+Status DB::AppendToLog(const WriteOptions& opt, WriteBatch* updates, bool* syncerror) {
+	const bool timed = options.ratelimiter != nullptr && options.ratelimiter->IsAutoTuned();
+	const uint64_t start = timed ? options.env->NowMicros() : 0;
+	PerfTimer waltimer(&GetPerfContext()->writewaltime);
+	*syncerror = false;
+	Status status;
+	if (options.sharedlog != nullptr) {
+		std::string record;
+		SharedLog::AppendEntry(&record, options.sharedlogid, WriteBatchInternal::Contents(updates));
+		status = options.sharedlog->AddRecord(record, opt.sync, syncerror);
+	}
+	else {
+		status = log->AddRecord(WriteBatchInternal::Contents(updates));
+		if (status.ok() && opt.sync) {
+			StopWatch sw(options.statistics.get(), kWalSyncMicros);
+			RecordTick(options.statistics, kWalSyncs);
+			status = logfile->sync();
+			if (!status.ok()) {
+				*syncerror = true;
+			}
+		}
+	}
+
+	if (timed) {
+		options.ratelimiter->RecordForegroundLatency(options.env->NowMicros() - start);
+	}
+	return status;
+}
+
+// The group is logged while w heads writers, exactly as in Write(), but
+// w gives up the head as soon as the record is in the log, so the next
+// group can log while this one inserts into the memtable.  Groups insert
+// and publish their sequence numbers one at a time, in log order; the
+// next group picks its sequence numbers from the last one queued.
+Status DB::PipelinedWrite(std::unique_lock<std::mutex>& lk, const WriteOptions& opt, Writer* w) {
+	Writer* lastwriter = w;
+	WriteBatch* updates = BuildBatchGroup(&lastwriter);
+	writecontroller->Consume(WriteBatchInternal::ByteSize(updates));
+	RecordTick(options.statistics, kNumberKeysWritten, WriteBatchInternal::Count(updates));
+	RecordTick(options.statistics, kBytesWritten, WriteBatchInternal::ByteSize(updates));
+
+	WriteGroup group;
+	group.mem = mem;
+	uint64_t seq = memtablegroups.empty() ?
+		versions->GetLastSequence() : memtablegroups.back()->lastsequence;
+	WriteBatchInternal::SetSequence(updates, seq + 1);
+	group.lastsequence = seq + WriteBatchInternal::Count(updates);
+
+	// Every member inserts its own batch, since updates is reused by the
+	// next group as soon as this one leaves the log stage.
+	seq++;
+	for (Writer* x : writers) {
+		group.members.push_back(x);
+		if (x->batch != nullptr) {
+			WriteBatchInternal::SetSequence(x->batch, seq);
+			seq += WriteBatchInternal::Count(x->batch);
+		}
+
+		if (x == lastwriter) break;
+	}
+	memtablegroups.push_back(&group);
+
+	lk.unlock();
+	bool syncerror;
+	Status status = AppendToLog(opt, updates, &syncerror);
+	lk.lock();
+
+	if (syncerror) {
+		// See Write(): all future writes fail.
+		RecordBackgroundError(status);
+	}
+
+	if (updates == tmpbatch.get()) {
+		tmpbatch->clear();
+	}
+
+	// Hand the log over to the next group.
+	for (size_t i = 0; i < group.members.size(); i++) {
+		assert(writers.front() == group.members[i]);
+		writers.pop_front();
+	}
+
+	if (!writers.empty()) {
+		writers.front()->cv.notify_one();
+	}
+
+	while (memtablegroups.front() != &group) {
+		memtablesignal.wait(lk);
+	}
+
+	if (status.ok()) {
+		lk.unlock();
+		PerfTimer memtimer(&GetPerfContext()->writememtabletime);
+		if (options.allowconcurrentmemtablewrite && group.members.size() > 1) {
+			status = ParallelInsertInto(lk, group.members, group.mem);
+		}
+		else {
+			for (Writer* x : group.members) {
+				if (status.ok() && x->batch != nullptr) {
+					status = WriteBatchInternal::InsertInto(x->batch, group.mem);
+				}
+			}
+		}
+		memtimer.Stop();
+		lk.lock();
+	}
+
+	versions->SetLastSequence(group.lastsequence);
+	UpdateWriteBufferUsage();
+	memtablegroups.pop_front();
+	for (Writer* x : group.members) {
+		if (x != w) {
+			x->status = status;
+			x->done = true;
+			x->cv.notify_one();
+		}
+	}
+
+	// Wake the next group, and a writer waiting in MakeRoomForWrite()
+	// for the memtable to drain.
+	memtablesignal.notify_all();
+	return status;
+}
+
 Status DB::Get(const ReadOptions& opt, const std::string_view& key, std::string* value) {
+	PinnableValue pinnable(value);
+	Status s = Get(opt, key, &pinnable);
+	if (s.ok() && pinnable.IsPinned()) {
+		value->assign(pinnable.data(), pinnable.size());
+	}
+	return s;
+}
+
+Status DB::Get(const ReadOptions& opt, const std::string_view& key, PinnableValue* value) {
 	Status s;
 	uint64_t snapshot;
+	// Read the sequence before the super version: everything written up
+	// to it is reachable from any super version installed afterwards.
+	if (opt.snapshot != nullptr) {
+		snapshot = opt.snapshot->GetSequenceNumber();
+	}
+	else {
+		snapshot = versions->GetLastSequence();
+	}
 
-	std::unique_lock<std::mutex> lk(mutex);
+	StopWatch sw(options.statistics.get(), kDBGetMicros);
+	RecordTick(options.statistics, kNumberKeysRead);
+	PerfContext* perf = GetPerfContext();
+	std::shared_ptr<SuperVersion> sv = GetSuperVersion();
+	LookupKey lkey(key, snapshot);
+	value->Reset();
+	PerfTimer memtimer(&perf->getfrommemtabletime);
+	const MergeOperator* mergeoperator = options.mergeoperator.get();
+	std::vector<std::string> operands;
+	bool done = sv->mem->Get(lkey, value, &s, mergeoperator, &operands) ||
+		(sv->imm != nullptr && sv->imm->Get(lkey, value, &s, mergeoperator, &operands));
+	memtimer.Stop();
+	if (done) {
+		RecordTick(options.statistics, kMemtableHit);
+		perf->getfrommemtablecount++;
+	}
+	else {
+		RecordTick(options.statistics, kMemtableMiss);
+		PerfTimer filetimer(&perf->getfromfilestime);
+
+		// Only reads that reach the table files tell the rate limiter
+		// something about disk contention.
+		const bool timed = options.ratelimiter != nullptr && options.ratelimiter->IsAutoTuned();
+		const uint64_t start = timed ? options.env->NowMicros() : 0;
+		Version::GetStats stats;
+		s = sv->current->Get(opt, lkey, value, &stats, &operands);
+		if (timed) {
+			options.ratelimiter->RecordForegroundLatency(options.env->NowMicros() - start);
+		}
+
+		if (sv->current->RecordSeek(stats)) {
+			// Rare: a file has used up its seeks, mark it for compaction.
+			std::unique_lock<std::mutex> lk(mutex);
+			if (sv->current->UpdateStats(stats)) {
+				MaybeScheduleCompaction();
+			}
+		}
+	}
+	return s;
+}
+
+void DB::MultiGet(const ReadOptions& opt, const std::vector<std::string_view>& keys,
+	std::vector<std::string>* values, std::vector<Status>* statuses) {
+	values->assign(keys.size(), std::string());
+	statuses->assign(keys.size(), Status());
+
+	uint64_t snapshot;
 	if (opt.snapshot != nullptr) {
 		snapshot = opt.snapshot->GetSequenceNumber();
 	}
@@ -708,33 +1805,74 @@ Status DB::Get(const ReadOptions& opt, const std::string_view& key, std::string*
 		snapshot = versions->GetLastSequence();
 	}
 
-	bool havestatppdate = false;
-	auto current = versions->current();
-	Version::GetStats stats;
+	struct ByUserKey {
+		const Comparator* ucmp;
+		const std::vector<std::string_view>* keys;
 
-	{
-		lk.unlock();
-		LookupKey lkey(key, snapshot);
-		if (mem->Get(lkey, value, &s)) {
-			// Done
+		bool operator()(size_t a, size_t b) const {
+			return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
 		}
-		else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-			// Done
+	};
+
+	std::vector<size_t> order(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		order[i] = i;
+	}
+
+	ByUserKey cmp = { GetComparator(), &keys };
+	std::sort(order.begin(), order.end(), cmp);
+
+	std::shared_ptr<SuperVersion> sv = GetSuperVersion();
+	std::vector<std::shared_ptr<LookupKey>> lkeys;
+	std::vector<Version::KeyContext> pending;
+	lkeys.reserve(keys.size());
+	const MergeOperator* mergeoperator = options.mergeoperator.get();
+	std::vector<std::string> operands;
+	for (size_t i : order) {
+		std::shared_ptr<LookupKey> lkey(new LookupKey(keys[i], snapshot));
+		std::string* value = &(*values)[i];
+		Status* s = &(*statuses)[i];
+		PinnableValue pinnable(value);
+		operands.clear();
+		if (sv->mem->Get(*lkey, &pinnable, s, mergeoperator, &operands) ||
+			(sv->imm != nullptr && sv->imm->Get(*lkey, &pinnable, s, mergeoperator, &operands))) {
+			if (pinnable.IsPinned()) {
+				value->assign(pinnable.data(), pinnable.size());
+			}
 		}
 		else {
-			s = current->Get(opt, lkey, value, &stats);
-			havestatppdate = true;
+			Version::KeyContext k;
+			k.key = lkey.get();
+			k.value = value;
+			k.status = s;
+			k.done = false;
+			k.operands.swap(operands);
+			pending.push_back(k);
+			lkeys.push_back(lkey);
 		}
-		lk.lock();
 	}
 
-	if (havestatppdate && current->UpdateStats(stats)) {
-		MaybeScheduleCompaction();
+	if (!pending.empty()) {
+		sv->current->MultiGet(opt, &pending);
 	}
-	return s;
 }
 
-Status DB::WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* edit, Version* base) {
+void DB::InstallSuperVersion() {
+	std::shared_ptr<SuperVersion> sv(new SuperVersion);
+	sv->mem = mem;
+	sv->imm = imm;
+	sv->current = versions->current();
+	std::atomic_store(&superversion, sv);
+	writecontroller->Update(versions->NumLevelFiles(0),
+		versions->EstimatedCompactionDebt(), options.env->NowMicros());
+}
+
+std::shared_ptr<DB::SuperVersion> DB::GetSuperVersion() const {
+	return std::atomic_load(&superversion);
+}
+
+Status DB::WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* edit, Version* base,
+	std::vector<uint64_t>* pending) {
 	const uint64_t startMicros = options.env->NowMicros();
 	FileMetaData meta;
 	meta.number = versions->NewFileNumber();
@@ -743,17 +1881,30 @@ Status DB::WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* e
 		(unsigned long long) meta.number);
 
 	Status s;
+	std::vector<BlobFileBuilder::FileInfo> blobfiles;
 	{
 		mutex.unlock();
 		std::shared_ptr<Iterator> iter = mem->NewIterator();
-		Status s = BuildTable(&meta, iter);
+		s = BuildTable(&meta, iter, &blobfiles);
 		mutex.lock();
 	}
-	Debug(options.infolog, "Level-0 table #%llu: %lld bytes %s\n", (unsigned long long) meta.number,
-		(unsigned long long) meta.filesize, s.ToString().c_str());
+	Debug(options.infolog, "Level-0 table #%llu: %lld bytes, %d blob files %s\n",
+		(unsigned long long) meta.number, (unsigned long long) meta.filesize,
+		static_cast<int>(blobfiles.size()), s.ToString().c_str());
 
-	size_t n = pendingoutputs.erase(meta.number);
-	assert(n == 1);
+	if (pending != nullptr) {
+		pending->push_back(meta.number);
+		for (size_t i = 0; i < blobfiles.size(); i++) {
+			pending->push_back(blobfiles[i].number);
+		}
+	}
+	else {
+		size_t n = pendingoutputs.erase(meta.number);
+		assert(n == 1);
+		for (size_t i = 0; i < blobfiles.size(); i++) {
+			pendingoutputs.erase(blobfiles[i].number);
+		}
+	}
 
 	// Note that if file_size is zero, the file has been deleted and
 	// should not be added to the manifest.
@@ -767,12 +1918,18 @@ Status DB::WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* e
 		}
 
 		edit->AddFile(level, meta.number, meta.filesize,
-			meta.smallest, meta.largest);
+			meta.smallest, meta.largest, meta.oldestblobfile);
+		for (size_t i = 0; i < blobfiles.size(); i++) {
+			edit->AddBlobFile(blobfiles[i].number, blobfiles[i].count, blobfiles[i].bytes);
+		}
 	}
 
 	CompactionStats sta;
 	sta.micros = options.env->NowMicros() - startMicros;
 	sta.byteswritten = meta.filesize;
+	for (size_t i = 0; i < blobfiles.size(); i++) {
+		sta.byteswritten += blobfiles[i].bytes;
+	}
 	stats[level].Add(sta);
 	return s;
 }
@@ -798,24 +1955,58 @@ void DB::BackgroundCallback() {
 	bgfinishedsignal.notify_all();
 }
 
-void DB::MaybeScheduleCompaction() {
-	if (bgcompactionscheduled) {
-		// Already scheduled
+void DB::BackgroundFlushCallback() {
+	std::unique_lock<std::mutex> lck(mutex);
+	assert(bgflushscheduled);
+	if (shuttingdown.load(std::memory_order_acquire)) {
+		// No more background work when shutting down.
 	}
-	else if (shuttingdown.load(std::memory_order_acquire)) {
+	else if (!bgerror.ok()) {
+		// No more background work after a background error.
+	}
+	else if (imm != nullptr) {
+		CompactMemTable();
+	}
+
+	bgflushscheduled = false;
+
+	// The new level-0 file may call for a compaction, and a compaction
+	// deferred while we were running can start now.
+	MaybeScheduleCompaction();
+	// Wake up MakeRoomForWrite() if necessary.
+	bgfinishedsignal.notify_all();
+}
+
+// Flushes of imm run in the HIGH priority pool and compactions in the
+// LOW pool, so a flush never waits for a long compaction to finish.
+void DB::MaybeScheduleCompaction() {
+	if (shuttingdown.load(std::memory_order_acquire)) {
 		// DB is being deleted; no more background compactions
+		return;
 	}
 	else if (!bgerror.ok()) {
 		// Already got an error; no more changes
+		return;
+	}
+
+	if (imm != nullptr && !bgflushscheduled) {
+		bgflushscheduled = true;
+		options.env->Schedule(std::bind(&DB::BackgroundFlushCallback, this), Env::HIGH);
+	}
+
+	// A compaction is not started while a flush is in flight: the flush
+	// may place its output below level-0 (see CompactMemTable), which is
+	// only safe if no compaction is writing to the same levels.
+	if (bgcompactionscheduled || bgflushscheduled) {
+		// Already scheduled, or deferred until the flush is done
 	}
-	else if (imm == nullptr &&
-		manualcompaction == nullptr &&
+	else if (manualcompaction == nullptr &&
 		!versions->NeedsCompaction()) {
 		// No work to be done
 	}
 	else {
 		bgcompactionscheduled = true;
-		options.env->Schedule(std::bind(&DB::BackgroundCallback, this));
+		options.env->Schedule(std::bind(&DB::BackgroundCallback, this), Env::LOW);
 	}
 }
 
@@ -880,11 +2071,6 @@ void DB::TESTCompactRange(int level, const std::string_view* begin, const std::s
 }
 
 void DB::BackgroundCompaction() {
-	if (imm != nullptr) {
-		CompactMemTable();
-		return;
-	}
-
 	std::shared_ptr<Compaction> c;
 	bool ismanual = (manualcompaction != nullptr);
 	InternalKey manualend;
@@ -916,9 +2102,12 @@ void DB::BackgroundCompaction() {
 		auto f = c->input(0, 0);
 		c->getEdit()->DeleteFile(c->getLevel(), f->number);
 		c->getEdit()->AddFile(c->getLevel() + 1, f->number, f->filesize,
-			f->smallest, f->largest);
+			f->smallest, f->largest, f->oldestblobfile);
 		status = versions->LogAndApply(c->getEdit(), &mutex);
 		assert(status.ok());
+		if (status.ok()) {
+			InstallSuperVersion();
+		}
 
 		VersionSet::LevelSummaryStorage tmp;
 		Debug(options.infolog, "Moved #%lld to level-%d %lld bytes %s: %s\n",
@@ -980,6 +2169,11 @@ void DB::CleanupCompaction(CompactionState* compact) {
 		size_t n = pendingoutputs.erase(out.number);
 		assert(n == 1);
 	}
+
+	for (size_t i = 0; i < compact->blobfiles.size(); i++) {
+		size_t n = pendingoutputs.erase(compact->blobfiles[i].number);
+		assert(n == 1);
+	}
 }
 
 Status DB::FinishCompactionOutputFile(CompactionState * compact,
@@ -1033,7 +2227,6 @@ Status DB::FinishCompactionOutputFile(CompactionState * compact,
 
 Status DB::DoCompactionWork(CompactionState* compact) {
 	const uint64_t startMicros = options.env->NowMicros();
-	int64_t immMicros = 0;  // Micros spent doing imm_ compactions
 	Debug(options.infolog, "Compacting %d@%d + %d@%d files",
 		compact->compaction->numInputFiles(0),
 		compact->compaction->getLevel(),
@@ -1051,34 +2244,215 @@ Status DB::DoCompactionWork(CompactionState* compact) {
 		compact->smallestsnapshot = snapshots->oldest()->GetSequenceNumber();
 	}
 
+	compact->blobgccutoff = versions->BlobGCCutoff(versions->current().get());
+
 	// Release mutex while we're actually doing the compaction work
 	mutex.unlock();
 
+	std::vector<std::string> boundaries;
+	GenSubcompactionBoundaries(compact->compaction, &boundaries);
+
+	Status status;
+	if (boundaries.empty()) {
+		ProcessKeyRange(compact);
+		status = compact->status;
+	}
+	else {
+		std::vector<std::shared_ptr<CompactionState>> subs;
+		for (size_t i = 0; i <= boundaries.size(); i++) {
+			std::shared_ptr<CompactionState> sub(new CompactionState(compact->compaction));
+			sub->smallestsnapshot = compact->smallestsnapshot;
+			sub->blobgccutoff = compact->blobgccutoff;
+			if (i > 0) {
+				sub->hasstart = true;
+				sub->start = boundaries[i - 1];
+			}
+
+			if (i < boundaries.size()) {
+				sub->hasend = true;
+				sub->end = boundaries[i];
+			}
+			subs.push_back(sub);
+		}
+
+		Debug(options.infolog, "Compaction split into %d subcompactions",
+			static_cast<int>(subs.size()));
+
+		// Run on dedicated threads rather than the env's pools: waiting
+		// here for work queued behind us in the same pool would deadlock.
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < subs.size(); i++) {
+			threads.emplace_back(std::bind(&DB::ProcessKeyRange, this, subs[i].get()));
+		}
+
+		ProcessKeyRange(subs[0].get());
+		for (auto& t : threads) {
+			t.join();
+		}
+
+		// Ranges are disjoint and in order, so appending keeps the
+		// outputs sorted.  All of them are installed by one edit below.
+		for (auto& sub : subs) {
+			if (status.ok()) {
+				status = sub->status;
+			}
+
+			if (sub->builder != nullptr) {
+				sub->builder->Abandon();
+				sub->builder.reset();
+				sub->outfile.reset();
+			}
+
+			compact->outputs.insert(compact->outputs.end(),
+				sub->outputs.begin(), sub->outputs.end());
+			compact->totalbytes += sub->totalbytes;
+			compact->blobfiles.insert(compact->blobfiles.end(),
+				sub->blobfiles.begin(), sub->blobfiles.end());
+			for (auto iter = sub->blobgarbage.begin(); iter != sub->blobgarbage.end(); ++iter) {
+				std::pair<uint64_t, uint64_t>& g = compact->blobgarbage[iter->first];
+				g.first += iter->second.first;
+				g.second += iter->second.second;
+			}
+		}
+	}
+
+	CompactionStats stats;
+	stats.micros = options.env->NowMicros() - startMicros;
+	for (int which = 0; which < 2; which++) {
+		for (int i = 0; i< compact->compaction->numInputFiles(which); i++) {
+			stats.bytesread += compact->compaction->input(which, i)->filesize;
+		}
+	}
+
+	for (size_t i = 0; i< compact->outputs.size(); i++) {
+		stats.byteswritten += compact->outputs[i].filesize;
+	}
+
+	for (size_t i = 0; i < compact->blobfiles.size(); i++) {
+		stats.byteswritten += compact->blobfiles[i].bytes;
+	}
+
+	mutex.lock();
+	this->stats[compact->compaction->getLevel() + 1].Add(stats);
+	if (status.ok()) {
+		status = InstallCompactionResults(compact);
+	}
+
+	if (!status.ok()) {
+		RecordBackgroundError(status);
+	}
+
+	VersionSet::LevelSummaryStorage tmp;
+	Debug(options.infolog, "compacted to: %s", versions->LevelSummary(&tmp));
+	return status;
+}
+
+void DB::GenSubcompactionBoundaries(Compaction* c, std::vector<std::string>* boundaries) {
+	boundaries->clear();
+	if (options.maxsubcompactions <= 1) {
+		return;
+	}
+
+	// Not worth the threads unless there are several output files' worth
+	// of input.
+	uint64_t inputbytes = 0;
+	std::vector<std::string_view> keys;
+	for (int which = 0; which < 2; which++) {
+		for (int i = 0; i < c->numInputFiles(which); i++) {
+			inputbytes += c->input(which, i)->filesize;
+			keys.push_back(c->input(which, i)->largest.UserKey());
+		}
+	}
+
+	if (inputbytes <= 2 * c->getMaxOutputFileSize()) {
+		return;
+	}
+
+	struct ByUserKey {
+		const Comparator* ucmp;
+
+		bool operator()(const std::string_view& a, const std::string_view& b) const {
+			return ucmp->Compare(a, b) < 0;
+		}
+	};
+
+	ByUserKey cmp = { GetComparator() };
+	std::sort(keys.begin(), keys.end(), cmp);
+	std::vector<std::string_view> unique;
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (unique.empty() || cmp(unique.back(), keys[i])) {
+			unique.push_back(keys[i]);
+		}
+	}
+	keys.swap(unique);
+
+	// The largest key of all closes the last range, it starts none.
+	if (!keys.empty()) {
+		keys.pop_back();
+	}
+
+	if (keys.empty()) {
+		return;
+	}
+
+	// Pick evenly spaced file ends as range boundaries.
+	const size_t ranges = std::min(keys.size() + 1,
+		static_cast<size_t>(options.maxsubcompactions));
+	for (size_t i = 1; i < ranges; i++) {
+		const std::string_view& k = keys[i * keys.size() / ranges];
+		if (boundaries->empty() || boundaries->back() != k) {
+			boundaries->push_back(std::string(k.data(), k.size()));
+		}
+	}
+}
+
+void DB::ProcessKeyRange(CompactionState* compact) {
 	std::shared_ptr<Iterator> input = versions->MakeInputIterator(compact->compaction);
-	input->SeekToFirst();
+	if (compact->hasstart) {
+		InternalKey start(compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+		input->Seek(start.Encode());
+	}
+	else {
+		input->SeekToFirst();
+	}
+
+	std::shared_ptr<CompactionFilter> filter;
+	if (options.compactionfilterfactory != nullptr) {
+		filter = options.compactionfilterfactory->CreateCompactionFilter(compact->smallestsnapshot);
+	}
+
+	// Blob values read by a compaction are not worth caching.
+	ReadOptions blobreadoptions;
+	blobreadoptions.verifychecksums = options.paranoidchecks;
+	blobreadoptions.fillcache = false;
 
 	Status status;
 	ParsedInternalKey ikey;
 	std::string currentuserkey;
 	bool hascurrentuserkey = false;
 	uint64_t lastsequenceforkey = kMaxSequenceNumber;
+	std::string filteredkey;
+	std::string changedvalue;
+	std::string blobkey;
+	std::string blobvalue;
+	std::string blobindex;
+	std::vector<std::pair<std::string, std::string>> mergedentries;
 	for (; input->Valid() && !shuttingdown.load(std::memory_order_acquire);) {
-		// Prioritize immutable compaction work
-		if (hasimm.load(std::memory_order_relaxed)) {
-			const uint64_t immStart = options.env->NowMicros();
-			mutex.lock();
-			if (imm != nullptr) {
-				CompactMemTable();
-				// Wake up MakeRoomForWrite() if necessary.
-				bgfinishedsignal.notify_all();
-			}
-
-			mutex.unlock();
-			immMicros += (options.env->NowMicros() - immStart);
+		std::string_view key = input->key();
+		std::string_view value = input->value();
+		bool isblobindex = false;     // value is a BlobIndex
+		bool hasblobvalue = false;    // blobvalue holds the value it points to
+		bool filtered = false;
+		bool changed = false;         // the filter replaced the value
+		bool separate = false;        // value is to be moved to a blob file
+		bool pastkey = false;         // input already stands past the entry
+		if (compact->hasend && key.size() >= 8 &&
+			GetComparator()->Compare(ExtractUserKey(key), compact->end) >= 0) {
+			// Reached the start of the next subcompaction
+			break;
 		}
 
-		std::string_view key = input->key();
-		if (compact->compaction->shouldStopBefore(key) &&
+		if (compact->compaction->shouldStopBefore(key, &compact->cursor) &&
 			compact->builder != nullptr) {
 			status = FinishCompactionOutputFile(compact, input);
 			if (!status.ok()) {
@@ -1108,7 +2482,7 @@ Status DB::DoCompactionWork(CompactionState* compact) {
 			}
 			else if (ikey.type == kTypeDeletion &&
 				ikey.sequence<= compact->smallestsnapshot &&
-				compact->compaction->isBaseLevelForKey(ikey.userkey)) {
+				compact->compaction->isBaseLevelForKey(ikey.userkey, &compact->cursor)) {
 				// For this user key:
 				// (1) there is no data in higher levels
 				// (2) data in lower levels will have larger sequence numbers
@@ -1118,7 +2492,88 @@ Status DB::DoCompactionWork(CompactionState* compact) {
 				// Therefore this deletion marker is obsolete and can be dropped.
 				drop = true;
 			}
+			else if (ikey.type == kTypeMerge && options.mergeoperator != nullptr &&
+				ikey.sequence <= compact->smallestsnapshot) {
+				// Fold the run of operands into the value under it, or at
+				// least into fewer operands.  The last entry of the result
+				// takes the place of the current one.
+				status = MergeCompactionOperands(compact, input, blobreadoptions,
+					&mergedentries, &pastkey);
+				for (size_t i = 0; status.ok() && i + 1 < mergedentries.size(); i++) {
+					status = AddCompactionOutput(compact, input,
+						mergedentries[i].first, mergedentries[i].second, false);
+				}
+
+				if (status.ok()) {
+					key = mergedentries.back().first;
+					value = mergedentries.back().second;
+					ParseInternalKey(key, &ikey);
+				}
+			}
+			else if (filter != nullptr &&
+				(ikey.type == kTypeValue || ikey.type == kTypeBlobIndex) &&
+				ikey.sequence <= compact->smallestsnapshot) {
+				// The filter judges the value itself, not its blob index.
+				std::string_view filtervalue = value;
+				if (ikey.type == kTypeBlobIndex) {
+					status = tablecache->GetBlob(blobreadoptions, value, &blobvalue);
+					hasblobvalue = true;
+					filtervalue = blobvalue;
+				}
+
+				if (status.ok() &&
+					filter->Filter(compact->compaction->getLevel(), ikey.userkey, filtervalue,
+						&changedvalue, &changed)) {
+					// Write a deletion in place of the value, so that older
+					// entries for the key in deeper levels stay hidden.  At the
+					// base level there are none and the marker itself can go.
+					filtered = true;
+					if (compact->compaction->isBaseLevelForKey(ikey.userkey, &compact->cursor)) {
+						drop = true;
+					}
+					else {
+						filteredkey.clear();
+						AppendInternalKey(&filteredkey,
+							ParsedInternalKey(ikey.userkey, ikey.sequence, kTypeDeletion));
+						key = filteredkey;
+						value = std::string_view();
+					}
+				}
+				else if (changed) {
+					// The new value is kept inline, in place of a blob index.
+					filteredkey.clear();
+					AppendInternalKey(&filteredkey,
+						ParsedInternalKey(ikey.userkey, ikey.sequence, kTypeValue));
+					key = filteredkey;
+					value = changedvalue;
+				}
+			}
 			lastsequenceforkey = ikey.sequence;
+			isblobindex = (ikey.type == kTypeBlobIndex);
+			// Values written before blob files were enabled are separated now
+			separate = (options.enableblobfiles && !drop && !filtered &&
+				ikey.type == kTypeValue && value.size() >= options.minblobsize);
+		}
+
+		if (status.ok() && isblobindex) {
+			status = ProcessBlobIndex(compact, blobreadoptions, input->value(),
+				drop || filtered || changed, hasblobvalue ? &blobvalue : nullptr, &blobindex);
+			if (!drop && !filtered && !changed) {
+				value = blobindex;
+			}
+		}
+		else if (status.ok() && separate) {
+			status = AddToBlobFile(compact, value, &blobindex);
+			blobkey.clear();
+			AppendInternalKey(&blobkey,
+				ParsedInternalKey(ikey.userkey, ikey.sequence, kTypeBlobIndex));
+			key = blobkey;
+			value = blobindex;
+			isblobindex = true;
+		}
+
+		if (!status.ok()) {
+			break;
 		}
 
 		std::string userkey = std::string(ikey.userkey.data(), ikey.userkey.size());
@@ -1126,35 +2581,20 @@ Status DB::DoCompactionWork(CompactionState* compact) {
 			"%d smallest_snapshot: %d",
 			userkey.c_str(),
 			(int)ikey.sequence, ikey.type, kTypeValue, drop,
-			compact->compaction->isBaseLevelForKey(ikey.userkey),
+			compact->compaction->isBaseLevelForKey(ikey.userkey, &compact->cursor),
 			(int)lastsequenceforkey, (int)compact->smallestsnapshot);
 
 		if (!drop) {
-			// Open output file if necessary
-			if (compact->builder == nullptr) {
-				status = OpenCompactionOutputFile(compact);
-				if (!status.ok()) {
-					break;
-				}
-			}
-
-			if (compact->builder->pendinghandle() == 0) {
-				compact->currentOutput()->smallest.DecodeFrom(key);
+			status = AddCompactionOutput(compact, input, key, value,
+				isblobindex && !filtered && !changed);
+			if (!status.ok()) {
+				break;
 			}
+		}
 
-			compact->currentOutput()->largest.DecodeFrom(key);
-			compact->builder->Add(key, input->value());
-
-			// Close output file if it is big enough
-			if (compact->builder->filesize() >=
-				compact->compaction->getMaxOutputFileSize()) {
-				status = FinishCompactionOutputFile(compact, input);
-				if (!status.ok()) {
-					break;
-				}
-			}
+		if (!pastkey) {
+			input->Next();
 		}
-		input->Next();
 	}
 
 	if (status.ok() && shuttingdown.load(std::memory_order_acquire)) {
@@ -1169,34 +2609,189 @@ Status DB::DoCompactionWork(CompactionState* compact) {
 		status = input->status();
 	}
 
-	input.reset();
-	CompactionStats stats;
-	stats.micros = options.env->NowMicros() - startMicros - immMicros;
-	for (int which = 0; which < 2; which++) {
-		for (int i = 0; i< compact->compaction->numInputFiles(which); i++) {
-			stats.bytesread += compact->compaction->input(which, i)->filesize;
+	if (compact->blobbuilder != nullptr) {
+		if (status.ok()) {
+			status = compact->blobbuilder->Finish();
 		}
+		compact->blobfiles = compact->blobbuilder->GetFiles();
+		compact->blobbuilder.reset();
 	}
 
-	for (size_t i = 0; i< compact->outputs.size(); i++) {
-		stats.byteswritten += compact->outputs[i].filesize;
+	compact->status = status;
+}
+
+Status DB::AddCompactionOutput(CompactionState* compact, const std::shared_ptr<Iterator>& input,
+	const std::string_view& key, const std::string_view& value, bool isblobindex) {
+	Status status;
+	// Open output file if necessary
+	if (compact->builder == nullptr) {
+		status = OpenCompactionOutputFile(compact);
+		if (!status.ok()) {
+			return status;
+		}
 	}
 
-	mutex.lock();
-	this->stats[compact->compaction->getLevel() + 1].Add(stats);
-	if (status.ok()) {
-		status = InstallCompactionResults(compact);
+	if (compact->builder->pendinghandle() == 0) {
+		compact->currentOutput()->smallest.DecodeFrom(key);
 	}
 
-	if (!status.ok()) {
-		RecordBackgroundError(status);
+	compact->currentOutput()->largest.DecodeFrom(key);
+	compact->builder->Add(key, value);
+	if (isblobindex) {
+		// value is the BlobIndex just checked or written
+		BlobIndex index;
+		index.DecodeFrom(value);
+		uint64_t& oldest = compact->currentOutput()->oldestblobfile;
+		if (oldest == 0 || index.filenumber < oldest) {
+			oldest = index.filenumber;
+		}
 	}
 
-	VersionSet::LevelSummaryStorage tmp;
-	Debug(options.infolog, "compacted to: %s", versions->LevelSummary(&tmp));
+	// Close output file if it is big enough
+	if (compact->builder->filesize() >=
+		compact->compaction->getMaxOutputFileSize()) {
+		status = FinishCompactionOutputFile(compact, input);
+	}
 	return status;
 }
 
+Status DB::MergeCompactionOperands(CompactionState* compact, const std::shared_ptr<Iterator>& input,
+	const ReadOptions& blobreadoptions, std::vector<std::pair<std::string, std::string>>* entries,
+	bool* pastkey) {
+	const MergeOperator* mergeoperator = options.mergeoperator.get();
+	ParsedInternalKey ikey;
+	ParseInternalKey(input->key(), &ikey);
+	const std::string userkey(ikey.userkey.data(), ikey.userkey.size());
+	std::vector<std::string> operands;    // Newest first
+	std::vector<uint64_t> sequences;
+	operands.push_back(std::string(input->value().data(), input->value().size()));
+	sequences.push_back(ikey.sequence);
+
+	// Entries below the first operand are older than every snapshot too.
+	Status s;
+	bool hasbase = false;     // The run ends in a value or deletion
+	bool hasvalue = false;
+	std::string basevalue;
+	*pastkey = true;
+	for (input->Next(); input->Valid(); input->Next()) {
+		if (!ParseInternalKey(input->key(), &ikey) ||
+			GetComparator()->Compare(ikey.userkey, userkey) != 0) {
+			break;
+		}
+
+		if (ikey.type == kTypeMerge) {
+			operands.push_back(std::string(input->value().data(), input->value().size()));
+			sequences.push_back(ikey.sequence);
+			continue;
+		}
+
+		// Consume the entry; the merged value replaces it.
+		*pastkey = false;
+		hasbase = true;
+		if (ikey.type == kTypeValue) {
+			basevalue.assign(input->value().data(), input->value().size());
+			hasvalue = true;
+		}
+		else if (ikey.type == kTypeBlobIndex) {
+			std::string unused;
+			s = tablecache->GetBlob(blobreadoptions, input->value(), &basevalue);
+			if (s.ok()) {
+				s = ProcessBlobIndex(compact, blobreadoptions, input->value(),
+					true, &basevalue, &unused);
+			}
+			hasvalue = true;
+		}
+		break;
+	}
+
+	if (!s.ok()) {
+		return s;
+	}
+
+	entries->clear();
+	std::string key;
+	if (hasbase || compact->compaction->isBaseLevelForKey(userkey, &compact->cursor)) {
+		// Nothing older can be under the run: fold it into a plain value.
+		std::string value;
+		std::string_view existing(basevalue);
+		s = FullMergeOperands(mergeoperator, userkey, hasvalue ? &existing : nullptr,
+			operands, &value);
+		AppendInternalKey(&key, ParsedInternalKey(userkey, sequences[0], kTypeValue));
+		entries->push_back(std::make_pair(key, value));
+		return s;
+	}
+
+	// Deeper levels may hold the value.  Combine adjacent operands,
+	// oldest first, as far as the operator allows.
+	std::string operand = operands.back();
+	uint64_t sequence = sequences.back();
+	for (size_t i = operands.size() - 1; i-- > 0;) {
+		std::string combined;
+		if (mergeoperator->PartialMerge(userkey, operand, operands[i], &combined)) {
+			operand.swap(combined);
+		}
+		else {
+			key.clear();
+			AppendInternalKey(&key, ParsedInternalKey(userkey, sequence, kTypeMerge));
+			entries->push_back(std::make_pair(key, operand));
+			operand = operands[i];
+		}
+		sequence = sequences[i];
+	}
+
+	key.clear();
+	AppendInternalKey(&key, ParsedInternalKey(userkey, sequence, kTypeMerge));
+	entries->push_back(std::make_pair(key, operand));
+	std::reverse(entries->begin(), entries->end());
+	return s;
+}
+
+Status DB::AddToBlobFile(CompactionState* compact, const std::string_view& value,
+	std::string* index) {
+	if (compact->blobbuilder == nullptr) {
+		compact->blobbuilder.reset(new BlobFileBuilder(options, dbname,
+			std::bind(&DB::NewBlobFileNumber, this), kIOLow));
+	}
+	return compact->blobbuilder->Add(value, index);
+}
+
+Status DB::ProcessBlobIndex(CompactionState* compact, const ReadOptions& readoptions,
+	const std::string_view& index, bool dropped, std::string* value, std::string* newindex) {
+	BlobIndex blobindex;
+	Status s = blobindex.DecodeFrom(index);
+	if (!s.ok()) {
+		return s;
+	}
+
+	if (!dropped && blobindex.filenumber >= compact->blobgccutoff) {
+		// Stays where it is
+		newindex->assign(index.data(), index.size());
+		return s;
+	}
+
+	if (!dropped) {
+		// Relocate the record out of an old blob file
+		std::string scratch;
+		if (value == nullptr) {
+			s = tablecache->GetBlob(readoptions, index, &scratch);
+			value = &scratch;
+		}
+
+		if (s.ok()) {
+			s = AddToBlobFile(compact, *value, newindex);
+		}
+
+		if (!s.ok()) {
+			return s;
+		}
+	}
+
+	std::pair<uint64_t, uint64_t>& garbage = compact->blobgarbage[blobindex.filenumber];
+	garbage.first++;
+	garbage.second += blobindex.RecordSize();
+	return s;
+}
+
 int64_t DB::TESTMaxNextLevelOverlappingBytes() {
 	std::unique_lock<std::mutex> lk(mutex);
 	return versions->MaxNextLevelOverlappingBytes();
@@ -1215,6 +2810,7 @@ Status DB::OpenCompactionOutputFile(CompactionState* compact) {
 		out.number = fileNumber;
 		out.smallest.clear();
 		out.largest.clear();
+		out.oldestblobfile = 0;
 		compact->outputs.push_back(out);
 	}
 
@@ -1222,7 +2818,12 @@ Status DB::OpenCompactionOutputFile(CompactionState* compact) {
 	std::string fname = TableFileName(dbname, fileNumber);
 	Status s = options.env->NewWritableFile(fname, compact->outfile);
 	if (s.ok()) {
-		compact->builder.reset(new TableBuilder(options, compact->outfile));
+		if (options.ratelimiter != nullptr) {
+			compact->outfile->SetRateLimiter(options.ratelimiter, kIOLow);
+		}
+
+		compact->builder.reset(new TableBuilder(options, compact->outfile,
+			compact->compaction->getLevel() + 1));
 	}
 	return s;
 }
@@ -1241,17 +2842,38 @@ Status DB::InstallCompactionResults(CompactionState* compact) {
 		const CompactionState::Output& out = compact->outputs[i];
 		compact->compaction->getEdit()->AddFile(
 			level + 1,
-			out.number, out.filesize, out.smallest, out.largest);
+			out.number, out.filesize, out.smallest, out.largest,
+			out.oldestblobfile);
+	}
+
+	for (size_t i = 0; i < compact->blobfiles.size(); i++) {
+		const BlobFileBuilder::FileInfo& info = compact->blobfiles[i];
+		compact->compaction->getEdit()->AddBlobFile(info.number, info.count, info.bytes);
+	}
+
+	for (auto iter = compact->blobgarbage.begin(); iter != compact->blobgarbage.end(); ++iter) {
+		compact->compaction->getEdit()->AddBlobGarbage(iter->first,
+			iter->second.first, iter->second.second);
 	}
-	return versions->LogAndApply(compact->compaction->getEdit(), &mutex);
+	Status s = versions->LogAndApply(compact->compaction->getEdit(), &mutex);
+	if (s.ok()) {
+		InstallSuperVersion();
+	}
+	return s;
 }
 
 void DB::CompactMemTable() {
 	assert(imm != nullptr);
 	// Save the Contents of the memtable as a new Table
 	VersionEdit edit;
-	auto base = versions->current();
-	Status s = WriteLevel0Table(imm, &edit, base.get());
+	// While a compaction runs it may be writing to any level, so the
+	// table must stay in level-0 rather than be pushed further down.
+	std::shared_ptr<Version> base;
+	if (!bgcompactionscheduled) {
+		base = versions->current();
+	}
+	std::vector<uint64_t> pending;
+	Status s = WriteLevel0Table(imm, &edit, base.get(), &pending);
 
 	if (s.ok() && shuttingdown.load(std::memory_order_acquire)) {
 		s = Status::IOError("Deleting DB during memtable compaction\n");
@@ -1260,14 +2882,31 @@ void DB::CompactMemTable() {
 	// Replace immutable memtable with the generated Table
 	if (s.ok()) {
 		edit.SetPrevLogNumber(0);
-		edit.SetLogNumber(logfilenumber);  // Earlier logs no longer needed
+		if (options.sharedlog != nullptr) {
+			edit.SetSharedLogNumber(logfilenumber);  // Earlier logs no longer needed by us
+		}
+		else {
+			edit.SetLogNumber(logfilenumber);  // Earlier logs no longer needed
+		}
 		s = versions->LogAndApply(&edit, &mutex);
 	}
 
+	for (size_t i = 0; i < pending.size(); i++) {
+		pendingoutputs.erase(pending[i]);
+	}
+
 	if (s.ok()) {
 		imm.reset();
 		hasimm.store(false, std::memory_order_release);
+		if (options.writebuffermanager != nullptr) {
+			options.writebuffermanager->FreeMem(immwritebufferusage);
+			immwritebufferusage = 0;
+		}
+		InstallSuperVersion();
 		DeleteObsoleteFiles();
+		if (options.sharedlog != nullptr) {
+			options.sharedlog->SetMinLogNumber(options.sharedlogid, versions->GetSharedLogNumber());
+		}
 	}
 	else {
 		RecordBackgroundError(s);
@@ -1281,7 +2920,19 @@ void DB::RecordBackgroundError(const Status & s) {
 	}
 }
 
-Status DB::BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter) {
+uint64_t DB::NewBlobFileNumber() {
+	std::unique_lock<std::mutex> lk(mutex);
+	const uint64_t number = versions->NewFileNumber();
+	pendingoutputs.insert(number);
+	return number;
+}
+
+Status DB::GetBlob(const ReadOptions& options, const std::string_view& index, std::string* value) {
+	return tablecache->GetBlob(options, index, value);
+}
+
+Status DB::BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter,
+	std::vector<BlobFileBuilder::FileInfo>* blobfiles) {
 	Status s;
 	meta->filesize = 0;
 	iter->SeekToFirst();
@@ -1293,16 +2944,59 @@ Status DB::BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter)
 		return s;
 	}
 
-	std::shared_ptr<TableBuilder> builder(new TableBuilder(options, file));
+	// Flushes go ahead of compactions: a slow flush stalls writers.
+	if (options.ratelimiter != nullptr) {
+		file->SetRateLimiter(options.ratelimiter, kIOHigh);
+	}
+
+	// Memtable output is compressed as level-0 data even if it is later
+	// placed deeper; it will be rewritten with the right codec on compaction.
+	std::shared_ptr<TableBuilder> builder(new TableBuilder(options, file, 0));
+	std::shared_ptr<BlobFileBuilder> blobbuilder;
+	if (options.enableblobfiles) {
+		blobbuilder.reset(new BlobFileBuilder(options, dbname,
+			std::bind(&DB::NewBlobFileNumber, this), kIOHigh));
+	}
+
+	std::string blobkey;
+	std::string blobindex;
+	ParsedInternalKey ikey;
 	meta->smallest.DecodeFrom(iter->key());
-	for (; iter->Valid(); iter->Next()) {
+	for (; iter->Valid() && s.ok(); iter->Next()) {
 		std::string_view key = iter->key();
+		std::string_view value = iter->value();
 		meta->largest.DecodeFrom(key);
-		builder->Add(key, iter->value());
+		if (blobbuilder != nullptr && value.size() >= options.minblobsize &&
+			ParseInternalKey(key, &ikey) && ikey.type == kTypeValue) {
+			// Store the value in a blob file and its index in the table
+			s = blobbuilder->Add(value, &blobindex);
+			blobkey.clear();
+			AppendInternalKey(&blobkey,
+				ParsedInternalKey(ikey.userkey, ikey.sequence, kTypeBlobIndex));
+			key = blobkey;
+			value = blobindex;
+		}
+		builder->Add(key, value);
+	}
+
+	if (blobbuilder != nullptr) {
+		if (s.ok()) {
+			s = blobbuilder->Finish();
+		}
+
+		*blobfiles = blobbuilder->GetFiles();
+		if (!blobfiles->empty()) {
+			meta->oldestblobfile = blobfiles->front().number;
+		}
 	}
 
 	// Finish and check for builder errors
-	s = builder->Finish();
+	if (s.ok()) {
+		s = builder->Finish();
+	}
+	else {
+		builder->Abandon();
+	}
 	if (s.ok()) {
 		meta->filesize = builder->filesize();
 		assert(meta->filesize > 0);
@@ -1335,6 +3029,9 @@ Status DB::BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter)
 	}
 	else {
 		options.env->DeleteFile(fname);
+		for (size_t i = 0; i < blobfiles->size(); i++) {
+			options.env->DeleteFile(BlobFileName(dbname, (*blobfiles)[i].number));
+		}
 	}
 	return s;
 }
@@ -1425,6 +3122,62 @@ bool DB::GetProperty(const std::string_view& property, std::string* value) {
 		}
 		return true;
 	}
+	else if (in == "statistics") {
+		if (options.statistics == nullptr) {
+			return false;
+		}
+		*value = options.statistics->ToString();
+		return true;
+	}
+	else if (in == "perf-context") {
+		*value = GetPerfContext()->ToString();
+		return true;
+	}
+	else if (in == "write-controller") {
+		*value = writecontroller->ToString();
+		return true;
+	}
+	else if (in == "delayed-write-rate") {
+		char buf[50];
+		snprintf(buf, sizeof(buf), "%llu",
+			static_cast<unsigned long long>(writecontroller->IsDelayed() ?
+				writecontroller->GetDelayedWriteRate() : 0));
+		value->append(buf);
+		return true;
+	}
+	else if (in == "estimate-pending-compaction-bytes") {
+		char buf[50];
+		snprintf(buf, sizeof(buf), "%llu",
+			static_cast<unsigned long long>(versions->EstimatedCompactionDebt()));
+		value->append(buf);
+		return true;
+	}
+	else if (in == "blob-stats") {
+		uint64_t totalcount = 0;
+		uint64_t totalbytes = 0;
+		uint64_t garbagecount = 0;
+		uint64_t garbagebytes = 0;
+		const auto& blobfiles = versions->current()->blobfiles;
+		for (auto iter = blobfiles.begin(); iter != blobfiles.end(); ++iter) {
+			totalcount += iter->second->totalcount;
+			totalbytes += iter->second->totalbytes;
+			garbagecount += iter->second->garbagecount;
+			garbagebytes += iter->second->garbagebytes;
+		}
+
+		char buf[200];
+		snprintf(buf, sizeof(buf),
+			"Blob files: %llu\n"
+			"Records: %llu (%.1f MB)\n"
+			"Garbage: %llu (%.1f MB)\n",
+			static_cast<unsigned long long>(blobfiles.size()),
+			static_cast<unsigned long long>(totalcount),
+			totalbytes / 1048576.0,
+			static_cast<unsigned long long>(garbagecount),
+			garbagebytes / 1048576.0);
+		value->append(buf);
+		return true;
+	}
 	else if (in == "sstables") {
 		*value = versions->current()->DebugString();
 	}
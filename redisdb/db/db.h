@@ -4,6 +4,7 @@
 #include <memory>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
 
 #include "logwriter.h"
 #include "versionedit.h"
@@ -14,6 +15,9 @@
 #include "env.h"
 #include "tablecache.h"
 #include "snapshot.h"
+#include "writecontroller.h"
+#include "writebuffermanager.h"
+#include "blobfile.h"
 
 // A range of keys
 struct Range {
@@ -46,11 +50,24 @@ public:
 	// Note: consider setting options.sync = true.
 	Status Delete(const WriteOptions&, const std::string_view& key);
 
+	// Apply "value" to the database entry for "key" with
+	// Options::mergeoperator, without reading the entry.  Returns
+	// NotSupported if the DB has no merge operator.
+	// Note: consider setting options.sync = true.
+	Status Merge(const WriteOptions&, const std::string_view& key, const std::string_view& value);
+
 	// Apply the specified updates to the database.
 	// Returns OK on success, non-OK on failure.
 	// Note: consider setting options.sync = true.
 	Status Write(const WriteOptions& options, WriteBatch* updates);
 
+	// Apply updates[i].second to updates[i].first for every i, as one
+	// atomic write: after a crash either all of the batches are there
+	// or none is.  Every DB must write to the same Options::sharedlog,
+	// and no DB may appear twice.
+	static Status AtomicWrite(const WriteOptions& options,
+		const std::vector<std::pair<DB*, WriteBatch*>>& updates);
+
 	// If the database Contains an entry for "key" store the
 	// corresponding value in *value and return OK.
 	//
@@ -60,6 +77,18 @@ public:
 	// May return some other Status on an error.
 	Status Get(const ReadOptions& options, const std::string_view& key, std::string* value);
 
+	// Like Get(), but leaves a value found in a memtable or a data block
+	// where it is and pins it there instead of copying it.  *value is
+	// reset first.
+	Status Get(const ReadOptions& options, const std::string_view& key, PinnableValue* value);
+
+	// Looks up every key of "keys" as Get() would, all at one snapshot.
+	// Sets (*values)[i] and (*statuses)[i] for keys[i].  Keys are looked
+	// up in sorted order, so neighbouring keys that share a table block
+	// cost a single read of that block.
+	void MultiGet(const ReadOptions& options, const std::vector<std::string_view>& keys,
+		std::vector<std::string>* values, std::vector<Status>* statuses);
+
 	Status DestroyDB(const std::string& dbname, const Options& options);
 
 	void DeleteObsoleteFiles();
@@ -72,9 +101,29 @@ public:
 	Status RecoverLogFile(uint64_t lognumber, bool lastLog,
 		bool* savemanifest, VersionEdit* edit, uint64_t* maxsequence);
 
-	Status WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* edit, Version* base);
+	// Replay this DB's entries of the logs of Options::sharedlog.
+	Status RecoverSharedLog(bool* savemanifest, VersionEdit* edit, uint64_t* maxsequence);
+
+	// If "pending" is non-null the new table and blob files stay in
+	// pendingoutputs and their numbers are appended to *pending; the
+	// caller erases them once *edit has been applied, so a concurrent
+	// DeleteObsoleteFiles() leaves them alone.
+	Status WriteLevel0Table(const std::shared_ptr<MemTable>& mem, VersionEdit* edit, Version* base,
+		std::vector<uint64_t>* pending = nullptr);
 
-	Status BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter);
+	// Large values are moved to blob files, which are listed in *blobfiles.
+	Status BuildTable(FileMetaData* meta, const std::shared_ptr<Iterator>& iter,
+		std::vector<BlobFileBuilder::FileInfo>* blobfiles);
+
+	// Allocate the number of a new blob file and protect it from
+	// deletion until it is installed.
+	// REQUIRES: mutex is not held
+	uint64_t NewBlobFileNumber();
+
+	// Read the value that the encoded BlobIndex "index" points to.
+	Status GetBlob(const ReadOptions& options, const std::string_view& index, std::string* value);
+
+	const MergeOperator* GetMergeOperator() const { return options.mergeoperator.get(); }
 
 	void MaybeScheduleCompaction();
 
@@ -117,6 +166,18 @@ public:
 	//     of the sstables that make up the db Contents.
 	//  "leveldb.approximate-memory-usage" - returns the approximate number of
 	//     bytes of memory in use by the DB.
+	//  "leveldb.statistics" - returns the tickers and histograms of
+	//     Options::statistics, if set.
+	//  "leveldb.perf-context" - returns the perf context of the calling
+	//     thread (see perfcontext.h).
+	//  "leveldb.write-controller" - returns a multi-line string with the
+	//     state of write throttling and how long writers have been delayed.
+	//  "leveldb.delayed-write-rate" - returns the rate, in bytes per second,
+	//     writes are currently throttled to, or 0 if they are not.
+	//  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+	//     number of bytes compactions have to rewrite to catch up.
+	//  "leveldb.blob-stats" - returns the number and size of the blob files
+	//     and how much of them is garbage.
 	bool GetProperty(const std::string_view& property, std::string* value);
 
 	// For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -146,15 +207,30 @@ public:
 	// file at a level >= 1.
 	int64_t TESTMaxNextLevelOverlappingBytes();
 
+	// Bytes used by the mutable memtable, as last reported to
+	// Options::writebuffermanager.
+	size_t GetWriteBufferUsage() const { return writebufferusage.load(std::memory_order_relaxed); }
+
+	// Switch out the memtable and schedule its flush, unless it is empty
+	// or the previous one is still being flushed.  Called by
+	// Options::writebuffermanager to free memory.
+	void FlushWriteBuffer();
+
 	void BackgroundCallback();
 
+	void BackgroundFlushCallback();
+
 	void MaybeIgnoreError(Status* s) const;
 
 	void RecordBackgroundError(const Status& s);
 
 private:
 	struct Writer;
+	struct MemTableInsertGroup;
+	struct WriteGroup;
 	struct CompactionState;
+	struct SuperVersion;
+	class LogReplayer;
 
 	// No copying allowed
 	DB(const DB&);
@@ -165,8 +241,77 @@ private:
 
 	WriteBatch* BuildBatchGroup(Writer** lastwriter);
 
+	Status ParallelInsertInto(std::unique_lock<std::mutex>& lk,
+		const std::vector<Writer*>& members, const std::shared_ptr<MemTable>& mem);
+
+	// Report the growth of mem to Options::writebuffermanager.
+	// REQUIRES: mutex is held
+	void UpdateWriteBufferUsage();
+
+	// Open the tables of the current version into the table cache ahead
+	// of the first reads; see Options::preopentables.
+	// REQUIRES: mutex is held, and no compaction has been scheduled
+	Status PreopenTables();
+
+	// Body of the scrubber thread: verifies the live tables over and
+	// over until the DB shuts down; see Options::scrubbytespersec.
+	void BackgroundScrub();
+
+	// Called by the scrubber with the n bytes it just read, "*scrubbed"
+	// bytes into a pass begun at "startmicros".  Waits as long as the
+	// pass is ahead of the configured rate.  Returns false once the DB
+	// is shutting down.
+	bool PaceScrub(uint64_t startmicros, uint64_t* scrubbed, uint64_t n);
+
+	// Account for time a writer spent throttled or stopped.
+	void RecordStall(uint64_t micros);
+
+	// Append a group's record to the log, and sync it if asked.  Sets
+	// *syncerror if the record was written but could not be synced.
+	Status AppendToLog(const WriteOptions& opt, WriteBatch* updates, bool* syncerror);
+
+	// Write() for Options::enablepipelinedwrite; w is the head of writers.
+	Status PipelinedWrite(std::unique_lock<std::mutex>& lk, const WriteOptions& opt, Writer* w);
+
 	Status DoCompactionWork(CompactionState* compact);
 
+	// Split a large compaction into disjoint user-key ranges; empty
+	// *boundaries means compact everything in one pass.
+	void GenSubcompactionBoundaries(Compaction* c, std::vector<std::string>* boundaries);
+
+	// Compact the keys of compact->compaction that fall into the range
+	// of *compact, leaving the result in compact->status.
+	void ProcessKeyRange(CompactionState* compact);
+
+	// Add an entry to the current output file of *compact, opening and
+	// finishing files as needed.  "isblobindex" tells that "value" is a
+	// BlobIndex.
+	Status AddCompactionOutput(CompactionState* compact, const std::shared_ptr<Iterator>& input,
+		const std::string_view& key, const std::string_view& value, bool isblobindex);
+
+	// "input" is at a merge operand that is older than every snapshot.
+	// Consume the operands of the key below it, and the value or deletion
+	// they apply to, and set *entries to what replaces them, newest first:
+	// a single value, or when older entries may sit in deeper levels, the
+	// operands combined as far as the merge operator allows.  *pastkey is
+	// set if "input" was moved past the last consumed entry.
+	Status MergeCompactionOperands(CompactionState* compact, const std::shared_ptr<Iterator>& input,
+		const ReadOptions& blobreadoptions, std::vector<std::pair<std::string, std::string>>* entries,
+		bool* pastkey);
+
+	// Append "value" to the blob files of *compact.
+	Status AddToBlobFile(CompactionState* compact, const std::string_view& value,
+		std::string* index);
+
+	// Account for an entry holding the blob index "index" that is being
+	// compacted.  If the entry is "dropped" its record becomes garbage;
+	// otherwise *newindex is set to the index to write, which moves the
+	// record to a new blob file if its file is old enough to be
+	// collected.  "value" is the record's value if already read, or null.
+	Status ProcessBlobIndex(CompactionState* compact, const ReadOptions& readoptions,
+		const std::string_view& index, bool dropped, std::string* value,
+		std::string* newindex);
+
 	Status FinishCompactionOutputFile(CompactionState* compact,
 		const std::shared_ptr<Iterator>& input);
 
@@ -174,6 +319,13 @@ private:
 
 	Status InstallCompactionResults(CompactionState* compact);
 
+	// Publish mem, imm and the current version to readers.  Must be
+	// called whenever any of them changes.
+	// REQUIRES: mutex is held
+	void InstallSuperVersion();
+
+	std::shared_ptr<SuperVersion> GetSuperVersion() const;
+
 	void CleanupCompaction(CompactionState* compact);
 
 	const Comparator* GetComparator() const {
@@ -184,9 +336,15 @@ private:
 	std::atomic<bool> hasimm;         // So bg thread can detect non-null imm_
 	// Has a background compaction been scheduled or is running?
 	bool bgcompactionscheduled;
+	// Has a flush of imm been scheduled or is running?
+	bool bgflushscheduled;
 
 	// Queue of writers.
 	std::deque<Writer*> writers;
+	// Groups that are in the log but not yet in the memtable, in log
+	// order (Options::enablepipelinedwrite only).
+	std::deque<WriteGroup*> memtablegroups;
+	std::condition_variable memtablesignal;
 	std::shared_ptr<WriteBatch> tmpbatch;
 	std::shared_ptr<MemTable> mem;
 	std::shared_ptr<MemTable> imm;
@@ -195,6 +353,14 @@ private:
 	std::shared_ptr<WritableFile> logfile;
 	std::shared_ptr<TableCache> tablecache;
 	std::shared_ptr<SnapshotList> snapshots;
+	// Throttles writes while compactions are behind; updated with every
+	// new super version.
+	std::shared_ptr<WriteController> writecontroller;
+	// Memory of mem and imm charged to Options::writebuffermanager.
+	std::atomic<size_t> writebufferusage;
+	size_t immwritebufferusage;
+	// Read by Get() with an atomic load instead of the mutex.
+	std::shared_ptr<SuperVersion> superversion;
 
 	// Lock over the persistent DB state.  Non-null iff successfully acquired.
 	std::shared_ptr<FileLock> dblock;
@@ -204,8 +370,8 @@ private:
 	const std::string dbname;
 	uint32_t seed;
 
-	// Set of table files to protect from deletion because they are
-	// part of ongoing compactions.
+	// Set of table and blob files to protect from deletion because they
+	// are part of ongoing compactions.
 	std::set<uint64_t> pendingoutputs;
 	const InternalKeyComparator internalcomparator;
 
@@ -240,4 +406,7 @@ private:
 	std::mutex mutex;
 	std::condition_variable bgfinishedsignal;
 	Status bgerror;
+
+	std::thread scrubber;
+	std::condition_variable scrubsignal;  // Wakes the scrubber to shut down
 };
@@ -21,7 +21,7 @@ bool ParseInternalKey(const std::string_view& internalKey, ParsedInternalKey* re
 	result->sequence = num >> 8;
 	result->type = static_cast<ValueType>(c);
 	result->userkey = std::string_view(internalKey.data(), n - 8);
-	return (c<= static_cast<unsigned char>(kTypeValue));
+	return (c<= static_cast<unsigned char>(kValueTypeForSeek));
 }
 
 std::string ParsedInternalKey::DebugString() const {
@@ -168,3 +168,19 @@ LookupKey::LookupKey(const std::string_view& userkey, uint64_t s) {
 	end = dst;
 }
 
+
+const char* InternalFilterPolicy::Name() const { 
+	return userpolicy->Name(); 
+}
+
+void InternalFilterPolicy::CreateFilter(const std::string_view* keys, int n, std::string* dst) const {
+	std::vector<std::string_view> userkeys(n);
+	for (int i = 0; i < n; i++) {
+		userkeys[i] = ExtractUserKey(keys[i]);
+	}
+	userpolicy->CreateFilter(userkeys.data(), n, dst);
+}
+
+bool InternalFilterPolicy::KeyMayMatch(const std::string_view& key, const std::string_view& f) const {
+	return userpolicy->KeyMayMatch(ExtractUserKey(key), f);
+}
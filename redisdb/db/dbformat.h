@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <string>
 #include <assert.h>
+#include <memory>
+#include <vector>
+#include "filterpolicy.h"
 
 static const int kNumLevels = 7;
 
@@ -34,7 +37,9 @@ class InternalKey;
 // data structures.
 enum ValueType {
 	kTypeDeletion = 0x0,
-	kTypeValue = 0x1
+	kTypeValue = 0x1,
+	kTypeBlobIndex = 0x2,  // The value is a BlobIndex into a blob file
+	kTypeMerge = 0x3       // The value is an operand of Options::mergeoperator
 };
 
 // kValueTypeForSeek defines the ValueType that should be passed when
@@ -43,7 +48,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 // We leave eight bits empty at the bottom so a type and sequence#
 // can be packed together into 64-bits.
@@ -179,6 +184,26 @@ private:
 	const Comparator* comparator;
 };
 
+// Filter policy wrapper that converts from internal keys to user keys
+class InternalFilterPolicy : public FilterPolicy {
+public:
+	explicit InternalFilterPolicy(const std::shared_ptr<FilterPolicy>& p) 
+		: userpolicy(p) {
+
+	}
+
+	virtual const char* Name() const;
+
+	virtual void CreateFilter(const std::string_view* keys, int n, std::string* dst) const;
+
+	virtual bool KeyMayMatch(const std::string_view& key, const std::string_view& filter) const;
+
+	const std::shared_ptr<FilterPolicy>& GetPolicy() const { return userpolicy; }
+
+private:
+	std::shared_ptr<FilterPolicy> userpolicy;
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
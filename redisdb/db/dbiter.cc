@@ -1,9 +1,11 @@
 #include "dbiter.h"
+#include <algorithm>
 
 #include "db.h"
 #include "filename.h"
 #include "dbformat.h"
 #include "status.h"
+#include "mergeoperator.h"
 
 // Memtables and sstables that make the DB representation contain
 // (userkey,seq,type) => uservalue entries.  DBIter
@@ -30,7 +32,9 @@ public:
 		iter(iter),
 		sequence(s),
 		direction(kForward),
-		vali(false) {
+		vali(false),
+		isblob(false),
+		merged(false) {
 
 	}
 
@@ -42,12 +46,15 @@ public:
 
 	virtual std::string_view key() const {
 		assert(vali);
-		return (direction == kForward) ? ExtractUserKey(iter->key()) : savedkey;
+		return (direction == kForward && !merged) ? ExtractUserKey(iter->key()) : savedkey;
 	}
 
 	virtual std::string_view value() const {
 		assert(vali);
-		return (direction == kForward) ? iter->value() : savedvalue;
+		if (direction == kForward && !merged) {
+			return isblob ? std::string_view(blobvalue) : iter->value();
+		}
+		return savedvalue;
 	}
 
 	virtual Status status() const {
@@ -78,6 +85,21 @@ private:
 
 	bool ParseKey(ParsedInternalKey* key);
 
+	// Replace the BlobIndex "index" by the value it points to.  On error
+	// the iterator becomes invalid and status() reports it.
+	bool ReadBlob(const std::string_view& index, std::string* value);
+
+	// Fold "operands", newest first, onto "existingvalue" (nullptr if the
+	// key has no value) into savedvalue.  On error the iterator becomes
+	// invalid and status() reports it.
+	bool MergeValues(const std::string_view* existingvalue,
+		const std::vector<std::string>& operands);
+
+	// The iterator is positioned at a merge operand of a visible key:
+	// collect the operands below it and fold them onto the value under
+	// them.  Leaves the internal iterator past the entries it consumed.
+	void MergeValuesForward();
+
 	inline void SaveKey(const std::string_view& k, std::string* dst) {
 		dst->assign(k.data(), k.size());
 	}
@@ -102,6 +124,9 @@ private:
 	std::string savedvalue;   // == current raw value when direction_==kReverse
 	Direction direction;
 	bool vali;
+	bool isblob;              // The current forward value is in blobvalue
+	std::string blobvalue;
+	bool merged;              // The current forward entry is in savedkey and savedvalue
 
 	std::default_random_engine random;
 
@@ -112,6 +137,76 @@ private:
 };
 
 
+bool DBIter::ReadBlob(const std::string_view& index, std::string* value) {
+	std::string result;
+	Status status = db->GetBlob(ReadOptions(), index, &result);
+	if (!status.ok()) {
+		s = status;
+		return false;
+	}
+
+	value->swap(result);
+	return true;
+}
+
+bool DBIter::MergeValues(const std::string_view* existingvalue,
+	const std::vector<std::string>& operands) {
+	Status status = FullMergeOperands(db->GetMergeOperator(), savedkey,
+		existingvalue, operands, &savedvalue);
+	if (!status.ok()) {
+		s = status;
+		return false;
+	}
+	return true;
+}
+
+void DBIter::MergeValuesForward() {
+	std::vector<std::string> operands;
+	SaveKey(ExtractUserKey(iter->key()), &savedkey);
+	std::string_view operand = iter->value();
+	operands.push_back(std::string(operand.data(), operand.size()));
+	merged = true;
+
+	// Entries below a visible one can not be newer than the snapshot.
+	ParsedInternalKey ikey;
+	for (iter->Next(); iter->Valid(); iter->Next()) {
+		if (!ParseKey(&ikey)) {
+			vali = false;
+			return;
+		}
+
+		if (comparator->Compare(ikey.userkey, savedkey) != 0) {
+			break;
+		}
+
+		switch (ikey.type) {
+		case kTypeMerge:
+			operand = iter->value();
+			operands.push_back(std::string(operand.data(), operand.size()));
+			break;
+		case kTypeDeletion:
+			vali = MergeValues(nullptr, operands);
+			return;
+		case kTypeValue: {
+			std::string_view existing = iter->value();
+			vali = MergeValues(&existing, operands);
+			return;
+		}
+		case kTypeBlobIndex: {
+			std::string existing;
+			vali = ReadBlob(iter->value(), &existing);
+			if (vali) {
+				std::string_view v(existing);
+				vali = MergeValues(&v, operands);
+			}
+			return;
+		}
+		}
+	}
+
+	vali = MergeValues(nullptr, operands);
+}
+
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
 	std::string_view k = iter->key();
 	if (!ParseInternalKey(k, ikey)) {
@@ -146,6 +241,16 @@ void DBIter::Next() {
 		}
 		// saved_key_ already Contains the key to Skip past.
 	}
+	else if (merged) {
+		// The operands of savedkey are consumed and iter_ is at or past
+		// its last entry; the skipping code below hides what is left.
+		merged = false;
+		if (!iter->Valid()) {
+			vali = false;
+			savedkey.clear();
+			return;
+		}
+	}
 	else {
 		// Store in saved_key_ the current key so we Skip it below.
 		SaveKey(ExtractUserKey(iter->key()), &savedkey);
@@ -176,16 +281,29 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 				skipping = true;
 				break;
 			case kTypeValue:
+			case kTypeBlobIndex:
 				if (skipping &&
 					comparator->Compare(ikey.userkey, std::string_view(*skip))<= 0) {
 					// Entry hidden
 				}
 				else {
-					vali = true;
+					isblob = (ikey.type == kTypeBlobIndex);
+					vali = !isblob || ReadBlob(iter->value(), &blobvalue);
 					savedkey.clear();
 					return;
 				}
 				break;
+			case kTypeMerge:
+				if (skipping &&
+					comparator->Compare(ikey.userkey, std::string_view(*skip))<= 0) {
+					// Entry hidden
+				}
+				else {
+					isblob = false;
+					MergeValuesForward();
+					return;
+				}
+				break;
 			}
 		}
 		iter->Next();
@@ -201,8 +319,18 @@ void DBIter::Prev() {
 	if (direction == kForward) {  // Switch directions?
 		// iter_ is pointing at the current entry.  Scan backwards until
 		// the key changes so we can use the normal reverse scanning code.
-		assert(iter->Valid());  // Otherwise valid_ would have been false
-		SaveKey(ExtractUserKey(iter->key()), &savedkey);
+		if (merged) {
+			// savedkey holds the key, and iter_ may already be past it.
+			merged = false;
+			if (!iter->Valid()) {
+				iter->SeekToLast();
+			}
+		}
+		else {
+			assert(iter->Valid());  // Otherwise valid_ would have been false
+			SaveKey(ExtractUserKey(iter->key()), &savedkey);
+		}
+
 		while (true) {
 			iter->Prev();
 			if (!iter->Valid()) {
@@ -225,6 +353,8 @@ void DBIter::FindPrevUserEntry() {
 	assert(direction == kReverse);
 
 	ValueType valueType = kTypeDeletion;
+	ValueType basetype = kTypeDeletion;  // What the operands apply to
+	std::vector<std::string> operands;   // Oldest first
 	if (iter->Valid()) {
 		do {
 			ParsedInternalKey ikey;
@@ -239,8 +369,17 @@ void DBIter::FindPrevUserEntry() {
 				if (valueType == kTypeDeletion) {
 					savedkey.clear();
 					ClearSavedValue();
+					basetype = kTypeDeletion;
+					operands.clear();
+				}
+				else if (valueType == kTypeMerge) {
+					SaveKey(ExtractUserKey(iter->key()), &savedkey);
+					std::string_view operand = iter->value();
+					operands.push_back(std::string(operand.data(), operand.size()));
 				}
 				else {
+					basetype = valueType;
+					operands.clear();
 					std::string_view rawvalue = iter->value();
 					if (savedvalue.capacity() > rawvalue.size() + 1048576) {
 						std::string empty;
@@ -262,6 +401,23 @@ void DBIter::FindPrevUserEntry() {
 		ClearSavedValue();
 		direction = kForward;
 	}
+	else if (valueType == kTypeBlobIndex) {
+		vali = ReadBlob(savedvalue, &savedvalue);
+	}
+	else if (valueType == kTypeMerge) {
+		std::reverse(operands.begin(), operands.end());
+		vali = true;
+		if (basetype == kTypeBlobIndex) {
+			vali = ReadBlob(savedvalue, &savedvalue);
+		}
+
+		if (vali) {
+			std::string existing;
+			existing.swap(savedvalue);
+			std::string_view v(existing);
+			vali = MergeValues(basetype == kTypeDeletion ? nullptr : &v, operands);
+		}
+	}
 	else {
 		vali = true;
 	}
@@ -269,6 +425,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const std::string_view& target) {
 	direction = kForward;
+	merged = false;
 	ClearSavedValue();
 	savedkey.clear();
 	AppendInternalKey(&savedkey, ParsedInternalKey(target, sequence, kValueTypeForSeek));
@@ -283,6 +440,7 @@ void DBIter::Seek(const std::string_view& target) {
 
 void DBIter::SeekToFirst() {
 	direction = kForward;
+	merged = false;
 	ClearSavedValue();
 	iter->SeekToFirst();
 	if (iter->Valid()) {
@@ -295,6 +453,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
 	direction = kReverse;
+	merged = false;
 	ClearSavedValue();
 	iter->SeekToLast();
 	FindPrevUserEntry();
@@ -97,6 +97,7 @@
 
 #include "status.h"
 #include "util.h"
+#include "ratelimiter.h"
 
 static const size_t kWritableFileBufferSize = 65536;
 
@@ -328,7 +329,8 @@ class WritableFile {
 public:
 	WritableFile(std::string filename, int fd)
 		: pos(0), fd(fd), manifest(isManifest(filename)),
-		filename(std::move(filename)), dirname(DirName(filename)) {}
+		filename(std::move(filename)), dirname(DirName(filename)),
+		iopriority(kIOLow) {}
 
 	~WritableFile() {
 		if (fd >= 0) {
@@ -381,6 +383,13 @@ public:
 		return FlushBuffer();
 	}
 
+	// Charge every write that reaches the OS against "limiter" at
+	// priority "pri".  Used for table files written in the background.
+	void SetRateLimiter(const std::shared_ptr<RateLimiter>& limiter, IOPriority pri) {
+		ratelimiter = limiter;
+		iopriority = pri;
+	}
+
 	Status sync() {
 		// Ensure new files referred to by the manifest are in the filesystem.
 		//
@@ -408,6 +417,10 @@ private:
 	}
 
 	Status WriteUnbuffered(const char* data, size_t size) {
+		if (ratelimiter != nullptr && size > 0) {
+			ratelimiter->Request(static_cast<int64_t>(size), iopriority);
+		}
+
 		while (size > 0) {
 			ssize_t result = ::write(fd, data, size);
 			if (result < 0) {
@@ -514,6 +527,8 @@ private:
 	const bool manifest;  // True if the file's name starts with MANIFEST.
 	const std::string filename;
 	const std::string dirname;  // The directory of filename_.
+	std::shared_ptr<RateLimiter> ratelimiter;
+	IOPriority iopriority;
 };
 
 static int LockOrUnlock(int fd, bool lock) {
@@ -590,16 +605,21 @@ class Env {
 public:
 	typedef std::function<void()> Functor;
 
+	// Background pools; see Schedule().
+	enum Priority {
+		LOW,
+		HIGH,
+		TOTAL
+	};
+
 	Env()
 		:limiter(kDefaultMmapLimit),
-		fdlimiter(MaxOpenFiles()),
-		startbgthread(false),
-		shuttingdown(false) {
+		fdlimiter(MaxOpenFiles()) {
 			
 	}
 
 	~Env() {
-
+		ExitSchedule();
 	}
 
 	Status NewSequentialFile(const std::string& filename,
@@ -795,59 +815,155 @@ public:
 		std::this_thread::sleep_for(std::chrono::microseconds(micros));
 	}
 
+	// Wait for every queued background task to run, then stop the
+	// background threads.  Later Schedule() calls start them again.
 	void ExitSchedule() {
-		if (startbgthread) {
-			shuttingdown = true;
-			Schedule(Functor());
-			if (bgthread->joinable()) {
-				bgthread->join();
-			}
-			startbgthread = false;
+		for (int i = 0; i < TOTAL; i++) {
+			pools[i].JoinAll();
 		}
 	}
 
-	void Schedule(Functor&& func) {
-		// Start the background thread, if we haven't done so already.
-		std::unique_lock<std::mutex> lk(bgmutex);
-		if (!startbgthread) {
-			startbgthread = true;
-			bgthread.reset(new std::thread(std::bind(&Env::BackgroundThreadMain, this)));
-		}
-		
-		// If the queue is empty, the background thread may be waiting for work.
-		bgqueue.emplace_back(func);
-		bgcond.notify_one();
+	// Arrange to run "func" once in a background thread of the pool
+	// for "pri".  Flushes are scheduled HIGH so that they never queue
+	// behind a long compaction running in the LOW pool.
+	void Schedule(Functor&& func, Priority pri = LOW) {
+		pools[pri].Schedule(std::move(func));
+	}
+
+	// The number of background threads of the pool for "pri".  Threads
+	// are started lazily by Schedule().  Default: 1 per pool.
+	void SetBackgroundThreads(int num, Priority pri = LOW) {
+		pools[pri].SetBackgroundThreads(num);
 	}
+
+	int GetBackgroundThreads(Priority pri = LOW) {
+		return pools[pri].GetBackgroundThreads();
+	}
+
+	// Like SetBackgroundThreads(), but only ever grows the pool, so
+	// that the DBs sharing an env cannot shrink it for each other.
+	void IncBackgroundThreadsIfNeeded(int num, Priority pri = LOW) {
+		pools[pri].IncBackgroundThreadsIfNeeded(num);
+	}
+
 private:
-	void BackgroundThreadMain() {
-		while (!shuttingdown) {
-			std::unique_lock<std::mutex> lk(bgmutex);
+	class ThreadPool {
+	public:
+		ThreadPool()
+			: total(1),
+			exit(false) {
+
+		}
+
+		~ThreadPool() {
+			JoinAll();
+		}
+
+		void Schedule(Functor&& func) {
+			std::unique_lock<std::mutex> lk(mutex);
+			// Start background threads, if we haven't done so already.
+			while (static_cast<int>(threads.size()) < total) {
+				threads.emplace_back(std::bind(&ThreadPool::BackgroundThreadMain, this));
+			}
+
+			queue.emplace_back(std::move(func));
+			cond.notify_one();
+		}
+
+		void SetBackgroundThreads(int num) {
+			std::unique_lock<std::mutex> lk(mutex);
+			total = (num < 1) ? 1 : num;
+			cond.notify_all();   // Surplus threads exit once idle
+		}
 
-			// Wait until there is work to be done.
-			while (bgqueue.empty()) {
-				bgcond.wait(lk);
+		int GetBackgroundThreads() {
+			std::unique_lock<std::mutex> lk(mutex);
+			return total;
+		}
+
+		void IncBackgroundThreadsIfNeeded(int num) {
+			std::unique_lock<std::mutex> lk(mutex);
+			if (num > total) {
+				total = num;
 			}
+		}
 
-			assert(!bgqueue.empty());
-			auto func = bgqueue.front();
-			bgqueue.pop_front();
-			if (func) {
-				func();
+		void JoinAll() {
+			std::vector<std::thread> joining;
+			{
+				std::unique_lock<std::mutex> lk(mutex);
+				exit = true;
+				cond.notify_all();
+				joining.swap(threads);
+			}
+
+			for (auto& t : joining) {
+				if (t.get_id() == std::this_thread::get_id()) {
+					// Called from one of our own tasks; cannot join ourselves.
+					t.detach();
+				}
+				else if (t.joinable()) {
+					t.join();
+				}
 			}
+
+			std::unique_lock<std::mutex> lk(mutex);
+			exit = false;
 		}
-	}
 
-private:
-	LockTable locks;  
-	Limiter limiter;  
-	Limiter fdlimiter;
+	private:
+		void BackgroundThreadMain() {
+			std::unique_lock<std::mutex> lk(mutex);
+			while (true) {
+				// Wait until there is work to be done.
+				while (queue.empty() && !exit && !IsSurplus()) {
+					cond.wait(lk);
+				}
 
-	std::atomic<bool> shuttingdown;
-	std::atomic<bool> startbgthread;
-	std::mutex bgmutex;
-	std::condition_variable bgcond;
-	std::deque<Functor> bgqueue;
-	std::shared_ptr<std::thread> bgthread;
+				if (queue.empty()) {
+					break;   // Exiting, or this thread is no longer wanted
+				}
+
+				auto func = std::move(queue.front());
+				queue.pop_front();
+				// Run the task without holding the pool mutex so that it may
+				// Schedule() follow-up work, e.g. another compaction.
+				lk.unlock();
+				if (func) {
+					func();
+				}
+				lk.lock();
+			}
+
+			if (IsSurplus() && !exit) {
+				// Shrunk by SetBackgroundThreads(); leave the pool for good.
+				for (auto it = threads.begin(); it != threads.end(); ++it) {
+					if (it->get_id() == std::this_thread::get_id()) {
+						it->detach();
+						threads.erase(it);
+						break;
+					}
+				}
+			}
+		}
+
+		// REQUIRES: mutex is held
+		bool IsSurplus() const {
+			return static_cast<int>(threads.size()) > total;
+		}
+
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::deque<Functor> queue;
+		std::vector<std::thread> threads;
+		int total;
+		bool exit;
+	};
+
+	LockTable locks;
+	Limiter limiter;
+	Limiter fdlimiter;
+	ThreadPool pools[TOTAL];
 };
 
 enum InfoLogLevel {
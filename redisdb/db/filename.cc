@@ -22,6 +22,11 @@ std::string TableFileName(const std::string& dbname, uint64_t number) {
 	return makeFileName(dbname, number, "ldb");
 }
 
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+	assert(number > 0);
+	return makeFileName(dbname, number, "blob");
+}
+
 std::string SSTableFileName(const std::string& dbname, uint64_t number) {
 	assert(number > 0);
 	return makeFileName(dbname, number, "sst");
@@ -64,7 +69,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
-//    dbname/[0-9]+.(log|sst|ldb)
+//    dbname/[0-9]+.(log|sst|ldb|blob)
 bool ParseFileName(const std::string& filename, uint64_t* number, FileType* type) {
 	std::string_view rest(filename);
 	if (rest == "CURRENT") {
@@ -107,6 +112,9 @@ bool ParseFileName(const std::string& filename, uint64_t* number, FileType* type
 		else if (suffix == std::string_view(".sst") || suffix == std::string_view(".ldb")) {
 			*type = kTableFile;
 		}
+		else if (suffix == std::string_view(".blob")) {
+			*type = kBlobFile;
+		}
 		else if (suffix == std::string_view(".dbtmp")) {
 			*type = kTempFile;
 		}
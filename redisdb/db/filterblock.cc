@@ -0,0 +1,114 @@
+#include "filterblock.h"
+#include "filterpolicy.h"
+#include <assert.h>
+#include "coding.h"
+
+// The filter block is laid out as:
+//    [filter 0]
+//    ...
+//    [filter N-1]
+//    [offset of filter 0]                  : 4 bytes
+//    ...
+//    [offset of filter N-1]                : 4 bytes
+//    [offset of beginning of offset array] : 4 bytes
+//    lg(base)                              : 1 byte
+//
+// Filter i covers all keys of the data blocks whose file offset falls
+// in [i*base ... (i+1)*base-1].
+
+// Generate new filter every 2KB of data
+static const size_t kFilterBaseLg = 11;
+static const size_t kFilterBase = 1 << kFilterBaseLg;
+
+FilterBlockBuilder::FilterBlockBuilder(const std::shared_ptr<FilterPolicy>& policy)
+	: policy(policy) {
+
+}
+
+void FilterBlockBuilder::StartBlock(uint64_t blockoffset) {
+	uint64_t filterindex = (blockoffset / kFilterBase);
+	assert(filterindex >= filteroffsets.size());
+	while (filterindex > filteroffsets.size()) {
+		GenerateFilter();
+	}
+}
+
+void FilterBlockBuilder::AddKey(const std::string_view& key) {
+	start.push_back(keys.size());
+	keys.append(key.data(), key.size());
+}
+
+std::string_view FilterBlockBuilder::Finish() {
+	if (!start.empty()) {
+		GenerateFilter();
+	}
+
+	// Append array of per-filter offsets
+	const uint32_t arrayoffset = result.size();
+	for (size_t i = 0; i < filteroffsets.size(); i++) {
+		PutFixed32(&result, filteroffsets[i]);
+	}
+
+	PutFixed32(&result, arrayoffset);
+	result.push_back(kFilterBaseLg);  // Save encoding parameter in result
+	return std::string_view(result);
+}
+
+void FilterBlockBuilder::GenerateFilter() {
+	const size_t numkeys = start.size();
+	if (numkeys == 0) {
+		// Fast path if there are no keys for this filter
+		filteroffsets.push_back(result.size());
+		return;
+	}
+
+	// Make list of keys from flattened key structure
+	start.push_back(keys.size());  // Simplify length computation
+	tmpkeys.resize(numkeys);
+	for (size_t i = 0; i < numkeys; i++) {
+		const char* base = keys.data() + start[i];
+		size_t length = start[i + 1] - start[i];
+		tmpkeys[i] = std::string_view(base, length);
+	}
+
+	// Generate filter for current set of keys and append to result.
+	filteroffsets.push_back(result.size());
+	policy->CreateFilter(&tmpkeys[0], static_cast<int>(numkeys), &result);
+
+	tmpkeys.clear();
+	keys.clear();
+	start.clear();
+}
+
+FilterBlockReader::FilterBlockReader(const std::shared_ptr<FilterPolicy>& policy, 
+	const std::string_view& contents)
+	: policy(policy), 
+	data(nullptr), 
+	offset(nullptr), 
+	num(0), 
+	baselg(0) {
+	size_t n = contents.size();
+	if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
+	baselg = contents[n - 1];
+	uint32_t lastword = DecodeFixed32(contents.data() + n - 5);
+	if (lastword > n - 5) return;
+	data = contents.data();
+	offset = data + lastword;
+	num = (n - 5 - lastword) / 4;
+}
+
+bool FilterBlockReader::KeyMayMatch(uint64_t blockoffset, const std::string_view& key) {
+	uint64_t index = blockoffset >> baselg;
+	if (index < num) {
+		uint32_t start = DecodeFixed32(offset + index * 4);
+		uint32_t limit = DecodeFixed32(offset + index * 4 + 4);
+		if (start <= limit && limit <= static_cast<size_t>(offset - data)) {
+			std::string_view filter(data + start, limit - start);
+			return policy->KeyMayMatch(key, filter);
+		} else if (start == limit) {
+			// Empty filters do not match any keys
+			return false;
+		}
+	}
+	return true;  // Errors are treated as potential matches
+}
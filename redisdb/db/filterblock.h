@@ -0,0 +1,61 @@
+#pragma once
+
+// A filter block is stored near the end of a Table file.  It contains
+// filters (e.g., bloom filters) for all data blocks in the table combined
+// into a single filter block.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+class FilterPolicy;
+
+// A FilterBlockBuilder is used to construct all of the filters for a
+// particular Table.  It generates a single string which is stored as
+// a special block in the Table.
+//
+// The sequence of calls to FilterBlockBuilder must match the regexp:
+//      (StartBlock AddKey*)* Finish
+class FilterBlockBuilder {
+public:
+	explicit FilterBlockBuilder(const std::shared_ptr<FilterPolicy>& policy);
+
+	FilterBlockBuilder(const FilterBlockBuilder&) = delete;
+
+	FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
+
+	void StartBlock(uint64_t blockoffset);
+
+	void AddKey(const std::string_view& key);
+
+	std::string_view Finish();
+
+private:
+	void GenerateFilter();
+
+	std::shared_ptr<FilterPolicy> policy;
+	std::string keys;             // Flattened key contents
+	std::vector<size_t> start;    // Starting index in keys of each key
+	std::string result;           // Filter data computed so far
+	std::vector<std::string_view> tmpkeys;  // policy->CreateFilter() argument
+	std::vector<uint32_t> filteroffsets;
+};
+
+class FilterBlockReader {
+public:
+	// REQUIRES: "contents" and *policy must stay live while *this is live.
+	FilterBlockReader(const std::shared_ptr<FilterPolicy>& policy, 
+		const std::string_view& contents);
+
+	bool KeyMayMatch(uint64_t blockoffset, const std::string_view& key);
+
+private:
+	std::shared_ptr<FilterPolicy> policy;
+	const char* data;    // Pointer to filter data (at block-start)
+	const char* offset;  // Pointer to beginning of offset array (at block-end)
+	size_t num;          // Number of entries in offset array
+	size_t baselg;      // Encoding parameter (see kFilterBaseLg in .cc file)
+};
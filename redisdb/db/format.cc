@@ -1,8 +1,10 @@
 #include "format.h"
+#include <algorithm>
 #include "block.h"
 #include "coding.h"
 #include "crc32c.h"
 #include "env.h"
+#include "perfcontext.h"
 
 void BlockHandle::EncodeTo(std::string* dst) const {
 	// Sanity check that all fields have been Set
@@ -56,10 +58,48 @@ Status Footer::DecodeFrom(std::string_view* input) {
 	return result;
 }
 
+VerifiedBlocks::VerifiedBlocks(std::vector<uint64_t>&& offsets)
+	: offsets(std::move(offsets)),
+	bits(new std::atomic<uint64_t>[(this->offsets.size() + 63) / 64]) {
+	for (size_t i = 0; i < (this->offsets.size() + 63) / 64; i++) {
+		bits[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+int64_t VerifiedBlocks::Find(uint64_t offset) const {
+	auto it = std::lower_bound(offsets.begin(), offsets.end(), offset);
+	if (it == offsets.end() || *it != offset) {
+		return -1;
+	}
+	return it - offsets.begin();
+}
+
+bool VerifiedBlocks::IsVerified(uint64_t offset) const {
+	const int64_t i = Find(offset);
+	if (i < 0) {
+		return false;
+	}
+	return (bits[i / 64].load(std::memory_order_acquire) >> (i % 64)) & 1;
+}
+
+void VerifiedBlocks::SetVerified(uint64_t offset) {
+	const int64_t i = Find(offset);
+	if (i >= 0) {
+		bits[i / 64].fetch_or(uint64_t(1) << (i % 64), std::memory_order_release);
+	}
+}
+
+size_t VerifiedBlocks::ApproximateMemoryUsage() const {
+	return sizeof(VerifiedBlocks) + offsets.capacity() * sizeof(uint64_t) +
+		(offsets.size() + 63) / 64 * sizeof(uint64_t);
+}
+
 Status ReadBlock(const std::shared_ptr<RandomAccessFile>& file,
 	const ReadOptions& options,
 	const BlockHandle& handle,
-	BlockContents* result) {
+	BlockContents* result,
+	const std::string_view& dict,
+	VerifiedBlocks* verified) {
 	result->data = std::string_view();
 	result->cachable = false;
 	result->heapallocated = false;
@@ -69,7 +109,12 @@ Status ReadBlock(const std::shared_ptr<RandomAccessFile>& file,
 	size_t n = static_cast<size_t>(handle.GetSize());
 	char* buf = (char*)malloc(n + kBlockTrailerSize);
 	std::string_view contents;
+	PerfContext* perf = GetPerfContext();
+	perf->blockreadcount++;
+	perf->blockreadbyte += n + kBlockTrailerSize;
+	PerfTimer readtimer(&perf->blockreadtime);
 	Status s = file->read(handle.GetOffset(), n + kBlockTrailerSize, &contents, buf);
+	readtimer.Stop();
 	if (!s.ok()) {
 		free(buf);
 		return s;
@@ -82,16 +127,27 @@ Status ReadBlock(const std::shared_ptr<RandomAccessFile>& file,
 
 	// Check the crc of the type and the block Contents
 	const char* data = contents.data();    // Pointer to where Read Put the data
-	if (options.verifychecksums) {
+	// A block read in place stays the same memory for as long as the file
+	// is open, so it only has to pass once.
+	const bool inplace = (verified != nullptr && data != buf);
+	if (options.verifychecksums &&
+		!(inplace && verified->IsVerified(handle.GetOffset()))) {
+		PerfTimer checksumtimer(&perf->blockchecksumtime);
 		const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
 		const uint32_t actual = crc32c::Value(data, n + 1);
+		checksumtimer.Stop();
 		if (actual != crc) {
 			free(buf);
 			s = Status::Corruption("block checksum mismatch");
 			return s;
 		}
+
+		if (inplace) {
+			verified->SetVerified(handle.GetOffset());
+		}
 	}
 
+	PerfTimer decompresstimer(&perf->blockdecompresstime);
 	switch (data[n]) {
 	case kNoCompression:
 		if (data != buf) {
@@ -123,7 +179,31 @@ Status ReadBlock(const std::shared_ptr<RandomAccessFile>& file,
 			free(ubuf);
 			return Status::Corruption("corrupted compressed block contents");
 		}
-		delete[] buf;
+		free(buf);
+		result->data = std::string_view(ubuf, ulength);
+		result->heapallocated = true;
+		result->cachable = true;
+		break;
+	}
+	case kLZ4Compression:
+	case kZstdCompression: {
+		// Both are stored as varint32 uncompressed length + compressed data.
+		uint32_t ulength = 0;
+		const char* p = GetVarint32Ptr(data, data + n, &ulength);
+		if (p == nullptr) {
+			free(buf);
+			return Status::Corruption("corrupted compressed block contents");
+		}
+
+		char* ubuf = (char*)malloc(ulength > 0 ? ulength : 1);
+		bool ok = (data[n] == kLZ4Compression) ?
+			LZ4_Uncompress(p, data + n - p, dict, ubuf, ulength) :
+			Zstd_Uncompress(p, data + n - p, dict, ubuf, ulength);
+		free(buf);
+		if (!ok) {
+			free(ubuf);
+			return Status::Corruption("corrupted compressed block contents");
+		}
 		result->data = std::string_view(ubuf, ulength);
 		result->heapallocated = true;
 		result->cachable = true;
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <string_view>
 #include <memory>
+#include <atomic>
+#include <vector>
 #include "status.h"
 #include "option.h"
 
@@ -79,6 +81,10 @@ private:
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Metaindex key of the block holding the dictionary that the table's
+// LZ4 and Zstd data blocks were compressed with.
+static const char kCompressionDictionaryKey[] = "compression.dictionary";
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -88,12 +94,47 @@ struct BlockContents {
 	bool heapallocated;  // True iff caller should delete[] data.data()
 };
 
+// Remembers which blocks of a file have had their checksum verified
+// where they lie in an mmap of the file, so that reads of them in place
+// need not verify it again.  Safe for concurrent use.
+class VerifiedBlocks {
+public:
+	// "offsets" are the offsets of the blocks to keep track of, sorted.
+	explicit VerifiedBlocks(std::vector<uint64_t>&& offsets);
+
+	bool IsVerified(uint64_t offset) const;
+
+	void SetVerified(uint64_t offset);
+
+	size_t ApproximateMemoryUsage() const;
+
+private:
+	// Returns the index of the block at "offset", or -1 if not tracked.
+	int64_t Find(uint64_t offset) const;
+
+	const std::vector<uint64_t> offsets;
+	std::unique_ptr<std::atomic<uint64_t>[]> bits;
+
+	// No copying allowed
+	VerifiedBlocks(const VerifiedBlocks&);
+
+	void operator=(const VerifiedBlocks&);
+};
+
 // Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// return non-OK.  On success fill *result and return OK.  "dict" is the
+// table's compression dictionary, if it has one; it is only consulted
+// for LZ4 and Zstd blocks.
+//
+// If "verified" is non-null, a block the file returns in place (from an
+// mmap) has its checksum verified only if it is not marked in
+// "verified" yet, and is marked once it passes.
 Status ReadBlock(const std::shared_ptr<RandomAccessFile>& file,
 	const ReadOptions& options,
 	const BlockHandle& handle,
-	BlockContents* result);
+	BlockContents* result,
+	const std::string_view& dict = std::string_view(),
+	VerifiedBlocks* verified = nullptr);
 
 // Implementation details follow.  Clients should ignore,
 
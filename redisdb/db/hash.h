@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Simple hash function used for internal data structures
+uint32_t Hash(const char* data, size_t n, uint32_t seed);
@@ -12,13 +12,15 @@ public:
 
 	std::string ToString() const;
 
-private:
-	enum { kNumBuckets = 154 };
-
 	double Median() const;
 	double Percentile(double p) const;
 	double Average() const;
 	double StandardDeviation() const;
+	double Count() const { return num; }
+	double Max() const { return max; }
+
+private:
+	enum { kNumBuckets = 154 };
 
 	static const double kBucketLimit[kNumBuckets];
 
@@ -97,40 +97,28 @@ private:
 
 class MultiHashLock {
 public:
+	// Distinct keys may share a lock shard, so lock each shard once and
+	// in index order; locking per key could deadlock on itself.
 	MultiHashLock(LockMgr* lockmgr, std::vector<std::string>& keys)
-		:lockmgr(lockmgr),
-		keys(keys) {
-		std::string prekey;
-		std::sort(keys.begin(), keys.end());
-		if (!keys.empty() &&
-			keys[0].empty()) {
-			lockmgr->Lock(prekey);
+		:lockmgr(lockmgr) {
+		for (const auto& key : keys) {
+			shards.push_back(std::hash<std::string>{}(key) % LockMgr::kShards);
 		}
 
-		for (const auto& key : keys) {
-			if (prekey != key) {
-				lockmgr->Lock(key);
-				prekey = key;
-			}
+		std::sort(shards.begin(), shards.end());
+		shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+		for (size_t shard : shards) {
+			lockmgr->lockshards[shard].lock();
 		}
 	}
 
 	~MultiHashLock() {
-		std::string prekey;
-		if (!keys.empty() &&
-			keys[0].empty()) {
-			lockmgr->Unlock(prekey);
-		}
-
-		for (const auto& key : keys) {
-			if (prekey != key) {
-				lockmgr->Unlock(key);
-				prekey = key;
-			}
+		for (size_t shard : shards) {
+			lockmgr->lockshards[shard].unlock();
 		}
 	}
 private:
-	std::vector<std::string> keys;
+	std::vector<size_t> shards;
 	LockMgr* const lockmgr;
 
 	MultiHashLock(const MultiHashLock&);
@@ -141,8 +129,8 @@ class SnapshotLock {
 public:
 	SnapshotLock(std::shared_ptr<DB>& db, std::shared_ptr<Snapshot>& snapshot)
 		:db(db),
-		snapshot(snapshot) {
-		snapshot = db->GetSnapshot();
+		snapshot(db->GetSnapshot()) {
+		snapshot = this->snapshot;
 	}
 
 	~SnapshotLock() {
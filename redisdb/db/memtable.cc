@@ -2,21 +2,28 @@
 #include "coding.h"
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-	: memoryusage(0),
-	kcmp(comparator),
-	table(comparator) {
+	: kcmp(comparator),
+	table(comparator, &arena) {
 
 }
 
 MemTable::~MemTable() {
-	ClearTable();
+	// Entries and skiplist nodes all live in the arena, which releases
+	// its blocks in bulk.
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Empty() {
+	Table::Iterator iter(&table);
+	iter.SeekToFirst();
+	return !iter.Valid();
+}
+
+bool MemTable::Get(const LookupKey& key, PinnableValue* value, Status* s,
+	const MergeOperator* mergeoperator, std::vector<std::string>* operands) {
 	std::string_view memkey = key.MemtableKey();
 	Table::Iterator iter(&table);
 	iter.Seek(memkey.data());
-	if (iter.Valid()) {
+	for (; iter.Valid(); iter.Next()) {
 		// entry format is:
 		// klength  varint32
 		// userkey  char[klength]
@@ -32,26 +39,56 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
 		const char* keyptr = GetVarint32Ptr(entry, entry + 5, &keylength);
 
 		if (kcmp.icmp.GetComparator()->Compare(std::string_view(keyptr, keylength - 8),
-			key.UserKey()) == 0) {
-			const uint64_t tag = DecodeFixed64(keyptr + keylength - 8);
-			switch (static_cast<ValueType>(tag & 0xff)) {
-			case kTypeValue: {
-				std::string_view v = GetLengthPrefixedSlice(keyptr + keylength);
-				value->assign(v.data(), v.size());
-				return true;
+			key.UserKey()) != 0) {
+			break;
+		}
+
+		const uint64_t tag = DecodeFixed64(keyptr + keylength - 8);
+		switch (static_cast<ValueType>(tag & 0xff)) {
+		case kTypeValue: {
+			std::string_view v = GetLengthPrefixedSlice(keyptr + keylength);
+			if (operands->empty()) {
+				value->PinSlice(v, shared_from_this());
+			}
+			else {
+				*s = FullMergeOperands(mergeoperator, key.UserKey(), &v, *operands, value->GetSelf());
+				value->PinSelf();
 			}
+			return true;
+		}
 
-			case kTypeDeletion:
+		case kTypeDeletion:
+			if (operands->empty()) {
 				*s = Status::NotFound(std::string_view());
+			}
+			else {
+				*s = FullMergeOperands(mergeoperator, key.UserKey(), nullptr, *operands, value->GetSelf());
+				value->PinSelf();
+			}
+			return true;
+
+		case kTypeMerge: {
+			if (mergeoperator == nullptr) {
+				*s = Status::NotSupported("merge operand found but no merge operator set");
 				return true;
 			}
+
+			// Keep looking for what the operand applies to.
+			std::string_view v = GetLengthPrefixedSlice(keyptr + keylength);
+			operands->push_back(std::string(v.data(), v.size()));
+			break;
+		}
+
+		default:
+			*s = Status::Corruption("unknown memtable entry type");
+			return true;
 		}
 	}
 	return false;
 }
 
 void MemTable::Add(uint64_t seq, ValueType type, const std::string_view& key,
-	const std::string_view& value) {
+	const std::string_view& value, bool concurrent) {
 	// Format of an entry is concatenation of:
 	//  key_size     : varint32 of internal_key.size()
 	//  key bytes   : char[internal_key.size()]
@@ -66,7 +103,7 @@ void MemTable::Add(uint64_t seq, ValueType type, const std::string_view& key,
 		VarintLength(internalkeysize) + internalkeysize +
 		VarintLength(valsize) + valsize;
 
-	char* buf = new char[encodedlen];
+	char* buf = concurrent ? arena.allocateConcurrently(encodedlen) : arena.allocate(encodedlen);
 	char* p = EncodeVarint32(buf, internalkeysize);
 	memcpy(p, key.data(), keysize);
 	p += keysize;
@@ -75,8 +112,12 @@ void MemTable::Add(uint64_t seq, ValueType type, const std::string_view& key,
 	p = EncodeVarint32(p, valsize);
 	memcpy(p, value.data(), valsize);
 	assert(p + valsize == buf + encodedlen);
-	table.Insert(buf);
-	memoryusage += encodedlen;
+	if (concurrent) {
+		table.InsertConcurrently(buf);
+	}
+	else {
+		table.Insert(buf);
+	}
 }
 
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr) const {
@@ -86,14 +127,6 @@ int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr) cons
 	return icmp.Compare(a, b);
 }
 
-void MemTable::ClearTable() {
-	SkipList<const char*, KeyComparator>::Iterator iter(&table);
-	for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
-		delete[] iter.key();
-	}
-	memoryusage = 0;
-}
-
 // Encode a suitable internal key target for "target" and return it.
 // Uses *scratch as scratch space, and the returned pointer will point
 // into this scratch space.
@@ -8,14 +8,22 @@
 #include "dbformat.h"
 #include "iterator.h"
 #include "skiplist.h"
+#include "arena.h"
+#include "mergeoperator.h"
+#include "pinnablevalue.h"
 
-class MemTable {
+class MemTable : public std::enable_shared_from_this<MemTable> {
 public:
 	MemTable(const InternalKeyComparator& comparator);
 
 	~MemTable();
 
-	size_t GetMemoryUsage() { return memoryusage; }
+	// Returns an estimate of the number of bytes of data in use by this
+	// data structure. It is safe to call when MemTable is being modified.
+	size_t GetMemoryUsage() { return arena.getMemoryUsage(); }
+
+	// Returns true iff no entry has been added to the memtable yet.
+	bool Empty();
 
 	// Return an iterator that yields the Contents of the memtable.
 	//
@@ -28,12 +36,22 @@ public:
 	// Add an entry into memtable that maps key to value at the
 	// specified sequence number and with the specified type.
 	// Typically value will be empty if type==kTypeDeletion.
+	//
+	// If "concurrent" is true, other threads may be adding entries at the
+	// same time (each with distinct sequence numbers), provided that none
+	// of them uses the non-concurrent path meanwhile.
 	void Add(uint64_t seq, ValueType type, const std::string_view& key,
-		const std::string_view& value);
-
-	bool Get(const LookupKey& key, std::string* value, Status* s);
+		const std::string_view& value, bool concurrent = false);
 
-	void ClearTable();
+	// If memtable Contains a value for key, store it in *value and return true.
+	// The value is pinned in the memtable, which must be owned by a
+	// std::shared_ptr.  If memtable Contains a deletion for key, store a
+	// NotFound() error in *s and return true.  Merge operands met on the
+	// way are appended to *operands, newest first, and folded onto the
+	// value or deletion below them with "mergeoperator".
+	// Else, return false, leaving any operands for older sources to fold.
+	bool Get(const LookupKey& key, PinnableValue* value, Status* s,
+		const MergeOperator* mergeoperator, std::vector<std::string>* operands);
 
 private:
 	struct KeyComparator {
@@ -48,9 +66,9 @@ private:
 
 	friend class MemTableIterator;
 	typedef SkipList<const char*, KeyComparator> Table;
-	Table table;
 	KeyComparator kcmp;
-	size_t memoryusage;
+	Arena arena;
+	Table table;
 public:
 	Table& GetTable() { return table; }
 };
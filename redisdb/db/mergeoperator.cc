@@ -0,0 +1,22 @@
+#include "mergeoperator.h"
+
+Status FullMergeOperands(const MergeOperator* mergeoperator, const std::string_view& key,
+	const std::string_view* existingvalue, const std::vector<std::string>& operands,
+	std::string* value) {
+	if (mergeoperator == nullptr) {
+		return Status::NotSupported("merge operand found but no merge operator set");
+	}
+
+	std::vector<std::string_view> ordered;
+	ordered.reserve(operands.size());
+	for (auto iter = operands.rbegin(); iter != operands.rend(); ++iter) {
+		ordered.push_back(*iter);
+	}
+
+	std::string result;
+	if (!mergeoperator->FullMerge(key, existingvalue, ordered, &result)) {
+		return Status::Corruption("merge failed for ", key);
+	}
+	value->swap(result);
+	return Status::OK();
+}
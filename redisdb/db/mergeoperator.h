@@ -0,0 +1,48 @@
+#pragma once
+
+// A database can be configured with a MergeOperator.  DB::Merge() then
+// records an operand for a key instead of a new value, without reading
+// the key first.  Reads fold the operands onto the value they apply to,
+// oldest first, and compactions fold them into a plain value as soon as
+// they meet that value, so an increment or an append costs a blind write.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "status.h"
+
+class MergeOperator {
+public:
+	virtual ~MergeOperator() {}
+
+	// The name of this operator.  Used for logging only.
+	virtual const char* Name() const = 0;
+
+	// Apply "operands", oldest first, to "existingvalue" and store the
+	// result in *newvalue.  "existingvalue" is nullptr if the key has no
+	// value below the operands, either because it was never written or
+	// because it was deleted.  Return false if the operands cannot be
+	// applied; the read or compaction that asked then fails with a
+	// corruption error.
+	//
+	// Must be deterministic and thread-safe: the same operands are
+	// folded again by every read that meets them.
+	virtual bool FullMerge(const std::string_view& key, const std::string_view* existingvalue,
+		const std::vector<std::string_view>& operands, std::string* newvalue) const = 0;
+
+	// Combine two adjacent operands, "leftoperand" being the older one,
+	// into a single operand with the same effect, if possible.
+	// Compactions that do not reach the value under a run of operands use
+	// this to shrink the run.  The default combines nothing.
+	virtual bool PartialMerge(const std::string_view& key, const std::string_view& leftoperand,
+		const std::string_view& rightoperand, std::string* newvalue) const {
+		return false;
+	}
+};
+
+// Fold "operands", newest first as a lookup collects them, onto
+// "existingvalue" (nullptr if the key has no value) and store the result
+// in *value.  "existingvalue" may point into *value.
+Status FullMergeOperands(const MergeOperator* mergeoperator, const std::string_view& key,
+	const std::string_view* existingvalue, const std::vector<std::string>& operands,
+	std::string* value);
@@ -7,7 +7,9 @@ public:
 		: comparator(comparator),
 		n(n),
 		current(nullptr),
-		direction(kForward) {
+		direction(kForward),
+		tree(n, 0),
+		runnerup(-1) {
 		for (int i = 0; i< child.size(); i++) {
 			std::shared_ptr<IteratorWrapper> iterWrap(new IteratorWrapper(child[i]));
 			children.push_back(iterWrap);
@@ -27,8 +29,8 @@ public:
 			children[i]->SeekToFirst();
 		}
 
-		findSmallest();
 		direction = kForward;
+		BuildTree();
 	}
 
 	virtual void SeekToLast() {
@@ -36,8 +38,8 @@ public:
 			children[i]->SeekToLast();
 		}
 
-		findLargest();
 		direction = kReverse;
+		BuildTree();
 	}
 
 	virtual void Seek(const std::string_view& target) {
@@ -45,8 +47,8 @@ public:
 			children[i]->Seek(target);
 		}
 
-		findSmallest();
 		direction = kForward;
+		BuildTree();
 	}
 
 	virtual void Next() {
@@ -69,10 +71,13 @@ public:
 				}
 			}
 			direction = kForward;
+			current->Next();
+			BuildTree();
+		}
+		else {
+			current->Next();
+			ReplayTree();
 		}
-
-		current->Next();
-		findSmallest();
 	}
 
 	virtual void Prev() {
@@ -99,10 +104,13 @@ public:
 				}
 			}
 			direction = kReverse;
+			current->Prev();
+			BuildTree();
+		}
+		else {
+			current->Prev();
+			ReplayTree();
 		}
-
-		current->Prev();
-		findLargest();
 	}
 
 	virtual std::string_view key() const {
@@ -131,13 +139,35 @@ public:
 	}
 
 private:
-	void findSmallest();
+	// Returns true if child "a" is to be yielded before child "b" in the
+	// current direction.  An exhausted child loses to any other; equal
+	// keys go to the lower index going forward and to the higher one in
+	// reverse.
+	bool Beats(int a, int b) const {
+		const IteratorWrapper* x = children[a].get();
+		const IteratorWrapper* y = children[b].get();
+		if (!x->Valid()) {
+			return false;
+		}
+		else if (!y->Valid()) {
+			return true;
+		}
 
-	void findLargest();
+		int r = comparator->Compare(x->key(), y->key());
+		if (direction == kForward) {
+			return r < 0 || (r == 0 && a < b);
+		}
+		else {
+			return r > 0 || (r == 0 && a > b);
+		}
+	}
+
+	// Play every match of the tournament after the children moved.
+	void BuildTree();
+
+	// Replay the matches of the winner after it moved by one entry.
+	void ReplayTree();
 
-	// We might want to use a heap in case there are lots of children.
-	// For now we use a simple array since we expect a very small number
-	// of children in leveldb.
 	const Comparator* comparator;
 	std::vector<std::shared_ptr<IteratorWrapper>> children;
 	std::shared_ptr<IteratorWrapper> current;
@@ -149,39 +179,67 @@ private:
 		kReverse
 	};
 	Direction direction;
+
+	// Loser tree over the children, so that the next entry costs about
+	// log2(n) comparisons instead of n.  Child i is leaf n + i of a
+	// binary tree whose node p has children 2p and 2p + 1.  Each internal
+	// node 1..n-1 holds the loser of the match played there, and tree[0]
+	// the overall winner, which is the current child.
+	std::vector<int> tree;
+
+	// The child that is next best after the winner, or -1 if not known.
+	// Known after a winner kept its place in a replay: while it keeps
+	// beating the runner-up, Next() and Prev() need one comparison.
+	int runnerup;
 	std::list<std::any> clearnups;
 };
 
-void MergingIterator::findSmallest() {
-	std::shared_ptr<IteratorWrapper> smallest = nullptr;
-	for (int i = 0; i< n; i++) {
-		std::shared_ptr<IteratorWrapper> child = children[i];
-		if (child->Valid()) {
-			if (smallest == nullptr) {
-				smallest = child;
-			}
-			else if (comparator->Compare(child->key(), smallest->key())< 0) {
-				smallest = child;
-			}
+void MergingIterator::BuildTree() {
+	std::vector<int> winners(n);
+	for (int p = n - 1; p >= 1; p--) {
+		const int left = (2 * p < n) ? winners[2 * p] : 2 * p - n;
+		const int right = (2 * p + 1 < n) ? winners[2 * p + 1] : 2 * p + 1 - n;
+		if (Beats(right, left)) {
+			winners[p] = right;
+			tree[p] = left;
+		}
+		else {
+			winners[p] = left;
+			tree[p] = right;
 		}
 	}
-	current = smallest;
+
+	tree[0] = winners[1];
+	runnerup = -1;
+	current = children[tree[0]]->Valid() ? children[tree[0]] : nullptr;
 }
 
-void MergingIterator::findLargest() {
-	std::shared_ptr<IteratorWrapper> largest = nullptr;
-	for (int i = n - 1; i >= 0; i--) {
-		std::shared_ptr<IteratorWrapper> child = children[i];
-		if (child->Valid()) {
-			if (largest == nullptr) {
-				largest = child;
-			}
-			else if (comparator->Compare(child->key(), largest->key()) > 0) {
-				largest = child;
+void MergingIterator::ReplayTree() {
+	const int last = tree[0];
+	if (runnerup >= 0 && Beats(last, runnerup)) {
+		// Still ahead of everybody else; the tree stays as it is.
+		return;
+	}
+
+	int winner = last;
+	for (int p = (winner + n) / 2; p > 0; p /= 2) {
+		if (Beats(tree[p], winner)) {
+			std::swap(tree[p], winner);
+		}
+	}
+
+	tree[0] = winner;
+	runnerup = -1;
+	if (winner == last) {
+		// Every other child lost to the winner on its way up; the best of
+		// them is the runner-up.
+		for (int p = (winner + n) / 2; p > 0; p /= 2) {
+			if (runnerup < 0 || Beats(tree[p], runnerup)) {
+				runnerup = tree[p];
 			}
 		}
 	}
-	current = largest;
+	current = children[winner]->Valid() ? children[winner] : nullptr;
 }
 
 std::shared_ptr<Iterator> NewMergingIterator(
@@ -12,13 +12,54 @@ Options::Options()
 	createifmissing(false),
 	errorifexists(false),
 	paranoidchecks(false),
+	verifychecksumsonce(false),
+	scrubbytespersec(0),
 	writebuffersize(4 * 1024 * 1024),
 	maxopenfiles(1000),
+	preopentables(false),
+	maxfileopeningthreads(16),
 	blocksize(4 * 1024),
 	blockrestartinterval(16),
 	maxfilesize(2 * 1024 * 1024),
-	compression(kNoCompression),
+	compression(kSnappyCompression),
+	zstdlevel(3),
 	reuselogs(false),
+	filterpolicy(nullptr),
+	allowconcurrentmemtablewrite(true),
+	enablepipelinedwrite(false),
+	delayedwriterate(16 * 1024 * 1024),
+	softpendingcompactionbyteslimit(64 * 1024 * 1024),
+	hardpendingcompactionbyteslimit(1024 * 1024 * 1024),
+	ratelimiter(nullptr),
+	statistics(nullptr),
+	sharedlog(nullptr),
+	sharedlogid(0),
+	writebuffermanager(nullptr),
+	reservetablereadermemory(false),
+	maxsubcompactions(4),
+	maxbackgroundcompactions(4),
+	maxbackgroundflushes(2),
+	recoverythreads(4),
+	blockhashindex(false),
+	compactionfilterfactory(nullptr),
+	enableblobfiles(false),
+	minblobsize(4096),
+	blobfilesize(256 * 1024 * 1024),
+	blobgcagecutoff(0.25),
+	blobgcforcethreshold(0.5),
+	mergeoperator(nullptr),
 	env(new Env()) {
 
 }
+
+CompressionType Options::CompressionForLevel(int level) const {
+	if (compressionperlevel.empty()) {
+		return compression;
+	}
+
+	size_t i = (level < 0) ? 0 : static_cast<size_t>(level);
+	if (i >= compressionperlevel.size()) {
+		i = compressionperlevel.size() - 1;
+	}
+	return compressionperlevel[i];
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <vector>
+#include <string>
 #include "logger.h"
 #include "dbformat.h"
 #include "snapshot.h"
+#include "ratelimiter.h"
+#include "statistics.h"
 
 
 // DB Contents are stored in a Set of blocks, each of which holds a
@@ -13,10 +17,26 @@ enum CompressionType {
 	// NOTE: do not change the values of existing entries, as these are
 	// part of the persistent format on disk.
 	kNoCompression = 0x0,
-	kSnappyCompression = 0x1
+	kSnappyCompression = 0x1,
+	kLZ4Compression = 0x4,
+	kZstdCompression = 0x7
 };
 
 class ShardedLRUCache;
+
+class CompactionFilterFactory;
+
+class MergeOperator;
+
+class SharedLog;
+
+class WriteBufferManager;
+
+// Return a builtin comparator that uses lexicographic byte-wise
+// ordering.  The result remains the property of this module and
+// must not be deleted.
+const Comparator* BytewiseComparator();
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
 	// -------------------
@@ -44,6 +64,23 @@ struct Options {
 	// Default: false
 	bool paranoidchecks;
 
+	// If true, ReadOptions::verifychecksums checks the checksum of a data
+	// block once rather than on every read of it: when it is read into
+	// the block cache, or, for a block read in place from an mmap'd
+	// table, the first time it is read.  Use scrubbytespersec to keep
+	// checking the blocks that stay in memory afterwards.
+	//
+	// Default: false
+	bool verifychecksumsonce;
+
+	// If not zero, a background thread reads every live table over and
+	// over at about this many bytes per second and verifies the checksum
+	// of each of its blocks.  A corruption it finds is logged and becomes
+	// the background error of the DB, which fails later writes.
+	//
+	// Default: 0
+	uint64_t scrubbytespersec;
+
 	// Any internal progress/error information generated by the db will
 	// be written to info_log if it is non-null, or to a file stored
 	// in the same directory as the DB Contents if info_log is null.
@@ -77,8 +114,26 @@ struct Options {
 	// increase this if your database has a large working Set (budget
 	// one Open file per 2MB of working Set).
 	//
+	// -1 keeps every table open, with its index and filter in memory,
+	// from the time it is opened until it is deleted, and implies
+	// preopentables.
+	//
 	// Default: 1000
 	int maxopenfiles;
+
+	// If true, DB::Open() opens the live tables, reading their footers,
+	// indexes and filters, before it returns, so that the first reads
+	// after a restart do not have to.  Lower levels go first, and no more
+	// tables are opened than the table cache can hold (see maxopenfiles).
+	// Progress is reported to infolog.
+	//
+	// Default: false
+	bool preopentables;
+
+	// Number of threads that open tables for preopentables.
+	//
+	// Default: 16
+	int maxfileopeningthreads;
 	// Approximate size of user data packed per block.  Note that the
 	// block size specified here corresponds to uncompressed data.  The
 	// actual size of the unit read from disk may be smaller if
@@ -120,23 +175,213 @@ struct Options {
 	// worth switching to kNoCompression.  Even if the input data is
 	// incompressible, the kSnappyCompression implementation will
 	// efficiently detect that and will switch to uncompressed mode.
+	//
+	// kLZ4Compression is about as fast as Snappy.  kZstdCompression is
+	// slower but compresses better, which suits the large, rarely
+	// rewritten bottom levels.  A codec that was not compiled in (see
+	// HAVE_SNAPPY, HAVE_LZ4 and HAVE_ZSTD in the makefile) falls back to
+	// storing blocks uncompressed.
 	CompressionType compression;
 
+	// If non-empty, overrides "compression" per level: tables written to
+	// level L use compressionperlevel[L], or the last entry for levels
+	// past the end.  For example {kNoCompression, kNoCompression,
+	// kLZ4Compression, kZstdCompression} keeps the often rewritten upper
+	// levels cheap to build.
+	//
+	// Default: empty
+	std::vector<CompressionType> compressionperlevel;
+
+	// Compression level passed to Zstd.
+	//
+	// Default: 3
+	int zstdlevel;
+
+	// If non-empty, data blocks compressed with LZ4 or Zstd use this
+	// dictionary; see Zstd_TrainDictionary() in util.h.  It is stored in
+	// every table written with it, so it may be changed at any time.
+	// Keep it small (a few KB to tens of KB): it is loaded for each block.
+	//
+	// Default: empty
+	std::string compressiondictionary;
+
 	// EXPERIMENTAL: If true, append to existing MANIFEST and log files
 	// when a database is opened.  This can significantly speed up Open.
 	//
 	// Default: currently false, but may become true later.
 	bool reuselogs;
 
+	// If non-null, use the specified filter policy to reduce disk reads.
+	// Many applications will benefit from passing the result of
+	// NewBloomFilterPolicy() here.
+	//
+	// Default: nullptr
+	std::shared_ptr<FilterPolicy> filterpolicy;
+
+	// If true, every writer in a Write() group inserts its own batch into
+	// the memtable in parallel once the group leader has appended the
+	// combined record to the log.  If false, the leader inserts the whole
+	// group by itself.  Groups with a single writer always take the
+	// serial path, so there is no cost when writes are not concurrent.
+	//
+	// Default: true
+	bool allowconcurrentmemtablewrite;
+
+	// If true, the write path runs as two stages: as soon as a group's
+	// record is in the log (and synced, if asked), the next group may
+	// start logging while the first one is still inserting into the
+	// memtable.  Writes become visible in log order, once both stages
+	// are done.  Mostly helps sync writes, whose fsync no longer waits
+	// behind memtable inserts.
+	//
+	// Default: false
+	bool enablepipelinedwrite;
+
+	// Once compactions fall behind (too many level-0 files, or more than
+	// softpendingcompactionbyteslimit bytes waiting to be compacted),
+	// writes are throttled to this many bytes per second.  The rate then
+	// adapts to whether compactions are catching up.
+	//
+	// Default: 16MB/s
+	uint64_t delayedwriterate;
+
+	// Estimated compaction debt, in bytes, at which writes start to be
+	// throttled and at which they stop until compactions catch up.  0
+	// disables the limit; level-0 file counts still apply.
+	//
+	// Default: 64MB and 1GB
+	uint64_t softpendingcompactionbyteslimit;
+	uint64_t hardpendingcompactionbyteslimit;
+
+	// If non-null, table files written by flushes and compactions are
+	// paced by this limiter, flushes ahead of compactions, so that they
+	// leave disk bandwidth for log writes and reads.  May be shared by
+	// several DBs on the same device.  An auto-tuned limiter is fed the
+	// latency of Get() and of log writes.
+	//
+	// Default: nullptr
+	std::shared_ptr<RateLimiter> ratelimiter;
+
+	// If non-null, the DB counts cache hits, bytes read per level, log
+	// syncs and stalls into it, and records Get() and Write() latencies.
+	// See CreateDBStatistics().
+	//
+	// Default: nullptr
+	std::shared_ptr<Statistics> statistics;
+
+	// If non-null, the DB writes to this log, shared with other DBs,
+	// instead of keeping a log of its own, and is known in it by
+	// sharedlogid.  The log must have been opened before the DB, and
+	// the id must not change for an existing DB.  See sharedlog.h.
+	//
+	// Default: nullptr
+	std::shared_ptr<SharedLog> sharedlog;
+	uint32_t sharedlogid;
+
+	// If non-null, the memtables of every DB given the same manager
+	// share its memory limit, on top of writebuffersize: once they get
+	// close to it, the DB with the largest memtable flushes it.  See
+	// writebuffermanager.h.
+	//
+	// Default: nullptr
+	std::shared_ptr<WriteBufferManager> writebuffermanager;
+
+	// If true, the index, filter and compression dictionary that an open
+	// table keeps in memory are charged against blockcache for as long
+	// as the table stays in the table cache.  Together with a
+	// writebuffermanager built on the same cache, the capacity of the
+	// cache then bounds most of the memory of the DBs sharing it.
+	//
+	// Default: false
+	bool reservetablereadermemory;
+
+	// A large compaction is split into up to this many disjoint key
+	// ranges which are compacted by separate threads and installed
+	// together as a single version edit.  1 disables the split.
+	//
+	// Default: 4
+	int maxsubcompactions;
+
+	// DB::Open() grows the pools of the env that run compactions (LOW)
+	// and flushes (HIGH) to at least this many threads.  A DB runs one
+	// compaction and one flush at a time, so these bound how many of the
+	// DBs sharing the env compact or flush at once.  A pool is never
+	// shrunk; see Env::SetBackgroundThreads() for that.
+	//
+	// Default: 4 and 2
+	int maxbackgroundcompactions;
+	int maxbackgroundflushes;
+
+	// Number of threads that decode the batches of the logs DB::Open()
+	// replays and insert them into memtables, concurrently.  Meanwhile
+	// the opening thread reads and checksums the log, and one more thread
+	// writes the memtables that fill up to level-0 tables.  1 replays
+	// everything on the opening thread.  No more threads than cores are
+	// used.
+	//
+	// Default: 4
+	int recoverythreads;
+
+	// If true, every data block carries a small hash index from user key
+	// to restart interval, which lets point lookups skip the binary
+	// search over the restart array.  Blocks written without it remain
+	// readable either way.  Requires a comparator that treats two user
+	// keys as equal only if their bytes are equal.
+	//
+	// Default: false
+	bool blockhashindex;
+
+	// If non-null, every compaction gets a filter from this factory
+	// that may drop values the application knows to be unreachable.
+	//
+	// Default: nullptr
+	std::shared_ptr<CompactionFilterFactory> compactionfilterfactory;
+
+	// If true, flushes and compactions move every value of at least
+	// minblobsize bytes out of the tables into append-only blob files
+	// of about blobfilesize bytes, and leave only a small reference in
+	// the tree.  Compactions then rewrite the keys but not the large
+	// values.  Reads resolve the reference transparently.  Values
+	// already in blob files stay readable when this is turned off.
+	//
+	// Default: false
+	bool enableblobfiles;
+	size_t minblobsize;
+	uint64_t blobfilesize;
+
+	// Compactions relocate the still live values of the oldest
+	// blobgcagecutoff fraction of blob files into new ones, so that
+	// a file whose values have all been overwritten or deleted can be
+	// removed.  0 disables relocation.  If the garbage in those files
+	// reaches blobgcforcethreshold of their size, the tables that
+	// point into them are compacted even if the tree does not ask for it.
+	//
+	// Default: 0.25 and 0.5
+	double blobgcagecutoff;
+	double blobgcforcethreshold;
+
+	// If non-null, DB::Merge() is allowed and reads and compactions use
+	// this operator to fold merge operands onto the values below them.
+	//
+	// REQUIRES: every DB that was given merge operands is opened with an
+	// operator that understands them.
+	//
+	// Default: nullptr
+	std::shared_ptr<MergeOperator> mergeoperator;
+
 	// Create an Options object with default values for all fields.
 	Options();
+
+	// The codec for tables written to "level".
+	CompressionType CompressionForLevel(int level) const;
 };
 
 // Options that control read operations
 struct ReadOptions {
 	// If true, all data read from underlying storage will be
-	// verified against corresponding checksums.
-	// Default: false
+	// verified against corresponding checksums.  See also
+	// Options::verifychecksumsonce.
+	// Default: true
 	bool verifychecksums;
 
 	// Should the data read for this iteration be cached in memory?
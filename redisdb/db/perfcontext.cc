@@ -0,0 +1,77 @@
+#include "perfcontext.h"
+#include <stdio.h>
+#include <chrono>
+
+static thread_local PerfLevel perflevel = kPerfCountOnly;
+static thread_local PerfContext perfcontext;
+
+static uint64_t NowNanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SetPerfLevel(PerfLevel level) {
+	perflevel = level;
+}
+
+PerfLevel GetPerfLevel() {
+	return perflevel;
+}
+
+PerfContext* GetPerfContext() {
+	return &perfcontext;
+}
+
+void PerfContext::Reset() {
+	getfrommemtablecount = 0;
+	blockcachehitcount = 0;
+	blockreadcount = 0;
+	blockreadbyte = 0;
+	getfrommemtabletime = 0;
+	getfromfilestime = 0;
+	indexseektime = 0;
+	blockreadtime = 0;
+	blockchecksumtime = 0;
+	blockdecompresstime = 0;
+	writewaltime = 0;
+	writememtabletime = 0;
+	writedelaytime = 0;
+}
+
+std::string PerfContext::ToString() const {
+	char buf[800];
+	snprintf(buf, sizeof(buf),
+		"getfrommemtablecount = %llu, blockcachehitcount = %llu, "
+		"blockreadcount = %llu, blockreadbyte = %llu, "
+		"getfrommemtabletime = %llu, getfromfilestime = %llu, "
+		"indexseektime = %llu, blockreadtime = %llu, "
+		"blockchecksumtime = %llu, blockdecompresstime = %llu, "
+		"writewaltime = %llu, writememtabletime = %llu, writedelaytime = %llu",
+		static_cast<unsigned long long>(getfrommemtablecount),
+		static_cast<unsigned long long>(blockcachehitcount),
+		static_cast<unsigned long long>(blockreadcount),
+		static_cast<unsigned long long>(blockreadbyte),
+		static_cast<unsigned long long>(getfrommemtabletime),
+		static_cast<unsigned long long>(getfromfilestime),
+		static_cast<unsigned long long>(indexseektime),
+		static_cast<unsigned long long>(blockreadtime),
+		static_cast<unsigned long long>(blockchecksumtime),
+		static_cast<unsigned long long>(blockdecompresstime),
+		static_cast<unsigned long long>(writewaltime),
+		static_cast<unsigned long long>(writememtabletime),
+		static_cast<unsigned long long>(writedelaytime));
+	return buf;
+}
+
+PerfTimer::PerfTimer(uint64_t* metric)
+	: metric(perflevel >= kPerfEnableTime ? metric : nullptr),
+	start(this->metric != nullptr ? NowNanos() : 0) {
+
+}
+
+void PerfTimer::Stop() {
+	if (metric != nullptr) {
+		*metric += NowNanos() - start;
+		metric = nullptr;
+	}
+}
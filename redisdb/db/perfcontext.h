@@ -0,0 +1,64 @@
+#pragma once
+
+// PerfContext breaks down where the calling thread spends the time of
+// its own operations.  Counts are always kept; timings are only taken
+// after SetPerfLevel(kPerfEnableTime), since reading the clock around
+// every block access is not free.  Reset() before the operation of
+// interest and read the fields (or ToString()) after it, or use
+// DB::GetProperty("leveldb.perf-context") from the same thread.
+
+#include <stdint.h>
+#include <string>
+
+enum PerfLevel {
+	kPerfCountOnly = 1,
+	kPerfEnableTime = 2
+};
+
+// Both apply to the calling thread only.
+void SetPerfLevel(PerfLevel level);
+
+PerfLevel GetPerfLevel();
+
+struct PerfContext {
+	void Reset();
+
+	std::string ToString() const;
+
+	// Counts
+	uint64_t getfrommemtablecount;    // Get()s answered by a memtable
+	uint64_t blockcachehitcount;
+	uint64_t blockreadcount;          // Blocks read from table files
+	uint64_t blockreadbyte;
+
+	// Times, in nanoseconds
+	uint64_t getfrommemtabletime;     // Probing the memtables
+	uint64_t getfromfilestime;        // Looking up the table files
+	uint64_t indexseektime;           // Seeking table index blocks
+	uint64_t blockreadtime;           // Reading blocks from the files
+	uint64_t blockchecksumtime;
+	uint64_t blockdecompresstime;
+	uint64_t writewaltime;            // Appending to and syncing the log
+	uint64_t writememtabletime;
+	uint64_t writedelaytime;          // Throttled or stopped writes
+};
+
+// The calling thread's context.
+PerfContext* GetPerfContext();
+
+// Adds the time between construction and Stop() (or destruction) to
+// *metric when the perf level is kPerfEnableTime.
+class PerfTimer {
+public:
+	explicit PerfTimer(uint64_t* metric);
+
+	~PerfTimer() {
+		Stop();
+	}
+
+	void Stop();
+
+private:
+	uint64_t* metric;
+	uint64_t start;
+};
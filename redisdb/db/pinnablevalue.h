@@ -0,0 +1,95 @@
+#pragma once
+
+// A PinnableValue is what DB::Get() returns a value in without copying
+// it.  A value read from a data block or a memtable is left where it is
+// and the block, the mmap of its file or the memtable is kept alive,
+// "pinned", until the value is reset or destroyed.  A value that has to
+// be built, because it was folded from merge operands or read from a
+// blob file, is stored in a buffer of the value itself instead.
+//
+// A pinned value holds the memory of its whole block or memtable, even
+// after the block is evicted from the cache or the memtable is flushed,
+// so it should not be kept for long.
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <assert.h>
+
+class PinnableValue {
+public:
+	PinnableValue()
+		: buf(&self) {
+
+	}
+
+	// Uses *buf instead of a buffer of its own when the value has to be
+	// copied, so that a caller that wants a std::string anyway can avoid
+	// a second copy.
+	explicit PinnableValue(std::string* buf)
+		: buf(buf) {
+
+	}
+
+	~PinnableValue() {
+
+	}
+
+	// Point at "v", which stays valid for as long as "holder" lives.
+	void PinSlice(const std::string_view& v, const std::shared_ptr<void>& holder) {
+		assert(holder != nullptr);
+		value = v;
+		pin = holder;
+	}
+
+	// Point at the contents of the buffer returned by GetSelf().
+	void PinSelf() {
+		value = *buf;
+		pin.reset();
+	}
+
+	// Copy "v" into the buffer and point at it.
+	void PinSelf(const std::string_view& v) {
+		buf->assign(v.data(), v.size());
+		PinSelf();
+	}
+
+	// The buffer to build a value in before calling PinSelf().
+	std::string* GetSelf() { return buf; }
+
+	// Drop the value and release whatever it pinned.
+	void Reset() {
+		value = std::string_view();
+		pin.reset();
+	}
+
+	// Returns true iff the value points into memory it pins rather than
+	// into its buffer.
+	bool IsPinned() const { return pin != nullptr; }
+
+	void RemoveSuffix(size_t n) {
+		assert(n <= value.size());
+		value.remove_suffix(n);
+	}
+
+	const char* data() const { return value.data(); }
+
+	size_t size() const { return value.size(); }
+
+	bool empty() const { return value.empty(); }
+
+	std::string_view ToStringView() const { return value; }
+
+	std::string ToString() const { return std::string(value.data(), value.size()); }
+
+private:
+	std::string_view value;
+	std::string self;
+	std::string* buf;
+	std::shared_ptr<void> pin;
+
+	// No copying allowed
+	PinnableValue(const PinnableValue&);
+
+	void operator=(const PinnableValue&);
+};
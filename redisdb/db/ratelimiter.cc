@@ -0,0 +1,188 @@
+#include "ratelimiter.h"
+#include <assert.h>
+#include <chrono>
+
+// Serve low priority first every kFairness periods.
+static const uint64_t kFairness = 10;
+
+// Re-evaluate the rate about once a second when auto-tuning.
+static const int64_t kTunePeriodMicros = 1000 * 1000;
+
+// Auto-tuning never goes below this fraction of the configured rate.
+static const int64_t kMinRateDivisor = 20;
+
+struct RateLimiter::Req {
+	int64_t bytes;
+	bool granted;
+
+	explicit Req(int64_t bytes)
+		: bytes(bytes),
+		granted(false) {
+
+	}
+};
+
+RateLimiter::RateLimiter(int64_t bytespersecond, int64_t refillperiodmicros, bool autotune)
+	: refillperiod(refillperiodmicros > 0 ? refillperiodmicros : 100 * 1000),
+	autotune(autotune),
+	maxrate(bytespersecond > 0 ? bytespersecond : 1),
+	rate(maxrate),
+	available(0),
+	nextrefill(NowMicros()),
+	lasttune(nextrefill),
+	refills(0),
+	fgmicros(0),
+	fgcount(0),
+	baseline(0) {
+	for (int i = 0; i < kIOTotal; i++) {
+		totalbytes[i] = 0;
+		totalrequests[i] = 0;
+	}
+}
+
+int64_t RateLimiter::NowMicros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t RateLimiter::BurstBytes() const {
+	int64_t burst = rate * refillperiod / 1000000;
+	return burst > 0 ? burst : 1;
+}
+
+void RateLimiter::SetBytesPerSecond(int64_t bytespersecond) {
+	std::unique_lock<std::mutex> lk(mutex);
+	maxrate = bytespersecond > 0 ? bytespersecond : 1;
+	rate = maxrate;
+}
+
+int64_t RateLimiter::GetBytesPerSecond() const {
+	std::unique_lock<std::mutex> lk(mutex);
+	return rate;
+}
+
+int64_t RateLimiter::GetTotalBytesThrough(IOPriority pri) const {
+	std::unique_lock<std::mutex> lk(mutex);
+	return totalbytes[pri];
+}
+
+int64_t RateLimiter::GetTotalRequests(IOPriority pri) const {
+	std::unique_lock<std::mutex> lk(mutex);
+	return totalrequests[pri];
+}
+
+void RateLimiter::RecordForegroundLatency(uint64_t micros) {
+	if (autotune) {
+		fgmicros.fetch_add(micros, std::memory_order_relaxed);
+		fgcount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void RateLimiter::Request(int64_t bytes, IOPriority pri) {
+	assert(pri < kIOTotal);
+	std::unique_lock<std::mutex> lk(mutex);
+	while (bytes > 0) {
+		const int64_t n = (bytes < BurstBytes()) ? bytes : BurstBytes();
+		bytes -= n;
+		totalbytes[pri] += n;
+		totalrequests[pri]++;
+
+		// Fast path: nobody is waiting and the period has room.
+		Refill(NowMicros());
+		if (queue[kIOHigh].empty() && queue[kIOLow].empty() && available >= n) {
+			available -= n;
+			continue;
+		}
+
+		Req r(n);
+		queue[pri].push_back(&r);
+		while (!r.granted) {
+			// Whoever wakes up after the end of the period hands out
+			// the next one.
+			cv.wait_until(lk, std::chrono::steady_clock::time_point(
+				std::chrono::microseconds(nextrefill)));
+			Refill(NowMicros());
+		}
+	}
+}
+
+// REQUIRES: mutex is held
+void RateLimiter::Refill(int64_t now) {
+	if (now < nextrefill) {
+		return;
+	}
+
+	if (autotune && now - lasttune >= kTunePeriodMicros) {
+		Tune();
+		lasttune = now;
+	}
+
+	refills++;
+	nextrefill = now + refillperiod;
+	available = BurstBytes();
+
+	const bool lowfirst = (refills % kFairness == 0);
+	const IOPriority order[kIOTotal] = {
+		lowfirst ? kIOLow : kIOHigh,
+		lowfirst ? kIOHigh : kIOLow
+	};
+
+	bool granted = false;
+	for (IOPriority pri : order) {
+		std::deque<Req*>& q = queue[pri];
+		while (!q.empty()) {
+			// The head of a fresh period is always served, even if the
+			// rate was lowered after it was split into pieces.
+			Req* r = q.front();
+			if (r->bytes > available && available < BurstBytes()) {
+				break;
+			}
+
+			available -= r->bytes;
+			r->granted = true;
+			q.pop_front();
+			granted = true;
+		}
+
+		if (!q.empty()) {
+			break;   // Keep requests in order: nothing of lower priority jumps ahead
+		}
+	}
+
+	if (granted || !queue[kIOHigh].empty() || !queue[kIOLow].empty()) {
+		cv.notify_all();
+	}
+}
+
+// REQUIRES: mutex is held
+void RateLimiter::Tune() {
+	const uint64_t count = fgcount.exchange(0, std::memory_order_relaxed);
+	const uint64_t micros = fgmicros.exchange(0, std::memory_order_relaxed);
+	if (count == 0) {
+		return;
+	}
+
+	// Let the baseline drift up slowly so that it follows a workload
+	// that simply got slower, not only interference from background I/O.
+	const double average = static_cast<double>(micros) / count;
+	if (baseline == 0 || average < baseline) {
+		baseline = average;
+	}
+	else {
+		baseline += (average - baseline) / 64;
+	}
+
+	const int64_t minrate = (maxrate / kMinRateDivisor > 0) ? maxrate / kMinRateDivisor : 1;
+	if (average > 2 * baseline) {
+		rate = rate * 3 / 4;
+		if (rate < minrate) {
+			rate = minrate;
+		}
+	}
+	else if (average < 1.25 * baseline) {
+		rate = rate * 5 / 4 + 1;
+		if (rate > maxrate) {
+			rate = maxrate;
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// RateLimiter caps the bandwidth of background writes so that flushes
+// and compactions do not starve foreground I/O on the same device.
+// Table files written by flushes and compactions charge every write
+// against it (see WritableFile::SetRateLimiter).
+//
+// Bytes are handed out in refill periods: each period makes
+// bytespersecond * refillperiod worth of bytes available, which go to
+// high priority (flush) requests before low priority (compaction)
+// ones.  Every kFairness-th period serves low priority first so that
+// compactions cannot be starved completely.
+//
+// With auto-tuning, the DB reports foreground latencies and the limiter
+// lowers its rate while they are well above the best recently seen,
+// and raises it back towards the configured rate when they recover.
+//
+// Thread safe.
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+enum IOPriority {
+	kIOLow = 0,    // Compaction output
+	kIOHigh = 1,   // Flush output
+	kIOTotal = 2
+};
+
+class RateLimiter {
+public:
+	RateLimiter(int64_t bytespersecond, int64_t refillperiodmicros = 100 * 1000,
+		bool autotune = false);
+
+	RateLimiter(const RateLimiter&) = delete;
+
+	void operator=(const RateLimiter&) = delete;
+
+	// Block until "bytes" may be written at priority "pri".  Requests
+	// larger than one refill period are served in several pieces.
+	void Request(int64_t bytes, IOPriority pri);
+
+	// Change the limit.  With auto-tuning this is the upper bound.
+	void SetBytesPerSecond(int64_t bytespersecond);
+
+	// The limit currently in effect.
+	int64_t GetBytesPerSecond() const;
+
+	bool IsAutoTuned() const { return autotune; }
+
+	// Report the latency of a foreground operation; only used for
+	// auto-tuning.  Cheap enough to call on every read.
+	void RecordForegroundLatency(uint64_t micros);
+
+	int64_t GetTotalBytesThrough(IOPriority pri) const;
+
+	int64_t GetTotalRequests(IOPriority pri) const;
+
+private:
+	struct Req;
+
+	int64_t BurstBytes() const;
+
+	void Refill(int64_t now);
+
+	void Tune();
+
+	static int64_t NowMicros();
+
+	const int64_t refillperiod;
+	const bool autotune;
+
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	int64_t maxrate;              // Configured bytes per second
+	int64_t rate;                 // Effective bytes per second
+	int64_t available;            // Bytes left in this period
+	int64_t nextrefill;           // Start of the next period, in micros
+	int64_t lasttune;
+	uint64_t refills;
+	std::deque<Req*> queue[kIOTotal];
+	int64_t totalbytes[kIOTotal];
+	int64_t totalrequests[kIOTotal];
+
+	// Foreground latencies since the last Tune().
+	std::atomic<uint64_t> fgmicros;
+	std::atomic<uint64_t> fgcount;
+	double baseline;              // Best recent average foreground latency
+};
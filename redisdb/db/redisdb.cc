@@ -1,10 +1,40 @@
 #include "redisdb.h"
 #include "comparator.h"
-
-RedisDB::RedisDB(const Options& options, const std::string& path)
+#include "hash.h"
+#include "sharedlog.h"
+#include <algorithm>
+
+// Ids of the types in the log they share.  These are written to the
+// log and must not change.
+static const uint32_t kStringsLogId = 0;
+static const uint32_t kHashesLogId = 1;
+static const uint32_t kZSetsLogId = 2;
+static const uint32_t kListsLogId = 3;
+static const uint32_t kSetsLogId = 4;
+static const uint32_t kNumLogIds = 5;
+
+RedisDB::RedisDB(const Options& options, const std::string& path, int numshards,
+	bool usesharedlog)
 	:options(options),
-	path(path) {
+	path(path),
+	numshards(numshards > 0 ? numshards : 1),
+	usesharedlog(usesharedlog) {
+
+}
 
+size_t RedisDB::ShardOf(const std::string_view& key) const {
+	if (numshards == 1) {
+		return 0;
+	}
+	return Hash(key.data(), key.size(), 0x5eed5eed) % numshards;
+}
+
+std::string RedisDB::ShardPath(const std::string& name, int shard) const {
+	// A single shard keeps the layout of an unsharded database.
+	if (numshards == 1) {
+		return path + "/" + name;
+	}
+	return path + "/" + name + "/" + std::to_string(shard);
 }
 
 RedisDB::~RedisDB() {
@@ -34,93 +64,141 @@ Status RedisDB::DestoryDB(const std::string path, const Options& options) {
 Status RedisDB::Open() {
 	options.env->CreateDir(path);
 
-	{
-		Options ops = options;
-		redisstring.reset(new RedisString(this, ops, path + "/strings"));
-		Status s = redisstring->Open();
-		assert(s.ok());
+	// Most commands probe for an existing key before writing (HSETNX, SADD,
+	// ZADD ...), so every type gets a bloom filter unless the caller chose one.
+	Options base = options;
+	if (base.filterpolicy == nullptr) {
+		base.filterpolicy = NewBloomFilterPolicy(10);
 	}
 
-	{
-		Options ops = options;
-		redishash.reset(new RedisHash(this, ops, path + "/hash"));
-		Status s = redishash->Open();
-		assert(s.ok());
+	// One cache for every store, rather than one each, so that a busy
+	// type can use the memory an idle one does not need.
+	if (base.blockcache == nullptr) {
+		base.blockcache = NewLRUCache(8 << 20);
 	}
 
-	{
-		Options ops = options;
-		ops.comparator = ZSetsScoreKeyComparator();
-		rediszset.reset(new RedisZset(this, ops, path + "/zset"));
-		Status s = rediszset->Open();
-		assert(s.ok());
+	if (numshards > 1) {
+		const char* names[] = { "strings", "hash", "zset", "list", "set", "wal" };
+		for (const char* name : names) {
+			options.env->CreateDir(path + "/" + name);
+		}
 	}
 
-	{
-		Options ops = options;
-		ops.comparator = ListsDataKeyComparator();
-		redislist.reset(new RedisList(this, ops, path + "/list"));
-		Status s = redislist->Open();
-		assert(s.ok());
-	}
+	for (int i = 0; i < numshards; i++) {
+		// The five types of a shard share one log.
+		Options ops = base;
+		if (usesharedlog) {
+			ops.sharedlog.reset(new SharedLog(base, ShardPath("wal", i), kNumLogIds));
+			Status s = ops.sharedlog->Open();
+			assert(s.ok());
+			sharedlogs.push_back(ops.sharedlog);
+		}
+
+		{
+			ops.sharedlogid = kStringsLogId;
+			std::shared_ptr<RedisString> shard(new RedisString(this, ops, ShardPath("strings", i)));
+			Status s = shard->Open();
+			assert(s.ok());
+			redisstrings.push_back(shard);
+		}
+
+		{
+			ops.sharedlogid = kHashesLogId;
+			std::shared_ptr<RedisHash> shard(new RedisHash(this, ops, ShardPath("hash", i)));
+			Status s = shard->Open();
+			assert(s.ok());
+			redishashes.push_back(shard);
+		}
 
-	{
-		redisset.reset(new RedisSet(this, options, path + "/set"));
-		Status s = redisset->Open();
-		assert(s.ok());
+		{
+			Options zsetops = ops;
+			zsetops.comparator = ZSetsScoreKeyComparator();
+			zsetops.sharedlogid = kZSetsLogId;
+			std::shared_ptr<RedisZset> shard(new RedisZset(this, zsetops, ShardPath("zset", i)));
+			Status s = shard->Open();
+			assert(s.ok());
+			rediszsets.push_back(shard);
+		}
+
+		{
+			Options listops = ops;
+			listops.comparator = ListsDataKeyComparator();
+			listops.sharedlogid = kListsLogId;
+			std::shared_ptr<RedisList> shard(new RedisList(this, listops, ShardPath("list", i)));
+			Status s = shard->Open();
+			assert(s.ok());
+			redislists.push_back(shard);
+		}
+
+		{
+			ops.sharedlogid = kSetsLogId;
+			std::shared_ptr<RedisSet> shard(new RedisSet(this, ops, ShardPath("set", i)));
+			Status s = shard->Open();
+			assert(s.ok());
+			redissets.push_back(shard);
+		}
 	}
 	return Status::OK();
 }
 
 int64_t RedisDB::Del(const std::vector<std::string>& keys, std::map<DataType, Status>* typestatus) {
-	Status s;
 	int64_t count = 0;
 	bool iscorruption = false;
 
 	for (const auto& key : keys) {
-		// Strings
-		Status s = redisstring->Del(key);
-		if (s.ok()) {
-			count++;
-		} else if (!s.IsNotFound()) {
-			iscorruption = true;
-			(*typestatus)[DataType::kStrings] = s;
-		}
-
-		// Hashes
-		s = redishash->Del(key);
-		if (s.ok()) {
-			count++;
-		} else if (!s.IsNotFound()) {
-			iscorruption = true;
-			(*typestatus)[DataType::kHashes] = s;
-		}
-
-		// Sets
-		s = redisset->Del(key);
-		if (s.ok()) {
-			count++;
-		} else if (!s.IsNotFound()) {
-			iscorruption = true;
-			(*typestatus)[DataType::kSets] = s;
+		const size_t shard = ShardOf(key);
+		RedisString* strings = redisstrings[shard].get();
+		RedisHash* hashes = redishashes[shard].get();
+		RedisSet* sets = redissets[shard].get();
+		RedisList* lists = redislists[shard].get();
+		RedisZset* zsets = rediszsets[shard].get();
+
+		// Hold the key in every type, always in this order, until all
+		// of its deletions are written.
+		HashLock stringslock(strings->GetLockMgr(), key);
+		HashLock hasheslock(hashes->GetLockMgr(), key);
+		HashLock setslock(sets->GetLockMgr(), key);
+		HashLock listslock(lists->GetLockMgr(), key);
+		HashLock zsetslock(zsets->GetLockMgr(), key);
+
+		WriteBatch stringsbatch;
+		WriteBatch hashesbatch;
+		WriteBatch setsbatch;
+		WriteBatch listsbatch;
+		WriteBatch zsetsbatch;
+		std::map<DataType, Status> found;
+		found[DataType::kStrings] = strings->Del(key, &stringsbatch);
+		found[DataType::kHashes] = hashes->Del(key, &hashesbatch);
+		found[DataType::kSets] = sets->Del(key, &setsbatch);
+		found[DataType::kLists] = lists->Del(key, &listsbatch);
+		found[DataType::kZSets] = zsets->Del(key, &zsetsbatch);
+
+		std::vector<std::pair<DB*, WriteBatch*>> updates;
+		std::pair<DB*, WriteBatch*> batches[] = {
+			{ strings->GetDB(), &stringsbatch },
+			{ hashes->GetDB(), &hashesbatch },
+			{ sets->GetDB(), &setsbatch },
+			{ lists->GetDB(), &listsbatch },
+			{ zsets->GetDB(), &zsetsbatch },
+		};
+
+		for (const auto& batch : batches) {
+			if (WriteBatchInternal::Count(batch.second) > 0) {
+				updates.push_back(batch);
+			}
 		}
 
-		// Lists
-		s = redislist->Del(key);
-		if (s.ok()) {
-			count++;
-		} else if (!s.IsNotFound()) {
-			iscorruption = true;
-			(*typestatus)[DataType::kLists] = s;
-		}
-
-		// ZSets
-		s = rediszset->Del(key);
-		if (s.ok()) {
-			count++;
-		} else if (!s.IsNotFound()) {
-			iscorruption = true;
-			(*typestatus)[DataType::kZSets] = s;
+		Status s = Write(updates);
+		for (const auto& it : found) {
+			if (it.second.ok() && s.ok()) {
+				count++;
+			} else if (it.second.ok()) {
+				iscorruption = true;
+				(*typestatus)[it.first] = s;
+			} else if (!it.second.IsNotFound()) {
+				iscorruption = true;
+				(*typestatus)[it.first] = it.second;
+			}
 		}
 	}
 
@@ -131,123 +209,243 @@ int64_t RedisDB::Del(const std::vector<std::string>& keys, std::map<DataType, St
 	}
 }
 
+Status RedisDB::Write(const std::vector<std::pair<DB*, WriteBatch*>>& updates) {
+	if (updates.empty()) {
+		return Status::OK();
+	}
+	else if (usesharedlog) {
+		return DB::AtomicWrite(WriteOptions(), updates);
+	}
+
+	Status s;
+	for (const auto& update : updates) {
+		s = update.first->Write(WriteOptions(), update.second);
+		if (!s.ok()) {
+			break;
+		}
+	}
+	return s;
+}
+
 Status RedisDB::BitPos(const std::string_view& key, int32_t bit, int64_t* ret) {
-	return redisstring->BitPos(key, bit, ret);
+	return StringsShard(key)->BitPos(key, bit, ret);
 }
 
 Status RedisDB::BitPos(const std::string_view& key, int32_t bit,
 		int64_t startoffset, int64_t* ret) {
-	return redisstring->BitPos(key, bit, startoffset, ret);		
+	return StringsShard(key)->BitPos(key, bit, startoffset, ret);		
 }
 
 Status RedisDB::BitPos(const std::string_view& key, int32_t bit,
 		int64_t startoffset, int64_t endoffset,
 		int64_t* ret) {
-	return redisstring->BitPos(key, bit, startoffset, endoffset, ret);				
+	return StringsShard(key)->BitPos(key, bit, startoffset, endoffset, ret);				
 }
 
 Status RedisDB::Decrby(const std::string_view& key, int64_t value, int64_t* ret) {
-	return redisstring->Decrby(key, value, ret);		
+	return StringsShard(key)->Decrby(key, value, ret);		
 }
 
 Status RedisDB::Incrby(const std::string_view& key, int64_t value, int64_t* ret) {
-	return redisstring->Incrby(key, value, ret);		
+	return StringsShard(key)->Incrby(key, value, ret);		
+}
+
+Status RedisDB::Incrbyfloat(const std::string_view& key, const std::string_view& value, std::string* ret) {
+	return StringsShard(key)->Incrbyfloat(key, value, ret);
 }
 
 Status RedisDB::Setex(const std::string_view& key, const std::string_view& value, int32_t ttl) {
-	return redisstring->Setex(key, value, ttl);		
+	return StringsShard(key)->Setex(key, value, ttl);		
 }
 
 Status RedisDB::Strlen(const std::string_view& key, int32_t* len) {
-	return redisstring->Strlen(key, len);		
+	return StringsShard(key)->Strlen(key, len);		
 }
 
 Status RedisDB::Set(const std::string_view& key,
 	const std::string_view& value) {
-	return redisstring->Set(key, value);
+	return StringsShard(key)->Set(key, value);
 }
 
 Status RedisDB::Get(const std::string_view& key, std::string* value) {
-	return redisstring->Get(key, value);
+	return StringsShard(key)->Get(key, value);
+}
+
+Status RedisDB::Get(const std::string_view& key, PinnableValue* value) {
+	return StringsShard(key)->Get(key, value);
 }
 
 Status RedisDB::GetSet(const std::string_view& key, 
 	const std::string_view& value, std::string* oldValue) {
-	return redisstring->GetSet(key, value, oldValue);
+	return StringsShard(key)->GetSet(key, value, oldValue);
 }
 
 Status RedisDB::Setxx(const std::string_view& key, 
 	const std::string_view& value, int32_t* ret, const int32_t ttl) {
-	return redisstring->Setxx(key, value, ret, ttl);
+	return StringsShard(key)->Setxx(key, value, ret, ttl);
 }
 
 Status RedisDB::SetBit(const std::string_view& key, 
 	int64_t offset, int32_t value, int32_t* ret) {
-	return redisstring->SetBit(key, offset, value, ret);
+	return StringsShard(key)->SetBit(key, offset, value, ret);
 }
 
 Status RedisDB::GetBit(const std::string_view& key, int64_t offset, int32_t* ret) {
-	return redisstring->GetBit(key, offset, ret);
+	return StringsShard(key)->GetBit(key, offset, ret);
 }
 
 Status RedisDB::MSet(const std::vector<KeyValue>& kvs) {
-	return redisstring->MSet(kvs);
+	if (numshards == 1) {
+		return redisstrings[0]->MSet(kvs);
+	}
+
+	std::vector<std::vector<KeyValue>> shards(numshards);
+	for (const auto& kv : kvs) {
+		shards[ShardOf(kv.key)].push_back(kv);
+	}
+
+	Status s;
+	for (int i = 0; i < numshards && s.ok(); i++) {
+		if (!shards[i].empty()) {
+			s = redisstrings[i]->MSet(shards[i]);
+		}
+	}
+	return s;
 }
 
 Status RedisDB::MGet(const std::vector<std::string>& keys,
 	std::vector<ValueStatus>* vss) {
-	return redisstring->MGet(keys, vss);
+	if (numshards == 1) {
+		return redisstrings[0]->MGet(keys, vss);
+	}
+
+	// Look up each shard's keys in one batch, then put the results back
+	// in the order of "keys".
+	std::vector<std::vector<std::string>> shardkeys(numshards);
+	std::vector<std::vector<size_t>> positions(numshards);
+	for (size_t i = 0; i < keys.size(); i++) {
+		const size_t shard = ShardOf(keys[i]);
+		shardkeys[shard].push_back(keys[i]);
+		positions[shard].push_back(i);
+	}
+
+	vss->assign(keys.size(), ValueStatus());
+	std::vector<ValueStatus> shardvss;
+	for (int i = 0; i < numshards; i++) {
+		if (shardkeys[i].empty()) {
+			continue;
+		}
+
+		Status s = redisstrings[i]->MGet(shardkeys[i], &shardvss);
+		if (!s.ok()) {
+			vss->clear();
+			return s;
+		}
+
+		for (size_t j = 0; j < shardvss.size(); j++) {
+			(*vss)[positions[i][j]] = std::move(shardvss[j]);
+		}
+	}
+	return Status::OK();
 }
 
 Status RedisDB::Setnx(const std::string_view& key,
 	const std::string_view& value, int32_t* ret, const int32_t ttl) {
-	return redisstring->Setnx(key, value, ret, ttl);
+	return StringsShard(key)->Setnx(key, value, ret, ttl);
 }
 
 Status RedisDB::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
-	return redisstring->MSetnx(kvs, ret);
+	if (numshards == 1) {
+		return redisstrings[0]->MSetnx(kvs, ret);
+	}
+
+	std::vector<std::vector<KeyValue>> shards(numshards);
+	std::vector<std::vector<std::string>> shardkeys(numshards);
+	for (const auto& kv : kvs) {
+		const size_t shard = ShardOf(kv.key);
+		shards[shard].push_back(kv);
+		shardkeys[shard].push_back(kv.key);
+	}
+
+	// Lock the keys in every shard involved, in shard order, and hold
+	// them all from the check until the last write.
+	*ret = 0;
+	std::vector<std::shared_ptr<MultiHashLock>> locks;
+	for (int i = 0; i < numshards; i++) {
+		if (!shards[i].empty()) {
+			locks.push_back(std::shared_ptr<MultiHashLock>(
+				new MultiHashLock(redisstrings[i]->GetLockMgr(), shardkeys[i])));
+		}
+	}
+
+	std::vector<WriteBatch> batches(numshards);
+	for (int i = 0; i < numshards; i++) {
+		if (shards[i].empty()) {
+			continue;
+		}
+
+		bool exists;
+		Status s = redisstrings[i]->MSetnx(shards[i], &exists, &batches[i]);
+		if (!s.ok() || exists) {
+			return s;
+		}
+	}
+
+	for (int i = 0; i < numshards; i++) {
+		if (!shards[i].empty()) {
+			Status s = redisstrings[i]->GetDB()->Write(WriteOptions(), &batches[i]);
+			if (!s.ok()) {
+				return s;
+			}
+		}
+	}
+
+	*ret = 1;
+	return Status::OK();
 }
 
 Status RedisDB::Setvx(const std::string_view& key, const std::string_view& value,
 	const std::string_view& newValue, int32_t* ret, const int32_t ttl) {
-	return redisstring->Setvx(key, value, newValue, ret, ttl);
+	return StringsShard(key)->Setvx(key, value, newValue, ret, ttl);
 }
 
 Status RedisDB::Delvx(const std::string_view& key, const std::string_view& value, int32_t* ret) {
-	return redisstring->Delvx(key, value, ret);
+	return StringsShard(key)->Delvx(key, value, ret);
 }
 
 Status RedisDB::Setrange(const std::string_view& key, int64_t startoffset,
 	const std::string_view& value, int32_t* ret) {
-	return redisstring->Setrange(key, startoffset, value, ret);
+	return StringsShard(key)->Setrange(key, startoffset, value, ret);
 }
 
 Status RedisDB::Getrange(const std::string_view& key, int64_t startoffset, int64_t endoffset,
 	std::string* ret) {
-	return redisstring->Getrange(key, startoffset, endoffset, ret);
+	return StringsShard(key)->Getrange(key, startoffset, endoffset, ret);
 }
 
 Status RedisDB::Append(const std::string_view& key, const std::string_view& value, int32_t* ret) {
-	return redisstring->Append(key, value, ret);
+	return StringsShard(key)->Append(key, value, ret);
 }
 
 Status RedisDB::BitCount(const std::string_view& key, int64_t startoffset, int64_t endoffset,
 				int32_t* ret, bool haveoffset) {
-	return redisstring->BitCount(key, startoffset, endoffset, ret, haveoffset);				
+	return StringsShard(key)->BitCount(key, startoffset, endoffset, ret, haveoffset);				
 }
 
 Status RedisDB::BitOp(BitOpType op, const std::string& destkey,
 			const std::vector<std::string>& srckeys, int64_t* ret) {
-	return redisstring->BitOp(op, destkey, srckeys, ret);		
+	// Not implemented by RedisString yet; goes to the shard of the
+	// destination key.
+	return StringsShard(destkey)->BitOp(op, destkey, srckeys, ret);		
 }
 
 Status RedisDB::HSet(const std::string_view& key,
 	const std::string_view& field, const std::string_view& value, int32_t* res) {
-	return redishash->HSet(key, field, value, res);
+	return HashesShard(key)->HSet(key, field, value, res);
 }
 
 Status RedisDB::HGetall(const std::string_view& key, std::vector<FieldValue>* fvs) {
-	return redishash->HGetall(key, fvs);
+	return HashesShard(key)->HGetall(key, fvs);
 }
 
 Status RedisDB::HKeys(const std::string_view& key, std::vector<std::string>* fields) {
@@ -255,7 +453,7 @@ Status RedisDB::HKeys(const std::string_view& key, std::vector<std::string>* fie
 }
 
 Status RedisDB::HMSet(const std::string_view& key,const std::vector<FieldValue>& fvs) {
-	return redishash->HMSet(key, fvs);
+	return HashesShard(key)->HMSet(key, fvs);
 }
 
 Status RedisDB::HVals(const std::string_view& key, std::vector<std::string>* values) {
@@ -263,12 +461,16 @@ Status RedisDB::HVals(const std::string_view& key, std::vector<std::string>* val
 }
 
 Status RedisDB::HGet(const std::string_view& key, const std::string_view& field, std::string* value) {
-	return redishash->HGet(key, field, value);
+	return HashesShard(key)->HGet(key, field, value);
+}
+
+Status RedisDB::HGet(const std::string_view& key, const std::string_view& field, PinnableValue* value) {
+	return HashesShard(key)->HGet(key, field, value);
 }
 
 Status RedisDB::ZAdd(const std::string_view& key,
 	const std::vector<ScoreMember>& scoremembers, int32_t* ret) {
-	return rediszset->ZAdd(key, scoremembers, ret);
+	return ZsetsShard(key)->ZAdd(key, scoremembers, ret);
 }
 
 int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
@@ -276,7 +478,7 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 	int32_t ret = 0;
 	bool iscorruption = false;
 
-	Status s = redisstring->Expire(key, ttl);
+	Status s = StringsShard(key)->Expire(key, ttl);
 	if (s.ok()) {
 		ret++;
 	} else if (!s.IsNotFound()) {
@@ -285,7 +487,7 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 	}
 
 	// Hash
-	s = redishash->Expire(key, ttl);
+	s = HashesShard(key)->Expire(key, ttl);
 	if (s.ok()) {
 		ret++;
 	} else if (!s.IsNotFound()) {
@@ -294,7 +496,7 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 	}
 
 	// Sets
-	s = redisset->Expire(key, ttl);
+	s = SetsShard(key)->Expire(key, ttl);
 	if (s.ok()) {
 		ret++;
 	} else if (!s.IsNotFound()) {
@@ -303,7 +505,7 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 	}
 
 	// Lists
-	s = redislist->Expire(key, ttl);
+	s = ListsShard(key)->Expire(key, ttl);
 	if (s.ok()) {
 		ret++;
 	} else if (!s.IsNotFound()) {
@@ -312,7 +514,7 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 	}
 
 	// Zsets
-	s = rediszset->Expire(key, ttl);
+	s = ZsetsShard(key)->Expire(key, ttl);
 	if (s.ok()) {
 		ret++;
 	} else if (!s.IsNotFound()) {
@@ -329,11 +531,11 @@ int32_t RedisDB::Expire(const std::string_view& key, int32_t ttl,
 
 Status RedisDB::SAdd(const std::string_view& key,
 	const std::vector<std::string>& members, int32_t* ret) {
-	return redisset->SAdd(key, members, ret);
+	return SetsShard(key)->SAdd(key, members, ret);
 }
 
 Status RedisDB::SCard(const std::string_view& key, int32_t* ret) {
-	return redisset->SCard(key, ret);
+	return SetsShard(key)->SCard(key, ret);
 }
 
 Status RedisDB::Compact(const DataType& type, bool sync) {
@@ -341,7 +543,7 @@ Status RedisDB::Compact(const DataType& type, bool sync) {
 }
 
 Status RedisDB::ZCard(const std::string_view& key, int32_t* ret) {
-	return rediszset->ZCard(key, ret);
+	return ZsetsShard(key)->ZCard(key, ret);
 }
 
 Status RedisDB::ZCount(const std::string_view& key,
@@ -358,7 +560,7 @@ Status RedisDB::ZRange(const std::string_view& key,
 		int32_t start,
 		int32_t stop,
 		std::vector<ScoreMember>* scoremembers) {
-	return rediszset->ZRange(key, start, stop, scoremembers);
+	return ZsetsShard(key)->ZRange(key, start, stop, scoremembers);
 }
 
 std::map<DataType, int64_t> RedisDB::TTL(const std::string_view& key,
@@ -374,9 +576,40 @@ Status RedisDB::Keys(const std::string& type,
 		  std::vector<std::string>* keys) {
 	Status s;
 	if (type == "hash") {
-		return redishash->ScanKeys(pattern, keys);		  
+		for (int i = 0; i < numshards && s.ok(); i++) {
+			s = redishashes[i]->ScanKeys(pattern, keys);
+		}
 	}
-	
+	else if (type == "string") {
+		for (int i = 0; i < numshards && s.ok(); i++) {
+			s = redisstrings[i]->ScanKeys(pattern, keys);
+		}
+	}
+	else if (type == "set") {
+		for (int i = 0; i < numshards && s.ok(); i++) {
+			s = redissets[i]->ScanKeys(pattern, keys);
+		}
+	}
+	else if (type == "zset") {
+		for (int i = 0; i < numshards && s.ok(); i++) {
+			s = rediszsets[i]->ScanKeys(pattern, keys);
+		}
+	}
+	else if (type == "list") {
+		for (int i = 0; i < numshards && s.ok(); i++) {
+			s = redislists[i]->ScanKeys(pattern, keys);
+		}
+	}
+	else {
+		return Status::InvalidArgument("unknown type");
+	}
+
+	// Each shard returns its keys in order; keep the merged list ordered
+	// as a single DB would.
+	if (s.ok() && numshards > 1) {
+		std::sort(keys->begin(), keys->end());
+	}
+	return s;
 }
 		  
 Status RedisDB::AddBGTask(const BGTask& bgtask) {
@@ -428,31 +661,41 @@ Status RedisDB::DoCompact(const DataType& type) {
 	}
 	
 	Status s;
-	if (type == kStrings) {
+	if (type == kStrings || type == kAll) {
 		currenttasktype = Operation::kCleanStrings;
-		s = redisstring->CompactRange(nullptr, nullptr);
-	} else if (type == kHashes) {
-		//currenttasktype = Operation::kCleanHashes;
-		//s = redishash->CompactRange(nullptr, nullptr);
-	} else if (type == kSets) {
-		//currenttasktype = Operation::kCleanSets;
-		//s = redisset->CompactRange(nullptr, nullptr);
-	} else if (type == kZSets) {
-		//currenttasktype = Operation::kCleanZSets;
-		//s = rediszset->CompactRange(nullptr, nullptr);
-	} else if (type == kLists) {
-		//currenttasktype = Operation::kCleanLists;
-		//s = redislist->CompactRange(nullptr, nullptr);
-	} else {
-		currenttasktype = Operation::kCleanAll;
-		s = redisstring->CompactRange(nullptr, nullptr);
-		/*s = redishash->CompactRange(nullptr, nullptr);
-		s = redisset->CompactRange(nullptr, nullptr);
-		s = rediszset->CompactRange(nullptr, nullptr);
-		s = redislist->CompactRange(nullptr, nullptr);
-		*/
+		for (size_t i = 0; i < redisstrings.size() && s.ok(); i++) {
+			s = redisstrings[i]->CompactRange(nullptr, nullptr);
+		}
 	}
-	
+
+	if (type == kHashes || type == kAll) {
+		currenttasktype = Operation::kCleanHashes;
+		for (size_t i = 0; i < redishashes.size() && s.ok(); i++) {
+			s = redishashes[i]->CompactRange(nullptr, nullptr);
+		}
+	}
+
+	if (type == kSets || type == kAll) {
+		currenttasktype = Operation::kCleanSets;
+		for (size_t i = 0; i < redissets.size() && s.ok(); i++) {
+			s = redissets[i]->CompactRange(nullptr, nullptr);
+		}
+	}
+
+	if (type == kZSets || type == kAll) {
+		currenttasktype = Operation::kCleanZSets;
+		for (size_t i = 0; i < rediszsets.size() && s.ok(); i++) {
+			s = rediszsets[i]->CompactRange(nullptr, nullptr);
+		}
+	}
+
+	if (type == kLists || type == kAll) {
+		currenttasktype = Operation::kCleanLists;
+		for (size_t i = 0; i < redislists.size() && s.ok(); i++) {
+			s = redislists[i]->CompactRange(nullptr, nullptr);
+		}
+	}
+
 	currenttasktype = Operation::kNone;
 	return s;
 }
@@ -467,18 +710,19 @@ Status RedisDB::CompactKey(const DataType& type, const std::string& key) {
 	std::string_view view_data_begin(datastartkey);
 	std::string_view view_data_end(dataendkey);
 	if (type == kSets) {
-		//redisset->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
-		//redisset->CompactRange(&view_data_begin, &view_data_end, kData);
+		SetsShard(key)->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
+		SetsShard(key)->CompactRange(&view_data_begin, &view_data_end, kData);
 	} else if (type == kZSets) {
-		//rediszset->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
-		//rediszset->CompactRange(&view_data_begin, &view_data_end, kData);
+		ZsetsShard(key)->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
+		ZsetsShard(key)->CompactRange(&view_data_begin, &view_data_end, kData);
 	} else if (type == kHashes) {
-		//redishash->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
-		//redishash->CompactRange(&view_data_begin, &view_data_end, kData);
+		HashesShard(key)->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
+		HashesShard(key)->CompactRange(&view_data_begin, &view_data_end, kData);
 	} else if (type == kLists) {
-		//redislist->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
-		//redislist->CompactRange(&view_data_begin, &view_data_end, kData);
+		ListsShard(key)->CompactRange(&view_meta_begin, &view_meta_end, kMeta);
+		ListsShard(key)->CompactRange(&view_data_begin, &view_data_end, kData);
 	}
+	return Status::OK();
 }
 
 Status RedisDB::StartBGThread() {
@@ -21,9 +21,27 @@
 #include "redisset.h"
 
 
+// Each data type lives in its own DB.  With numshards > 1 every type is
+// split into that many DBs by a hash of the key, so that writes and
+// compactions of one type run on several memtables, logs and background
+// threads.  A command on one key goes to that key's shard; MSet, MGet,
+// MSetnx, Del and Keys fan out to the shards involved and merge the
+// results.  Commands that touch several shards are not atomic across
+// them.  The shard count of an existing database must not change.
+//
+// With usesharedlog, the five types of a shard write to one log (see
+// sharedlog.h) instead of five, so mixed commands cost one append and
+// one sync per group, and Del removes a key from all types atomically.
+//
+// All stores share options.blockcache, or one 8MB cache if it is null.
+// To keep the whole database within a fixed amount of memory, pass a
+// WriteBufferManager built on that cache as options.writebuffermanager
+// and set options.reservetablereadermemory: memtables, open tables and
+// cached blocks are then all charged to the capacity of the cache.
 class RedisDB {
 public:
-	RedisDB(const Options& options, const std::string& path);
+	RedisDB(const Options& options, const std::string& path, int numshards = 1,
+		bool usesharedlog = false);
 	~RedisDB();
 
 	Status Open();
@@ -47,6 +65,10 @@ public:
 	// the special value nil is returned
 	Status Get(const std::string_view& key, std::string* value);
 
+	// Like Get(), but leaves the value in the DB's memory, pinned there
+	// until *value is reset, so that it can go to a reply without a copy.
+	Status Get(const std::string_view& key, PinnableValue* value);
+
 	// Atomically sets key to value and returns the old value stored at key
 	// Returns an error when key exists but does not hold a string value.
 	Status GetSet(const std::string_view& key, const std::string_view& value, std::string* old_value);
@@ -103,7 +125,8 @@ public:
 
 	// If key already exists and is a string, this command appends the value at
 	// the end of the string
-	// return the length of the string after the append operation
+	// return the length of the string after the append operation, unless
+	// ret is nullptr: then the key is not read (see RedisString::Incrby)
 	Status Append(const std::string_view& key, const std::string_view& value, int32_t* ret);
 
 	// Count the number of set bits (population counting) in a string.
@@ -134,6 +157,8 @@ public:
 
 	// Increments the number stored at key by increment.
 	// If the key does not exist, it is set to 0 before performing the operation
+	// If ret is nullptr the key is not read, and neither is it by Decrby and
+	// Incrbyfloat (see RedisString::Incrby)
 	Status Incrby(const std::string_view& key, int64_t value, int64_t* ret);
 
 	// Increment the string representing a floating point number
@@ -167,6 +192,9 @@ public:
 	// hash or key does not exist.
 	Status HGet(const std::string_view& key, const std::string_view& field, std::string* value);
 
+	// Like HGet(), but pins the value instead of copying it; see Get().
+	Status HGet(const std::string_view& key, const std::string_view& field, PinnableValue* value);
+
 	// Sets the specified fields to their respective values in the hash stored at
 	// key. This command overwrites any specified fields already existing in the
 	// hash. If key does not exist, a new key holding a hash is created.
@@ -346,13 +374,46 @@ public:
 	Status CompactKey(const DataType& type, const std::string& key);
 	
 private:
-	std::shared_ptr<RedisString> redisstring;
-	std::shared_ptr<RedisHash> redishash;
-	std::shared_ptr<RedisZset> rediszset;
-	std::shared_ptr<RedisList> redislist;
-	std::shared_ptr<RedisSet> redisset;
+	// Write updates[i].second to updates[i].first, atomically if the
+	// types share a log.
+	Status Write(const std::vector<std::pair<DB*, WriteBatch*>>& updates);
+
+	// The shard that holds "key", the same for every type.
+	size_t ShardOf(const std::string_view& key) const;
+
+	// Directory of shard "shard" of the type stored under "name".
+	std::string ShardPath(const std::string& name, int shard) const;
+
+	RedisString* StringsShard(const std::string_view& key) {
+		return redisstrings[ShardOf(key)].get();
+	}
+
+	RedisHash* HashesShard(const std::string_view& key) {
+		return redishashes[ShardOf(key)].get();
+	}
+
+	RedisZset* ZsetsShard(const std::string_view& key) {
+		return rediszsets[ShardOf(key)].get();
+	}
+
+	RedisList* ListsShard(const std::string_view& key) {
+		return redislists[ShardOf(key)].get();
+	}
+
+	RedisSet* SetsShard(const std::string_view& key) {
+		return redissets[ShardOf(key)].get();
+	}
+
+	std::vector<std::shared_ptr<RedisString>> redisstrings;
+	std::vector<std::shared_ptr<RedisHash>> redishashes;
+	std::vector<std::shared_ptr<RedisZset>> rediszsets;
+	std::vector<std::shared_ptr<RedisList>> redislists;
+	std::vector<std::shared_ptr<RedisSet>> redissets;
+	std::vector<std::shared_ptr<SharedLog>> sharedlogs;
 	const Options options;
 	std::string path;
+	const int numshards;
+	const bool usesharedlog;
 		
 	std::unique_ptr<std::thread> bgthread;
 	std::mutex bgtasksmutex;
@@ -0,0 +1,158 @@
+#include "redisfilter.h"
+
+bool StringsFilter::Filter(int level, const std::string_view& key,
+	const std::string_view& value, std::string* newvalue,
+	bool* valuechanged) {
+	ParsedStringsMetaValue pstringsvalue(value);
+	if (pstringsvalue.IsStale() && !pstringsvalue.GetValue().empty()) {
+		StringsMetaValue stringsvalue("");
+		stringsvalue.SetTimestamp(pstringsvalue.GetTimestamp());
+		std::string_view encoded = stringsvalue.Encode();
+		newvalue->assign(encoded.data(), encoded.size());
+		*valuechanged = true;
+	}
+	return false;
+}
+
+std::shared_ptr<CompactionFilter> StringsFilterFactory::CreateCompactionFilter(
+	uint64_t smallestsnapshot) {
+	std::shared_ptr<CompactionFilter> filter(new StringsFilter());
+	return filter;
+}
+
+BaseDataFilter::BaseDataFilter(DB* db, uint64_t smallestsnapshot)
+	: db(db),
+	hascached(false),
+	metafound(false),
+	metaversion(0),
+	metastale(false) {
+	readopts.snapshot.reset(new Snapshot(smallestsnapshot));
+	readopts.fillcache = false;
+}
+
+bool BaseDataFilter::Filter(int level, const std::string_view& key,
+	const std::string_view& value, std::string* newvalue,
+	bool* valuechanged) {
+	std::string_view owner;
+	int32_t version;
+	if (!ParseDataKey(key, &owner, &version)) {
+		return false;
+	}
+
+	if (!hascached || owner != cachedkey) {
+		cachedkey.assign(owner.data(), owner.size());
+		hascached = true;
+		std::string metavalue;
+		Status s = db->Get(readopts, MetaKey(owner), &metavalue);
+		metafound = s.ok() && ParseMeta(metavalue, &metaversion, &metastale);
+	}
+
+	if (!metafound) {
+		return false;
+	}
+	return metastale || version < metaversion;
+}
+
+bool BaseDataFilter::ParseDataKey(const std::string_view& key,
+	std::string_view* owner, int32_t* version) {
+	// "<key size><key><version>..."
+	if (key.size() < sizeof(int32_t) * 2) {
+		return false;
+	}
+
+	const uint32_t keylen = DecodeFixed32(key.data());
+	if (keylen > key.size() - sizeof(int32_t) * 2) {
+		return false;
+	}
+
+	*owner = std::string_view(key.data() + sizeof(int32_t), keylen);
+	*version = DecodeFixed32(owner->data() + owner->size());
+	return !IsMetaKey(*version);
+}
+
+std::string BaseDataFilter::MetaKey(const std::string_view& key) {
+	return std::string(key.data(), key.size());
+}
+
+bool BaseDataFilter::ParseMeta(const std::string_view& value, int32_t* version, bool* stale) {
+	if (value.size() < sizeof(int32_t) * 3) {
+		return false;
+	}
+
+	ParsedBaseMetaValue pmetavalue(value);
+	*version = pmetavalue.GetVersion();
+	*stale = pmetavalue.IsStale();
+	return true;
+}
+
+std::string ListsDataFilter::MetaKey(const std::string_view& key) {
+	ListsDataKey metakey(key, 0, 0);
+	return std::string(metakey.Encode());
+}
+
+bool ListsDataFilter::ParseMeta(const std::string_view& value, int32_t* version, bool* stale) {
+	if (value.size() < sizeof(int64_t) * 3 + sizeof(int32_t) * 2) {
+		return false;
+	}
+
+	ParsedListsMetaValue pmetavalue(value);
+	*version = pmetavalue.GetVersion();
+	*stale = pmetavalue.IsStale();
+	return true;
+}
+
+bool ZSetsDataFilter::ParseDataKey(const std::string_view& key,
+	std::string_view* owner, int32_t* version) {
+	// "<key size><key><version><score><member>"
+	if (key.size() < sizeof(int32_t) * 2 + sizeof(uint64_t)) {
+		return false;
+	}
+
+	const uint32_t keylen = DecodeFixed32(key.data());
+	if (keylen > key.size() - sizeof(int32_t) * 2 - sizeof(uint64_t)) {
+		return false;
+	}
+
+	ParsedZSetsScoreKey pkey(key);
+	*owner = pkey.GetKey();
+	if (pkey.GetVersion() != 0) {
+		// Score key
+		*version = pkey.GetVersion();
+		return true;
+	}
+	else if (pkey.GetScore() == 0 && pkey.GetMember().empty()) {
+		// Meta key
+		return false;
+	}
+	else {
+		// Member key
+		*version = static_cast<int32_t>(pkey.GetScore());
+		return true;
+	}
+}
+
+std::string ZSetsDataFilter::MetaKey(const std::string_view& key) {
+	ZSetsScoreKey metakey(key, 0, 0, "");
+	return std::string(metakey.Encode());
+}
+
+std::shared_ptr<CompactionFilter> DataFilterFactory::CreateCompactionFilter(
+	uint64_t smallestsnapshot) {
+	std::shared_ptr<CompactionFilter> filter;
+	if (db == nullptr) {
+		return filter;
+	}
+
+	switch (kind) {
+	case kLists:
+		filter.reset(new ListsDataFilter(db, smallestsnapshot));
+		break;
+	case kZSets:
+		filter.reset(new ZSetsDataFilter(db, smallestsnapshot));
+		break;
+	default:
+		filter.reset(new BaseDataFilter(db, smallestsnapshot));
+		break;
+	}
+	return filter;
+}
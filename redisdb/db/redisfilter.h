@@ -0,0 +1,146 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "compactionfilter.h"
+#include "db.h"
+#include "serialize.h"
+
+// Compaction filters of the redis types.  Deleting or expiring a hash,
+// set, zset or list only bumps the version or the timestamp in its meta
+// value, and strings carry their own timestamp; these filters let
+// compaction reclaim what such updates leave behind.
+//
+// Meta keys and data keys share one DB per type.  Data keys start with
+// "<key size><key><version>", so an entry that parses that way is
+// checked against the meta value of its owner, read at the oldest live
+// snapshot.  An entry is only dropped when that meta value exists and is
+// stale or newer, so a meta key that happens to parse as a data key is
+// left alone unless another meta key contradicts it.
+
+// Empties strings whose timestamp has passed.  They cannot be dropped:
+// merge operands written before the string expired may still sit in a
+// memtable or a newer table, and folded onto nothing they would bring
+// the key back without its timestamp.  Folded onto the empty value they
+// keep the old timestamp and stay expired.
+class StringsFilter : public CompactionFilter {
+public:
+	virtual const char* Name() const { return "redis.StringsFilter"; }
+
+	virtual bool Filter(int level, const std::string_view& key,
+		const std::string_view& value, std::string* newvalue,
+		bool* valuechanged);
+};
+
+class StringsFilterFactory : public CompactionFilterFactory {
+public:
+	virtual const char* Name() const { return "redis.StringsFilterFactory"; }
+
+	virtual std::shared_ptr<CompactionFilter> CreateCompactionFilter(
+		uint64_t smallestsnapshot);
+};
+
+// Drops data entries of hashes and sets whose owner is stale or has
+// moved to a newer version.
+class BaseDataFilter : public CompactionFilter {
+public:
+	BaseDataFilter(DB* db, uint64_t smallestsnapshot);
+
+	virtual const char* Name() const { return "redis.BaseDataFilter"; }
+
+	virtual bool Filter(int level, const std::string_view& key,
+		const std::string_view& value, std::string* newvalue,
+		bool* valuechanged);
+
+protected:
+	// Split a data key into its owner and version.  Returns false if
+	// "key" is not a data key, such as a meta key.
+	virtual bool ParseDataKey(const std::string_view& key,
+		std::string_view* owner, int32_t* version);
+
+	// Return the key of the meta value that owns data of "key".
+	virtual std::string MetaKey(const std::string_view& key);
+
+	// Parse a meta value.  Returns false if "value" is not one.
+	virtual bool ParseMeta(const std::string_view& value, int32_t* version, bool* stale);
+
+	// Return true if the data key is the meta key itself.
+	virtual bool IsMetaKey(int32_t version) { return false; }
+
+private:
+	DB* const db;
+	ReadOptions readopts;
+
+	// Meta state of the last owner, so that the data entries of one key,
+	// which are adjacent, cost a single lookup.
+	std::string cachedkey;
+	bool hascached;
+	bool metafound;
+	int32_t metaversion;
+	bool metastale;
+};
+
+// Lists keep their meta value under ListsDataKey(key, 0, 0).
+class ListsDataFilter : public BaseDataFilter {
+public:
+	ListsDataFilter(DB* db, uint64_t smallestsnapshot)
+		: BaseDataFilter(db, smallestsnapshot) {
+	}
+
+	virtual const char* Name() const { return "redis.ListsDataFilter"; }
+
+protected:
+	virtual std::string MetaKey(const std::string_view& key);
+
+	virtual bool ParseMeta(const std::string_view& value, int32_t* version, bool* stale);
+
+	virtual bool IsMetaKey(int32_t version) { return version == 0; }
+};
+
+// Zsets keep every key in the "<key size><key><version><score><member>"
+// layout of ZSetsScoreKey.  The meta value is under
+// ZSetsScoreKey(key, 0, 0, ""), and a member key holds 0 in the version
+// slot and the version, as a double, in the score slot.
+class ZSetsDataFilter : public BaseDataFilter {
+public:
+	ZSetsDataFilter(DB* db, uint64_t smallestsnapshot)
+		: BaseDataFilter(db, smallestsnapshot) {
+	}
+
+	virtual const char* Name() const { return "redis.ZSetsDataFilter"; }
+
+protected:
+	virtual bool ParseDataKey(const std::string_view& key,
+		std::string_view* owner, int32_t* version);
+
+	virtual std::string MetaKey(const std::string_view& key);
+};
+
+// Creates the data filter of a hash, set, zset or list DB, reading the
+// meta values of "db".  The DB is created with options that already
+// refer to the factory, so it is attached afterwards.
+class DataFilterFactory : public CompactionFilterFactory {
+public:
+	enum Kind {
+		kBase,      // Hashes and sets
+		kLists,
+		kZSets
+	};
+
+	explicit DataFilterFactory(Kind kind = kBase)
+		: db(nullptr),
+		kind(kind) {
+	}
+
+	void SetDB(DB* db) { this->db = db; }
+
+	virtual const char* Name() const { return "redis.DataFilterFactory"; }
+
+	virtual std::shared_ptr<CompactionFilter> CreateCompactionFilter(
+		uint64_t smallestsnapshot);
+
+private:
+	DB* db;
+	const Kind kind;
+};
@@ -1,10 +1,14 @@
 #include "redishash.h"
+#include "redisfilter.h"
 #include "redisdb.h"
 
 RedisHash::RedisHash(RedisDB* redis, const Options& options, const std::string& path)
-	:redis(redis),
-	db(new DB(options, path)) {
-
+	:redis(redis) {
+	std::shared_ptr<DataFilterFactory> factory(new DataFilterFactory());
+	Options opts(options);
+	opts.compactionfilterfactory = factory;
+	db.reset(new DB(opts, path));
+	factory->SetDB(db.get());
 }
 
 RedisHash::~RedisHash() {
@@ -96,7 +100,17 @@ Status RedisHash::HSet(const std::string_view& key,
 
 Status RedisHash::HGet(const std::string_view& key,
 	const std::string_view& field, std::string* value) {
-	std::string metavalue;
+	PinnableValue pinnable(value);
+	Status s = HGet(key, field, &pinnable);
+	if (s.ok() && pinnable.IsPinned()) {
+		value->assign(pinnable.data(), pinnable.size());
+	}
+	return s;
+}
+
+Status RedisHash::HGet(const std::string_view& key,
+	const std::string_view& field, PinnableValue* value) {
+	PinnableValue metavalue;
 	ReadOptions readopts;
 	std::shared_ptr<Snapshot> snapshot;
 	SnapshotLock ss(db, snapshot);
@@ -106,7 +120,7 @@ Status RedisHash::HGet(const std::string_view& key,
 	int32_t version = 0;
 	Status s = db->Get(readopts, key, &metavalue);
 	if (s.ok()) {
-		ParsedHashesMetaValue phashmetavalue(&metavalue);
+		ParsedHashesMetaValue phashmetavalue(metavalue.ToStringView());
 		if (phashmetavalue.IsStale()) {
 			return Status::NotFound("Stale");
 		}
@@ -195,7 +209,6 @@ Status RedisHash::HMGet(const std::string_view& key,
 	vss->clear();
 	int32_t version = 0;
 	bool isstable = false;
-	std::string value;
 	std::string metavalue;
 	ReadOptions readopts;
 	std::shared_ptr<Snapshot> snapshot;
@@ -214,12 +227,20 @@ Status RedisHash::HMGet(const std::string_view& key,
 		}
 		else {
 			version = phashesmetavalue.GetVersion();
+			std::vector<std::string> datakeys;
 			for (const auto& field : fields) {
 				HashesDataKey hashesdatakey(key, version, field);
-				s = db->Get(readopts,
-					hashesdatakey.Encode(), &value);
+				datakeys.push_back(std::string(hashesdatakey.Encode()));
+			}
+
+			std::vector<std::string_view> views(datakeys.begin(), datakeys.end());
+			std::vector<std::string> values;
+			std::vector<Status> statuses;
+			db->MultiGet(readopts, views, &values, &statuses);
+			for (size_t i = 0; i < fields.size(); i++) {
+				s = statuses[i];
 				if (s.ok()) {
-					vss->push_back({ value, Status::OK() });
+					vss->push_back({ values[i], Status::OK() });
 				}
 				else if (s.IsNotFound()) {
 					vss->push_back({ std::string(), Status::NotFound("") });
@@ -348,9 +369,17 @@ Status RedisHash::Expire(const std::string_view& key, int32_t ttl) {
 }
 
 Status RedisHash::Del(const std::string_view& key) {
-	std::string metavalue;
 	HashLock l(&lockmgr, key);
 	WriteBatch batch;
+	Status s = Del(key, &batch);
+	if (s.ok()) {
+		s = db->Write(WriteOptions(), &batch);
+	}
+	return s;
+}
+
+Status RedisHash::Del(const std::string_view& key, WriteBatch* batch) {
+	std::string metavalue;
 	Status s = db->Get(ReadOptions(), key, &metavalue);
 	if (s.ok()) {
 		ParsedHashesMetaValue phashesmetavalue(&metavalue);
@@ -361,18 +390,18 @@ Status RedisHash::Del(const std::string_view& key) {
 			return Status::NotFound("");
 		}
 		else {
-			batch.Delete(key);
+			batch->Delete(key);
 			int32_t version = phashesmetavalue.GetVersion();
 			HashesDataKey hdatakey(key, version, "");
 			std::string_view prefix = hdatakey.Encode();
 			auto iter = db->NewIterator(ReadOptions());
 			for (iter->Seek(prefix); iter->Valid() &&
 				StartsWith(iter->key(), prefix); iter->Next()) {
-				batch.Delete(iter->key());
+				batch->Delete(iter->key());
 			}
 		}
 	}
-	return db->Write(WriteOptions(), &batch);
+	return Status::OK();
 }
 
 Status RedisHash::HKeys(const std::string_view& key,
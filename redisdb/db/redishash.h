@@ -35,6 +35,10 @@ public:
 	Status HGet(const std::string_view& key,
 		const std::string_view& field, std::string* value);
 
+	// Like HGet(), but without copying the value out of the DB.
+	Status HGet(const std::string_view& key,
+		const std::string_view& field, PinnableValue* value);
+
 	Status HMSet(const std::string_view& key,
 		const std::vector<FieldValue>& fvs);
 
@@ -51,6 +55,14 @@ public:
 
 	Status Del(const std::string_view& key);
 
+	// Add the deletion of "key" to *batch instead of writing it.
+	// REQUIRES: the lock of "key" in GetLockMgr() is held.
+	Status Del(const std::string_view& key, WriteBatch* batch);
+
+	DB* GetDB() const { return db.get(); }
+
+	LockMgr* GetLockMgr() { return &lockmgr; }
+
 	Status ScanKeyNum(KeyInfo* keyinfo);
 
 	Status ScanKeys(const std::string& pattern,
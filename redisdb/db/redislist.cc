@@ -1,10 +1,14 @@
 #include "redislist.h"
+#include "redisfilter.h"
 
 RedisList::RedisList(RedisDB* redis,
 	const Options& options, const std::string& path)
-	:redis(redis),
-	db(new DB(options, path)) {
-
+	:redis(redis) {
+	std::shared_ptr<DataFilterFactory> factory(new DataFilterFactory(DataFilterFactory::kLists));
+	Options opts(options);
+	opts.compactionfilterfactory = factory;
+	db.reset(new DB(opts, path));
+	factory->SetDB(db.get());
 }
 
 RedisList::~RedisList() {
@@ -15,6 +19,13 @@ Status RedisList::Open() {
 	return db->Open();
 }
 
+Status RedisList::CompactRange(const std::string_view* begin,
+	const std::string_view* end, const ColumnFamilyType& type) {
+	// Meta and data keys share one DB.
+	db->CompactRange(begin, end);
+	return Status::OK();
+}
+
 Status RedisList::DestroyDB(const std::string path, const Options& options) {
 	return db->DestroyDB(path, options);
 }
@@ -383,9 +394,18 @@ Status RedisList::Expire(const std::string_view& key, int32_t ttl) {
 }
 
 Status RedisList::Del(const std::string_view& key) {
+	HashLock l(&lockmgr, key);
+	WriteBatch batch;
+	Status s = Del(key, &batch);
+	if (s.ok()) {
+		s = db->Write(WriteOptions(), &batch);
+	}
+	return s;
+}
+
+Status RedisList::Del(const std::string_view& key, WriteBatch* batch) {
 	ListsDataKey lkey(key, 0, 0);
 	std::string metavalue;
-	HashLock l(&lockmgr, key);
 	Status s = db->Get(ReadOptions(), lkey.Encode(), &metavalue);
 	if (s.ok()) {
 		ParsedListsMetaValue plistsmetavalue(&metavalue);
@@ -394,9 +414,8 @@ Status RedisList::Del(const std::string_view& key) {
 		} else if (plistsmetavalue.GetCount() == 0) {
 			return Status::NotFound("");
 		} else {
-			uint32_t statistic = plistsmetavalue.GetCount();
 			plistsmetavalue.InitialMetaValue();
-			s = db->Put(WriteOptions(), lkey.Encode(), metavalue);
+			batch->Put(lkey.Encode(), metavalue);
 		}
 	}
 	return s;
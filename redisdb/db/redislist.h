@@ -22,6 +22,9 @@ public:
 
 	Status Open();
 
+	Status CompactRange(const std::string_view* begin,
+		const std::string_view* end, const ColumnFamilyType& type = kMetaAndData);
+
 	Status DestroyDB(const std::string path, const Options& options);
 
 	Status LPop(const std::string_view& key, std::string* element);
@@ -47,6 +50,14 @@ public:
 		std::vector<std::string>* keys);
 	
 	Status Del(const std::string_view& key);
+
+	// Add the deletion of "key" to *batch instead of writing it.
+	// REQUIRES: the lock of "key" in GetLockMgr() is held.
+	Status Del(const std::string_view& key, WriteBatch* batch);
+
+	DB* GetDB() const { return db.get(); }
+
+	LockMgr* GetLockMgr() { return &lockmgr; }
 	
 	Status Expire(const std::string_view& key, int32_t ttl);
 				
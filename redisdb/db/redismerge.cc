@@ -0,0 +1,109 @@
+#include "redismerge.h"
+#include "util.h"
+
+void StringsMergeOperator::EncodeHeader(Kind kind, std::string* operand) {
+	operand->clear();
+	operand->push_back(static_cast<char>(kind));
+	PutFixed32(operand, static_cast<uint32_t>(time(0)));
+}
+
+void StringsMergeOperator::EncodeIncrby(int64_t value, std::string* operand) {
+	EncodeHeader(kIncrby, operand);
+	PutFixed64(operand, static_cast<uint64_t>(value));
+}
+
+void StringsMergeOperator::EncodeIncrbyfloat(const std::string_view& value, std::string* operand) {
+	EncodeHeader(kIncrbyfloat, operand);
+	operand->append(value.data(), value.size());
+}
+
+void StringsMergeOperator::EncodeAppend(const std::string_view& value, std::string* operand) {
+	EncodeHeader(kAppend, operand);
+	operand->append(value.data(), value.size());
+}
+
+bool StringsMergeOperator::FullMerge(const std::string_view& key, const std::string_view* existingvalue,
+	const std::vector<std::string_view>& operands, std::string* newvalue) const {
+	bool exists = false;
+	std::string uservalue;
+	int32_t timestamp = 0;
+	if (existingvalue != nullptr) {
+		ParsedStringsMetaValue pstringsvalue(*existingvalue);
+		uservalue = pstringsvalue.GetValueToString();
+		timestamp = pstringsvalue.GetTimestamp();
+		exists = true;
+	}
+
+	for (size_t i = 0; i < operands.size(); i++) {
+		std::string_view operand = operands[i];
+		if (operand.size() < kOperandHeaderSize) {
+			return false;
+		}
+
+		const char kind = operand[0];
+		const int32_t writetime = static_cast<int32_t>(DecodeFixed32(operand.data() + 1));
+		operand.remove_prefix(kOperandHeaderSize);
+		if (exists && timestamp != 0 && timestamp < writetime) {
+			// Had expired when the command ran
+			uservalue.clear();
+			timestamp = 0;
+			exists = false;
+		}
+
+		switch (kind) {
+		case kIncrby: {
+			if (operand.size() != sizeof(uint64_t)) {
+				return false;
+			}
+
+			const int64_t by = static_cast<int64_t>(DecodeFixed64(operand.data()));
+			int64_t ival = 0;
+			if (exists) {
+				char* end = nullptr;
+				ival = strtoll(uservalue.c_str(), &end, 10);
+				if (*end != 0 ||
+					(by >= 0 && LLONG_MAX - by < ival) ||
+					(by < 0 && LLONG_MIN - by > ival)) {
+					break;
+				}
+			}
+			uservalue = std::to_string(ival + by);
+			exists = true;
+			break;
+		}
+
+		case kIncrbyfloat: {
+			long double by, oldnumber = 0;
+			if (StrToLongDouble(operand.data(), operand.size(), &by) == -1) {
+				return false;
+			}
+
+			if (exists && StrToLongDouble(uservalue.data(), uservalue.size(), &oldnumber) == -1) {
+				break;
+			}
+
+			std::string total;
+			if (LongDoubleToStr(oldnumber + by, &total) == -1) {
+				break;
+			}
+			uservalue.swap(total);
+			exists = true;
+			break;
+		}
+
+		case kAppend:
+			uservalue.append(operand.data(), operand.size());
+			exists = true;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	StringsMetaValue stringsvalue(uservalue);
+	stringsvalue.SetTimestamp(timestamp);
+	std::string_view encoded = stringsvalue.Encode();
+	newvalue->assign(encoded.data(), encoded.size());
+	return true;
+}
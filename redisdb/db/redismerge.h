@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mergeoperator.h"
+#include "serialize.h"
+
+// Merge operator of the strings DB, so that INCRBY, INCRBYFLOAT and
+// APPEND can be written without reading the key.
+//
+// An operand is "<kind><write time><argument>".  The write time lets the
+// fold apply each operand to the value as it was when the command ran: a
+// value that had expired by then is replaced rather than extended, just
+// as the read-modify-write commands do.  An increment of a value that is
+// not a number, or that would overflow, is ignored, like the command
+// that fails on it.
+class StringsMergeOperator : public MergeOperator {
+public:
+	virtual const char* Name() const { return "redis.StringsMergeOperator"; }
+
+	virtual bool FullMerge(const std::string_view& key, const std::string_view* existingvalue,
+		const std::vector<std::string_view>& operands, std::string* newvalue) const;
+
+	static void EncodeIncrby(int64_t value, std::string* operand);
+
+	// "value" must already have been checked to parse as a long double.
+	static void EncodeIncrbyfloat(const std::string_view& value, std::string* operand);
+
+	static void EncodeAppend(const std::string_view& value, std::string* operand);
+
+private:
+	enum Kind {
+		kIncrby = 'i',
+		kIncrbyfloat = 'f',
+		kAppend = 'a'
+	};
+
+	static const size_t kOperandHeaderSize = 1 + sizeof(int32_t);
+
+	static void EncodeHeader(Kind kind, std::string* operand);
+};
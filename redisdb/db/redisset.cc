@@ -1,10 +1,15 @@
 #include "redisset.h"
+#include "redisfilter.h"
 #include "redisdb.h"
 
 RedisSet::RedisSet(RedisDB* redis, 
     const Options& options, const std::string& path) 
-    :redis(redis),
-	db(new DB(options, path)) {
+    :redis(redis) {
+	std::shared_ptr<DataFilterFactory> factory(new DataFilterFactory());
+	Options opts(options);
+	opts.compactionfilterfactory = factory;
+	db.reset(new DB(opts, path));
+	factory->SetDB(db.get());
 }
 
 RedisSet::~RedisSet() {
@@ -15,6 +20,13 @@ Status RedisSet::Open() {
     return db->Open();
 }
 
+Status RedisSet::CompactRange(const std::string_view* begin,
+	const std::string_view* end, const ColumnFamilyType& type) {
+	// Meta and data keys share one DB.
+	db->CompactRange(begin, end);
+	return Status::OK();
+}
+
 Status RedisSet::DestroyDB(const std::string path, const Options& options) {
     return db->DestroyDB(path, options);
 }
@@ -40,6 +52,7 @@ Status RedisSet::SAdd(const std::string_view& key,
         ParsedSetsMetaValue psetsvalue(&metavalue);
         if (psetsvalue.IsStale()  
             || psetsvalue.GetCount() == 0) {
+            version = psetsvalue.InitialMetaValue();
             psetsvalue.SetCount(filteredmembers.size());
             batch.Put(key, metavalue);
             for (const auto& member : filteredmembers) {
@@ -224,8 +237,17 @@ Status RedisSet::Expire(const std::string_view& key, int32_t ttl) {
 }
 
 Status RedisSet::Del(const std::string_view& key) {
-    std::string metavalue;
     HashLock l(&lockmgr, key);
+    WriteBatch batch;
+    Status s = Del(key, &batch);
+    if (s.ok()) {
+        s = db->Write(WriteOptions(), &batch);
+    }
+    return s;
+}
+
+Status RedisSet::Del(const std::string_view& key, WriteBatch* batch) {
+    std::string metavalue;
     Status s = db->Get(ReadOptions(),  key, &metavalue);
     if (s.ok()) {
         ParsedSetsMetaValue psetsmetavalue(&metavalue);
@@ -234,9 +256,8 @@ Status RedisSet::Del(const std::string_view& key) {
         } else if (psetsmetavalue.GetCount() == 0) {
             return Status::NotFound("");
         } else {
-            uint32_t statistic = psetsmetavalue.GetCount();
             psetsmetavalue.InitialMetaValue();
-            s = db->Put(WriteOptions(), key, metavalue);
+            batch->Put(key, metavalue);
         }
     }
     return s;
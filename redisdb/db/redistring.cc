@@ -1,12 +1,16 @@
 #include "redistring.h"
+#include "redisfilter.h"
+#include "redismerge.h"
 #include "redisdb.h"
 #include "util.h"
 
 RedisString::RedisString(RedisDB* redis,
 	const Options& options, const std::string& path)
-	:redis(redis),
-	db(new DB(options, path)) {
-
+	:redis(redis) {
+	Options opts(options);
+	opts.compactionfilterfactory.reset(new StringsFilterFactory());
+	opts.mergeoperator.reset(new StringsMergeOperator());
+	db.reset(new DB(opts, path));
 }
 
 RedisString::~RedisString() {
@@ -31,15 +35,32 @@ Status RedisString::Set(const std::string_view& key,
 Status RedisString::Get(const std::string_view& key,
 	std::string* value) {
 	value->clear();
+	PinnableValue pinnable(value);
+	Status s = Get(key, &pinnable);
+	if (!s.ok()) {
+		value->clear();
+	}
+	else if (pinnable.IsPinned()) {
+		value->assign(pinnable.data(), pinnable.size());
+	}
+	else {
+		// The value is a prefix of *value
+		value->resize(pinnable.size());
+	}
+	return s;
+}
+
+Status RedisString::Get(const std::string_view& key,
+	PinnableValue* value) {
 	Status s = db->Get(ReadOptions(), key, value);
 	if (s.ok()) {
-		ParsedStringsMetaValue pstringsvalue(value);
+		ParsedStringsMetaValue pstringsvalue(value->ToStringView());
 		if (pstringsvalue.IsStale()) {
-			value->clear();
+			value->Reset();
 			return Status::NotFound("Stale");
 		}
 		else {
-			pstringsvalue.StripSuffix();
+			value->RemoveSuffix(value->size() - pstringsvalue.GetValue().size());
 		}
 	}
 	return s;
@@ -205,12 +226,14 @@ Status RedisString::MGet(const std::vector<std::string>& keys,
 	readopts.snapshot = snapshot;
 	readopts.fillcache = false;
 
-	Status s;
-	std::string value;
-	for (const auto& key : keys) {
-		s = db->Get(readopts, key, &value);
+	std::vector<std::string_view> views(keys.begin(), keys.end());
+	std::vector<std::string> values;
+	std::vector<Status> statuses;
+	db->MultiGet(readopts, views, &values, &statuses);
+	for (size_t i = 0; i < keys.size(); i++) {
+		const Status& s = statuses[i];
 		if (s.ok()) {
-			ParsedStringsMetaValue pstringsvalue(&value);
+			ParsedStringsMetaValue pstringsvalue(&values[i]);
 			if (pstringsvalue.IsStale()) {
 				vss->push_back({ std::string(), Status::NotFound("Stale") });
 			}
@@ -270,28 +293,50 @@ Status RedisString::Setnx(const std::string_view& key,
 
 Status RedisString::MSetnx(const std::vector<KeyValue>& kvs,
 	int32_t * ret) {
-	Status s;
-	bool exists = false;
 	*ret = 0;
+	std::vector<std::string> keys;
+	for (const auto& kv : kvs) {
+		keys.push_back(kv.key);
+	}
+
+	// Hold the keys from the check until the write, so that no key can
+	// be set in between.
+	MultiHashLock l(&lockmgr, keys);
+	bool exists;
+	WriteBatch batch;
+	Status s = MSetnx(kvs, &exists, &batch);
+	if (s.ok() && !exists) {
+		s = db->Write(WriteOptions(), &batch);
+		if (s.ok()) {
+			*ret = 1;
+		}
+	}
+	return s;
+}
+
+Status RedisString::MSetnx(const std::vector<KeyValue>& kvs,
+	bool* exists, WriteBatch* batch) {
+	*exists = false;
 	std::string value;
 	for (size_t i = 0; i < kvs.size(); i++) {
-		s = db->Get(ReadOptions(), kvs[i].key, &value);
+		Status s = db->Get(ReadOptions(), kvs[i].key, &value);
 		if (s.ok()) {
 			ParsedStringsMetaValue pstringsvalue(&value);
 			if (!pstringsvalue.IsStale()) {
-				exists = true;
-				break;
+				*exists = true;
+				return Status::OK();
 			}
 		}
+		else if (!s.IsNotFound()) {
+			return s;
+		}
 	}
 
-	if (!exists) {
-		s = MSet(kvs);
-		if (s.ok()) {
-			*ret = 1;
-		}
+	for (const auto& kv : kvs) {
+		StringsMetaValue stringsvalue(kv.value);
+		batch->Put(kv.key, stringsvalue.Encode());
 	}
-	return s;
+	return Status::OK();
 }
 
 Status RedisString::Setvx(const std::string_view& key,
@@ -336,15 +381,24 @@ Status RedisString::Setvx(const std::string_view& key,
 }
 
 Status RedisString::Del(const std::string_view& key) {
-	std::string value;
 	HashLock l(&lockmgr, key);
+	WriteBatch batch;
+	Status s = Del(key, &batch);
+	if (s.ok()) {
+		s = db->Write(WriteOptions(), &batch);
+	}
+	return s;
+}
+
+Status RedisString::Del(const std::string_view& key, WriteBatch* batch) {
+	std::string value;
 	Status s = db->Get(ReadOptions(), key, &value);
 	if (s.ok()) {
 		ParsedStringsMetaValue pstringsvalue(&value);
 		if (pstringsvalue.IsStale()) {
 			return Status::NotFound("Stale");
 		}
-		return db->Delete(WriteOptions(), key);
+		batch->Delete(key);
 	}
 	return s;
 }
@@ -620,6 +674,12 @@ Status RedisString::Incrby(const std::string_view& key,
 	std::string oldvalue;
 	std::string newvalue;
 	HashLock l(&lockmgr, key);
+	if (ret == nullptr) {
+		std::string operand;
+		StringsMergeOperator::EncodeIncrby(value, &operand);
+		return db->Merge(WriteOptions(), key, operand);
+	}
+
 	Status s = db->Get(ReadOptions(), key, &oldvalue);
 	if (s.ok()) {
 		ParsedStringsMetaValue pstringsvalue(&oldvalue);
@@ -668,6 +728,12 @@ Status RedisString::Incrbyfloat(const std::string_view& key,
 	}
 
 	HashLock l(&lockmgr, key);
+	if (ret == nullptr) {
+		std::string operand;
+		StringsMergeOperator::EncodeIncrbyfloat(value, &operand);
+		return db->Merge(WriteOptions(), key, operand);
+	}
+
 	Status s = db->Get(ReadOptions(), key, &oldvalue);
 	if (s.ok()) {
 		ParsedStringsMetaValue pstringsvalue(&oldvalue);
@@ -718,6 +784,15 @@ Status RedisString::Decrby(const std::string_view& key, int64_t value, int64_t*
 	std::string oldvalue;
 	std::string newvalue;
 	HashLock l(&lockmgr, key);
+	if (ret == nullptr) {
+		if (value == LLONG_MIN) {
+			return Status::InvalidArgument("Overflow");
+		}
+		std::string operand;
+		StringsMergeOperator::EncodeIncrby(-value, &operand);
+		return db->Merge(WriteOptions(), key, operand);
+	}
+
 	Status s = db->Get(ReadOptions(), key, &oldvalue);
 	if (s.ok()) {
 		ParsedStringsMetaValue pstringsvalue(&oldvalue);
@@ -760,8 +835,14 @@ Status RedisString::Decrby(const std::string_view& key, int64_t value, int64_t*
 Status RedisString::Append(const std::string_view& key,
 	const std::string_view& value, int32_t* ret) {
 	std::string oldvalue;
-	*ret = 0;
 	HashLock l(&lockmgr, key);
+	if (ret == nullptr) {
+		std::string operand;
+		StringsMergeOperator::EncodeAppend(value, &operand);
+		return db->Merge(WriteOptions(), key, operand);
+	}
+
+	*ret = 0;
 	Status s = db->Get(ReadOptions(), key, &oldvalue);
 	if (s.ok()) {
 		ParsedStringsMetaValue pstringsvalue(&oldvalue);
@@ -45,6 +45,10 @@ public:
 	Status Get(const std::string_view& key,
 		std::string* value);
 
+	// Like Get(), but without copying the value out of the DB.
+	Status Get(const std::string_view& key,
+		PinnableValue* value);
+
 	Status GetSet(const std::string_view& key,
 		const std::string_view& value, std::string* oldvalue);
 
@@ -59,11 +63,25 @@ public:
 	Status MSetnx(const std::vector<KeyValue>& kvs,
 		int32_t* ret);
 
+	// Set *exists if any key of "kvs" holds a value that is not stale,
+	// and add the writes of "kvs" to *batch otherwise.
+	// REQUIRES: the locks of the keys in GetLockMgr() are held.
+	Status MSetnx(const std::vector<KeyValue>& kvs,
+		bool* exists, WriteBatch* batch);
+
 	Status MGet(const std::vector<std::string>& keys,
 		std::vector<ValueStatus>* vss);
 
 	Status Del(const std::string_view& key);
 
+	// Add the deletion of "key" to *batch instead of writing it.
+	// REQUIRES: the lock of "key" in GetLockMgr() is held.
+	Status Del(const std::string_view& key, WriteBatch* batch);
+
+	DB* GetDB() const { return db.get(); }
+
+	LockMgr* GetLockMgr() { return &lockmgr; }
+
 	Status Delvx(const std::string_view& key,
 		const std::string_view& value, int32_t* ret);
 
@@ -94,6 +112,11 @@ public:
 	Status TTL(const std::string_view& key,
 		int64_t* timestamp);
 
+	// Incrby, Incrbyfloat, Decrby and Append store the result in *ret.
+	// If "ret" is nullptr they do not read the key: the update is written
+	// as an operand of StringsMergeOperator, and an update that cannot
+	// apply, such as an increment of a value that is not a number, is
+	// dropped silently when the operand is folded.
 	Status Incrby(const std::string_view& key,
 		int64_t value, int64_t* ret);
 
@@ -1,8 +1,13 @@
 #include "rediszset.h"
+#include "redisfilter.h"
 
 RedisZset::RedisZset(RedisDB* redis, const Options& options, const std::string& path)
-	:redis(redis),
-	db(new DB(options, path)) {
+	:redis(redis) {
+	std::shared_ptr<DataFilterFactory> factory(new DataFilterFactory(DataFilterFactory::kZSets));
+	Options opts(options);
+	opts.compactionfilterfactory = factory;
+	db.reset(new DB(opts, path));
+	factory->SetDB(db.get());
 }
 
 RedisZset::~RedisZset() {
@@ -13,6 +18,13 @@ Status RedisZset::Open() {
 	return db->Open();
 }
 
+Status RedisZset::CompactRange(const std::string_view* begin,
+	const std::string_view* end, const ColumnFamilyType& type) {
+	// Meta and data keys share one DB.
+	db->CompactRange(begin, end);
+	return Status::OK();
+}
+
 Status RedisZset::DestroyDB(const std::string path, const Options& options) {
 	return db->DestroyDB(path, options);
 }
@@ -30,7 +42,7 @@ Status RedisZset::ZAdd(const std::string_view& key,
 		}
 	}
 
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 	char scorebuf[8];
 	int32_t version = 0;
 	std::string metavalue;
@@ -128,7 +140,7 @@ Status RedisZset::ZRange(const std::string_view& key,
 	readopts.snapshot = snapshot;
 	readopts.fillcache = false;
 
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 	std::string metavalue;
 	Status s = db->Get(readopts, zkey.Encode(), &metavalue);
 	if (s.ok()) {
@@ -184,7 +196,7 @@ Status RedisZset::ZRank(const std::string_view& key,
 	readopts.snapshot = snapshot;
 	readopts.fillcache = false;
 
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 	Status s = db->Get(readopts, zkey.Encode(), &metavalue);
 	if (s.ok()) {
 		ParsedZSetsMetaValue pzsetmetavalue(&metavalue);
@@ -227,7 +239,7 @@ Status RedisZset::ZRank(const std::string_view& key,
 Status RedisZset::ZCard(const std::string_view& key, int32_t* card) {
 	*card = 0;
 	std::string metavalue;
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 
 	Status s = db->Get(ReadOptions(), zkey.Encode(), &metavalue);
 	if (s.ok()) {
@@ -258,7 +270,7 @@ Status RedisZset::ZIncrby(const std::string_view& key,
 	WriteBatch batch;
 	HashLock l(&lockmgr, key);
 	
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 	Status s = db->Get(ReadOptions(), zkey.Encode(), &metavalue);
 	if (s.ok()) {
 		ParsedZSetsMetaValue pzsetmetavalue(&metavalue);
@@ -366,7 +378,7 @@ Status RedisZset::ScanKeys(const std::string& pattern,
 			&& phashesmetavalue.GetCount() != 0) {
 			key =ToString(iter->key());
 
-			ZSetsScoreKey zkey(pattern, 0, 0, 0);
+			ZSetsScoreKey zkey(pattern, 0, 0, "");
 			const std::string_view keyview = zkey.Encode();
 			if (StringMatchLen(keyview.data(),
 					keyview.size(), key.data(), key.size(), 0)) {
@@ -385,7 +397,7 @@ Status RedisZset::ZCount(const std::string_view& key, double min, double max,
 
 Status RedisZset::Expire(const std::string_view& key, int32_t ttl) {
 	std::string metavalue;
-	ZSetsScoreKey zkey(key, 0, 0, 0);
+	ZSetsScoreKey zkey(key, 0, 0, "");
 
 	HashLock l(&lockmgr, key);
 	Status s = db->Get(ReadOptions(), zkey.Encode(), &metavalue);
@@ -408,9 +420,18 @@ Status RedisZset::Expire(const std::string_view& key, int32_t ttl) {
 }
 
 Status RedisZset::Del(const std::string_view& key) {
-	ZSetsScoreKey zkey(key, 0, 0, 0);
-	std::string metavalue;
 	HashLock l(&lockmgr, key);
+	WriteBatch batch;
+	Status s = Del(key, &batch);
+	if (s.ok()) {
+		s = db->Write(WriteOptions(), &batch);
+	}
+	return s;
+}
+
+Status RedisZset::Del(const std::string_view& key, WriteBatch* batch) {
+	ZSetsScoreKey zkey(key, 0, 0, "");
+	std::string metavalue;
 	Status s = db->Get(ReadOptions(), zkey.Encode(), &metavalue);
 	if (s.ok()) {
 		ParsedZSetsMetaValue pzsetsmetavalue(&metavalue);
@@ -419,9 +440,8 @@ Status RedisZset::Del(const std::string_view& key) {
 		} else if (pzsetsmetavalue.GetCount() == 0) {
 			return Status::NotFound("");
 		} else {
-			uint32_t statistic = pzsetsmetavalue.GetCount();
 			pzsetsmetavalue.InitialMetaValue();
-			s = db->Put(WriteOptions(), zkey.Encode(), metavalue);
+			batch->Put(zkey.Encode(), metavalue);
 		}
 	}
 	return s;
@@ -21,6 +21,9 @@ public:
 
 	Status Open();
 
+	Status CompactRange(const std::string_view* begin,
+		const std::string_view* end, const ColumnFamilyType& type = kMetaAndData);
+
 	Status DestroyDB(const std::string path, const Options& options);
 
 	Status ZAdd(const std::string_view& key,
@@ -46,6 +49,14 @@ public:
 
 	Status Del(const std::string_view& key);
 
+	// Add the deletion of "key" to *batch instead of writing it.
+	// REQUIRES: the lock of "key" in GetLockMgr() is held.
+	Status Del(const std::string_view& key, WriteBatch* batch);
+
+	DB* GetDB() const { return db.get(); }
+
+	LockMgr* GetLockMgr() { return &lockmgr; }
+
 	Status ScanKeys(const std::string& pattern,
 				std::vector<std::string>* keys);
 private:
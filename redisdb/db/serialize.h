@@ -202,7 +202,7 @@ public:
 		dst += value.size() + 2 * sizeof(int32_t);
 		EncodeFixed64(dst, leftindex);
 		dst += sizeof(int64_t);
-		EncodeFixed64(dst, leftindex);
+		EncodeFixed64(dst, rightindex);
 		return 2 * sizeof(int64_t);
 	}
 
@@ -0,0 +1,249 @@
+#include "sharedlog.h"
+#include <algorithm>
+#include <functional>
+#include "coding.h"
+#include "filename.h"
+#include "logging.h"
+
+// Do not let a group grow past this many bytes of records, as in
+// DB::BuildBatchGroup().
+static const size_t kMaxGroupBytes = 1 << 20;
+
+// Information kept for every waiting writer
+struct SharedLog::Writer {
+	std::string_view record;
+	bool roll;          // Switch to a new log file instead of appending
+	bool sync;
+	bool done;
+	bool syncerror;
+	Status status;
+	std::condition_variable cv;
+
+	Writer()
+		: roll(false),
+		sync(false),
+		done(false),
+		syncerror(false) {
+
+	}
+};
+
+SharedLog::SharedLog(const Options& options, const std::string& dirname, uint32_t members)
+	: options(options),
+	dirname(dirname),
+	members(members),
+	logfilenumber(0) {
+
+}
+
+SharedLog::~SharedLog() {
+	assert(writers.empty());
+	log.reset();
+	logfile.reset();
+	if (dirlock != nullptr) {
+		options.env->UnlockFile(dirlock);
+	}
+}
+
+Status SharedLog::Open() {
+	std::unique_lock<std::mutex> lk(mutex);
+	options.env->CreateDir(dirname);
+	Status s = options.env->LockFile(LockFileName(dirname), dirlock);
+	if (!s.ok()) {
+		return s;
+	}
+
+	std::vector<std::string> filenames;
+	s = options.env->GetChildren(dirname, &filenames);
+	if (!s.ok()) {
+		return s;
+	}
+
+	uint64_t number;
+	FileType type;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+			recoverylogs.push_back(number);
+		}
+	}
+
+	std::sort(recoverylogs.begin(), recoverylogs.end());
+	logfilenumber = recoverylogs.empty() ? 1 : recoverylogs.back() + 1;
+	s = options.env->NewWritableFile(LogFileName(dirname, logfilenumber), logfile);
+	if (s.ok()) {
+		log.reset(new LogWriter(logfile.get()));
+	}
+	return s;
+}
+
+Status SharedLog::AddRecord(const std::string_view& record, bool sync, bool* syncerror) {
+	Writer w;
+	w.record = record;
+	w.sync = sync;
+
+	std::unique_lock<std::mutex> lk(mutex);
+	writers.push_back(&w);
+	while (!w.done && &w != writers.front()) {
+		w.cv.wait(lk);
+	}
+
+	if (w.done) {
+		*syncerror = w.syncerror;
+		return w.status;
+	}
+
+	// Take the writers queued behind us up to the next log switch.  A
+	// sync writer may join a group led by a non-sync one; the group is
+	// then synced for all of its members.
+	std::vector<Writer*> group;
+	size_t bytes = 0;
+	bool syncgroup = false;
+	for (Writer* x : writers) {
+		if (x->roll || (!group.empty() && bytes + x->record.size() > kMaxGroupBytes)) {
+			break;
+		}
+
+		bytes += x->record.size();
+		syncgroup = syncgroup || x->sync;
+		group.push_back(x);
+	}
+
+	Status s = error;
+	bool syncfailed = false;
+	if (s.ok()) {
+		// Only the head of writers touches the log, so it can be
+		// written without the mutex.
+		lk.unlock();
+		for (Writer* x : group) {
+			s = log->AddRecord(x->record);
+			if (!s.ok()) {
+				break;
+			}
+		}
+
+		if (s.ok() && syncgroup) {
+			s = logfile->sync();
+			syncfailed = !s.ok();
+		}
+		lk.lock();
+
+		if (syncfailed) {
+			// The records may or may not show up after a restart, so
+			// fail every later write.
+			error = s;
+		}
+	}
+
+	for (Writer* x : group) {
+		assert(writers.front() == x);
+		writers.pop_front();
+		if (x != &w) {
+			x->status = s;
+			x->syncerror = syncfailed;
+			x->done = true;
+			x->cv.notify_one();
+		}
+	}
+
+	// Notify new head of write queue
+	if (!writers.empty()) {
+		writers.front()->cv.notify_one();
+	}
+
+	*syncerror = syncfailed;
+	return s;
+}
+
+Status SharedLog::NewLogFile(uint64_t* number) {
+	Writer w;
+	w.roll = true;
+
+	std::unique_lock<std::mutex> lk(mutex);
+	writers.push_back(&w);
+	while (&w != writers.front()) {
+		w.cv.wait(lk);
+	}
+
+	const uint64_t newlognumber = logfilenumber + 1;
+	Status s = error;
+	if (s.ok()) {
+		lk.unlock();
+		std::shared_ptr<WritableFile> lfile;
+		s = options.env->NewWritableFile(LogFileName(dirname, newlognumber), lfile);
+		lk.lock();
+
+		if (s.ok()) {
+			logfile = lfile;
+			log.reset(new LogWriter(lfile.get()));
+			logfilenumber = newlognumber;
+			*number = newlognumber;
+		}
+	}
+
+	writers.pop_front();
+	if (!writers.empty()) {
+		writers.front()->cv.notify_one();
+	}
+	return s;
+}
+
+uint64_t SharedLog::GetLogNumber() {
+	std::unique_lock<std::mutex> lk(mutex);
+	return logfilenumber;
+}
+
+void SharedLog::GetRecoveryLogs(uint64_t minlog, std::vector<uint64_t>* logs) {
+	std::unique_lock<std::mutex> lk(mutex);
+	logs->clear();
+	for (uint64_t number : recoverylogs) {
+		if (number >= minlog) {
+			logs->push_back(number);
+		}
+	}
+}
+
+void SharedLog::SetMinLogNumber(uint32_t id, uint64_t number) {
+	assert(id < members);
+	std::unique_lock<std::mutex> lk(mutex);
+	uint64_t& minlog = minlogs[id];
+	minlog = std::max(minlog, number);
+	// A member that has not been opened yet may still need every log.
+	if (minlogs.size() == members) {
+		DeleteObsoleteFiles();
+	}
+}
+
+// REQUIRES: mutex is held
+void SharedLog::DeleteObsoleteFiles() {
+	uint64_t minlog = logfilenumber;
+	for (const auto& it : minlogs) {
+		minlog = std::min(minlog, it.second);
+	}
+
+	std::vector<std::string> filenames;
+	options.env->GetChildren(dirname, &filenames);  // Ignoring errors on purpose
+	uint64_t number;
+	FileType type;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (ParseFileName(filenames[i], &number, &type) &&
+			type == kLogFile && number < minlog) {
+			Debug(options.infolog, "Delete shared log #%lld\n",
+				static_cast<unsigned long long>(number));
+			options.env->DeleteFile(dirname + "/" + filenames[i]);
+		}
+	}
+
+	recoverylogs.erase(std::remove_if(recoverylogs.begin(), recoverylogs.end(),
+		std::bind(std::less<uint64_t>(), std::placeholders::_1, minlog)), recoverylogs.end());
+}
+
+void SharedLog::AppendEntry(std::string* record, uint32_t id, const std::string_view& contents) {
+	PutVarint32(record, id);
+	PutLengthPrefixedSlice(record, contents);
+}
+
+bool SharedLog::GetEntry(std::string_view* input, uint32_t* id, std::string_view* contents) {
+	return !input->empty() &&
+		GetVarint32(input, id) &&
+		GetLengthPrefixedSlice(input, contents);
+}
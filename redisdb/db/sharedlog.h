@@ -0,0 +1,104 @@
+#pragma once
+
+// SharedLog is a write-ahead log used by several DBs at once, so that
+// writes to all of them cost one log append and, for sync writes, one
+// fsync per group instead of one per DB.  Each DB keeps its own
+// memtables, tables and manifest and is told apart in the log by the
+// id it was given in Options::sharedlogid.
+//
+// A log record holds one or more entries, each a member id followed by
+// the contents of a WriteBatch for that member.  A record with entries
+// for several members is how DB::AtomicWrite() makes a write to
+// several DBs atomic: after a crash either every member replays its
+// part of the record or none does.
+//
+// Appends from all members are queued and committed in groups by the
+// writer at the head of the queue, the same way DB::Write() groups the
+// writers of a single DB.
+//
+// Every member remembers the oldest log that still holds data it has
+// not flushed (VersionSet::GetSharedLogNumber()).  Logs older than that
+// of every member are deleted once all members have reported in.
+//
+// Thread safe.
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "logwriter.h"
+#include "option.h"
+#include "status.h"
+#include "env.h"
+
+class SharedLog {
+public:
+	// Logs are kept in "dirname", for "members" DBs with ids in
+	// [0, members).
+	SharedLog(const Options& options, const std::string& dirname, uint32_t members);
+
+	~SharedLog();
+
+	SharedLog(const SharedLog&) = delete;
+
+	void operator=(const SharedLog&) = delete;
+
+	// Start a new log file after the existing ones, which are kept for
+	// the members to recover from.  Must be called before any member
+	// is opened.
+	Status Open();
+
+	// Append "record" to the log and sync it if "sync" is true.  Sets
+	// *syncerror if the record was written but could not be synced.
+	Status AddRecord(const std::string_view& record, bool sync, bool* syncerror);
+
+	// Switch to a new log file, whose number is stored in *number.
+	Status NewLogFile(uint64_t* number);
+
+	// Number of the log file that is being appended to.
+	uint64_t GetLogNumber();
+
+	const std::string& GetDirName() const { return dirname; }
+
+	// Numbers of the logs written before Open() that are not older
+	// than "minlog", in ascending order.
+	void GetRecoveryLogs(uint64_t minlog, std::vector<uint64_t>* logs);
+
+	// Member "id" no longer needs logs older than "number".
+	void SetMinLogNumber(uint32_t id, uint64_t number);
+
+	// Add an entry for member "id" holding "contents" to *record.
+	static void AppendEntry(std::string* record, uint32_t id, const std::string_view& contents);
+
+	// Parse the next entry of *input, advancing it past the entry.
+	// Returns false at the end of the record or if it is malformed.
+	static bool GetEntry(std::string_view* input, uint32_t* id, std::string_view* contents);
+
+private:
+	struct Writer;
+
+	void DeleteObsoleteFiles();
+
+	const Options options;
+	const std::string dirname;
+	const uint32_t members;
+	std::shared_ptr<FileLock> dirlock;
+
+	// mutex protects the following state.  The log itself is only
+	// touched by the writer at the head of writers.
+	std::mutex mutex;
+	std::deque<Writer*> writers;
+	std::shared_ptr<WritableFile> logfile;
+	std::shared_ptr<LogWriter> log;
+	uint64_t logfilenumber;
+	std::vector<uint64_t> recoverylogs;
+	std::map<uint32_t, uint64_t> minlogs;
+	// Set when a sync failed; the log is in an unknown state and
+	// every later append fails.
+	Status error;
+};
@@ -3,6 +3,9 @@
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <random>
+#include <thread>
+#include "arena.h"
 
 template<typename Key, class Comparator>
 class SkipList {
@@ -12,12 +15,19 @@ public:
 	// Create a new SkipList object that will use "cmp" for comparing keys,
 	// and will allocate memory using "*arena".  Objects allocated in the arena
 	// must remain allocated for the lifetime of the skiplist object.
-	explicit SkipList(Comparator cmp);
+	explicit SkipList(Comparator cmp, Arena* arena);
 
 	// Insert key into the list.
 	// REQUIRES: nothing that compares Equal to key is currently in the list.
 	void Insert(const Key& key);
 
+	// Like Insert(key), but may be called by several threads at once, as
+	// long as none of them is calling Insert() at the same time.  Links are
+	// published with compare-and-swap, bottom level first, so concurrent
+	// readers still never observe a partially linked node.
+	// REQUIRES: nothing that compares Equal to key is currently in the list.
+	void InsertConcurrently(const Key& key);
+
 	// Returns true iff an entry that compares Equal to key is in the list.
 	bool Contains(const Key& key) const;
 
@@ -67,6 +77,7 @@ private:
 
 	// Immutable after construction
 	Comparator const compare;
+	Arena* const arena;    // Arena used for allocations of nodes
 
 	Node* const head;
 
@@ -83,8 +94,17 @@ private:
 
 	Node* NewNode(const Key& key, int height);
 
+	Node* NewNodeConcurrently(const Key& key, int height);
+
 	int RandomHeight();
 
+	int RandomHeight(std::default_random_engine* r);
+
+	// Starting at "before" (which must sort before key), walk level "level"
+	// to find the pair of adjacent nodes that key should be linked between.
+	void FindSpliceForLevel(const Key& key, Node* before, int level,
+		Node** outprev, Node** outnext) const;
+
 	bool Equal(const Key& a, const Key& b) const { return (compare(a, b) == 0); }
 
 	// Return true if key is greater than the data stored in "n"
@@ -115,9 +135,6 @@ template<typename Key, class Comparator>
 struct SkipList<Key, Comparator>::Node {
 	explicit Node(const Key& k) : key(k) { }
 
-	~Node() {
-		delete[] key;
-	}
 	Key const key;
 
 	// Accessors/mutators for links.  Wrapped in methods so we can
@@ -147,6 +164,13 @@ struct SkipList<Key, Comparator>::Node {
 		nextnode[n].store(x, std::memory_order_relaxed);
 	}
 
+	// Link x in at level n iff the current successor is still "expected".
+	bool casNext(int n, Node* expected, Node* x) {
+		assert(n >= 0);
+		return nextnode[n].compare_exchange_strong(expected, x,
+			std::memory_order_release, std::memory_order_relaxed);
+	}
+
 private:
 	// Array of length Equal to the node height.  next_[0] is lowest level link.
 	std::atomic<Node*> nextnode[1];
@@ -155,8 +179,16 @@ private:
 template<typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node*
 SkipList<Key, Comparator>::NewNode(const Key& key, int height) {
-	char* const nodememory = new char[
-		sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1)];
+	char* const nodememory = arena->allocateAligned(
+		sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+	return new (nodememory) Node(key);
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::NewNodeConcurrently(const Key& key, int height) {
+	char* const nodememory = arena->allocateAlignedConcurrently(
+		sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
 	return new (nodememory) Node(key);
 }
 
@@ -214,10 +246,15 @@ inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
 
 template<typename Key, class Comparator>
 int SkipList<Key, Comparator>::RandomHeight() {
+	return RandomHeight(&rnd);
+}
+
+template<typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeight(std::default_random_engine* r) {
 	// Increase height with probability 1 in kBranching
 	static const unsigned int kBranching = 4;
 	int height = 1;
-	while (height< kMaxHeight && ((rnd() % kBranching) == 0)) {
+	while (height< kMaxHeight && (((*r)() % kBranching) == 0)) {
 		height++;
 	}
 
@@ -303,8 +340,9 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
 }
 
 template<typename Key, class Comparator>
-SkipList<Key, Comparator>::SkipList(Comparator cmp)
+SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
 	: compare(cmp),
+	arena(arena),
 	head(NewNode(0 /* any key will do */, kMaxHeight)),
 	maxheight(1),
 	rnd(time(0)) {
@@ -352,6 +390,68 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
 	}
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key, Node* before,
+	int level, Node** outprev, Node** outnext) const {
+	while (true) {
+		Node* next = before->Next(level);
+		if (KeyIsAfterNode(key, next)) {
+			// Keep searching in this list
+			before = next;
+		}
+		else {
+			*outprev = before;
+			*outnext = next;
+			return;
+		}
+	}
+}
+
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+	// rnd is owned by Insert(); every concurrent inserter draws heights
+	// from its own engine instead.
+	static thread_local std::default_random_engine trnd(
+		std::hash<std::thread::id>()(std::this_thread::get_id()));
+	int height = RandomHeight(&trnd);
+
+	// Raise maxheight if needed.  Readers tolerate seeing the new height
+	// before the node is linked, exactly as in Insert().
+	int max = GetMaxHeight();
+	while (height > max) {
+		if (maxheight.compare_exchange_weak(max, height, std::memory_order_relaxed)) {
+			max = height;
+			break;
+		}
+	}
+
+	// Compute the splice at every level from the top down, reusing the
+	// predecessor found at the level above as the starting point.
+	Node* prev[kMaxHeight];
+	Node* next[kMaxHeight];
+	Node* before = head;
+	for (int i = max - 1; i >= 0; i--) {
+		FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+		before = prev[i];
+	}
+
+	// Our data structure does not allow duplicate insertion
+	assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+	Node* x = NewNodeConcurrently(key, height);
+	for (int i = 0; i < height; i++) {
+		while (true) {
+			x->noBarrierSetNext(i, next[i]);
+			if (prev[i]->casNext(i, next[i], x)) {
+				break;
+			}
+			// Another writer linked a node between prev[i] and next[i];
+			// the correct splice is somewhere to the right of prev[i].
+			FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+		}
+	}
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
 	Node* x = FindGreaterOrEqual(key, nullptr);
@@ -38,12 +38,13 @@ public:
 	const std::shared_ptr<Snapshot> NewSnapshot(uint64_t sequencenumber) {
 		assert(empty() || newest()->GetSequenceNumber()<= sequencenumber);
 		std::shared_ptr<Snapshot> snapshot(new Snapshot(sequencenumber));
+		lists.push_back(snapshot);
 		return snapshot;
 	}
 
 	void DeleteSnapshot(const std::shared_ptr<Snapshot>& shapshot) {
 		for (auto it = lists.begin(); it != lists.end();) {
-			if ((*it)->GetSequenceNumber() == shapshot->GetSequenceNumber()) {
+			if (*it == shapshot) {
 				lists.erase(it++);
 				break;
 			}
@@ -0,0 +1,108 @@
+#include "statistics.h"
+#include <stdio.h>
+#include <chrono>
+
+static const char* const kTickerNames[kBytesReadLevel0] = {
+	"block.cache.hit",
+	"block.cache.miss",
+	"block.cache.add",
+	"bloom.filter.useful",
+	"memtable.hit",
+	"memtable.miss",
+	"number.keys.read",
+	"number.keys.written",
+	"bytes.written",
+	"wal.syncs",
+	"stall.micros",
+};
+
+static const char* const kHistogramNames[kHistogramMax] = {
+	"db.get.micros",
+	"db.write.micros",
+	"wal.sync.micros",
+	"stall.micros",
+};
+
+static uint64_t NowMicros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Statistics::Statistics() {
+	Reset();
+}
+
+void Statistics::MeasureTime(uint32_t histogram, uint64_t micros) {
+	HistogramSlot& slot = histograms[histogram];
+	std::unique_lock<std::mutex> lk(slot.mutex);
+	slot.histogram.Add(static_cast<double>(micros));
+}
+
+std::string Statistics::GetHistogramString(uint32_t histogram) const {
+	const HistogramSlot& slot = histograms[histogram];
+	std::unique_lock<std::mutex> lk(slot.mutex);
+	return slot.histogram.ToString();
+}
+
+void Statistics::Reset() {
+	for (uint32_t i = 0; i < kTickerMax; i++) {
+		tickers[i].store(0, std::memory_order_relaxed);
+	}
+
+	for (uint32_t i = 0; i < kHistogramMax; i++) {
+		std::unique_lock<std::mutex> lk(histograms[i].mutex);
+		histograms[i].histogram.Clear();
+	}
+}
+
+std::string Statistics::ToString() const {
+	std::string r;
+	char buf[200];
+	for (uint32_t i = 0; i < kTickerMax; i++) {
+		if (i < kBytesReadLevel0) {
+			snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[i],
+				static_cast<unsigned long long>(GetTickerCount(i)));
+		}
+		else {
+			snprintf(buf, sizeof(buf), "bytes.read.level%u COUNT : %llu\n",
+				i - kBytesReadLevel0,
+				static_cast<unsigned long long>(GetTickerCount(i)));
+		}
+		r.append(buf);
+	}
+
+	for (uint32_t i = 0; i < kHistogramMax; i++) {
+		const HistogramSlot& slot = histograms[i];
+		std::unique_lock<std::mutex> lk(slot.mutex);
+		const Histogram& h = slot.histogram;
+		const bool empty = (h.Count() == 0);
+		snprintf(buf, sizeof(buf),
+			"%s P50 : %.2f P95 : %.2f P99 : %.2f MAX : %.0f COUNT : %.0f AVG : %.2f\n",
+			kHistogramNames[i], empty ? 0.0 : h.Median(), empty ? 0.0 : h.Percentile(95),
+			empty ? 0.0 : h.Percentile(99), h.Max(), h.Count(), h.Average());
+		r.append(buf);
+	}
+	return r;
+}
+
+std::shared_ptr<Statistics> CreateDBStatistics() {
+	std::shared_ptr<Statistics> statistics(new Statistics());
+	return statistics;
+}
+
+StopWatch::StopWatch(Statistics* statistics, uint32_t histogram)
+	: statistics(statistics),
+	histogram(histogram),
+	start(statistics != nullptr ? NowMicros() : 0) {
+
+}
+
+StopWatch::~StopWatch() {
+	if (statistics != nullptr) {
+		statistics->MeasureTime(histogram, NowMicros() - start);
+	}
+}
+
+uint64_t StopWatch::ElapsedMicros() const {
+	return statistics != nullptr ? NowMicros() - start : 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Statistics collects DB-wide counters ("tickers") and latency
+// histograms.  Attach one through Options::statistics; it may be shared
+// by several DBs.  Everything is thread safe.  Read it back with
+// DB::GetProperty("leveldb.statistics") or the accessors below.
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "dbformat.h"
+#include "histogram.h"
+
+enum Tickers : uint32_t {
+	kBlockCacheHit = 0,
+	kBlockCacheMiss,
+	kBlockCacheAdd,
+	kBloomFilterUseful,       // Table lookups a filter answered alone
+	kMemtableHit,
+	kMemtableMiss,
+	kNumberKeysRead,
+	kNumberKeysWritten,
+	kBytesWritten,
+	kWalSyncs,
+	kStallMicros,             // Time writers spent delayed or stopped
+	kBytesReadLevel0,         // Block bytes read by Get() from level N is
+	                          // kBytesReadLevel0 + N
+	kTickerMax = kBytesReadLevel0 + kNumLevels
+};
+
+enum Histograms : uint32_t {
+	kDBGetMicros = 0,
+	kDBWriteMicros,
+	kWalSyncMicros,
+	kStallHistogramMicros,
+	kHistogramMax
+};
+
+class Statistics {
+public:
+	Statistics();
+
+	Statistics(const Statistics&) = delete;
+
+	void operator=(const Statistics&) = delete;
+
+	void RecordTick(uint32_t ticker, uint64_t count = 1) {
+		tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+	}
+
+	uint64_t GetTickerCount(uint32_t ticker) const {
+		return tickers[ticker].load(std::memory_order_relaxed);
+	}
+
+	void MeasureTime(uint32_t histogram, uint64_t micros);
+
+	// Full bucket dump of one histogram.
+	std::string GetHistogramString(uint32_t histogram) const;
+
+	void Reset();
+
+	// One line per ticker and a summary line per histogram.
+	std::string ToString() const;
+
+private:
+	struct HistogramSlot {
+		mutable std::mutex mutex;
+		Histogram histogram;
+	};
+
+	std::atomic<uint64_t> tickers[kTickerMax];
+	HistogramSlot histograms[kHistogramMax];
+};
+
+std::shared_ptr<Statistics> CreateDBStatistics();
+
+inline void RecordTick(const std::shared_ptr<Statistics>& statistics,
+	uint32_t ticker, uint64_t count = 1) {
+	if (statistics != nullptr) {
+		statistics->RecordTick(ticker, count);
+	}
+}
+
+// Measures the lifetime of a scope into a histogram, if statistics are
+// enabled.
+class StopWatch {
+public:
+	StopWatch(Statistics* statistics, uint32_t histogram);
+
+	~StopWatch();
+
+	// Microseconds since construction; 0 without statistics.
+	uint64_t ElapsedMicros() const;
+
+private:
+	Statistics* const statistics;
+	const uint32_t histogram;
+	const uint64_t start;
+};
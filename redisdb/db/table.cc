@@ -3,24 +3,51 @@
 #include "coding.h"
 #include "option.h"
 #include "cache.h"
+#include "filterblock.h"
+#include "perfcontext.h"
+#include <algorithm>
 
 struct Table::Rep {
 	~Rep() {
-
+		if (filterdata != nullptr) {
+			free((void*)filterdata);
+		}
 	}
 
 	Options options;
 	Status status;
 	std::shared_ptr<RandomAccessFile> file;
 	uint64_t cacheid;
+	std::shared_ptr<FilterBlockReader> filter;
+	const char* filterdata = nullptr;
+	size_t filtersize = 0;
 	BlockHandle metaindexhandle;  // Handle to metaindex_block: saved from footer
 	std::shared_ptr<Block> indexblock;
+	std::string compressiondict;  // Dictionary of LZ4/Zstd data blocks, if any
+	std::shared_ptr<VerifiedBlocks> verified;  // Set if options.verifychecksumsonce
 };
 
 Table::~Table() {
 
 }
 
+// Keeps track of the data blocks listed in "indexblock".
+static std::shared_ptr<VerifiedBlocks> NewVerifiedBlocks(const Options& options,
+	const std::shared_ptr<Block>& indexblock) {
+	std::vector<uint64_t> offsets;
+	std::shared_ptr<Iterator> iter = indexblock->NewIterator(options.comparator);
+	for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+		BlockHandle handle;
+		std::string_view input = iter->value();
+		if (handle.DecodeFrom(&input).ok()) {
+			offsets.push_back(handle.GetOffset());
+		}
+	}
+
+	std::sort(offsets.begin(), offsets.end());
+	return std::shared_ptr<VerifiedBlocks>(new VerifiedBlocks(std::move(offsets)));
+}
+
 Status Table::Open(const Options& options,
 	const std::shared_ptr<RandomAccessFile>& file,
 	uint64_t size,
@@ -58,11 +85,96 @@ Status Table::Open(const Options& options,
 		rep->file = file;
 		rep->metaindexhandle = footer.GetMetaindexHandle();
 		rep->indexblock = indexblock;
+		rep->cacheid = (options.blockcache != nullptr ? options.blockcache->NewId() : 0);
+		if (options.verifychecksumsonce) {
+			rep->verified = NewVerifiedBlocks(options, indexblock);
+		}
 		table = std::shared_ptr<Table>(new Table(rep));
+		table->ReadMeta(footer);
 	}
 	return s;
 }
 
+void Table::ReadMeta(const Footer& footer) {
+	ReadOptions opt;
+	if (rep->options.paranoidchecks) {
+		opt.verifychecksums = true;
+	}
+
+	BlockContents contents;
+	if (!ReadBlock(rep->file, opt, footer.GetMetaindexHandle(), &contents).ok()) {
+		// Do not propagate errors since meta info is not needed for operation
+		return;
+	}
+
+	std::shared_ptr<Block> meta(new Block(contents));
+	std::shared_ptr<Iterator> iter = meta->NewIterator(BytewiseComparator());
+	iter->Seek(kCompressionDictionaryKey);
+	if (iter->Valid() && iter->key() == std::string_view(kCompressionDictionaryKey)) {
+		ReadCompressionDictionary(iter->value());
+	}
+
+	if (rep->options.filterpolicy == nullptr) {
+		return;  // Do not need the filter
+	}
+
+	std::string key = "filter.";
+	key.append(rep->options.filterpolicy->Name());
+	iter->Seek(key);
+	if (iter->Valid() && iter->key() == std::string_view(key)) {
+		ReadFilter(iter->value());
+	}
+}
+
+void Table::ReadCompressionDictionary(const std::string_view& dicthandlevalue) {
+	std::string_view v = dicthandlevalue;
+	BlockHandle dicthandle;
+	if (!dicthandle.DecodeFrom(&v).ok()) {
+		return;
+	}
+
+	ReadOptions opt;
+	if (rep->options.paranoidchecks) {
+		opt.verifychecksums = true;
+	}
+
+	BlockContents block;
+	if (!ReadBlock(rep->file, opt, dicthandle, &block).ok()) {
+		return;
+	}
+
+	rep->compressiondict.assign(block.data.data(), block.data.size());
+	if (block.heapallocated) {
+		free((void*)block.data.data());
+	}
+}
+
+void Table::ReadFilter(const std::string_view& filterhandlevalue) {
+	std::string_view v = filterhandlevalue;
+	BlockHandle filterhandle;
+	if (!filterhandle.DecodeFrom(&v).ok()) {
+		return;
+	}
+
+	// We might want to unify with ReadBlock() if we start
+	// requiring checksum verification in Table::Open.
+	ReadOptions opt;
+	if (rep->options.paranoidchecks) {
+		opt.verifychecksums = true;
+	}
+
+	BlockContents block;
+	if (!ReadBlock(rep->file, opt, filterhandle, &block).ok()) {
+		return;
+	}
+
+	if (block.heapallocated) {
+		rep->filterdata = block.data.data();  // Will need to delete later
+		rep->filtersize = block.data.size();
+	}
+	rep->filter.reset(new FilterBlockReader(rep->options.filterpolicy, block.data));
+}
+
 std::shared_ptr<Iterator> Table::NewIterator(const ReadOptions& options) {
 	std::shared_ptr<Iterator> indexIter = rep->indexblock->NewIterator(rep->options.comparator);
 	return NewTwoLevelIterator(indexIter, options, std::bind(&Table::BlockReader,
@@ -75,46 +187,62 @@ static void DeleteBlock(const std::any &arg) {
 
 static void ReleaseBlock(const std::any& arg1, const std::any& arg2) {
 	std::shared_ptr<ShardedLRUCache> cache = std::any_cast<std::shared_ptr<ShardedLRUCache>>(arg1);
-	std::shared_ptr<LRUHandle> handle = std::any_cast<std::shared_ptr<LRUHandle>>(arg2);
+	LRUHandle* handle = std::any_cast<LRUHandle*>(arg2);
 	cache->Release(handle);
 }
 
-std::shared_ptr<Iterator> Table::BlockReader(const ReadOptions& options, const std::string_view& indexvalue) {
+Status Table::ReadDataBlock(const ReadOptions& options, const std::string_view& indexvalue,
+	std::shared_ptr<Block>* block, LRUHandle** cachehandle) {
 	auto blockcache = rep->options.blockcache;
 
-	std::shared_ptr<Block> block;
 	BlockHandle handle;
 	std::string_view input = indexvalue;
 	Status s = handle.DecodeFrom(&input);
-	std::shared_ptr<LRUHandle> cachehandle;
+	*cachehandle = nullptr;
 
 	if (s.ok()) {
 		BlockContents contents;
 		if (blockcache != nullptr) {
-			char cachekeybuffer[8];
-			EncodeFixed64(cachekeybuffer, handle.GetOffset());
+			// Blocks of every table share the cache, so prefix the offset
+			// with the id of this table.
+			char cachekeybuffer[16];
+			EncodeFixed64(cachekeybuffer, rep->cacheid);
+			EncodeFixed64(cachekeybuffer + 8, handle.GetOffset());
 			std::string_view key(cachekeybuffer, sizeof(cachekeybuffer));
-			cachehandle = blockcache->Lookup(key);
-			if (cachehandle != nullptr) {
-				block = std::any_cast<std::shared_ptr<Block>>(cachehandle->value);
+			*cachehandle = blockcache->Lookup(key);
+			if (*cachehandle != nullptr) {
+				*block = std::any_cast<const std::shared_ptr<Block>&>(blockcache->Value(*cachehandle));
+				RecordTick(rep->options.statistics, kBlockCacheHit);
+				GetPerfContext()->blockcachehitcount++;
 			}
 			else {
-				s = ReadBlock(rep->file, options, handle, &contents);
+				RecordTick(rep->options.statistics, kBlockCacheMiss);
+				s = ReadBlock(rep->file, options, handle, &contents, rep->compressiondict,
+					rep->verified.get());
 				if (s.ok()) {
-					block.reset(new Block(contents));
+					block->reset(new Block(contents));
 					if (contents.cachable && options.fillcache) {
-						cachehandle = blockcache->Insert(key, block, block->GetSize(), nullptr);
+						*cachehandle = blockcache->Insert(key, *block, (*block)->GetSize(), nullptr);
+						RecordTick(rep->options.statistics, kBlockCacheAdd);
 					}
 				}
 			}
 		}
 		else {
-			s = ReadBlock(rep->file, options, handle, &contents);
+			s = ReadBlock(rep->file, options, handle, &contents, rep->compressiondict,
+				rep->verified.get());
 			if (s.ok()) {
-				block.reset(new Block(contents));
+				block->reset(new Block(contents));
 			}
 		}
 	}
+	return s;
+}
+
+std::shared_ptr<Iterator> Table::BlockReader(const ReadOptions& options, const std::string_view& indexvalue) {
+	std::shared_ptr<Block> block;
+	LRUHandle* cachehandle;
+	Status s = ReadDataBlock(options, indexvalue, &block, &cachehandle);
 
 	std::shared_ptr<Iterator> iter;
 	if (block != nullptr) {
@@ -123,7 +251,7 @@ std::shared_ptr<Iterator> Table::BlockReader(const ReadOptions& options, const s
 			iter->RegisterCleanup(std::bind(DeleteBlock, block));
 		}
 		else {
-			iter->RegisterCleanup(std::bind(ReleaseBlock, blockcache, cachehandle));
+			iter->RegisterCleanup(std::bind(ReleaseBlock, rep->options.blockcache, cachehandle));
 		}
 	}
 	else {
@@ -137,19 +265,142 @@ Status Table::InternalGet(
 	const std::string_view& key,
 	const std::any& arg,
 	std::function<void(const std::any& arg,
-		const std::string_view& k, const std::string_view& v)>& callback) {
+		const std::string_view& k, const std::string_view& v)>& callback,
+	std::shared_ptr<void>* pin) {
 	Status s;
 	std::shared_ptr<Iterator> iter = rep->indexblock->NewIterator(rep->options.comparator);
+	PerfTimer seektimer(&GetPerfContext()->indexseektime);
 	iter->Seek(key);
+	seektimer.Stop();
 	if (iter->Valid()) {
-		std::shared_ptr<Iterator> blockIter = BlockReader(options, iter->value());
-		blockIter->Seek(key);
-		if (blockIter->Valid()) {
-			callback(arg, blockIter->key(), blockIter->value());
+		std::string_view handlevalue = iter->value();
+		auto filter = rep->filter;
+		BlockHandle handle;
+		if (filter != nullptr && handle.DecodeFrom(&handlevalue).ok() &&
+			!filter->KeyMayMatch(handle.GetOffset(), key)) {
+			// Not found
+			RecordTick(rep->options.statistics, kBloomFilterUseful);
 		}
-		s = blockIter->status();
+		else {
+			std::shared_ptr<Block> block;
+			LRUHandle* cachehandle;
+			s = ReadDataBlock(options, iter->value(), &block, &cachehandle);
+			if (block != nullptr) {
+				if (pin != nullptr) {
+					// A block read through an mmap points into the file.
+					if (block->IsOwned()) {
+						*pin = block;
+					}
+					else {
+						*pin = rep->file;
+					}
+				}
+				s = block->InternalGet(rep->options.comparator, key, arg, callback);
+				if (cachehandle != nullptr) {
+					rep->options.blockcache->Release(cachehandle);
+				}
+			}
+		}
+	}
+
+	if (s.ok()) {
+		s = iter->status();
+	}
+	return s;
 }
 
+Status Table::MultiGet(
+	const ReadOptions& options,
+	const std::vector<std::string_view>& keys,
+	const std::vector<std::any>& args,
+	std::function<void(const std::any& arg,
+		const std::string_view& k, const std::string_view& v)>& callback) {
+	assert(keys.size() == args.size());
+	const Comparator* cmp = rep->options.comparator;
+	Status s;
+	std::shared_ptr<Iterator> iter = rep->indexblock->NewIterator(cmp);
+	std::shared_ptr<Block> block;
+	LRUHandle* cachehandle = nullptr;
+	uint64_t blockoffset = 0;
+	for (size_t i = 0; i < keys.size() && s.ok(); i++) {
+		// An index entry is >= every key of its block and < every key of
+		// the next one, so a sorted key that is still <= it needs no seek.
+		if (!iter->Valid() || cmp->Compare(keys[i], iter->key()) > 0) {
+			iter->Seek(keys[i]);
+			if (!iter->Valid()) {
+				break;      // Every remaining key is past the last block
+			}
+		}
+
+		std::string_view handlevalue = iter->value();
+		BlockHandle handle;
+		s = handle.DecodeFrom(&handlevalue);
+		if (!s.ok()) {
+			break;
+		}
+
+		auto filter = rep->filter;
+		if (filter != nullptr && !filter->KeyMayMatch(handle.GetOffset(), keys[i])) {
+			continue;
+		}
+
+		if (block == nullptr || handle.GetOffset() != blockoffset) {
+			if (cachehandle != nullptr) {
+				rep->options.blockcache->Release(cachehandle);
+			}
+
+			block.reset();
+			s = ReadDataBlock(options, iter->value(), &block, &cachehandle);
+			if (!s.ok()) {
+				break;
+			}
+			blockoffset = handle.GetOffset();
+		}
+		s = block->InternalGet(cmp, keys[i], args[i], callback);
+	}
+
+	if (cachehandle != nullptr) {
+		rep->options.blockcache->Release(cachehandle);
+	}
+
+	if (s.ok()) {
+		s = iter->status();
+	}
+	return s;
+}
+
+size_t Table::ApproximateMemoryUsage() const {
+	return sizeof(Rep) + rep->indexblock->GetSize() + rep->filtersize +
+		rep->compressiondict.size() +
+		(rep->verified != nullptr ? rep->verified->ApproximateMemoryUsage() : 0);
+}
+
+Status Table::VerifyChecksums(const std::function<bool(uint64_t)>& pace) {
+	ReadOptions opt;
+	opt.verifychecksums = true;
+	opt.fillcache = false;
+
+	Status s;
+	std::shared_ptr<Iterator> iter = rep->indexblock->NewIterator(rep->options.comparator);
+	for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+		BlockHandle handle;
+		std::string_view input = iter->value();
+		s = handle.DecodeFrom(&input);
+		if (s.ok()) {
+			// Bypass the cache and the blocks already verified: the point
+			// is to look at the bytes as they are now.
+			BlockContents contents;
+			s = ReadBlock(rep->file, opt, handle, &contents, rep->compressiondict);
+			if (s.ok() && contents.heapallocated) {
+				free((void*)contents.data.data());
+			}
+		}
+
+		if (s.ok() && !pace(handle.GetSize() + kBlockTrailerSize)) {
+			break;
+		}
+	}
+
 	if (s.ok()) {
 		s = iter->status();
 	}
@@ -3,6 +3,7 @@
 #include "status.h"
 #include "block.h"
 #include "iterator.h"
+#include <vector>
 
 class Block;
 
@@ -18,6 +19,8 @@ struct ReadOptions;
 
 class TableCache;
 
+struct LRUHandle;
+
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
 // multiple threads without external synchronization.
@@ -55,21 +58,57 @@ public:
 	// be close to the file length.
 	uint64_t ApproximateOffsetOf(const std::string_view& key) const;
 
+	// Bytes of memory held for as long as the table is open: the index
+	// block, the filter and the compression dictionary.
+	size_t ApproximateMemoryUsage() const;
+
 	// Calls (*handle_result)(arg, ...) with the entry found after a call
 	// to Seek(key).  May not make such a call if filter policy says
 	// that key is not present.
+	//
+	// If "pin" is not nullptr, it is set before the call to an object
+	// that keeps the entry passed to callback valid for as long as it
+	// lives: the data block searched, or the file it points into.
 	Status InternalGet(
 		const ReadOptions& options,
 		const std::string_view& key,
 		const std::any& arg,
+		std::function<void(const std::any& arg,
+			const std::string_view& k, const std::string_view& v)>& callback,
+		std::shared_ptr<void>* pin = nullptr);
+
+	// Like InternalGet() for each of "keys", which must be sorted.  Keys
+	// that fall in the same data block share one read of the block.
+	// callback is called with args[i] for an entry found for keys[i].
+	Status MultiGet(
+		const ReadOptions& options,
+		const std::vector<std::string_view>& keys,
+		const std::vector<std::any>& args,
 		std::function<void(const std::any& arg,
 			const std::string_view& k, const std::string_view& v)>& callback);
 
+	// Read every data block of the table from the file, whether it is
+	// cached or not, and verify its checksum.  pace(n) is called after
+	// each block with the n bytes read, and stops the walk if it returns
+	// false.
+	Status VerifyChecksums(const std::function<bool(uint64_t)>& pace);
+
 	// Convert an index iterator value (i.e., an encoded BlockHandle)
 	// into an iterator over the Contents of the corresponding block.
 	std::shared_ptr<Iterator> BlockReader(const ReadOptions& options, const std::string_view& indexvalue);
 
 private:
+	// Find the block named by an index entry in the block cache, or read
+	// it from the file.  If the block is cached, "*cachehandle" is set
+	// and must be released when the block is no longer needed.
+	Status ReadDataBlock(const ReadOptions& options, const std::string_view& indexvalue,
+		std::shared_ptr<Block>* block, LRUHandle** cachehandle);
+
+	void ReadMeta(const Footer& footer);
+
+	void ReadFilter(const std::string_view& filterhandlevalue);
+
+	void ReadCompressionDictionary(const std::string_view& dicthandlevalue);
 
 	struct Rep;
 	std::shared_ptr<Rep> rep;
@@ -4,6 +4,7 @@
 #include "blockbuilder.h"
 #include "env.h"
 #include "format.h"
+#include "filterblock.h"
 
 struct TableBuilder::Rep {
 	Options options;
@@ -13,6 +14,7 @@ struct TableBuilder::Rep {
 	Status status;
 	BlockBuilder datablock;
 	BlockBuilder indexblock;
+	std::shared_ptr<FilterBlockBuilder> filterblock;
 	std::string lastkey;
 	int64_t pendinghandle;
 	bool closed;          // Either Finish() or Abandon() has been called.
@@ -30,23 +32,34 @@ struct TableBuilder::Rep {
 	BlockHandle blockhandle;  // Handle to Add to index block
 	std::string compressedoutput;
 
-	Rep(const Options& opt, const std::shared_ptr<WritableFile>& f)
+	CompressionType compression;
+	bool dictused;        // Some data block was compressed with the dictionary
+
+	Rep(const Options& opt, const std::shared_ptr<WritableFile>& f, int level)
 		: options(opt),
 		indexblockoptions(opt),
 		file(f),
 		offset(0),
-		datablock(&options),
+		datablock(&options, opt.blockhashindex),
 		indexblock(&indexblockoptions),
 		pendinghandle(0),
 		closed(false),
-		pendingindexentry(false) {
+		pendingindexentry(false),
+		compression(opt.CompressionForLevel(level)),
+		dictused(false) {
 		indexblockoptions.blockrestartinterval = 1;
+		if (opt.filterpolicy != nullptr) {
+			filterblock.reset(new FilterBlockBuilder(opt.filterpolicy));
+		}
 	}
 };
 
-TableBuilder::TableBuilder(const Options& options, const std::shared_ptr<WritableFile>& file)
-	: rep(new Rep(options, file)) {
-
+TableBuilder::TableBuilder(const Options& options, const std::shared_ptr<WritableFile>& file,
+	int level)
+	: rep(new Rep(options, file, level)) {
+	if (rep->filterblock != nullptr) {
+		rep->filterblock->StartBlock(0);
+	}
 }
 
 TableBuilder::~TableBuilder() {
@@ -71,6 +84,10 @@ void TableBuilder::Add(const std::string_view& key, const std::string_view& valu
 		rep->pendingindexentry = false;
 	}
 
+	if (rep->filterblock != nullptr) {
+		rep->filterblock->AddKey(key);
+	}
+
 	rep->lastkey.assign(key.data(), key.size());
 	rep->pendinghandle++;
 	rep->datablock.Add(key, value);
@@ -86,10 +103,35 @@ Status TableBuilder::Finish() {
 	assert(!rep->closed);
 	rep->closed = true;
 
-	BlockHandle metaindexBlockHandle, indexBlockHandle;
+	BlockHandle dictBlockHandle, filterBlockHandle, metaindexBlockHandle, indexBlockHandle;
+	// Write the compression dictionary, needed to read back the data blocks
+	if (ok() && rep->dictused) {
+		WriteRawBlock(rep->options.compressiondictionary, kNoCompression, &dictBlockHandle);
+	}
+
+	// Write filter block
+	if (ok() && rep->filterblock != nullptr) {
+		WriteRawBlock(rep->filterblock->Finish(), kNoCompression, &filterBlockHandle);
+	}
+
 	// Write metaindex block
 	if (ok()) {
 		BlockBuilder metaIndexBlock(&rep->options);
+		if (rep->dictused) {
+			std::string handleEncoding;
+			dictBlockHandle.EncodeTo(&handleEncoding);
+			metaIndexBlock.Add(kCompressionDictionaryKey, handleEncoding);
+		}
+
+		if (rep->filterblock != nullptr) {
+			// Add mapping from "filter.Name" to location of filter data
+			std::string key = "filter.";
+			key.append(rep->options.filterpolicy->Name());
+			std::string handleEncoding;
+			filterBlockHandle.EncodeTo(&handleEncoding);
+			metaIndexBlock.Add(key, handleEncoding);
+		}
+
 		WriteBlock(&metaIndexBlock, &metaindexBlockHandle);
 	}
 
@@ -125,10 +167,16 @@ void TableBuilder::flush() {
 
 	if (rep->datablock.empty()) return;
 	assert(!rep->pendingindexentry);
-	WriteBlock(&rep->datablock, &rep->blockhandle);
+	WriteBlock(&rep->datablock, &rep->blockhandle, true);
+
+	if (ok()) {
+		rep->pendingindexentry = true;
+		rep->status = rep->file->flush();
+	}
 
-	rep->pendingindexentry = true;
-	rep->status = rep->file->flush();
+	if (rep->filterblock != nullptr) {
+		rep->filterblock->StartBlock(rep->offset);
+	}
 }
 
 void TableBuilder::WriteRawBlock(const std::string_view& blockContents,
@@ -149,34 +197,55 @@ void TableBuilder::WriteRawBlock(const std::string_view& blockContents,
 	}
 }
 
-void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle, bool usedict) {
 	// File format Contains a sequence of blocks where each block has:
 	//    block_data: uint8[n]
 	//    type: uint8
 	//    crc: uint32
 	std::string_view raw = block->Finish();
 	std::string_view blockcontents;
-	CompressionType type = rep->options.compression;
-	// TODO(postrelease): Support more compression options: zlib?
+	std::string* compressed = &rep->compressedoutput;
+	CompressionType type = rep->compression;
+	std::string_view dict;
+	if (usedict) {
+		dict = rep->options.compressiondictionary;
+	}
+
+	bool compressedok = false;
 	switch (type) {
 		case kNoCompression:
-			blockcontents = raw;
 			break;
 
-		case kSnappyCompression: {
-			std::string* compressed = &rep->compressedoutput;
-			if (Snappy_Compress(raw.data(), raw.size(), compressed) &&
-				compressed->size() < raw.size() - (raw.size() / 8u)) {
-				blockcontents = *compressed;
-			} else {
-				// Snappy not supported, or compressed less than 12.5%, so just
-				// store uncompressed form
-				blockcontents = raw;
-				type = kNoCompression;
-			}
+		case kSnappyCompression:
+			compressedok = Snappy_Compress(raw.data(), raw.size(), compressed);
+			break;
+
+		case kLZ4Compression:
+		case kZstdCompression: {
+			// The reader needs the exact uncompressed size up front.
+			std::string output;
+			PutVarint32(compressed, static_cast<uint32_t>(raw.size()));
+			compressedok = (type == kLZ4Compression) ?
+				LZ4_Compress(raw.data(), raw.size(), dict, &output) :
+				Zstd_Compress(rep->options.zstdlevel, raw.data(), raw.size(), dict, &output);
+			compressed->append(output);
+			break;
 		}
 	}
 
+	if (compressedok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+		blockcontents = *compressed;
+		if (type != kSnappyCompression && !dict.empty()) {
+			rep->dictused = true;
+		}
+	}
+	else {
+		// Codec not supported, or compressed less than 12.5%, so just
+		// store uncompressed form
+		blockcontents = raw;
+		type = kNoCompression;
+	}
+
 	WriteRawBlock(blockcontents, type, handle);
 	rep->compressedoutput.clear();
 	block->reset();
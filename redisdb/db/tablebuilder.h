@@ -14,8 +14,11 @@ class TableBuilder {
 public:
 	// Create a builder that will store the Contents of the table it is
 	// building in *file.  Does not close the file.  It is up to the
-	// caller to close the file after calling Finish().
-	TableBuilder(const Options& options, const std::shared_ptr<WritableFile>& file);
+	// caller to close the file after calling Finish().  "level" is the
+	// level the table is written to; it selects the compression codec
+	// (see Options::compressionperlevel).
+	TableBuilder(const Options& options, const std::shared_ptr<WritableFile>& file,
+		int level = 0);
 
 	TableBuilder(const TableBuilder&) = delete;
 
@@ -61,7 +64,7 @@ public:
 private:
 	bool ok() const { return status().ok(); }
 
-	void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+	void WriteBlock(BlockBuilder* block, BlockHandle* handle, bool usedict = false);
 
 	void WriteRawBlock(const std::string_view& blockContents,
 		CompressionType type, BlockHandle* handle);
@@ -1,17 +1,20 @@
 #include "tablecache.h"
+#include "blobfile.h"
 #include "filename.h"
 #include "coding.h"
+#include "crc32c.h"
 #include "table.h"
 
+// Blob files are cached under their file number like tables, with no
+// table.
 struct TableAndFile {
 	std::shared_ptr<RandomAccessFile> file;
 	std::shared_ptr<Table> table;
+	// Charges the table's memory to the block cache until the entry is
+	// evicted (Options::reservetablereadermemory).
+	std::shared_ptr<CacheReservation> reservation;
 };
 
-static void deleteEntry(const std::string_view& key, std::any& value) {
-
-}
-
 TableCache::TableCache(const std::string& dbname, const Options& options, int entries)
 	: options(options),
 	dbname(dbname),
@@ -31,13 +34,13 @@ void TableCache::evict(uint64_t fileNumber) {
 }
 
 Status TableCache::FindTable(uint64_t fileNumber, uint64_t filesize,
-	std::shared_ptr<LRUHandle>& handle) {
+	LRUHandle** handle) {
 	Status s;
 	char buf[sizeof(fileNumber)];
 	EncodeFixed64(buf, fileNumber);
 	std::string_view key(buf, sizeof(buf));
-	handle = cache->Lookup(key);
-	if (handle == nullptr) {
+	*handle = cache->Lookup(key);
+	if (*handle == nullptr) {
 		std::string fname = TableFileName(dbname, fileNumber);
 		std::shared_ptr<RandomAccessFile> file = nullptr;
 		std::shared_ptr<Table> table = nullptr;
@@ -55,16 +58,84 @@ Status TableCache::FindTable(uint64_t fileNumber, uint64_t filesize,
 			std::shared_ptr<TableAndFile> tf(new TableAndFile);
 			tf->file = file;
 			tf->table = table;
-			handle = cache->Insert(key, tf, 1, nullptr);
+			if (options.reservetablereadermemory && options.blockcache != nullptr) {
+				const size_t usage = table->ApproximateMemoryUsage();
+				tf->reservation.reset(new CacheReservation(options.blockcache, usage));
+				tf->reservation->Update(usage);
+			}
+			*handle = cache->Insert(key, tf, 1, nullptr);
 			Debug(options.infolog, "Table cache is Open %s\n", fname.c_str());
 		}
 	}
 	return s;
 }
 
+Status TableCache::FindBlobFile(uint64_t fileNumber, LRUHandle** handle) {
+	Status s;
+	char buf[sizeof(fileNumber)];
+	EncodeFixed64(buf, fileNumber);
+	std::string_view key(buf, sizeof(buf));
+	*handle = cache->Lookup(key);
+	if (*handle == nullptr) {
+		std::shared_ptr<RandomAccessFile> file = nullptr;
+		s = options.env->NewRandomAccessFile(BlobFileName(dbname, fileNumber), file);
+		if (s.ok()) {
+			std::shared_ptr<TableAndFile> tf(new TableAndFile);
+			tf->file = file;
+			*handle = cache->Insert(key, tf, 1, nullptr);
+		}
+	}
+	return s;
+}
+
+Status TableCache::GetBlob(const ReadOptions& options, const std::string_view& index,
+	std::string* value) {
+	BlobIndex blobindex;
+	Status s = blobindex.DecodeFrom(index);
+	if (!s.ok()) {
+		return s;
+	}
+
+	if (blobindex.offset < kBlobRecordHeaderSize) {
+		return Status::Corruption("bad blob offset");
+	}
+
+	LRUHandle* handle = nullptr;
+	s = FindBlobFile(blobindex.filenumber, &handle);
+	if (!s.ok()) {
+		return s;
+	}
+
+	const std::shared_ptr<RandomAccessFile>& file =
+		std::any_cast<const std::shared_ptr<TableAndFile>&>(cache->Value(handle))->file;
+	const size_t n = static_cast<size_t>(blobindex.RecordSize());
+	std::string scratch;
+	scratch.resize(n);
+	std::string_view contents;
+	s = file->read(blobindex.offset - kBlobRecordHeaderSize, n, &contents, &scratch[0]);
+	if (s.ok() && contents.size() != n) {
+		s = Status::Corruption("truncated blob record");
+	}
+
+	if (s.ok() && options.verifychecksums) {
+		const uint32_t crc = crc32c::Unmask(DecodeFixed32(contents.data()));
+		const uint32_t actual = crc32c::Value(contents.data() + kBlobRecordHeaderSize,
+			n - kBlobRecordHeaderSize);
+		if (actual != crc) {
+			s = Status::Corruption("blob checksum mismatch");
+		}
+	}
+
+	if (s.ok()) {
+		value->assign(contents.data() + kBlobRecordHeaderSize, n - kBlobRecordHeaderSize);
+	}
+	cache->Release(handle);
+	return s;
+}
+
 static void UnrefEntry(const std::any &arg1, const std::any &arg2) {
 	std::shared_ptr<ShardedLRUCache> cache = std::any_cast<std::shared_ptr<ShardedLRUCache>>(arg1);
-	std::shared_ptr<LRUHandle> handle = std::any_cast<std::shared_ptr<LRUHandle>>(arg2);
+	LRUHandle* handle = std::any_cast<LRUHandle*>(arg2);
 	cache->Release(handle);
 }
 
@@ -72,13 +143,13 @@ std::shared_ptr<Iterator> TableCache::NewIterator(const ReadOptions& options,
 	uint64_t filenumber,
 	uint64_t filesize,
 	std::shared_ptr<Table> tableptr) {
-	std::shared_ptr<LRUHandle> handle;
-	Status s = FindTable(filenumber, filesize, handle);
+	LRUHandle* handle = nullptr;
+	Status s = FindTable(filenumber, filesize, &handle);
 	if (!s.ok()) {
 		return NewErrorIterator(s);
 	}
 
-	std::shared_ptr<Table> table = std::any_cast<std::shared_ptr<TableAndFile>>(handle->value)->table;
+	std::shared_ptr<Table> table = std::any_cast<const std::shared_ptr<TableAndFile>&>(cache->Value(handle))->table;
 	std::shared_ptr<Iterator> result = table->NewIterator(options);
 	result->RegisterCleanup(std::bind(UnrefEntry, cache, handle));
 	if (tableptr != nullptr) {
@@ -105,14 +176,49 @@ Status TableCache::Get(const ReadOptions& options,
 	const std::string_view & k,
 	const std::any & arg,
 	std::function<void(const std::any&,
-		const std::string_view&, const std::string_view&)> && callback) {
-	std::shared_ptr<LRUHandle> handle;
-	Status s = FindTable(filenumber, filesize, handle);
+		const std::string_view&, const std::string_view&)> && callback,
+	std::shared_ptr<void>* pin) {
+	LRUHandle* handle = nullptr;
+	Status s = FindTable(filenumber, filesize, &handle);
 	if (s.ok()) {
 		//printf("Table cache get file number :%d bytes %lld\n", filenumber, filesize);
-		std::shared_ptr<Table> table = std::any_cast<std::shared_ptr<TableAndFile>>(handle->value)->table;
-		s = table->InternalGet(options, k, arg, callback);
+		const std::shared_ptr<Table>& table =
+			std::any_cast<const std::shared_ptr<TableAndFile>&>(cache->Value(handle))->table;
+		s = table->InternalGet(options, k, arg, callback, pin);
+		cache->Release(handle);
 	}
 
 	return s;
 }
+
+Status TableCache::VerifyChecksums(uint64_t filenumber,
+	uint64_t filesize,
+	const std::function<bool(uint64_t)>& pace) {
+	LRUHandle* handle = nullptr;
+	Status s = FindTable(filenumber, filesize, &handle);
+	if (s.ok()) {
+		const std::shared_ptr<Table>& table =
+			std::any_cast<const std::shared_ptr<TableAndFile>&>(cache->Value(handle))->table;
+		s = table->VerifyChecksums(pace);
+		cache->Release(handle);
+	}
+	return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+	uint64_t filenumber,
+	uint64_t filesize,
+	const std::vector<std::string_view>& keys,
+	const std::vector<std::any>& args,
+	std::function<void(const std::any&,
+		const std::string_view&, const std::string_view&)> && callback) {
+	LRUHandle* handle = nullptr;
+	Status s = FindTable(filenumber, filesize, &handle);
+	if (s.ok()) {
+		const std::shared_ptr<Table>& table =
+			std::any_cast<const std::shared_ptr<TableAndFile>&>(cache->Value(handle))->table;
+		s = table->MultiGet(options, keys, args, callback);
+		cache->Release(handle);
+	}
+	return s;
+}
@@ -26,17 +26,39 @@ public:
 		std::shared_ptr<Table> tableptr = nullptr);
 
 	// If a Seek to internal key "k" in specified file finds an entry,
-	// call (*handle_result)(arg, found_key, found_value).
+	// call (*handle_result)(arg, found_key, found_value).  "pin" is
+	// passed on to Table::InternalGet().
 	Status Get(const ReadOptions& options,
 		uint64_t fileNumber,
 		uint64_t filesize,
 		const std::string_view& k,
 		const std::any& arg,
+		std::function<void(const std::any&,
+			const std::string_view&, const std::string_view&)>&& callback,
+		std::shared_ptr<void>* pin = nullptr);
+
+	// Calls Table::MultiGet() on the specified file for the sorted
+	// internal keys "keys".
+	Status MultiGet(const ReadOptions& options,
+		uint64_t fileNumber,
+		uint64_t filesize,
+		const std::vector<std::string_view>& keys,
+		const std::vector<std::any>& args,
 		std::function<void(const std::any&,
 			const std::string_view&, const std::string_view&)>&& callback);
 
+	// Calls Table::VerifyChecksums() on the specified file.
+	Status VerifyChecksums(uint64_t fileNumber,
+		uint64_t filesize,
+		const std::function<bool(uint64_t)>& pace);
+
 	Status FindTable(uint64_t fileNumber, uint64_t filesize,
-		std::shared_ptr<LRUHandle>& handle);
+		LRUHandle** handle);
+
+	// Read the value that the encoded BlobIndex "index" points to into
+	// "*value".  Open blob files are cached alongside the tables.
+	Status GetBlob(const ReadOptions& options, const std::string_view& index,
+		std::string* value);
 
 	std::shared_ptr<ShardedLRUCache> GetCache() { return cache; }
 
@@ -45,6 +67,8 @@ public:
 	std::shared_ptr<Iterator> GetFileIterator(const ReadOptions& options, const std::string_view& fileValue);
 
 private:
+	Status FindBlobFile(uint64_t fileNumber, LRUHandle** handle);
+
 	TableCache(const TableCache&) = delete;
 
 	void operator=(const TableCache&) = delete;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <iostream>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +18,15 @@
 #include <snappy.h>
 #endif
 
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
 bool IsTailWildcard(const std::string& pattern);
 
 int32_t StringMatchLen(const char *pattern, int32_t patternlen,
@@ -91,4 +102,148 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 	return false;
 #endif  // HAVE_SNAPPY
 
-}
\ No newline at end of file
+}
+
+// LZ4 and Zstd take an optional dictionary: compressing with one lets
+// small blocks share the strings that recur across blocks.  The same
+// dictionary must be passed to uncompress.  "outputlength" is the
+// exact uncompressed size, which the caller stores with the block.
+inline bool LZ4_Compress(const char* input, size_t length,
+	const std::string_view& dict, std::string* output) {
+#if HAVE_LZ4
+	const int bound = LZ4_compressBound(static_cast<int>(length));
+	output->resize(bound);
+	int outlen;
+	if (dict.empty()) {
+		outlen = LZ4_compress_default(input, &(*output)[0],
+			static_cast<int>(length), bound);
+	}
+	else {
+		LZ4_stream_t* stream = LZ4_createStream();
+		LZ4_loadDict(stream, dict.data(), static_cast<int>(dict.size()));
+		outlen = LZ4_compress_fast_continue(stream, input, &(*output)[0],
+			static_cast<int>(length), bound, 1);
+		LZ4_freeStream(stream);
+	}
+
+	if (outlen <= 0) {
+		return false;
+	}
+	output->resize(outlen);
+	return true;
+#else
+	(void)input;
+	(void)length;
+	(void)dict;
+	(void)output;
+	return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length,
+	const std::string_view& dict, char* output, size_t outputlength) {
+#if HAVE_LZ4
+	int n;
+	if (dict.empty()) {
+		n = LZ4_decompress_safe(input, output, static_cast<int>(length),
+			static_cast<int>(outputlength));
+	}
+	else {
+		n = LZ4_decompress_safe_usingDict(input, output, static_cast<int>(length),
+			static_cast<int>(outputlength), dict.data(), static_cast<int>(dict.size()));
+	}
+	return n >= 0 && static_cast<size_t>(n) == outputlength;
+#else
+	(void)input;
+	(void)length;
+	(void)dict;
+	(void)output;
+	(void)outputlength;
+	return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+	const std::string_view& dict, std::string* output) {
+#if HAVE_ZSTD
+	const size_t bound = ZSTD_compressBound(length);
+	output->resize(bound);
+	size_t outlen;
+	if (dict.empty()) {
+		outlen = ZSTD_compress(&(*output)[0], bound, input, length, level);
+	}
+	else {
+		ZSTD_CCtx* ctx = ZSTD_createCCtx();
+		outlen = ZSTD_compress_usingDict(ctx, &(*output)[0], bound, input, length,
+			dict.data(), dict.size(), level);
+		ZSTD_freeCCtx(ctx);
+	}
+
+	if (ZSTD_isError(outlen)) {
+		return false;
+	}
+	output->resize(outlen);
+	return true;
+#else
+	(void)level;
+	(void)input;
+	(void)length;
+	(void)dict;
+	(void)output;
+	return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length,
+	const std::string_view& dict, char* output, size_t outputlength) {
+#if HAVE_ZSTD
+	size_t n;
+	if (dict.empty()) {
+		n = ZSTD_decompress(output, outputlength, input, length);
+	}
+	else {
+		ZSTD_DCtx* ctx = ZSTD_createDCtx();
+		n = ZSTD_decompress_usingDict(ctx, output, outputlength, input, length,
+			dict.data(), dict.size());
+		ZSTD_freeDCtx(ctx);
+	}
+	return !ZSTD_isError(n) && n == outputlength;
+#else
+	(void)input;
+	(void)length;
+	(void)dict;
+	(void)output;
+	(void)outputlength;
+	return false;
+#endif  // HAVE_ZSTD
+}
+
+// Train a dictionary of at most "maxsize" bytes from "samples", which
+// should look like the blocks it will compress.  Returns false if Zstd
+// is not available or training fails.
+inline bool Zstd_TrainDictionary(const std::vector<std::string>& samples,
+	size_t maxsize, std::string* dict) {
+#if HAVE_ZSTD
+	std::string buffer;
+	std::vector<size_t> sizes;
+	for (size_t i = 0; i < samples.size(); i++) {
+		buffer.append(samples[i]);
+		sizes.push_back(samples[i].size());
+	}
+
+	dict->resize(maxsize);
+	size_t n = ZDICT_trainFromBuffer(&(*dict)[0], maxsize, buffer.data(),
+		sizes.data(), static_cast<unsigned>(sizes.size()));
+	if (ZDICT_isError(n)) {
+		dict->clear();
+		return false;
+	}
+	dict->resize(n);
+	return true;
+#else
+	(void)samples;
+	(void)maxsize;
+	(void)dict;
+	return false;
+#endif  // HAVE_ZSTD
+}
@@ -14,7 +14,11 @@ enum Tag {
 	kDeletedFile = 6,
 	kNewFile = 7,
 	// 8 was used for large value refs
-	kPrevLogNumber = 9
+	kPrevLogNumber = 9,
+	kSharedLogNumber = 10,
+	kNewBlobFile = 11,
+	kBlobGarbage = 12,
+	kNewFileWithBlob = 13     // kNewFile followed by the oldest blob file
 };
 
 void VersionEdit::clear() {
@@ -23,13 +27,17 @@ void VersionEdit::clear() {
 	prevlognumber = 0;
 	lastsequence = 0;
 	nextfilenumber = 0;
+	sharedlognumber = 0;
 	hascomparator = false;
 	haslognumber = false;
 	hasprevlognumber = false;
 	hasnextfilenumber = false;
 	haslastsequence = false;
+	hassharedlognumber = false;
 	deletedfiles.clear();
 	newfiles.clear();
+	newblobfiles.clear();
+	blobgarbage.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -58,6 +66,11 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 		PutVarint64(dst, lastsequence);
 	}
 
+	if (hassharedlognumber) {
+		PutVarint32(dst, kSharedLogNumber);
+		PutVarint64(dst, sharedlognumber);
+	}
+
 	for (size_t i = 0; i< compactpointers.size(); i++) {
 		PutVarint32(dst, kCompactPointer);
 		PutVarint32(dst, compactpointers[i].first);  // level
@@ -72,12 +85,32 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
 	for (size_t i = 0; i< newfiles.size(); i++) {
 		const FileMetaData& f = newfiles[i].second;
-		PutVarint32(dst, kNewFile);
+		// Tables without blob references keep the old tag, so that
+		// a DB that never enabled blob files stays readable by older code.
+		PutVarint32(dst, f.oldestblobfile != 0 ? kNewFileWithBlob : kNewFile);
 		PutVarint32(dst, newfiles[i].first);  // level
 		PutVarint64(dst, f.number);
 		PutVarint64(dst, f.filesize);
 		PutLengthPrefixedSlice(dst, f.smallest.Encode());
 		PutLengthPrefixedSlice(dst, f.largest.Encode());
+		if (f.oldestblobfile != 0) {
+			PutVarint64(dst, f.oldestblobfile);
+		}
+	}
+
+	for (size_t i = 0; i< newblobfiles.size(); i++) {
+		const BlobFileMetaData& b = newblobfiles[i];
+		PutVarint32(dst, kNewBlobFile);
+		PutVarint64(dst, b.number);
+		PutVarint64(dst, b.totalcount);
+		PutVarint64(dst, b.totalbytes);
+	}
+
+	for (auto iter = blobgarbage.begin(); iter != blobgarbage.end(); ++iter) {
+		PutVarint32(dst, kBlobGarbage);
+		PutVarint64(dst, iter->first);          // file number
+		PutVarint64(dst, iter->second.first);   // count
+		PutVarint64(dst, iter->second.second);  // bytes
 	}
 }
 
@@ -113,6 +146,9 @@ Status VersionEdit::DecodeFrom(const std::string_view& src) {
 	int level;
 	uint64_t number;
 	FileMetaData f;
+	BlobFileMetaData b;
+	uint64_t count;
+	uint64_t bytes;
 	std::string_view str;
 	InternalKey key;
 
@@ -164,6 +200,15 @@ Status VersionEdit::DecodeFrom(const std::string_view& src) {
 			}
 			break;
 
+		case kSharedLogNumber:
+			if (GetVarint64(&input, &sharedlognumber)) {
+				hassharedlognumber = true;
+			}
+			else {
+				msg = "shared log number";
+			}
+			break;
+
 		case kCompactPointer:
 			if (getLevel(&input, &level) && getInternalKey(&input, &key)) {
 				compactpointers.push_back(std::make_pair(level, key));
@@ -188,6 +233,21 @@ Status VersionEdit::DecodeFrom(const std::string_view& src) {
 				GetVarint64(&input, &f.filesize) &&
 				getInternalKey(&input, &f.smallest) &&
 				getInternalKey(&input, &f.largest)) {
+				f.oldestblobfile = 0;
+				newfiles.push_back(std::make_pair(level, f));
+			}
+			else {
+				msg = "new-file entry";
+			}
+			break;
+
+		case kNewFileWithBlob:
+			if (getLevel(&input, &level) &&
+				GetVarint64(&input, &f.number) &&
+				GetVarint64(&input, &f.filesize) &&
+				getInternalKey(&input, &f.smallest) &&
+				getInternalKey(&input, &f.largest) &&
+				GetVarint64(&input, &f.oldestblobfile)) {
 				newfiles.push_back(std::make_pair(level, f));
 			}
 			else {
@@ -195,6 +255,28 @@ Status VersionEdit::DecodeFrom(const std::string_view& src) {
 			}
 			break;
 
+		case kNewBlobFile:
+			if (GetVarint64(&input, &b.number) &&
+				GetVarint64(&input, &b.totalcount) &&
+				GetVarint64(&input, &b.totalbytes)) {
+				newblobfiles.push_back(b);
+			}
+			else {
+				msg = "new-blob-file entry";
+			}
+			break;
+
+		case kBlobGarbage:
+			if (GetVarint64(&input, &number) &&
+				GetVarint64(&input, &count) &&
+				GetVarint64(&input, &bytes)) {
+				AddBlobGarbage(number, count, bytes);
+			}
+			else {
+				msg = "blob garbage entry";
+			}
+			break;
+
 		default:
 			msg = "unknown tag";
 			break;
@@ -240,6 +322,11 @@ std::string VersionEdit::DebugString() const {
 		AppendNumberTo(&r, lastsequence);
 	}
 
+	if (hassharedlognumber) {
+		r.append("\n  SharedLogNumber: ");
+		AppendNumberTo(&r, sharedlognumber);
+	}
+
 	for (size_t i = 0; i< compactpointers.size(); i++) {
 		r.append("\n  CompactPointer: ");
 		AppendNumberTo(&r, compactpointers[i].first);
@@ -266,6 +353,29 @@ std::string VersionEdit::DebugString() const {
 		r.append(f.smallest.DebugString());
 		r.append(" .. ");
 		r.append(f.largest.DebugString());
+		if (f.oldestblobfile != 0) {
+			r.append(" blob ");
+			AppendNumberTo(&r, f.oldestblobfile);
+		}
+	}
+
+	for (size_t i = 0; i< newblobfiles.size(); i++) {
+		const BlobFileMetaData& b = newblobfiles[i];
+		r.append("\n  AddBlobFile: ");
+		AppendNumberTo(&r, b.number);
+		r.append(" ");
+		AppendNumberTo(&r, b.totalcount);
+		r.append(" ");
+		AppendNumberTo(&r, b.totalbytes);
+	}
+
+	for (auto iter = blobgarbage.begin(); iter != blobgarbage.end(); ++iter) {
+		r.append("\n  BlobGarbage: ");
+		AppendNumberTo(&r, iter->first);
+		r.append(" ");
+		AppendNumberTo(&r, iter->second.first);
+		r.append(" ");
+		AppendNumberTo(&r, iter->second.second);
 	}
 	r.append("\n}\n");
 	return r;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <map>
 #include <set>
 #include <utility>
 #include <string_view>
@@ -10,13 +12,48 @@
 class VersionSet;
 
 struct FileMetaData {
-	int allowedseeks;          // Seeks allowed until compaction
+	std::atomic<int> allowedseeks;          // Seeks allowed until compaction
 	uint64_t number;
 	uint64_t filesize;         // File size in bytes
 	InternalKey smallest;       // Smallest internal key served by table
 	InternalKey largest;        // Largest internal key served by table
+	uint64_t oldestblobfile;    // Oldest blob file the table points into, or 0
 
-	FileMetaData() : allowedseeks(1 << 30), filesize(0) {}
+	FileMetaData() : allowedseeks(1 << 30), filesize(0), oldestblobfile(0) {}
+
+	FileMetaData(const FileMetaData& f)
+		: allowedseeks(f.allowedseeks.load(std::memory_order_relaxed)),
+		number(f.number),
+		filesize(f.filesize),
+		smallest(f.smallest),
+		largest(f.largest),
+		oldestblobfile(f.oldestblobfile) {
+
+	}
+
+	FileMetaData& operator=(const FileMetaData& f) {
+		allowedseeks.store(f.allowedseeks.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		number = f.number;
+		filesize = f.filesize;
+		smallest = f.smallest;
+		largest = f.largest;
+		oldestblobfile = f.oldestblobfile;
+		return *this;
+	}
+};
+
+// A blob file (see blobfile.h) and how much of it is garbage.
+struct BlobFileMetaData {
+	uint64_t number;
+	uint64_t totalcount;       // Records in the file
+	uint64_t totalbytes;       // Bytes of those records
+	uint64_t garbagecount;     // Records no longer referenced by any table
+	uint64_t garbagebytes;
+
+	BlobFileMetaData()
+		: number(0), totalcount(0), totalbytes(0),
+		garbagecount(0), garbagebytes(0) {}
 };
 
 class VersionEdit {
@@ -42,6 +79,12 @@ public:
 		prevlognumber = num;
 	}
 
+	// Oldest log of Options::sharedlog that still holds data of this DB.
+	void SetSharedLogNumber(uint64_t num) {
+		hassharedlognumber = true;
+		sharedlognumber = num;
+	}
+
 	void SetNextFile(uint64_t num) {
 		hasnextfilenumber = true;
 		nextfilenumber = num;
@@ -62,15 +105,33 @@ public:
 	void AddFile(int level, uint64_t file,
 		uint64_t filesize,
 		const InternalKey& smallest,
-		const InternalKey& largest) {
+		const InternalKey& largest,
+		uint64_t oldestblobfile = 0) {
 		FileMetaData f;
 		f.number = file;
 		f.filesize = filesize;
 		f.smallest = smallest;
 		f.largest = largest;
+		f.oldestblobfile = oldestblobfile;
 		newfiles.push_back(std::make_pair(level, f));
 	}
 
+	// Add a blob file of "count" records and "bytes" bytes.
+	void AddBlobFile(uint64_t file, uint64_t count, uint64_t bytes) {
+		BlobFileMetaData b;
+		b.number = file;
+		b.totalcount = count;
+		b.totalbytes = bytes;
+		newblobfiles.push_back(b);
+	}
+
+	// Add "count" records and "bytes" bytes of "file" to its garbage.
+	void AddBlobGarbage(uint64_t file, uint64_t count, uint64_t bytes) {
+		std::pair<uint64_t, uint64_t>& g = blobgarbage[file];
+		g.first += count;
+		g.second += bytes;
+	}
+
 	// Delete the specified "file" from the specified "level".
 	void DeleteFile(int level, uint64_t file) {
 		deletedfiles.insert(std::make_pair(level, file));
@@ -88,14 +149,18 @@ public:
 	uint64_t prevlognumber;
 	uint64_t nextfilenumber;
 	uint64_t lastsequence;
+	uint64_t sharedlognumber;
 
 	bool hascomparator;
 	bool haslognumber;
 	bool hasprevlognumber;
 	bool hasnextfilenumber;
 	bool haslastsequence;
+	bool hassharedlognumber;
 
 	std::vector<std::pair<int, InternalKey>> compactpointers;
 	DeletedFileSet deletedfiles;
 	std::vector<std::pair<int, FileMetaData>> newfiles;
+	std::vector<BlobFileMetaData> newblobfiles;
+	std::map<uint64_t, std::pair<uint64_t, uint64_t>> blobgarbage;  // file -> (count, bytes)
 };
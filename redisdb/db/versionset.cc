@@ -1,14 +1,17 @@
 #include "logreader.h"
 #include "versionset.h"
+#include "perfcontext.h"
 #include "logging.h"
 #include "filename.h"
 #include "merger.h"
+#include "mergeoperator.h"
 
 enum SaverState {
 	kNotFound,
 	kFound,
 	kDeleted,
 	kCorrupt,
+	kMerge,
 };
 
 struct Saver {
@@ -16,6 +19,11 @@ struct Saver {
 	const Comparator* ucmp;
 	std::string_view userkey;
 	std::string* value;
+	bool blobindex;     // *value is a BlobIndex to be resolved
+	std::vector<std::string>* operands;   // Merge operands met, newest first
+	uint64_t mergesequence;               // Sequence of the last operand met
+	PinnableValue* pinnable;              // If not nullptr, pin a plain value here
+	std::shared_ptr<void> pin;            // Keeps the entries of the block searched valid
 };
 
 static bool AfterFile(const Comparator* ucmp,
@@ -236,20 +244,31 @@ void Version::AddIterators(const ReadOptions& ops, std::vector<std::shared_ptr<I
 	}
 }
 
+bool Version::RecordSeek(const GetStats& stats) {
+	auto f = stats.seekFile;
+	if (f != nullptr) {
+		const int left = f->allowedseeks.fetch_sub(1, std::memory_order_relaxed) - 1;
+		return left <= 0 && !hasfiletocompact.load(std::memory_order_acquire);
+	}
+	return false;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
 	auto f = stats.seekFile;
 	if (f != nullptr) {
-		f->allowedseeks--;
 		if (f->allowedseeks <= 0 && filetocompact == nullptr) {
 			filetocompact = f;
 			filetocompactlevel = stats.seekFileLevel;
+			hasfiletocompact.store(true, std::memory_order_release);
 			return true;
 		}
 	}
 	return false;
 }
 
-Status Version::Get(const ReadOptions& options, const LookupKey& key, std::string* value, GetStats* stats) {
+Status Version::Get(const ReadOptions& options, const LookupKey& key, PinnableValue* pinnable,
+	GetStats* stats, std::vector<std::string>* operands) {
+	std::string* value = pinnable->GetSelf();
 	std::string_view ikey = key.InternalKey();
 	std::string_view userkey = key.UserKey();
 	const Comparator* ucmp = vset->icmp.GetComparator();
@@ -327,10 +346,19 @@ Status Version::Get(const ReadOptions& options, const LookupKey& key, std::strin
 			saver.ucmp = ucmp;
 			saver.userkey = userkey;
 			saver.value = value;
+			saver.blobindex = false;
+			saver.operands = operands;
+			saver.pinnable = pinnable;
+			const uint64_t readbytes = GetPerfContext()->blockreadbyte;
 			s = vset->GetTableCache()->Get(options, f->number, f->filesize,
 				ikey, &saver, std::bind(&Version::SaveValue, this,
 					std::placeholders::_1, std::placeholders::_2,
-					std::placeholders::_3));
+					std::placeholders::_3), &saver.pin);
+			if (s.ok() && saver.state == kMerge) {
+				s = GetMergeOperands(options, f, &saver);
+			}
+			RecordTick(vset->options.statistics, kBytesReadLevel0 + level,
+				GetPerfContext()->blockreadbyte - readbytes);
 
 			if (!s.ok()) {
 				return s;
@@ -338,10 +366,30 @@ Status Version::Get(const ReadOptions& options, const LookupKey& key, std::strin
 
 			switch (saver.state) {
 			case kNotFound:
+			case kMerge:
 				break;      // Keep searching in other files
 			case kFound:
+				if (saver.blobindex) {
+					std::string index;
+					index.swap(*value);
+					s = vset->GetTableCache()->GetBlob(options, index, value);
+					pinnable->PinSelf();
+				}
+
+				if (s.ok() && !operands->empty()) {
+					std::string_view existing = pinnable->ToStringView();
+					s = FullMergeOperands(vset->options.mergeoperator.get(), userkey,
+						&existing, *operands, value);
+					pinnable->PinSelf();
+				}
 				return s;
 			case kDeleted:
+				if (!operands->empty()) {
+					s = FullMergeOperands(vset->options.mergeoperator.get(), userkey,
+						nullptr, *operands, value);
+					pinnable->PinSelf();
+					return s;
+				}
 				s = Status::NotFound(std::string_view());  // Use empty error message for speed
 				return s;
 			case kCorrupt:
@@ -350,9 +398,204 @@ Status Version::Get(const ReadOptions& options, const LookupKey& key, std::strin
 			}
 		}
 	}
+
+	if (!operands->empty()) {
+		// Nothing below the operands: they apply to a missing key.
+		s = FullMergeOperands(vset->options.mergeoperator.get(), userkey,
+			nullptr, *operands, value);
+		pinnable->PinSelf();
+		return s;
+	}
 	return Status::NotFound(std::string_view());  // Use an empty error message for speed
 }
 
+void Version::MultiGet(const ReadOptions& options, std::vector<KeyContext>* keys) {
+	const Comparator* ucmp = vset->icmp.GetComparator();
+	std::vector<KeyContext*> pending;
+	for (size_t i = 0; i < keys->size(); i++) {
+		(*keys)[i].done = false;
+		pending.push_back(&(*keys)[i]);
+	}
+
+	std::vector<KeyContext*> batch;
+	std::vector<KeyContext*> remaining;
+	for (int level = 0; level < kNumLevels && !pending.empty(); level++) {
+		if (files[level].empty()) continue;
+
+		if (level == 0) {
+			// Level-0 files may overlap each other.  Visit them from newest
+			// to oldest, each with the keys it may contain that are still
+			// unresolved.
+			std::vector<std::shared_ptr<FileMetaData>> fs = files[level];
+			std::sort(fs.begin(), fs.end(), NewestFirst);
+			for (const auto& f : fs) {
+				batch.clear();
+				for (KeyContext* k : pending) {
+					std::string_view userkey = k->key->UserKey();
+					if (!k->done &&
+						ucmp->Compare(userkey, f->smallest.UserKey()) >= 0 &&
+						ucmp->Compare(userkey, f->largest.UserKey()) <= 0) {
+						batch.push_back(k);
+					}
+				}
+
+				if (!batch.empty()) {
+					MultiGetFromFile(options, f, batch);
+				}
+			}
+		}
+		else {
+			// Files do not overlap, and the keys are sorted, so the keys of
+			// each file form a run.
+			size_t current = files[level].size();
+			batch.clear();
+			for (KeyContext* k : pending) {
+				uint32_t index = FindFile(vset->icmp, files[level], k->key->InternalKey());
+				if (index >= files[level].size() ||
+					ucmp->Compare(k->key->UserKey(), files[level][index]->smallest.UserKey()) < 0) {
+					continue;   // No file of this level holds the key
+				}
+
+				if (index != current && !batch.empty()) {
+					MultiGetFromFile(options, files[level][current], batch);
+					batch.clear();
+				}
+				current = index;
+				batch.push_back(k);
+			}
+
+			if (!batch.empty()) {
+				MultiGetFromFile(options, files[level][current], batch);
+			}
+		}
+
+		remaining.clear();
+		for (KeyContext* k : pending) {
+			if (!k->done) {
+				remaining.push_back(k);
+			}
+		}
+		pending.swap(remaining);
+	}
+
+	for (KeyContext* k : pending) {
+		if (!k->operands.empty()) {
+			*k->status = FullMergeOperands(vset->options.mergeoperator.get(), k->key->UserKey(),
+				nullptr, k->operands, k->value);
+		}
+		else {
+			*k->status = Status::NotFound(std::string_view());
+		}
+		k->done = true;
+	}
+}
+
+void Version::MultiGetFromFile(const ReadOptions& options, const std::shared_ptr<FileMetaData>& f,
+	const std::vector<KeyContext*>& batch) {
+	const Comparator* ucmp = vset->icmp.GetComparator();
+	std::vector<Saver> savers(batch.size());
+	std::vector<std::string_view> ikeys;
+	std::vector<std::any> args;
+	for (size_t i = 0; i < batch.size(); i++) {
+		Saver& saver = savers[i];
+		saver.state = kNotFound;
+		saver.ucmp = ucmp;
+		saver.userkey = batch[i]->key->UserKey();
+		saver.value = batch[i]->value;
+		saver.blobindex = false;
+		saver.operands = &batch[i]->operands;
+		saver.pinnable = nullptr;
+		ikeys.push_back(batch[i]->key->InternalKey());
+		args.push_back(&saver);
+	}
+
+	Status s = vset->GetTableCache()->MultiGet(options, f->number, f->filesize,
+		ikeys, args, std::bind(&Version::SaveValue, this,
+			std::placeholders::_1, std::placeholders::_2,
+			std::placeholders::_3));
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		KeyContext* k = batch[i];
+		if (!s.ok()) {
+			*k->status = s;
+			k->done = true;
+			continue;
+		}
+
+		if (savers[i].state == kMerge) {
+			// Rare: follow the operands down the file one lookup at a time.
+			*k->status = GetMergeOperands(options, f, &savers[i]);
+			if (!k->status->ok()) {
+				k->done = true;
+				continue;
+			}
+		}
+
+		switch (savers[i].state) {
+		case kNotFound:
+		case kMerge:
+			break;      // Keep searching in other files
+		case kFound:
+			*k->status = Status::OK();
+			if (savers[i].blobindex) {
+				std::string index;
+				index.swap(*k->value);
+				*k->status = vset->GetTableCache()->GetBlob(options, index, k->value);
+			}
+
+			if (k->status->ok() && !k->operands.empty()) {
+				std::string_view existing(*k->value);
+				*k->status = FullMergeOperands(vset->options.mergeoperator.get(),
+					savers[i].userkey, &existing, k->operands, k->value);
+			}
+			k->done = true;
+			break;
+		case kDeleted:
+			if (!k->operands.empty()) {
+				*k->status = FullMergeOperands(vset->options.mergeoperator.get(),
+					savers[i].userkey, nullptr, k->operands, k->value);
+			}
+			else {
+				*k->status = Status::NotFound(std::string_view());
+			}
+			k->done = true;
+			break;
+		case kCorrupt:
+			*k->status = Status::Corruption("corrupted key for ", savers[i].userkey);
+			k->done = true;
+			break;
+		}
+	}
+}
+
+Status Version::GetMergeOperands(const ReadOptions& options, const std::shared_ptr<FileMetaData>& f,
+	Saver* saver) {
+	Status s;
+	std::string older;
+	while (saver->state == kMerge) {
+		if (vset->options.mergeoperator == nullptr) {
+			return Status::NotSupported("merge operand found but no merge operator set");
+		}
+
+		const uint64_t sequence = saver->mergesequence;
+		if (sequence == 0) {
+			break;
+		}
+
+		older.clear();
+		AppendInternalKey(&older, ParsedInternalKey(saver->userkey,
+			sequence - 1, kValueTypeForSeek));
+		s = vset->GetTableCache()->Get(options, f->number, f->filesize,
+			older, saver, std::bind(&Version::SaveValue, this,
+				std::placeholders::_1, std::placeholders::_2,
+				std::placeholders::_3), &saver->pin);
+		if (!s.ok() || (saver->state == kMerge && saver->mergesequence == sequence)) {
+			break;      // Nothing of the key is left in "f"
+		}
+	}
+	return s;
+}
+
 void Version::SaveValue(const std::any& arg, const std::string_view& ikey, const std::string_view& v) {
 	Saver* s = std::any_cast<Saver*>(arg);
 	ParsedInternalKey parsedKey;
@@ -361,9 +604,28 @@ void Version::SaveValue(const std::any& arg, const std::string_view& ikey, const
 	}
 	else {
 		if (s->ucmp->Compare(parsedKey.userkey, s->userkey) == 0) {
-			s->state = (parsedKey.type == kTypeValue) ? kFound : kDeleted;
-			if (s->state == kFound) {
-				s->value->assign(v.data(), v.size());
+			switch (parsedKey.type) {
+			case kTypeDeletion:
+				s->state = kDeleted;
+				break;
+			case kTypeMerge:
+				s->state = kMerge;
+				s->operands->push_back(std::string(v.data(), v.size()));
+				s->mergesequence = parsedKey.sequence;
+				break;
+			default:
+				s->state = kFound;
+				s->blobindex = (parsedKey.type == kTypeBlobIndex);
+				if (s->pinnable != nullptr && s->pin != nullptr && !s->blobindex) {
+					s->pinnable->PinSlice(v, s->pin);
+				}
+				else {
+					s->value->assign(v.data(), v.size());
+					if (s->pinnable != nullptr) {
+						s->pinnable->PinSelf();
+					}
+				}
+				break;
 			}
 		}
 	}
@@ -445,6 +707,27 @@ std::string Version::DebugString() const {
 			r.append("]\n");
 		}
 	}
+
+	if (!blobfiles.empty()) {
+		// E.g.,
+		//   --- blob files ---
+		//   21:100/4096000 garbage 10/409600
+		r.append("--- blob files ---\n");
+		for (auto iter = blobfiles.begin(); iter != blobfiles.end(); ++iter) {
+			const BlobFileMetaData* b = iter->second.get();
+			r.push_back(' ');
+			AppendNumberTo(&r, b->number);
+			r.push_back(':');
+			AppendNumberTo(&r, b->totalcount);
+			r.push_back('/');
+			AppendNumberTo(&r, b->totalbytes);
+			r.append(" garbage ");
+			AppendNumberTo(&r, b->garbagecount);
+			r.push_back('/');
+			AppendNumberTo(&r, b->garbagebytes);
+			r.push_back('\n');
+		}
+	}
 	return r;
 }
 
@@ -480,7 +763,8 @@ int Version::PickLevelForMemTableOutput(const std::string_view& smallestuserkey,
 
 Builder::Builder(VersionSet* vset, const std::shared_ptr<Version>& base)
 	: vset(vset),
-	base(base) {
+	base(base),
+	blobfiles(base->blobfiles) {
 	BySmallestKey cmp;
 	cmp.internalComparator = &(vset->icmp);
 	for (int level = 0; level < kNumLevels; level++) {
@@ -501,11 +785,13 @@ VersionSet::VersionSet(const std::string& dbname,
 	nextfilenumber(2),
 	lognumber(0),
 	prevlognumber(0),
+	sharedlognumber(0),
 	manifestfilenumber(0),
 	descriptorlog(nullptr),
 	descriptorfile(nullptr),
 	tablecache(tablecache),
-	icmp(*cmp) {
+	icmp(*cmp),
+	manifestwriting(false) {
 	std::shared_ptr<Version> v(new Version(this));
 	AppendVersion(v);
 }
@@ -597,6 +883,7 @@ Status VersionSet::Recover(bool* manifest) {
 	uint64_t lastsequence = 0;
 	uint64_t lognumber = 0;
 	uint64_t prevlognumber = 0;
+	uint64_t sharedlognumber = 0;
 
 	Builder builder(this, current());
 	LogReporter reporter;
@@ -622,6 +909,10 @@ Status VersionSet::Recover(bool* manifest) {
 			havePrevLogNumber = true;
 		}
 
+		if (edit.hassharedlognumber) {
+			sharedlognumber = edit.sharedlognumber;
+		}
+
 		if (edit.hasnextfilenumber) {
 			nextFile = edit.nextfilenumber;
 			haveNextFile = true;
@@ -663,6 +954,7 @@ Status VersionSet::Recover(bool* manifest) {
 		this->lastsequence = lastsequence;
 		this->lognumber = lognumber;
 		this->prevlognumber = prevlognumber;
+		this->sharedlognumber = sharedlognumber;
 		//See if we can reuse the existing MANIFEST file.
 		if (ReuseManifest(dscname, cur)) {
 			// No need to save new manifest
@@ -675,13 +967,22 @@ Status VersionSet::Recover(bool* manifest) {
 }
 
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
-	for (auto &it : dummyversions) {
+	for (auto &weak : liveversions) {
+		std::shared_ptr<Version> it = weak.lock();
+		if (it == nullptr) {
+			continue;
+		}
+
 		for (int level = 0; level < kNumLevels; level++) {
 			auto& files = it->files[level];
 			for (size_t i = 0; i < files.size(); i++) {
 				live->insert(files[i]->number);
 			}
 		}
+
+		for (auto iter = it->blobfiles.begin(); iter != it->blobfiles.end(); ++iter) {
+			live->insert(iter->first);
+		}
 	}
 }
 
@@ -758,6 +1059,73 @@ void VersionSet::Finalize(Version* v) {
 
 	v->compactionlevel = bestLevel;
 	v->compactionscore = bestScore;
+
+	// If the blob files that compactions relocate are mostly garbage,
+	// compact a table that still points into them, so that they can be
+	// deleted even when the tree itself needs no compaction.  Tables in
+	// the last level are reached through an overlapping table one level
+	// up; one with no such table waits for a regular compaction.
+	const uint64_t cutoff = BlobGCCutoff(v);
+	if (cutoff == 0) {
+		return;
+	}
+
+	uint64_t totalbytes = 0;
+	uint64_t garbagebytes = 0;
+	for (auto iter = v->blobfiles.begin();
+		iter != v->blobfiles.end() && iter->first < cutoff; ++iter) {
+		totalbytes += iter->second->totalbytes;
+		garbagebytes += iter->second->garbagebytes;
+	}
+
+	if (totalbytes == 0 ||
+		garbagebytes < options.blobgcforcethreshold * totalbytes) {
+		return;
+	}
+
+	for (int level = 0; level < kNumLevels; level++) {
+		for (size_t i = 0; i < v->files[level].size(); i++) {
+			const std::shared_ptr<FileMetaData>& f = v->files[level][i];
+			if (f->oldestblobfile == 0 || f->oldestblobfile >= cutoff) {
+				continue;
+			}
+
+			if (level < kNumLevels - 1) {
+				v->filetocompact = f;
+				v->filetocompactlevel = level;
+				v->hasfiletocompact.store(true, std::memory_order_release);
+				return;
+			}
+
+			std::vector<std::shared_ptr<FileMetaData>> overlaps;
+			v->GetOverlappingInputs(level - 1, &f->smallest, &f->largest, &overlaps);
+			if (!overlaps.empty()) {
+				v->filetocompact = overlaps[0];
+				v->filetocompactlevel = level - 1;
+				v->hasfiletocompact.store(true, std::memory_order_release);
+				return;
+			}
+		}
+	}
+}
+
+uint64_t VersionSet::BlobGCCutoff(const Version* v) const {
+	if (options.blobgcagecutoff <= 0 || v->blobfiles.empty()) {
+		return 0;
+	}
+
+	size_t count = static_cast<size_t>(options.blobgcagecutoff * v->blobfiles.size());
+	if (count == 0) {
+		return 0;
+	}
+
+	if (count >= v->blobfiles.size()) {
+		return v->blobfiles.rbegin()->first + 1;
+	}
+
+	auto iter = v->blobfiles.begin();
+	std::advance(iter, count);
+	return iter->first;
 }
 
 bool VersionSet::ReuseManifest(const std::string& dscname, const std::string& dscbase) {
@@ -804,6 +1172,28 @@ int64_t VersionSet::NumLevelBytes(int level) const {
 	return TotalFileSize(current()->files[level]);
 }
 
+uint64_t VersionSet::EstimatedCompactionDebt() const {
+	const Version* v = current().get();
+	uint64_t debt = 0;
+
+	// Level-0 files are all merged into level-1 once there are enough
+	// of them.
+	if (v->files[0].size() >= kL0_CompactionTrigger) {
+		debt += TotalFileSize(v->files[0]) + TotalFileSize(v->files[1]);
+	}
+
+	// Every byte over a level's limit is merged with about ten times as
+	// many bytes of the next level.
+	for (int level = 1; level < kNumLevels - 1; level++) {
+		const double levelbytes = static_cast<double>(TotalFileSize(v->files[level]));
+		const double limit = MaxBytesForLevel(&options, level);
+		if (levelbytes > limit) {
+			debt += static_cast<uint64_t>((levelbytes - limit) * 11);
+		}
+	}
+	return debt;
+}
+
 int VersionSet::NumLevelFiles(int level) const {
 	assert(level >= 0);
 	assert(level < kNumLevels);
@@ -811,13 +1201,31 @@ int VersionSet::NumLevelFiles(int level) const {
 }
 
 void VersionSet::AppendVersion(const std::shared_ptr<Version>& v) {
-	if (!dummyversions.empty()) {
-		dummyversions.pop_front();
+	// Forget versions that nobody refers to any more
+	for (auto it = liveversions.begin(); it != liveversions.end();) {
+		if (it->expired()) {
+			it = liveversions.erase(it);
+		}
+		else {
+			++it;
+		}
 	}
-	dummyversions.push_back(v);
+
+	currentversion = v;
+	liveversions.push_back(v);
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mutex) {
+	// Wait for an edit written by another thread to be installed first,
+	// otherwise its changes would be lost when we install ours.
+	{
+		std::unique_lock<std::mutex> lk(*mutex, std::adopt_lock);
+		while (manifestwriting) {
+			manifestcv.wait(lk);
+		}
+		lk.release();
+	}
+
 	if (edit->haslognumber) {
 		assert(edit->lognumber >= lognumber);
 		assert(edit->lognumber < nextfilenumber);
@@ -830,6 +1238,13 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mutex) {
 		edit->SetPrevLogNumber(prevlognumber);
 	}
 
+	if (edit->hassharedlognumber) {
+		assert(edit->sharedlognumber >= sharedlognumber);
+	}
+	else if (sharedlognumber != 0) {
+		edit->SetSharedLogNumber(sharedlognumber);
+	}
+
 	edit->SetNextFile(nextfilenumber);
 	edit->SetLastSequence(lastsequence);
 
@@ -858,6 +1273,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mutex) {
 		}
 	}
 
+	manifestwriting = true;
 	mutex->unlock();
 	// Write new record to MANIFEST log
 	if (s.ok()) {
@@ -886,6 +1302,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mutex) {
 		AppendVersion(v);
 		lognumber = edit->lognumber;
 		prevlognumber = edit->prevlognumber;
+		sharedlognumber = edit->sharedlognumber;
 	}
 	else {
 		if (!newManifestFile.empty()) {
@@ -894,6 +1311,9 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mutex) {
 			options.env->DeleteFile(newManifestFile);
 		}
 	}
+
+	manifestwriting = false;
+	manifestcv.notify_all();
 	return s;
 }
 
@@ -918,7 +1338,18 @@ Status VersionSet::WriteSnapshot() {
 		const auto& files = current()->files[level];
 		for (size_t i = 0; i < files.size(); i++) {
 			const auto f = files[i];
-			edit.AddFile(level, f->number, f->filesize, f->smallest, f->largest);
+			edit.AddFile(level, f->number, f->filesize, f->smallest, f->largest,
+				f->oldestblobfile);
+		}
+	}
+
+	// Save blob files
+	const auto& blobfiles = current()->blobfiles;
+	for (auto iter = blobfiles.begin(); iter != blobfiles.end(); ++iter) {
+		const BlobFileMetaData* b = iter->second.get();
+		edit.AddBlobFile(b->number, b->totalcount, b->totalbytes);
+		if (b->garbagecount > 0) {
+			edit.AddBlobGarbage(b->number, b->garbagecount, b->garbagebytes);
 		}
 	}
 
@@ -1249,6 +1680,25 @@ void Builder::Apply(VersionEdit* edit) {
 		levels[level].deletedfiles.erase(f->number);
 		levels[level].addedFiles->insert(f);
 	}
+
+	// Add new blob files, then the garbage found in old ones
+	for (size_t i = 0; i < edit->newblobfiles.size(); i++) {
+		const BlobFileMetaData& b = edit->newblobfiles[i];
+		blobfiles[b.number].reset(new BlobFileMetaData(b));
+	}
+
+	for (auto iter = edit->blobgarbage.begin(); iter != edit->blobgarbage.end(); ++iter) {
+		auto it = blobfiles.find(iter->first);
+		if (it == blobfiles.end()) {
+			continue;
+		}
+
+		// The metadata may be shared with installed versions: copy it.
+		std::shared_ptr<BlobFileMetaData> b(new BlobFileMetaData(*it->second));
+		b->garbagecount += iter->second.first;
+		b->garbagebytes += iter->second.second;
+		it->second = b;
+	}
 }
 
 // Save the current() state in *v.
@@ -1298,6 +1748,13 @@ void Builder::SaveTo(Version* v) {
 		}
 #endif
 	}
+
+	// A blob file goes away once every record in it is garbage.
+	for (auto iter = blobfiles.begin(); iter != blobfiles.end(); ++iter) {
+		if (iter->second->garbagecount < iter->second->totalcount) {
+			v->blobfiles.insert(v->blobfiles.end(), *iter);
+		}
+	}
 }
 
 void Builder::MaybeAddFile(Version* v, int level, const std::shared_ptr<FileMetaData>& f) {
@@ -1318,13 +1775,8 @@ void Builder::MaybeAddFile(Version* v, int level, const std::shared_ptr<FileMeta
 Compaction::Compaction(const Options* options, int level)
 	: level(level),
 	maxoutputfilesize(MaxFileSizeForLevel(options, level)),
-	inputversion(nullptr),
-	grandparentindex(0),
-	seenkey(false),
-	overlappedbytes(0) {
-	for (int i = 0; i < kNumLevels; i++) {
-		levelptrs[i] = 0;
-	}
+	inputversion(nullptr) {
+
 }
 
 Compaction::~Compaction() {
@@ -1348,13 +1800,23 @@ void Compaction::addInputDeletions(VersionEdit* edit) {
 	}
 }
 
-bool Compaction::isBaseLevelForKey(const std::string_view& userkey) {
+CompactionCursor::CompactionCursor()
+	: grandparentindex(0),
+	seenkey(false),
+	overlappedbytes(0) {
+	for (int i = 0; i < kNumLevels; i++) {
+		levelptrs[i] = 0;
+	}
+}
+
+bool Compaction::isBaseLevelForKey(const std::string_view& userkey, CompactionCursor* cursor) {
 	// Maybe use binary search to find right entry instead of linear search?
 	const Comparator* cmp = inputversion->vset->icmp.GetComparator();
 	for (int lvl = level + 2; lvl < kNumLevels; lvl++) {
 		auto& files = inputversion->files[lvl];
-		for (; levelptrs[lvl] < files.size();) {
-			auto f = files[levelptrs[lvl]];
+		size_t& ptr = cursor->levelptrs[lvl];
+		for (; ptr < files.size();) {
+			auto f = files[ptr];
 			if (cmp->Compare(userkey, f->largest.UserKey()) <= 0) {
 				// We've advanced far enough
 				if (cmp->Compare(userkey, f->smallest.UserKey()) >= 0) {
@@ -1363,30 +1825,30 @@ bool Compaction::isBaseLevelForKey(const std::string_view& userkey) {
 				}
 				break;
 			}
-			levelptrs[lvl]++;
+			ptr++;
 		}
 	}
 	return true;
 }
 
-bool Compaction::shouldStopBefore(const std::string_view& internalKey) {
+bool Compaction::shouldStopBefore(const std::string_view& internalKey, CompactionCursor* cursor) {
 	const VersionSet* vset = inputversion->vset;
 	// Scan to find earliest grandparent file that Contains key.
 	const InternalKeyComparator* icmp = &vset->icmp;
-	while (grandparentindex < grandparents.size() &&
+	while (cursor->grandparentindex < grandparents.size() &&
 		icmp->Compare(internalKey,
-			grandparents[grandparentindex]->largest.Encode()) > 0) {
-		if (seenkey) {
-			overlappedbytes += grandparents[grandparentindex]->filesize;
+			grandparents[cursor->grandparentindex]->largest.Encode()) > 0) {
+		if (cursor->seenkey) {
+			cursor->overlappedbytes += grandparents[cursor->grandparentindex]->filesize;
 		}
-		grandparentindex++;
+		cursor->grandparentindex++;
 	}
 
-	seenkey = true;
+	cursor->seenkey = true;
 
-	if (overlappedbytes > MaxGrandParentOverlapBytes(&vset->options)) {
+	if (cursor->overlappedbytes > MaxGrandParentOverlapBytes(&vset->options)) {
 		// Too much overlap for current() output; start new output
-		overlappedbytes = 0;
+		cursor->overlappedbytes = 0;
 		return true;
 	}
 	else {
@@ -5,6 +5,7 @@
 #include <vector>
 #include <list>
 #include <deque>
+#include <condition_variable>
 #include <assert.h>
 #include "logwriter.h"
 #include "tablecache.h"
@@ -12,15 +13,19 @@
 #include "option.h"
 #include "dbformat.h"
 #include "env.h"
+#include "pinnablevalue.h"
 
 class VersionSet;
 
 class Compaction;
 
+struct Saver;
+
 class Version {
 public:
 	Version(VersionSet* vset)
-		: vset(vset) {
+		: vset(vset),
+		hasfiletocompact(false) {
 
 	}
 
@@ -40,8 +45,28 @@ public:
 		int seekFileLevel;
 	};
 
-	Status Get(const ReadOptions& options, const LookupKey& key, std::string* val,
-		GetStats* stats);
+	// "operands" holds the merge operands of the key that the memtables
+	// have already collected, newest first; the lookup adds to them.
+	// A value found as is in a data block is pinned in the block.
+	Status Get(const ReadOptions& options, const LookupKey& key, PinnableValue* val,
+		GetStats* stats, std::vector<std::string>* operands);
+
+	// One key of a MultiGet() batch.  The value and status are written
+	// once the key is resolved.
+	struct KeyContext {
+		const LookupKey* key;
+		std::string* value;
+		Status* status;
+		bool done;
+		std::vector<std::string> operands;  // Merge operands met so far, newest first
+	};
+
+	// Like Get() for every key in "keys", which must be sorted by user
+	// key.  Keys that live in the same file are looked up with one call
+	// into the table, so each data block is read only once.  Does not
+	// charge seeks.
+	// REQUIRES: lock is not held
+	void MultiGet(const ReadOptions& options, std::vector<KeyContext>* keys);
 
 	// Return the level at which we should place a new memtable compaction
 	// result that covers the range [smallest_user_key,largest_user_key].
@@ -56,6 +81,17 @@ public:
 		std::vector<std::shared_ptr<FileMetaData>>* inputs);
 
 	void SaveValue(const std::any& arg, const std::string_view& ikey, const std::string_view& v);
+
+	// Called when a lookup through "saver" stopped at a merge operand in
+	// file "f": looks up the older entries of the same key in "f" in
+	// turn until one is not an operand or none is left.
+	Status GetMergeOperands(const ReadOptions& options, const std::shared_ptr<FileMetaData>& f,
+		Saver* saver);
+
+	// Looks up "batch" in file "f" for MultiGet(), marking resolved keys
+	// as done.
+	void MultiGetFromFile(const ReadOptions& options, const std::shared_ptr<FileMetaData>& f,
+		const std::vector<KeyContext*>& batch);
 	// Returns true iff some file in the specified level overlaps
 	// some part of [*smallest_user_key,*largest_user_key].
 	// smallest_user_key==nullptr represents a key smaller than all the DB's keys.
@@ -64,6 +100,12 @@ public:
 	bool OverlapInLevel(int level, const std::string_view* smallestuserkey,
 		const std::string_view* largestuserkey);
 
+	// Charges one seek to stats.seekFile.  Returns true if the file has
+	// run out of seeks while no file of this version is marked for
+	// compaction; the caller should then call UpdateStats().
+	// REQUIRES: lock is not held
+	bool RecordSeek(const GetStats& stats);
+
 	// Adds "stats" into the version state.  Returns true if a new
 	// compaction may need to be triggered, false otherwise.
 	// REQUIRES: lock is held
@@ -88,9 +130,15 @@ public:
 	// List of files per level
 	std::vector<std::shared_ptr<FileMetaData>> files[kNumLevels];
 
+	// Blob files by number, oldest first.  Shared between versions and
+	// never changed once installed.
+	std::map<uint64_t, std::shared_ptr<BlobFileMetaData>> blobfiles;
+
 	// Next file to compact based on Seek stats.
 	std::shared_ptr<FileMetaData> filetocompact;
 	int filetocompactlevel;
+	// Set once filetocompact is; lets RecordSeek() skip the lock.
+	std::atomic<bool> hasfiletocompact;
 
 	// Level that should be compacted Next and its compaction score.
 	// Score< 1 means compaction is not strictly needed.  These fields
@@ -140,6 +188,7 @@ private:
 	VersionSet* vset;
 	std::shared_ptr<Version> base;
 	LevelState levels[kNumLevels];
+	std::map<uint64_t, std::shared_ptr<BlobFileMetaData>> blobfiles;
 };
 
 class VersionSet {
@@ -150,15 +199,16 @@ public:
 	~VersionSet();
 
 	std::shared_ptr<Version> current() const {
-		assert(!dummyversions.empty());
-		return dummyversions.back();
+		assert(currentversion != nullptr);
+		return currentversion;
 	}
 
-	uint64_t GetLastSequence() const { return lastsequence; }
+	// May be called without the lock; see DB::Get().
+	uint64_t GetLastSequence() const { return lastsequence.load(std::memory_order_acquire); }
 
 	void SetLastSequence(uint64_t s) {
 		assert(s >= lastsequence);
-		lastsequence = s;
+		lastsequence.store(s, std::memory_order_release);
 	}
 
 	// Returns true iff some level needs a compaction.
@@ -179,11 +229,18 @@ public:
 	// is both saved to persistent state and installed as the new
 	// version version.  Will Release *mu while actually writing to the file.
 	// REQUIRES: *mu is held on entry.
-	// REQUIRES: no other thread concurrently calls LogAndApply()
+	// Concurrent callers (a flush and a compaction) are serialized: each
+	// waits for the edit in progress to be installed before applying its
+	// own edit on top of the result.
 	Status LogAndApply(VersionEdit* edit, std::mutex* mutex);
 
 	void Finalize(Version* v);
 
+	// Compactions move the live records of blob files numbered below
+	// the result into new blob files; see Options::blobgcagecutoff.
+	// Returns 0 if nothing is to be relocated.
+	uint64_t BlobGCCutoff(const Version* v) const;
+
 	// Save version Contents to *log
 	Status WriteSnapshot();
 
@@ -199,6 +256,9 @@ public:
 
 	uint64_t GetPrevLogNumber() { return prevlognumber; }
 
+	// Oldest log of Options::sharedlog the DB may need to recover from.
+	uint64_t GetSharedLogNumber() { return sharedlognumber; }
+
 	const InternalKeyComparator icmp;
 
 	uint64_t NewFileNumber() { return nextfilenumber++; }
@@ -219,6 +279,10 @@ public:
 	// Return the combined file size of all files at the specified level.
 	int64_t NumLevelBytes(int level) const;
 
+	// Return an estimate of the bytes compactions have to rewrite to
+	// bring every level back under its size limit.
+	uint64_t EstimatedCompactionDebt() const;
+
 	// Return the maximum overlapping data (in bytes) at Next level for any
 	// file at a level >= 1.
 	int64_t MaxNextLevelOverlappingBytes();
@@ -268,14 +332,24 @@ public:
 	const Options options;
 	uint64_t nextfilenumber;
 	uint64_t manifestfilenumber;
-	uint64_t lastsequence;
+	std::atomic<uint64_t> lastsequence;
 	uint64_t lognumber;
 	uint64_t prevlognumber;  // 0 or backing store for memtable being compacted
+	uint64_t sharedlognumber;
 
-	std::list<std::shared_ptr<Version>> dummyversions;
+	// The installed version, and every version that may still be in use
+	// by a reader, an iterator or a compaction.  Their table files are
+	// kept until the last reference to the version is dropped.
+	std::shared_ptr<Version> currentversion;
+	std::list<std::weak_ptr<Version>> liveversions;
 	std::shared_ptr<LogWriter> descriptorlog;
 	std::shared_ptr<WritableFile> descriptorfile;
 	std::shared_ptr<TableCache> tablecache;
+
+	// True while some thread is writing an edit to the MANIFEST with
+	// the mutex released; other LogAndApply() callers wait on manifestcv.
+	bool manifestwriting;
+	std::condition_variable manifestcv;
 };
 
 int FindFile(const InternalKeyComparator& icmp,
@@ -287,6 +361,25 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp, bool disjointSorte
 	const std::string_view* smallestuserkey,
 	const std::string_view* largestuserkey);
 
+// Position of one pass over the key space of a compaction.  Keys must
+// be presented in increasing order.  Subcompactions each walk a disjoint
+// key range with their own cursor, so they can share one Compaction.
+struct CompactionCursor {
+	size_t grandparentindex; // Index in grandparent_starts_
+	bool seenkey; // Some output key has been seen
+	int64_t overlappedbytes; // Bytes of overlap between version output
+	// and grandparent files
+	// State for implementing IsBaseLevelForKey
+
+	// level_ptrs_ holds indices into input_version_->levels_: our state
+	// is that we are positioned at one of the file ranges for each
+	// higher level than the ones involved in this compaction (i.e. for
+	// all L >= level_ + 2).
+	size_t levelptrs[kNumLevels];
+
+	CompactionCursor();
+};
+
 // A Compaction encapsulates information about a compaction.
 class Compaction {
 public:
@@ -321,11 +414,19 @@ public:
 	// Returns true if the information we have available guarantees that
 	// the compaction is producing data in "level+1" for which no data exists
 	// in levels greater than "level+1".
-	bool isBaseLevelForKey(const std::string_view& userkey);
+	bool isBaseLevelForKey(const std::string_view& userkey) {
+		return isBaseLevelForKey(userkey, &cursor);
+	}
+
+	bool isBaseLevelForKey(const std::string_view& userkey, CompactionCursor* cursor);
 
 	// Returns true iff we should stop building the version output
 	// before processing "internal_key".
-	bool shouldStopBefore(const std::string_view& internalKey);
+	bool shouldStopBefore(const std::string_view& internalKey) {
+		return shouldStopBefore(internalKey, &cursor);
+	}
+
+	bool shouldStopBefore(const std::string_view& internalKey, CompactionCursor* cursor);
 
 	// Release the input version for the compaction, once the compaction
 	// is successful.
@@ -338,17 +439,8 @@ private:
 
 	int level;
 	uint64_t maxoutputfilesize;
-	size_t grandparentindex; // Index in grandparent_starts_
-	bool seenkey; // Some output key has been seen
-	int64_t overlappedbytes; // Bytes of overlap between version output
-	// and grandparent files
-	// State for implementing IsBaseLevelForKey
-
-	// level_ptrs_ holds indices into input_version_->levels_: our state
-	// is that we are positioned at one of the file ranges for each
-	// higher level than the ones involved in this compaction (i.e. for
-	// all L >= level_ + 2).
-	size_t levelptrs[kNumLevels];
+	// Cursor used by the single-pass overloads above
+	CompactionCursor cursor;
 
 	VersionEdit edit;
 	std::shared_ptr<Version> inputversion;
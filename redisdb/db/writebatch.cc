@@ -29,11 +29,19 @@ void WriteBatch::Put(const std::string_view& key, const std::string_view& value)
 	PutLengthPrefixedSlice(&rep, value);
 }
 
+void WriteBatch::Merge(const std::string_view& key, const std::string_view& value) {
+	WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+	rep.push_back(static_cast<char>(kTypeMerge));
+	PutLengthPrefixedSlice(&rep, key);
+	PutLengthPrefixedSlice(&rep, value);
+}
+
 size_t WriteBatch::ApproximateSize() {
 	return rep.size();
 }
 
-Status WriteBatch::Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& mem) const {
+Status WriteBatch::Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& mem,
+	bool concurrent) const {
 	std::string_view input(rep);
 	if (input.size()< kHeader) {
 		return Status::Corruption("malformed WriteBatch (too small)");
@@ -49,7 +57,7 @@ Status WriteBatch::Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& m
 		switch (tag) {
 		case kTypeValue: {
 			if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value)) {
-				mem->Add(sequence++, kTypeValue, key, value);
+				mem->Add(sequence++, kTypeValue, key, value, concurrent);
 			}
 			else {
 				return Status::Corruption("bad WriteBatch Put");
@@ -58,13 +66,22 @@ Status WriteBatch::Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& m
 		}
 		case kTypeDeletion: {
 			if (GetLengthPrefixedSlice(&input, &key)) {
-				mem->Add(sequence++, kTypeDeletion, key, std::string_view());
+				mem->Add(sequence++, kTypeDeletion, key, std::string_view(), concurrent);
 			}
 			else {
 				return Status::Corruption("bad WriteBatch Delete");
 			}
 			break;
 		}
+		case kTypeMerge: {
+			if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value)) {
+				mem->Add(sequence++, kTypeMerge, key, value, concurrent);
+			}
+			else {
+				return Status::Corruption("bad WriteBatch Merge");
+			}
+			break;
+		}
 		default:
 			return Status::Corruption("unknown WriteBatch tag");
 		}
@@ -79,8 +96,9 @@ Status WriteBatch::Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& m
 	}
 }
 
-Status WriteBatchInternal::InsertInto(const WriteBatch* batch, const std::shared_ptr<MemTable>& memtable) {
-	return batch->Iterate(GetSequence(batch), memtable);
+Status WriteBatchInternal::InsertInto(const WriteBatch* batch, const std::shared_ptr<MemTable>& memtable,
+	bool concurrent) {
+	return batch->Iterate(GetSequence(batch), memtable, concurrent);
 }
 
 int WriteBatchInternal::Count(const WriteBatch* b) {
@@ -26,10 +26,15 @@ public:
 	// If the database Contains a mapping for "key", erase it.  Else do nothing.
 	void Delete(const std::string_view& key);
 
+	// Apply "value" as an operand of Options::mergeoperator to the
+	// current value of "key".
+	void Merge(const std::string_view& key, const std::string_view& value);
+
 	// Clear all updates buffered in this batch.
 	void clear();
 
-	Status Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& mem) const;
+	Status Iterate(uint64_t sequence, const std::shared_ptr<MemTable>& mem,
+		bool concurrent = false) const;
 
 	// The size of the database changes caused by this batch.
 	//
@@ -63,5 +68,8 @@ public:
 
 	static void append(WriteBatch* dst, const WriteBatch* src);
 
-	static Status InsertInto(const WriteBatch* batch, const std::shared_ptr<MemTable>& memtable);
+	// If "concurrent" is true, other writers may be inserting their own
+	// batches into the same memtable at the same time.
+	static Status InsertInto(const WriteBatch* batch, const std::shared_ptr<MemTable>& memtable,
+		bool concurrent = false);
 };
@@ -0,0 +1,91 @@
+#include "writebuffermanager.h"
+#include <algorithm>
+#include "db.h"
+
+// Memtables are charged to the cache in units of this size, so that
+// the reservation changes only every so often as they grow.
+static const size_t kReservationUnit = 256 * 1024;
+
+WriteBufferManager::WriteBufferManager(size_t buffersize,
+	const std::shared_ptr<ShardedLRUCache>& cache)
+	: buffersize(buffersize),
+	mutablelimit(buffersize * 7 / 8),
+	memoryused(0),
+	mutablememory(0) {
+	if (cache != nullptr) {
+		reservation.reset(new CacheReservation(cache, kReservationUnit));
+	}
+}
+
+size_t WriteBufferManager::GetCacheReserved() {
+	std::unique_lock<std::mutex> lk(cachemutex);
+	return reservation != nullptr ? reservation->GetReserved() : 0;
+}
+
+void WriteBufferManager::ReserveMem(size_t mem) {
+	memoryused.fetch_add(mem, std::memory_order_relaxed);
+	mutablememory.fetch_add(mem, std::memory_order_relaxed);
+	UpdateCacheReservation();
+}
+
+void WriteBufferManager::ScheduleFreeMem(size_t mem) {
+	mutablememory.fetch_sub(mem, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(size_t mem) {
+	memoryused.fetch_sub(mem, std::memory_order_relaxed);
+	UpdateCacheReservation();
+}
+
+void WriteBufferManager::UpdateCacheReservation() {
+	if (reservation != nullptr) {
+		std::unique_lock<std::mutex> lk(cachemutex);
+		reservation->Update(memoryused.load(std::memory_order_relaxed));
+	}
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+	if (!Enabled()) {
+		return false;
+	}
+
+	const size_t mutablemem = GetMutableMemoryUsage();
+	if (mutablemem > mutablelimit) {
+		return true;
+	}
+
+	// Memtables being flushed free their memory soon, so only flush
+	// more when at least half of the limit could be freed by doing so.
+	return GetMemoryUsage() >= buffersize && mutablemem >= buffersize / 2;
+}
+
+void WriteBufferManager::FlushLargest() {
+	std::unique_lock<std::mutex> lk(mutex, std::try_to_lock);
+	if (!lk.owns_lock() || !ShouldFlush()) {
+		return;
+	}
+
+	DB* largest = nullptr;
+	size_t largestusage = 0;
+	for (DB* db : members) {
+		const size_t usage = db->GetWriteBufferUsage();
+		if (usage > largestusage) {
+			largest = db;
+			largestusage = usage;
+		}
+	}
+
+	if (largest != nullptr) {
+		largest->FlushWriteBuffer();
+	}
+}
+
+void WriteBufferManager::AddMember(DB* db) {
+	std::unique_lock<std::mutex> lk(mutex);
+	members.push_back(db);
+}
+
+void WriteBufferManager::RemoveMember(DB* db) {
+	std::unique_lock<std::mutex> lk(mutex);
+	members.erase(std::remove(members.begin(), members.end(), db), members.end());
+}
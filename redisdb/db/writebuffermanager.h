@@ -0,0 +1,89 @@
+#pragma once
+
+// WriteBufferManager caps the memory used by the memtables of several
+// DBs, handed to each of them through Options::writebuffermanager.
+// Every DB reports the size of its memtables as they grow; once the
+// total gets close to the limit, the DB with the largest mutable
+// memtable is made to switch it out and flush it, so an idle DB gives
+// up its memory to a busy one instead of each DB keeping a buffer of
+// its own.
+//
+// If a cache is given, the memtables are also charged against its
+// capacity (see CacheReservation), so that a single number bounds the
+// memtables and the cached blocks together.
+//
+// Thread safe.
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "cache.h"
+
+class DB;
+
+class WriteBufferManager {
+public:
+	// "buffersize" is the limit in bytes over all memtables; 0 only
+	// counts them.  If "cache" is non-null the memtables are charged
+	// to it as well.
+	explicit WriteBufferManager(size_t buffersize,
+		const std::shared_ptr<ShardedLRUCache>& cache = nullptr);
+
+	WriteBufferManager(const WriteBufferManager&) = delete;
+
+	void operator=(const WriteBufferManager&) = delete;
+
+	bool Enabled() const { return buffersize > 0; }
+
+	size_t GetBufferSize() const { return buffersize; }
+
+	// Bytes used by all memtables, and by the mutable ones only.
+	size_t GetMemoryUsage() const { return memoryused.load(std::memory_order_relaxed); }
+
+	size_t GetMutableMemoryUsage() const { return mutablememory.load(std::memory_order_relaxed); }
+
+	// Bytes of the cache taken up by memtables.
+	size_t GetCacheReserved();
+
+	// A mutable memtable grew by "mem" bytes.
+	void ReserveMem(size_t mem);
+
+	// A memtable of "mem" bytes became immutable and will be flushed.
+	void ScheduleFreeMem(size_t mem);
+
+	// A memtable of "mem" bytes, already immutable, was released.
+	void FreeMem(size_t mem);
+
+	// Should a memtable be flushed to stay within the limit?
+	bool ShouldFlush() const;
+
+	// Make the member with the largest mutable memtable flush it, if
+	// ShouldFlush().  Returns at once if another thread is already
+	// doing so.
+	// REQUIRES: the caller holds no lock of any member DB.
+	void FlushLargest();
+
+	// Members are the DBs that FlushLargest() picks from; a DB adds
+	// itself when it is created and removes itself when it is deleted.
+	void AddMember(DB* db);
+
+	void RemoveMember(DB* db);
+
+private:
+	void UpdateCacheReservation();
+
+	const size_t buffersize;
+	const size_t mutablelimit;
+	std::atomic<size_t> memoryused;
+	std::atomic<size_t> mutablememory;
+
+	// Protects members, and serializes FlushLargest() with member
+	// removal so that a DB is not deleted while it is flushed.
+	std::mutex mutex;
+	std::vector<DB*> members;
+
+	std::mutex cachemutex;
+	std::shared_ptr<CacheReservation> reservation;
+};
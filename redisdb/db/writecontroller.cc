@@ -0,0 +1,135 @@
+#include "writecontroller.h"
+#include "dbformat.h"
+#include <stdio.h>
+
+// Never throttle below this rate, however far behind compactions are.
+static const uint64_t kMinWriteRate = 16 * 1024;
+
+// The bucket holds at most this much time worth of writes, so an idle
+// period does not let a later burst through unthrottled.
+static const uint64_t kRefillIntervalMicros = 1000;
+
+static const uint64_t kMicrosPerSecond = 1000000;
+
+WriteController::WriteController(uint64_t maxrate, uint64_t softlimit, uint64_t hardlimit)
+	: maxrate(maxrate > kMinWriteRate ? maxrate : kMinWriteRate),
+	softlimit(softlimit),
+	hardlimit(hardlimit),
+	state(kNormal),
+	rate(this->maxrate),
+	debt(0),
+	l0files(0),
+	credit(0),
+	lastrefill(0),
+	delaycount(0),
+	delaymicros(0),
+	stopcount(0) {
+
+}
+
+void WriteController::Update(int l0files, uint64_t debt, uint64_t now) {
+	State newstate = kNormal;
+	if (l0files >= kL0_StopWritesTrigger ||
+		(hardlimit > 0 && debt >= hardlimit)) {
+		newstate = kStopped;
+	}
+	else if (l0files >= kL0_SlowdownWritesTrigger ||
+		(softlimit > 0 && debt >= softlimit)) {
+		newstate = kDelayed;
+	}
+
+	if (newstate == kDelayed) {
+		if (state != kDelayed) {
+			// Start a new slowdown with an empty bucket.
+			Refill(now);
+			credit = 0;
+		}
+
+		// Slow down further while the debt or the number of level-0
+		// files keeps growing, speed up again while compactions win.
+		if (debt > this->debt || l0files > this->l0files) {
+			rate = rate * 4 / 5;
+		}
+		else if (debt < this->debt || l0files < this->l0files) {
+			rate = rate * 5 / 4;
+		}
+
+		// One file away from a stop: slow down hard.
+		if (l0files >= kL0_StopWritesTrigger - 1) {
+			rate /= 4;
+		}
+
+		if (rate < kMinWriteRate) {
+			rate = kMinWriteRate;
+		}
+		else if (rate > maxrate) {
+			rate = maxrate;
+		}
+	}
+	else if (newstate == kNormal) {
+		rate = maxrate;
+	}
+	else if (state != kStopped) {
+		stopcount++;
+	}
+
+	state = newstate;
+	this->debt = debt;
+	this->l0files = l0files;
+}
+
+void WriteController::Refill(uint64_t now) {
+	if (now > lastrefill) {
+		const uint64_t elapsed = now - lastrefill;
+		credit += static_cast<int64_t>(elapsed * rate / kMicrosPerSecond);
+		const int64_t burst = static_cast<int64_t>(rate * kRefillIntervalMicros / kMicrosPerSecond);
+		if (credit > burst) {
+			credit = burst;
+		}
+	}
+	lastrefill = now;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now) {
+	if (state != kDelayed) {
+		return 0;
+	}
+
+	Refill(now);
+	if (credit >= 0) {
+		return 0;
+	}
+	return static_cast<uint64_t>(-credit) * kMicrosPerSecond / rate;
+}
+
+void WriteController::Consume(uint64_t bytes) {
+	if (state == kDelayed) {
+		credit -= static_cast<int64_t>(bytes);
+	}
+}
+
+void WriteController::RecordDelay(uint64_t micros) {
+	delaycount++;
+	delaymicros += micros;
+}
+
+std::string WriteController::ToString() const {
+	static const char* const kStateNames[] = { "normal", "delayed", "stopped" };
+	char buf[300];
+	snprintf(buf, sizeof(buf),
+		"state: %s\n"
+		"delayed-write-rate: %llu\n"
+		"pending-compaction-bytes: %llu\n"
+		"level0-files: %d\n"
+		"delays: %llu\n"
+		"delay-micros: %llu\n"
+		"stops: %llu\n",
+		kStateNames[state],
+		static_cast<unsigned long long>(rate),
+		static_cast<unsigned long long>(debt),
+		l0files,
+		static_cast<unsigned long long>(delaycount),
+		static_cast<unsigned long long>(delaymicros),
+		static_cast<unsigned long long>(stopcount));
+	return buf;
+}
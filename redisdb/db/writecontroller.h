@@ -0,0 +1,75 @@
+#pragma once
+
+// WriteController throttles writers while compactions fall behind.
+// Instead of sleeping a fixed time per write once level-0 fills up, the
+// DB feeds it the compaction debt after every version change and it
+// derives a write rate from it: the rate drops while the debt keeps
+// growing and recovers while compactions catch up.  Writers draw from a
+// token bucket that refills at that rate, so a burst is spread out over
+// many small delays instead of ending in a hard stall.
+//
+// Not thread safe: the DB calls it with its mutex held.
+
+#include <stdint.h>
+#include <string>
+
+class WriteController {
+public:
+	enum State {
+		kNormal,
+		kDelayed,
+		kStopped
+	};
+
+	// "maxrate" is the write rate, in bytes per second, allowed when a
+	// slowdown starts.  The limits are compaction debts in bytes at which
+	// writes are slowed down and stopped; 0 disables either one.
+	WriteController(uint64_t maxrate, uint64_t softlimit, uint64_t hardlimit);
+
+	// Re-evaluate the state from the current shape of the tree.
+	// "l0files" is the number of level-0 files and "debt" the estimated
+	// number of bytes compactions still have to rewrite.
+	void Update(int l0files, uint64_t debt, uint64_t now);
+
+	// Return how long, in microseconds, the next write has to wait
+	// until the bucket is no longer in debt.  0 unless delayed.
+	uint64_t GetDelay(uint64_t now);
+
+	// Charge "bytes" that were just written against the bucket.
+	void Consume(uint64_t bytes);
+
+	// Record a delay that a writer actually slept.
+	void RecordDelay(uint64_t micros);
+
+	State GetState() const { return state; }
+
+	bool IsDelayed() const { return state == kDelayed; }
+
+	bool IsStopped() const { return state == kStopped; }
+
+	uint64_t GetDelayedWriteRate() const { return rate; }
+
+	uint64_t GetCompactionDebt() const { return debt; }
+
+	// Human readable summary for DB::GetProperty().
+	std::string ToString() const;
+
+private:
+	void Refill(uint64_t now);
+
+	const uint64_t maxrate;
+	const uint64_t softlimit;
+	const uint64_t hardlimit;
+
+	State state;
+	uint64_t rate;          // Current delayed write rate, bytes per second
+	uint64_t debt;          // Compaction debt at the last Update()
+	int l0files;
+	int64_t credit;         // Bytes writers may still write; negative = in debt
+	uint64_t lastrefill;
+
+	// Cumulative counters
+	uint64_t delaycount;
+	uint64_t delaymicros;
+	uint64_t stopcount;
+};
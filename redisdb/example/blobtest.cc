@@ -0,0 +1,203 @@
+#include "db.h"
+#include "filename.h"
+#include <assert.h>
+#include <stdio.h>
+#include <map>
+#include <random>
+#include <set>
+
+// Values of at least minblobsize bytes are kept in blob files (see
+// blobfile.h).  The tests mix large and small values, overwrite and
+// delete some, compact and reopen, and check reads through Get() and
+// iteration against a model.  Blob files whose records have all become
+// garbage must be gone from the manifest and from the directory.
+
+static const int kNumKeys = 300;
+static const size_t kMinBlobSize = 100;
+
+static std::string Key(int i) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "key%04d", i);
+	return buf;
+}
+
+class BlobTest {
+public:
+	BlobTest()
+		: dbname("./test_blob"),
+		rnd(301) {
+		options.createifmissing = true;
+		options.enableblobfiles = true;
+		options.minblobsize = kMinBlobSize;
+		options.blobfilesize = 32 * 1024;
+		DestroyDir(dbname);
+		Reopen();
+	}
+
+	void Reopen() {
+		db.reset();
+		db.reset(new DB(options, dbname));
+		assert(db->Open().ok());
+	}
+
+	void ReadsAndGarbage() {
+		// Even keys get large values, odd keys small ones.
+		for (int i = 0; i < kNumKeys; i++) {
+			Put(i, (i % 2 == 0) ? kMinBlobSize + rnd() % 900 : rnd() % kMinBlobSize);
+		}
+		db->CompactRange(nullptr, nullptr);
+		Check();
+		const std::set<uint64_t> firstfiles = BlobFiles();
+		assert(!firstfiles.empty());
+
+		// Overwrite some values with large and small ones and delete
+		// others; the first files now hold garbage and live records.
+		for (int i = 0; i < kNumKeys; i += 3) {
+			switch (i % 4) {
+			case 0:
+				Put(i, kMinBlobSize + rnd() % 900);
+				break;
+			case 1:
+				Put(i, rnd() % kMinBlobSize);
+				break;
+			default:
+				Delete(i);
+				break;
+			}
+		}
+		db->CompactRange(nullptr, nullptr);
+		Check();
+		BlobFiles();
+		Reopen();
+		Check();
+
+		// Replace every value written in the first round.
+		for (int i = 0; i < kNumKeys; i++) {
+			if (i % 3 != 0) {
+				if (i % 5 == 0) {
+					Delete(i);
+				}
+				else {
+					Put(i, (i % 2 == 0) ? kMinBlobSize : kMinBlobSize - 1);
+				}
+			}
+		}
+		db->CompactRange(nullptr, nullptr);
+		Check();
+
+		const std::set<uint64_t> files = BlobFiles();
+		for (uint64_t number : firstfiles) {
+			assert(files.count(number) == 0);
+		}
+
+		Reopen();
+		Check();
+		assert(BlobFiles() == files);
+	}
+
+private:
+	void Put(int i, size_t size) {
+		std::string value(size, 'a' + rnd() % 26);
+		value.replace(0, std::min(size, Key(i).size()), Key(i), 0, size);
+		assert(db->Put(WriteOptions(), Key(i), value).ok());
+		model[Key(i)] = value;
+	}
+
+	void Delete(int i) {
+		assert(db->Delete(WriteOptions(), Key(i)).ok());
+		model.erase(Key(i));
+	}
+
+	void Check() {
+		for (int i = 0; i < kNumKeys; i++) {
+			std::string value;
+			Status s = db->Get(ReadOptions(), Key(i), &value);
+			auto it = model.find(Key(i));
+			if (it == model.end()) {
+				assert(s.IsNotFound());
+			}
+			else {
+				assert(s.ok());
+				assert(value == it->second);
+			}
+		}
+
+		std::shared_ptr<Iterator> iter = db->NewIterator(ReadOptions());
+		auto it = model.begin();
+		for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+			assert(it != model.end());
+			assert(iter->key() == it->first);
+			assert(iter->value() == it->second);
+		}
+		assert(it == model.end());
+
+		auto rit = model.rbegin();
+		for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++rit) {
+			assert(rit != model.rend());
+			assert(iter->key() == rit->first);
+			assert(iter->value() == rit->second);
+		}
+		assert(rit == model.rend());
+		assert(iter->status().ok());
+	}
+
+	// Numbers of the blob files in the directory, checked against the
+	// blob-stats property: the files listed there are exactly those on
+	// disk, and their live records are exactly the large values.
+	std::set<uint64_t> BlobFiles() {
+		std::set<uint64_t> files;
+		std::vector<std::string> filenames;
+		assert(options.env->GetChildren(dbname, &filenames).ok());
+		uint64_t number;
+		FileType type;
+		for (size_t i = 0; i < filenames.size(); i++) {
+			if (ParseFileName(filenames[i], &number, &type) && type == kBlobFile) {
+				files.insert(number);
+			}
+		}
+
+		std::string stats;
+		assert(db->GetProperty("leveldb.blob-stats", &stats));
+		unsigned long long numfiles, records, garbage;
+		double mb;
+		assert(sscanf(stats.c_str(), "Blob files: %llu\nRecords: %llu (%lf MB)\nGarbage: %llu",
+			&numfiles, &records, &mb, &garbage) == 4);
+		assert(numfiles == files.size());
+
+		unsigned long long large = 0;
+		for (const auto& it : model) {
+			if (it.second.size() >= kMinBlobSize) {
+				large++;
+			}
+		}
+		assert(records - garbage == large);
+		return files;
+	}
+
+	void DestroyDir(const std::string& dirname) {
+		std::vector<std::string> filenames;
+		if (!options.env->GetChildren(dirname, &filenames).ok()) {
+			return;
+		}
+
+		for (size_t i = 0; i < filenames.size(); i++) {
+			if (filenames[i] != "." && filenames[i] != "..") {
+				options.env->DeleteFile(dirname + "/" + filenames[i]);
+			}
+		}
+		options.env->DeleteDir(dirname);
+	}
+
+	Options options;
+	const std::string dbname;
+	std::mt19937 rnd;
+	std::shared_ptr<DB> db;
+	std::map<std::string, std::string> model;
+};
+
+int main() {
+	BlobTest test;
+	test.ReadsAndGarbage();
+	printf("PASS\n");
+	return 0;
+}
@@ -1,95 +1,374 @@
-#include "dbimpl.h"
-#include "option.h"
 #include "cache.h"
 #include "coding.h"
+#include "hash.h"
+#include <set>
+#include <random>
 #include <vector>
-#include <functional>
 
 // Conversions between numeric keys/values and the types expected by Cache.
-static std::string encodeKey(int k) {
-    std::string result;
-    putFixed32(&result, k);
-    return result;
+static std::string EncodeKey(int k) {
+	std::string result;
+	PutFixed32(&result, k);
+	return result;
 }
 
-static int decodeKey(const std::string_view &k) {
-    assert(k.size() == 4);
-    return decodeFixed32(k.data());
+static int DecodeKey(const std::string_view& k) {
+	assert(k.size() == 4);
+	return DecodeFixed32(k.data());
 }
 
-static int decodeValue(const std::any &v) {
-    assert(v.has_value());
-    return std::any_cast<int>(v);
+static int DecodeValue(const std::any& v) {
+	assert(v.has_value());
+	return std::any_cast<int>(v);
+}
+
+// The deleter is a plain function, so it reports to the test running.
+static std::vector<int> deletedkeys;
+static std::vector<int> deletedvalues;
+
+static void Deleter(const std::string_view& key, const std::any& v) {
+	deletedkeys.push_back(DecodeKey(key));
+	deletedvalues.push_back(DecodeValue(v));
 }
 
 class CacheTest {
 public:
-    void deleterCallBack(const std::string_view &key, const std::any &v) {
-        deletedKeys.push_back(decodeKey(key));
-        deletedValues.push_back(decodeValue(v));
-    }
-
-    CacheTest()
-            : cache(new ShardedLRUCache(kCacheSize)) {
-
-    }
-
-    int lookup(int key) {
-        auto handle = cache->lookup(encodeKey(key));
-        const int r = (handle == nullptr) ? -1 : decodeValue(cache->value(handle));
-        if (handle != nullptr) {
-            cache->erase(encodeKey(key));
-        }
-        return r;
-    }
-
-    void insert(int key, int value, int charge = 1) {
-        cache->insert(encodeKey(key), value, charge,
-                      std::bind(&CacheTest::deleterCallBack, this,
-                                std::placeholders::_1, std::placeholders::_2));
-    }
-
-    void erase(int key) {
-        cache->erase(encodeKey(key));
-    }
-
-    void hitAndMiss() {
-        assert(lookup(100) == -1);
-        insert(100, 101);
-        assert(lookup(100) == 101);
-        assert(lookup(200) == -1);
-        assert(lookup(300) == -1);
-
-        insert(200, 201);
-        assert(lookup(100) == 101);
-        assert(lookup(200) == 201);
-        assert(lookup(300) == -1);
-
-        insert(100, 102);
-        assert(lookup(100) == 102);
-        assert(lookup(200) == 201);
-        assert(lookup(300) == -1);
-
-        assert(deletedKeys.size() == 1);
-        assert(deletedKeys[0] == 100);
-        assert(deletedValues[0] == 101);
-    }
-
-    void erase() {
-
-    }
+	CacheTest()
+		: cache(new ShardedLRUCache(kCacheSize)) {
+		deletedkeys.clear();
+		deletedvalues.clear();
+	}
+
+	int Lookup(int key) {
+		LRUHandle* handle = cache->Lookup(EncodeKey(key));
+		const int r = (handle == nullptr) ? -1 : DecodeValue(cache->Value(handle));
+		if (handle != nullptr) {
+			cache->Release(handle);
+		}
+		return r;
+	}
+
+	void Insert(int key, int value, int charge = 1) {
+		cache->Release(cache->Insert(EncodeKey(key), value, charge, Deleter));
+	}
+
+	LRUHandle* InsertAndReturnHandle(int key, int value, int charge = 1) {
+		return cache->Insert(EncodeKey(key), value, charge, Deleter);
+	}
+
+	void Erase(int key) {
+		cache->Erase(EncodeKey(key));
+	}
+
+	void HitAndMiss() {
+		assert(Lookup(100) == -1);
+
+		Insert(100, 101);
+		assert(Lookup(100) == 101);
+		assert(Lookup(200) == -1);
+		assert(Lookup(300) == -1);
+
+		Insert(200, 201);
+		assert(Lookup(100) == 101);
+		assert(Lookup(200) == 201);
+		assert(Lookup(300) == -1);
+
+		// Replacing a key frees the old entry once.
+		Insert(100, 102);
+		assert(Lookup(100) == 102);
+		assert(Lookup(200) == 201);
+		assert(Lookup(300) == -1);
+
+		assert(deletedkeys.size() == 1);
+		assert(deletedkeys[0] == 100);
+		assert(deletedvalues[0] == 101);
+	}
+
+	void EraseEntry() {
+		Erase(200);
+		assert(deletedkeys.size() == 0);
+
+		Insert(100, 101);
+		Insert(200, 201);
+		Erase(100);
+		assert(Lookup(100) == -1);
+		assert(Lookup(200) == 201);
+		assert(deletedkeys.size() == 1);
+		assert(deletedkeys[0] == 100);
+		assert(deletedvalues[0] == 101);
+
+		Erase(100);
+		assert(Lookup(100) == -1);
+		assert(Lookup(200) == 201);
+		assert(deletedkeys.size() == 1);
+	}
+
+	void EntriesArePinned() {
+		Insert(100, 101);
+		LRUHandle* h1 = cache->Lookup(EncodeKey(100));
+		assert(DecodeValue(cache->Value(h1)) == 101);
+
+		// A replaced entry lives on until its handle is released.
+		Insert(100, 102);
+		LRUHandle* h2 = cache->Lookup(EncodeKey(100));
+		assert(DecodeValue(cache->Value(h2)) == 102);
+		assert(deletedkeys.size() == 0);
+
+		cache->Release(h1);
+		assert(deletedkeys.size() == 1);
+		assert(deletedkeys[0] == 100);
+		assert(deletedvalues[0] == 101);
+
+		// So does an erased one.
+		Erase(100);
+		assert(Lookup(100) == -1);
+		assert(DecodeValue(cache->Value(h2)) == 102);
+		assert(deletedkeys.size() == 1);
+
+		cache->Release(h2);
+		assert(deletedkeys.size() == 2);
+		assert(deletedkeys[1] == 100);
+		assert(deletedvalues[1] == 102);
+	}
+
+	void EvictionPolicy() {
+		Insert(100, 101);
+		Insert(200, 201);
+		Insert(300, 301);
+		LRUHandle* h = cache->Lookup(EncodeKey(300));
+
+		// Frequently used entry must be kept around,
+		// as must things that are still in use.
+		for (int i = 0; i < kCacheSize + 100; i++) {
+			Insert(1000 + i, 2000 + i);
+			assert(Lookup(1000 + i) == 2000 + i);
+			assert(Lookup(100) == 101);
+		}
+		assert(Lookup(100) == 101);
+		assert(Lookup(200) == -1);
+		assert(Lookup(300) == 301);
+		cache->Release(h);
+	}
+
+	void UseExceedsCacheSize() {
+		// Overfill the cache, keeping handles on all inserted entries.
+		std::vector<LRUHandle*> h;
+		for (int i = 0; i < kCacheSize + 100; i++) {
+			h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+		}
+
+		// Check that all the entries can be found in the cache.
+		for (int i = 0; i < h.size(); i++) {
+			assert(Lookup(1000 + i) == 2000 + i);
+		}
+
+		for (int i = 0; i < h.size(); i++) {
+			cache->Release(h[i]);
+		}
+	}
+
+	void HeavyEntries() {
+		// Add a bunch of light and heavy entries and then count the combined
+		// size of items still in the cache, which must be approximately the
+		// same as the total capacity.
+		const int kLight = 1;
+		const int kHeavy = 10;
+		int added = 0;
+		int index = 0;
+		while (added < 2 * kCacheSize) {
+			const int weight = (index & 1) ? kLight : kHeavy;
+			Insert(index, 1000 + index, weight);
+			added += weight;
+			index++;
+		}
+
+		int cachedweight = 0;
+		for (int i = 0; i < index; i++) {
+			const int weight = (i & 1 ? kLight : kHeavy);
+			int r = Lookup(i);
+			if (r >= 0) {
+				cachedweight += weight;
+				assert(1000 + i == r);
+			}
+		}
+		assert(cachedweight <= kCacheSize + kCacheSize / 10);
+	}
+
+	void NewId() {
+		uint64_t a = cache->NewId();
+		uint64_t b = cache->NewId();
+		assert(a != b);
+	}
+
+	void ZeroSizeCache() {
+		cache.reset(new ShardedLRUCache(0));
+		Insert(1, 100);
+		assert(Lookup(1) == -1);
+		assert(deletedkeys.size() == 1);
+	}
+
+private:
+	static const int kCacheSize = 1000;
+	std::shared_ptr<ShardedLRUCache> cache;
+};
+
+// Tests of the replacement policy and the table of a single shard, so
+// that which entries compete for the capacity is known.
+class LRUCacheTest {
+public:
+	LRUCacheTest() {
+		deletedkeys.clear();
+		deletedvalues.clear();
+	}
+
+	void Insert(LRUCache* shard, int key, int value) {
+		const std::string k = EncodeKey(key);
+		shard->Release(shard->Insert(k, HashKey(k), value, 1, Deleter));
+	}
+
+	int Lookup(LRUCache* shard, int key) {
+		const std::string k = EncodeKey(key);
+		LRUHandle* handle = shard->Lookup(k, HashKey(k));
+		const int r = (handle == nullptr) ? -1 : DecodeValue(handle->value);
+		if (handle != nullptr) {
+			shard->Release(handle);
+		}
+		return r;
+	}
+
+	void Erase(LRUCache* shard, int key) {
+		const std::string k = EncodeKey(key);
+		shard->Erase(k, HashKey(k));
+	}
+
+	// Entries looked up since their insertion survive a scan of entries
+	// that are read only once.
+	void ScanResistance() {
+		LRUCache shard;
+		shard.SetCapacity(100);
+		for (int i = 0; i < 50; i++) {
+			Insert(&shard, i, 1000 + i);
+			assert(Lookup(&shard, i) == 1000 + i);
+		}
+
+		for (int i = 0; i < 10000; i++) {
+			Insert(&shard, 100000 + i, i);
+		}
+
+		for (int i = 0; i < 50; i++) {
+			assert(Lookup(&shard, i) == 1000 + i);
+		}
+		assert(shard.TotalCharge() <= 100);
+
+		// Only the most recent part of the scan is still cached.
+		assert(Lookup(&shard, 100000) == -1);
+		assert(Lookup(&shard, 100000 + 9999) == 9999);
+	}
+
+	// The hot list is capped, so entries that stop being used are
+	// demoted and evicted in the end.
+	void HotListIsCapped() {
+		LRUCache shard;
+		shard.SetCapacity(100);
+		for (int i = 0; i < 100; i++) {
+			Insert(&shard, i, i);
+			assert(Lookup(&shard, i) == i);
+		}
+
+		for (int i = 0; i < 100; i++) {
+			Insert(&shard, 1000 + i, i);
+			assert(Lookup(&shard, 1000 + i) == i);
+		}
+
+		int left = 0;
+		for (int i = 0; i < 100; i++) {
+			if (Lookup(&shard, i) >= 0) {
+				left++;
+			}
+		}
+		assert(left == 0);
+		assert(shard.TotalCharge() <= 100);
+	}
+
+	// Inserting and erasing at random leaves many tombstones behind in
+	// the table; the table must keep finding exactly the live keys while
+	// it is resized over and over.
+	void Churn() {
+		LRUCache shard;
+		shard.SetCapacity(1 << 20);
+		std::mt19937 rnd(301);
+		std::set<int> live;
+		size_t inserted = 0;
+		deletedkeys.clear();
+		deletedvalues.clear();
+		for (int i = 0; i < 200000; i++) {
+			const int key = rnd() % 2000;
+			switch (rnd() % 3) {
+			case 0:
+				Insert(&shard, key, key + 1);
+				live.insert(key);
+				inserted++;
+				break;
+			case 1:
+				Erase(&shard, key);
+				live.erase(key);
+				break;
+			default:
+				assert(Lookup(&shard, key) == (live.count(key) > 0 ? key + 1 : -1));
+				break;
+			}
+		}
+
+		for (int key = 0; key < 2000; key++) {
+			assert(Lookup(&shard, key) == (live.count(key) > 0 ? key + 1 : -1));
+		}
+		assert(shard.TotalCharge() == live.size());
+		assert(deletedkeys.size() == inserted - live.size());
+	}
 
 private:
-    static const int kCacheSize = 1000;
-    std::vector<int> deletedKeys;
-    std::vector<int> deletedValues;
-    std::shared_ptr <ShardedLRUCache> cache;
+	static uint32_t HashKey(const std::string& k) {
+		return Hash(k.data(), k.size(), 0);
+	}
 };
 
-int main(int argc, char *argv[]) {
-    CacheTest test;
-    test.hitAndMiss();
-    test.erase();
-    return 0;
+int main(int argc, char* argv[]) {
+	{
+		CacheTest test;
+		test.HitAndMiss();
+	}
+	{
+		CacheTest test;
+		test.EraseEntry();
+	}
+	{
+		CacheTest test;
+		test.EntriesArePinned();
+	}
+	{
+		CacheTest test;
+		test.EvictionPolicy();
+	}
+	{
+		CacheTest test;
+		test.UseExceedsCacheSize();
+	}
+	{
+		CacheTest test;
+		test.HeavyEntries();
+	}
+	{
+		CacheTest test;
+		test.NewId();
+	}
+	{
+		CacheTest test;
+		test.ZeroSizeCache();
+	}
 
+	LRUCacheTest test;
+	test.ScanResistance();
+	test.HotListIsCapped();
+	test.Churn();
+	return 0;
 }
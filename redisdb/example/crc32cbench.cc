@@ -0,0 +1,63 @@
+#include "crc32c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Compares the hardware and portable crc32c paths, then reports the
+// throughput of each for a range of buffer sizes.
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+static bool checkAgree(const std::string& data) {
+	for (size_t offset = 0; offset < 16; offset++) {
+		for (size_t n = 0; offset + n <= data.size(); n = n * 3 + 1) {
+			uint32_t hw = crc32c::Extend(0, data.data() + offset, n);
+			uint32_t sw = crc32c::ExtendPortable(0, data.data() + offset, n);
+			if (hw != sw) {
+				fprintf(stderr, "mismatch at offset %zu length %zu: %08x != %08x\n",
+					offset, n, hw, sw);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static double throughput(ExtendFunction func, const std::string& data, size_t size) {
+	const size_t total = 256 << 20;
+	const size_t iterations = total / size;
+	uint32_t crc = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++) {
+		crc = func(crc, data.data(), size);
+	}
+	auto end = std::chrono::steady_clock::now();
+	double micros = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	if (crc == 0x12345678) {
+		printf(" ");    // Keep the loop from being optimized away.
+	}
+	return (iterations * size) / (1048576.0) / (micros / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+	std::string data;
+	srand(301);
+	for (int i = 0; i < (1 << 20) + 64; i++) {
+		data.push_back(static_cast<char>(rand()));
+	}
+
+	printf("crc32c hardware acceleration: %s\n", crc32c::CanAccelerate() ? "yes" : "no");
+	if (!checkAgree(data)) {
+		return 1;
+	}
+
+	const size_t sizes[] = { 64, 4096, 65536, 1 << 20 };
+	for (size_t size : sizes) {
+		double hw = throughput(crc32c::Extend, data, size);
+		double sw = throughput(crc32c::ExtendPortable, data, size);
+		printf("%8zu bytes: extend %9.1f MB/s  portable %9.1f MB/s\n", size, hw, sw);
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include "merger.h"
+#include "iterator.h"
+#include "dbformat.h"
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// Drives a MergingIterator over random children with random moves and
+// checks every position against a sorted vector of all their entries.
+// Keys repeat across children.  Equal keys are yielded in child order
+// going forward and in reverse child order going backwards; changing
+// direction moves past every entry of the current key, since the
+// children other than the current one are repositioned by key.
+
+struct Entry {
+	std::string key;
+	std::string value;
+	int child;
+};
+
+static bool EntryLess(const Entry& a, const Entry& b) {
+	if (a.key != b.key) {
+		return a.key < b.key;
+	}
+	return a.child < b.child;
+}
+
+// Iterates over the sorted entries of a vector.
+class VectorIterator : public Iterator {
+public:
+	explicit VectorIterator(const std::vector<Entry>& entries)
+		: entries(entries),
+		pos(entries.size()) {
+	}
+
+	virtual bool Valid() const { return pos < entries.size(); }
+
+	virtual void SeekToFirst() { pos = 0; }
+
+	virtual void SeekToLast() { pos = entries.empty() ? 0 : entries.size() - 1; }
+
+	virtual void Seek(const std::string_view& target) {
+		for (pos = 0; pos < entries.size() && entries[pos].key < target; pos++) {
+		}
+	}
+
+	virtual void Next() {
+		assert(Valid());
+		pos++;
+	}
+
+	virtual void Prev() {
+		assert(Valid());
+		pos = (pos == 0) ? entries.size() : pos - 1;
+	}
+
+	virtual std::string_view key() const { return entries[pos].key; }
+
+	virtual std::string_view value() const { return entries[pos].value; }
+
+	virtual Status status() const { return Status::OK(); }
+
+private:
+	const std::vector<Entry> entries;
+	size_t pos;
+};
+
+class MergerTest {
+public:
+	MergerTest()
+		: rnd(301) {
+	}
+
+	void Run(int numchildren, int numsteps) {
+		std::vector<std::shared_ptr<Iterator>> children;
+		std::vector<Entry> all;
+		for (int c = 0; c < numchildren; c++) {
+			// Some children are empty, some hold most of the key space.
+			std::vector<Entry> entries;
+			const int numkeys = (rnd() % 4 == 0) ? 0 : rnd() % 80;
+			for (int i = 0; i < numkeys; i++) {
+				Entry e;
+				e.key = Key(rnd() % kKeySpace);
+				e.value = e.key + "@" + std::to_string(c);
+				e.child = c;
+				entries.push_back(e);
+			}
+
+			std::sort(entries.begin(), entries.end(), EntryLess);
+			entries.erase(std::unique(entries.begin(), entries.end(), EntryEqual), entries.end());
+			all.insert(all.end(), entries.begin(), entries.end());
+			children.push_back(std::shared_ptr<Iterator>(new VectorIterator(entries)));
+		}
+		std::sort(all.begin(), all.end(), EntryLess);
+
+		std::shared_ptr<Iterator> iter = NewMergingIterator(&comparator, children, numchildren);
+		const size_t end = all.size();
+		size_t pos = end;
+		bool forward = true;
+		for (int step = 0; step < numsteps; step++) {
+			const int op = (pos == end) ? rnd() % 3 : rnd() % 5;
+			switch (op) {
+			case 0:
+				iter->SeekToFirst();
+				pos = 0;
+				forward = true;
+				break;
+			case 1:
+				iter->SeekToLast();
+				pos = all.empty() ? end : all.size() - 1;
+				forward = false;
+				break;
+			case 2: {
+				const std::string target = Key(rnd() % (kKeySpace + 1));
+				iter->Seek(target);
+				for (pos = 0; pos < end && all[pos].key < target; pos++) {
+				}
+				forward = true;
+				break;
+			}
+			case 3:
+				iter->Next();
+				if (forward) {
+					pos++;
+				}
+				else {
+					pos = NextKey(all, pos);
+				}
+				forward = true;
+				break;
+			default:
+				iter->Prev();
+				if (!forward) {
+					pos = (pos == 0) ? end : pos - 1;
+				}
+				else {
+					pos = PrevKey(all, pos);
+				}
+				forward = false;
+				break;
+			}
+
+			if (pos == end) {
+				assert(!iter->Valid());
+			}
+			else {
+				assert(iter->Valid());
+				assert(iter->key() == all[pos].key);
+				assert(iter->value() == all[pos].value);
+			}
+		}
+		assert(iter->status().ok());
+	}
+
+private:
+	static const int kKeySpace = 200;
+
+	static std::string Key(int i) {
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%05d", i);
+		return buf;
+	}
+
+	static bool EntryEqual(const Entry& a, const Entry& b) {
+		return a.key == b.key;
+	}
+
+	// First entry with a key past that of all[pos].
+	static size_t NextKey(const std::vector<Entry>& all, size_t pos) {
+		const std::string key = all[pos].key;
+		while (pos < all.size() && all[pos].key == key) {
+			pos++;
+		}
+		return pos;
+	}
+
+	// Last entry with a key before that of all[pos], or all.size().
+	static size_t PrevKey(const std::vector<Entry>& all, size_t pos) {
+		const std::string key = all[pos].key;
+		while (pos > 0 && all[pos].key == key) {
+			pos--;
+		}
+		return (all[pos].key == key) ? all.size() : pos;
+	}
+
+	BytewiseComparatorImpl comparator;
+	std::mt19937 rnd;
+};
+
+int main() {
+	// Powers of two fill the loser tree exactly, the others leave the
+	// leaves on two depths.
+	const int counts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 16, 17, 31, 32, 33, 100 };
+	MergerTest test;
+	for (int count : counts) {
+		for (int round = 0; round < 20; round++) {
+			test.Run(count, 2000);
+		}
+	}
+	printf("PASS\n");
+	return 0;
+}
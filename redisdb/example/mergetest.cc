@@ -0,0 +1,245 @@
+#include "redistring.h"
+#include "util.h"
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <map>
+#include <thread>
+
+// Blind INCRBY, INCRBYFLOAT and APPEND write merge operands to the
+// strings DB (see redismerge.h).  The tests spread the values and
+// operands of every key over a deep level, level 0, the level between
+// and the memtable, and compare what Get(), MultiGet() and iteration in
+// both directions return with a model of the keys, before and after
+// compactions fold the operands.
+
+static const int kNumKeys = 60;
+
+static std::string Key(int i) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "key%03d", i);
+	return buf;
+}
+
+class MergeTest {
+public:
+	MergeTest()
+		: path("./test_merge") {
+		options.createifmissing = true;
+		DestroyDir(path);
+		strings.reset(new RedisString(nullptr, options, path));
+		assert(strings->Open().ok());
+	}
+
+	// Every third key takes increments, every third float increments
+	// and every third appends.  Even keys start from a value of their
+	// own, odd keys do not exist until the first operand.
+	void Operands() {
+		for (int i = 0; i < kNumKeys; i += 2) {
+			static const char* bases[] = { "10", "1.5", "base" };
+			assert(strings->Set(Key(i), bases[i % 3]).ok());
+			model[Key(i)] = bases[i % 3];
+		}
+		strings->CompactRange(nullptr, nullptr);
+		assert(NumLevels() == 1);
+
+		for (int round = 0; round < 3; round++) {
+			for (int i = 0; i < kNumKeys; i++) {
+				Apply(i, round);
+			}
+
+			if (round < 2) {
+				// Each flush lands in the level above the previous one.
+				assert(strings->GetDB()->TESTCompactMemTable().ok());
+				assert(NumLevels() == round + 2);
+			}
+		}
+		// Operands of round 1 are in level 0, those of round 0 in the
+		// level between it and the values, and those of round 2 in the
+		// memtable.
+		assert(NumFiles(0) > 0);
+		Check();
+
+		strings->CompactRange(nullptr, nullptr);
+		assert(NumLevels() == 1);
+		Check();
+
+		// Folded values under new operands
+		for (int i = 0; i < kNumKeys; i++) {
+			Apply(i, 3);
+		}
+		Check();
+		strings->CompactRange(nullptr, nullptr);
+		Check();
+	}
+
+	// A string that expires while an increment written before is still
+	// in the memtable must stay expired once compaction reaches it.
+	void ExpiredBaseValue() {
+		int32_t ret;
+		assert(strings->Setnx("expiring", "5", &ret, 1).ok());
+		assert(ret == 1);
+		strings->CompactRange(nullptr, nullptr);
+		assert(strings->Incrby("expiring", 1, nullptr).ok());
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+		std::string value;
+		assert(strings->Get("expiring", &value).IsNotFound());
+
+		// Compact the level of the expired value, but not the memtable
+		// that holds the increment.
+		int level = 0;
+		while (NumFiles(level) == 0) {
+			level++;
+		}
+		strings->GetDB()->TESTCompactRange(level, nullptr, nullptr);
+		assert(strings->Get("expiring", &value).IsNotFound());
+
+		strings->CompactRange(nullptr, nullptr);
+		assert(strings->Get("expiring", &value).IsNotFound());
+
+		// A later increment starts over, without the old timestamp.
+		assert(strings->Incrby("expiring", 2, nullptr).ok());
+		assert(strings->Get("expiring", &value).ok());
+		assert(value == "2");
+		int64_t ttl;
+		assert(strings->TTL("expiring", &ttl).ok());
+		assert(ttl == -1);
+	}
+
+private:
+	// Write the operand of "round" for key i, and apply it to the model.
+	void Apply(int i, int round) {
+		const std::string key = Key(i);
+		std::string& expected = model[key];
+		switch (i % 3) {
+		case 0: {
+			const int64_t by = round * 7 - 5;
+			assert(strings->Incrby(key, by, nullptr).ok());
+			expected = std::to_string((expected.empty() ? 0 : std::stoll(expected)) + by);
+			break;
+		}
+
+		case 1: {
+			const std::string by = std::to_string(round) + ".25";
+			assert(strings->Incrbyfloat(key, by, nullptr).ok());
+			long double oldnumber = 0, number;
+			if (!expected.empty()) {
+				assert(StrToLongDouble(expected.data(), expected.size(), &oldnumber) == 0);
+			}
+			assert(StrToLongDouble(by.data(), by.size(), &number) == 0);
+			assert(LongDoubleToStr(oldnumber + number, &expected) == 0);
+			break;
+		}
+
+		default: {
+			const std::string suffix = "-" + std::to_string(round);
+			assert(strings->Append(key, suffix, nullptr).ok());
+			expected += suffix;
+			break;
+		}
+		}
+	}
+
+	void Check() {
+		std::vector<std::string> keys;
+		for (const auto& it : model) {
+			std::string value;
+			assert(strings->Get(it.first, &value).ok());
+			assert(value == it.second);
+			keys.push_back(it.first);
+		}
+
+		std::vector<ValueStatus> vss;
+		assert(strings->MGet(keys, &vss).ok());
+		assert(vss.size() == keys.size());
+		for (size_t i = 0; i < keys.size(); i++) {
+			assert(vss[i].status.ok());
+			assert(vss[i].value == model[keys[i]]);
+		}
+
+		std::shared_ptr<Iterator> iter = strings->GetDB()->NewIterator(ReadOptions());
+		auto it = model.begin();
+		for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+			assert(it != model.end());
+			assert(iter->key() == it->first);
+			assert(UserValue(iter->value()) == it->second);
+		}
+		assert(it == model.end());
+		assert(iter->status().ok());
+
+		auto rit = model.rbegin();
+		for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++rit) {
+			assert(rit != model.rend());
+			assert(iter->key() == rit->first);
+			assert(UserValue(iter->value()) == rit->second);
+		}
+		assert(rit == model.rend());
+		assert(iter->status().ok());
+
+		// Seek into the middle and turn around
+		iter->Seek(Key(kNumKeys / 2));
+		assert(iter->Valid() && iter->key() == Key(kNumKeys / 2));
+		iter->Prev();
+		assert(iter->Valid() && iter->key() == Key(kNumKeys / 2 - 1));
+		assert(UserValue(iter->value()) == model[Key(kNumKeys / 2 - 1)]);
+		iter->Next();
+		assert(iter->Valid() && iter->key() == Key(kNumKeys / 2));
+		assert(UserValue(iter->value()) == model[Key(kNumKeys / 2)]);
+	}
+
+	static std::string UserValue(const std::string_view& value) {
+		ParsedStringsMetaValue pstringsvalue(value);
+		return pstringsvalue.GetValueToString();
+	}
+
+	int NumFiles(int level) {
+		std::string value;
+		assert(strings->GetDB()->GetProperty(
+			"leveldb.num-files-at-level" + std::to_string(level), &value));
+		return std::stoi(value);
+	}
+
+	// Number of levels that hold tables
+	int NumLevels() {
+		int n = 0;
+		for (int level = 0; level < kNumLevels; level++) {
+			if (NumFiles(level) > 0) {
+				n++;
+			}
+		}
+		return n;
+	}
+
+	void DestroyDir(const std::string& dirname) {
+		std::vector<std::string> filenames;
+		if (!options.env->GetChildren(dirname, &filenames).ok()) {
+			return;
+		}
+
+		for (size_t i = 0; i < filenames.size(); i++) {
+			if (filenames[i] != "." && filenames[i] != "..") {
+				options.env->DeleteFile(dirname + "/" + filenames[i]);
+			}
+		}
+		options.env->DeleteDir(dirname);
+	}
+
+	Options options;
+	const std::string path;
+	std::shared_ptr<RedisString> strings;
+	std::map<std::string, std::string> model;
+};
+
+int main() {
+	{
+		MergeTest test;
+		test.Operands();
+	}
+	{
+		MergeTest test;
+		test.ExpiredBaseValue();
+	}
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,231 @@
+#include "redishash.h"
+#include "redisset.h"
+#include "rediszset.h"
+#include "redislist.h"
+#include "comparator.h"
+#include <assert.h>
+#include <stdio.h>
+
+// Compactions of the hash, set, zset and list DBs run the data filters
+// of redisfilter.h.  Every test writes kNumKeys keys of kNumElements
+// elements, deletes or expires the first kNumDeleted keys, which leaves
+// their data behind, and writes the first kNumRewritten of those again
+// under a new version.  It compacts after each step, so that the last
+// compaction merges tables that were already filtered.  Then the data
+// left must be exactly that of the live keys; the meta values of all
+// keys stay.
+
+static const int kNumKeys = 50;
+static const int kNumElements = 10;
+static const int kNumDeleted = 25;
+static const int kNumRewritten = 10;
+static const int kNumRewrittenElements = 3;
+
+static std::string Key(int i) {
+	return "key" + std::to_string(i);
+}
+
+static std::string Element(int i) {
+	return "element" + std::to_string(i);
+}
+
+// Number of entries, meta and data, left in "db".
+static int CountEntries(DB* db) {
+	int n = 0;
+	std::shared_ptr<Iterator> iter = db->NewIterator(ReadOptions());
+	for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+		n++;
+	}
+	assert(iter->status().ok());
+	return n;
+}
+
+// Elements each key should hold after the test.
+static int LiveElements(int i) {
+	if (i < kNumRewritten) {
+		return kNumRewrittenElements;
+	}
+	else if (i < kNumDeleted) {
+		return 0;
+	}
+	return kNumElements;
+}
+
+// Data entries, after the meta entries of all keys, that should be left.
+static int LiveDataEntries(int perelement) {
+	int n = 0;
+	for (int i = 0; i < kNumKeys; i++) {
+		n += LiveElements(i) * perelement;
+	}
+	return n;
+}
+
+class RedisFilterTest {
+public:
+	RedisFilterTest()
+		: path("./test_redisfilter") {
+		options.createifmissing = true;
+		options.env->DeleteDir(path);
+		options.env->CreateDir(path);
+	}
+
+	void Hash() {
+		RedisHash hash(nullptr, options, path + "/hash");
+		assert(hash.Open().ok());
+		for (int round = 0; round < 2; round++) {
+			const int kept = (round == 0) ? kNumKeys : kNumRewritten;
+			const int elements = (round == 0) ? kNumElements : kNumRewrittenElements;
+			for (int i = 0; i < kept; i++) {
+				std::vector<FieldValue> fvs;
+				for (int j = 0; j < elements; j++) {
+					fvs.push_back(FieldValue{ Element(j), Element(j + round) });
+				}
+				assert(hash.HMSet(Key(i), fvs).ok());
+			}
+
+			hash.CompactRange(nullptr, nullptr);
+			// RedisHash::Del() deletes the data itself, and Expire() is
+			// not implemented, so expire the keys by hand.
+			for (int i = 0; round == 0 && i < kNumDeleted; i++) {
+				ExpireNow(hash.GetDB(), Key(i));
+			}
+		}
+
+		hash.CompactRange(nullptr, nullptr);
+		for (int i = 0; i < kNumKeys; i++) {
+			std::vector<FieldValue> fvs;
+			Status s = hash.HGetall(Key(i), &fvs);
+			assert(LiveElements(i) == 0 ? s.IsNotFound() : s.ok());
+			assert(fvs.size() == LiveElements(i));
+		}
+		assert(CountEntries(hash.GetDB()) == kNumKeys + LiveDataEntries(1));
+	}
+
+	void Set() {
+		RedisSet set(nullptr, options, path + "/set");
+		assert(set.Open().ok());
+		for (int round = 0; round < 2; round++) {
+			const int kept = (round == 0) ? kNumKeys : kNumRewritten;
+			const int elements = (round == 0) ? kNumElements : kNumRewrittenElements;
+			for (int i = 0; i < kept; i++) {
+				std::vector<std::string> members;
+				for (int j = 0; j < elements; j++) {
+					members.push_back(Element(j));
+				}
+				int32_t ret;
+				assert(set.SAdd(Key(i), members, &ret).ok());
+			}
+
+			set.CompactRange(nullptr, nullptr);
+			for (int i = 0; round == 0 && i < kNumDeleted; i++) {
+				assert(set.Del(Key(i)).ok());
+			}
+		}
+
+		set.CompactRange(nullptr, nullptr);
+		for (int i = 0; i < kNumKeys; i++) {
+			std::vector<std::string> members;
+			Status s = set.SMembers(Key(i), &members);
+			assert(LiveElements(i) == 0 ? s.IsNotFound() : s.ok());
+			assert(members.size() == LiveElements(i));
+		}
+		assert(CountEntries(set.GetDB()) == kNumKeys + LiveDataEntries(1));
+	}
+
+	void Zset() {
+		static ZSetsScoreKeyComparatorImpl comparator;
+		Options zsetoptions = options;
+		zsetoptions.comparator = &comparator;
+		RedisZset zset(nullptr, zsetoptions, path + "/zset");
+		assert(zset.Open().ok());
+		for (int round = 0; round < 2; round++) {
+			const int kept = (round == 0) ? kNumKeys : kNumRewritten;
+			const int elements = (round == 0) ? kNumElements : kNumRewrittenElements;
+			for (int i = 0; i < kept; i++) {
+				std::vector<ScoreMember> scoremembers;
+				for (int j = 0; j < elements; j++) {
+					scoremembers.push_back(ScoreMember{ j * 1.5 - 3, Element(j) });
+				}
+				int32_t ret;
+				assert(zset.ZAdd(Key(i), scoremembers, &ret).ok());
+			}
+
+			zset.CompactRange(nullptr, nullptr);
+			for (int i = 0; round == 0 && i < kNumDeleted; i++) {
+				assert(zset.Del(Key(i)).ok());
+			}
+		}
+
+		zset.CompactRange(nullptr, nullptr);
+		for (int i = 0; i < kNumKeys; i++) {
+			std::vector<ScoreMember> scoremembers;
+			Status s = zset.ZRange(Key(i), 0, -1, &scoremembers);
+			assert(LiveElements(i) == 0 ? s.IsNotFound() : s.ok());
+			assert(scoremembers.size() == LiveElements(i));
+			for (int j = 0; j < scoremembers.size(); j++) {
+				assert(scoremembers[j].member == Element(j));
+				assert(scoremembers[j].score == j * 1.5 - 3);
+			}
+		}
+
+		// A member key and a score key per element.
+		assert(CountEntries(zset.GetDB()) == kNumKeys + LiveDataEntries(2));
+	}
+
+	void List() {
+		static ListsDataKeyComparatorImpl comparator;
+		Options listoptions = options;
+		listoptions.comparator = &comparator;
+		RedisList list(nullptr, listoptions, path + "/list");
+		assert(list.Open().ok());
+		for (int round = 0; round < 2; round++) {
+			const int kept = (round == 0) ? kNumKeys : kNumRewritten;
+			const int elements = (round == 0) ? kNumElements : kNumRewrittenElements;
+			for (int i = 0; i < kept; i++) {
+				std::vector<std::string> values;
+				for (int j = 0; j < elements; j++) {
+					values.push_back(Element(j));
+				}
+				uint64_t ret;
+				assert(list.LPush(Key(i), values, &ret).ok());
+			}
+
+			list.CompactRange(nullptr, nullptr);
+			for (int i = 0; round == 0 && i < kNumDeleted; i++) {
+				assert(list.Del(Key(i)).ok());
+			}
+		}
+
+		list.CompactRange(nullptr, nullptr);
+		for (int i = 0; i < kNumKeys; i++) {
+			std::vector<std::string> values;
+			Status s = list.LRange(Key(i), 0, -1, &values);
+			assert(LiveElements(i) == 0 ? s.IsNotFound() : s.ok());
+			assert(values.size() == LiveElements(i));
+		}
+		assert(CountEntries(list.GetDB()) == kNumKeys + LiveDataEntries(1));
+	}
+
+private:
+	// Make the meta value of a hash under "key" stale.
+	static void ExpireNow(DB* db, const std::string& key) {
+		std::string metavalue;
+		assert(db->Get(ReadOptions(), key, &metavalue).ok());
+		ParsedHashesMetaValue phashesmetavalue(&metavalue);
+		phashesmetavalue.SetRelativeTimestamp(-1);
+		assert(db->Put(WriteOptions(), key, metavalue).ok());
+	}
+
+	Options options;
+	const std::string path;
+};
+
+int main() {
+	RedisFilterTest test;
+	test.Hash();
+	test.Set();
+	test.Zset();
+	test.List();
+	printf("PASS\n");
+	return 0;
+}
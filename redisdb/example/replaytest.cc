@@ -0,0 +1,144 @@
+#include "db.h"
+#include "writebatch.h"
+#include <assert.h>
+#include <stdio.h>
+#include <map>
+#include <random>
+
+// DB::Open() replays the logs a DB left behind through DB::LogReplayer,
+// with Options::recoverythreads inserter threads.  The test writes with
+// a memtable large enough that nothing is flushed, drops the DB without
+// flushing, as a crash would, and reopens it with a memtable small
+// enough that the replay flushes many times.  Most keys are overwritten
+// throughout the log, so their versions end up in different memtables
+// and level-0 tables, and one hot key is written by every batch.  Every
+// batch also writes a key of its own, which nothing overwrites, so an
+// entry lost anywhere in the log shows.  The DB must then hold exactly
+// what was written.
+//
+// The number of threads is capped at the number of cores, so on a
+// machine with fewer cores than a run asks for, that run checks fewer
+// threads.
+
+static const int kNumKeys = 2000;
+static const int kNumBatches = 20000;
+
+static std::string Key(int i) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "key%05d", i);
+	return buf;
+}
+
+class ReplayTest {
+public:
+	ReplayTest()
+		: dbname("./test_replay"),
+		rnd(301) {
+		options.createifmissing = true;
+	}
+
+	// Crash and reopen twice: the second replay lands on top of the
+	// tables of the first, after writes that the first sequence numbers
+	// recovered must not shadow.
+	void Run(int threads) {
+		DestroyDir(dbname);
+		model.clear();
+		for (int round = 0; round < 2; round++) {
+			Open(64 << 20, threads);
+			Write(round);
+			db.reset();
+
+			Open(64 << 10, threads);
+			Check();
+			db.reset();
+		}
+	}
+
+private:
+	void Open(size_t writebuffersize, int threads) {
+		Options opts = options;
+		opts.writebuffersize = writebuffersize;
+		opts.recoverythreads = threads;
+		db.reset(new DB(opts, dbname));
+		assert(db->Open().ok());
+	}
+
+	// Batches of one to five updates, some to the same key twice, with
+	// a tenth of them deletions, and the updates of the hot key and of
+	// the batch's own key.
+	void Write(int round) {
+		for (int b = 0; b < kNumBatches; b++) {
+			WriteBatch batch;
+			const int n = 1 + rnd() % 5;
+			for (int i = 0; i < n; i++) {
+				const std::string key = Key(rnd() % kNumKeys);
+				if (rnd() % 10 == 0) {
+					batch.Delete(key);
+					model.erase(key);
+				}
+				else {
+					const std::string value = key + ":" + std::to_string(b) + ":" +
+						std::string(rnd() % 200, 'v');
+					batch.Put(key, value);
+					model[key] = value;
+				}
+			}
+
+			const std::string hot = std::to_string(b);
+			batch.Put("hot", hot);
+			model["hot"] = hot;
+			const std::string own = "own" + std::to_string(round) + ":" + hot;
+			batch.Put(own, hot);
+			model[own] = hot;
+			assert(db->Write(WriteOptions(), &batch).ok());
+		}
+	}
+
+	void Check() {
+		for (const auto& it : model) {
+			std::string value;
+			assert(db->Get(ReadOptions(), it.first, &value).ok());
+			assert(value == it.second);
+		}
+
+		std::shared_ptr<Iterator> iter = db->NewIterator(ReadOptions());
+		auto it = model.begin();
+		for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+			assert(it != model.end());
+			assert(iter->key() == it->first);
+			assert(iter->value() == it->second);
+		}
+		assert(it == model.end());
+		assert(iter->status().ok());
+	}
+
+	void DestroyDir(const std::string& dirname) {
+		std::vector<std::string> filenames;
+		if (!options.env->GetChildren(dirname, &filenames).ok()) {
+			return;
+		}
+
+		for (size_t i = 0; i < filenames.size(); i++) {
+			if (filenames[i] != "." && filenames[i] != "..") {
+				options.env->DeleteFile(dirname + "/" + filenames[i]);
+			}
+		}
+		options.env->DeleteDir(dirname);
+	}
+
+	Options options;
+	const std::string dbname;
+	std::mt19937 rnd;
+	std::shared_ptr<DB> db;
+	std::map<std::string, std::string> model;
+};
+
+int main() {
+	ReplayTest test;
+	const int threads[] = { 1, 4, 8 };
+	for (int t : threads) {
+		test.Run(t);
+	}
+	printf("PASS\n");
+	return 0;
+}
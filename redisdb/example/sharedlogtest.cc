@@ -0,0 +1,179 @@
+#include "db.h"
+#include "filename.h"
+#include "sharedlog.h"
+#include "writebatch.h"
+#include <assert.h>
+#include <stdio.h>
+
+// Two DBs, the members, write to one SharedLog.  The tests reopen them
+// after some of the members have flushed and check that every member
+// replays its own entries of the log and nothing else, and that a log
+// file stays until every member has flushed what it holds for it.
+
+static const int kNumMembers = 2;
+
+class SharedLogTest {
+public:
+	SharedLogTest()
+		: dbname("./test_sharedlog") {
+		options.createifmissing = true;
+		DestroyDir(LogDir());
+		for (int i = 0; i < kNumMembers; i++) {
+			DestroyDir(MemberDir(i));
+		}
+		options.env->CreateDir(dbname);
+	}
+
+	~SharedLogTest() {
+		Close();
+	}
+
+	// Open the log and the members in "members"; the others stay closed.
+	void Open(int members = kNumMembers) {
+		Close();
+		log.reset(new SharedLog(options, LogDir(), kNumMembers));
+		assert(log->Open().ok());
+		for (int i = 0; i < members; i++) {
+			OpenMember(i);
+		}
+	}
+
+	void OpenMember(int i) {
+		Options memberoptions = options;
+		memberoptions.sharedlog = log;
+		memberoptions.sharedlogid = i;
+		dbs[i].reset(new DB(memberoptions, MemberDir(i)));
+		assert(dbs[i]->Open().ok());
+	}
+
+	void Close() {
+		for (int i = 0; i < kNumMembers; i++) {
+			dbs[i].reset();
+		}
+		log.reset();
+	}
+
+	std::string Get(int i, const std::string& key) {
+		std::string value;
+		Status s = dbs[i]->Get(ReadOptions(), key, &value);
+		if (s.IsNotFound()) {
+			return "NOT_FOUND";
+		}
+		else if (!s.ok()) {
+			return s.ToString();
+		}
+		return value;
+	}
+
+	int CountEntries(int i) {
+		int n = 0;
+		std::shared_ptr<Iterator> iter = dbs[i]->NewIterator(ReadOptions());
+		for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+			n++;
+		}
+		assert(iter->status().ok());
+		return n;
+	}
+
+	bool LogExists(uint64_t number) {
+		return options.env->FileExists(LogFileName(LogDir(), number));
+	}
+
+	// An atomic write reaches both members, or neither, and after a
+	// restart each member gets back exactly its half of it, whether it
+	// flushed before the restart or replays the log.
+	void AtomicWriteRecovery() {
+		Open();
+		WriteBatch batch0;
+		WriteBatch batch1;
+		batch0.Put("a", "va");
+		batch1.Put("b", "vb");
+		std::vector<std::pair<DB*, WriteBatch*>> updates;
+		updates.push_back(std::make_pair(dbs[0].get(), &batch0));
+		updates.push_back(std::make_pair(dbs[1].get(), &batch1));
+		assert(DB::AtomicWrite(WriteOptions(), updates).ok());
+		assert(dbs[0]->Put(WriteOptions(), "c", "vc").ok());
+		assert(dbs[1]->Put(WriteOptions(), "d", "vd").ok());
+
+		// Member 0 flushes, so only member 1 has to replay the log.
+		assert(dbs[0]->TESTCompactMemTable().ok());
+		assert(dbs[1]->Put(WriteOptions(), "e", "ve").ok());
+
+		for (int reopen = 0; reopen < 2; reopen++) {
+			Open();
+			assert(Get(0, "a") == "va");
+			assert(Get(0, "c") == "vc");
+			assert(Get(1, "b") == "vb");
+			assert(Get(1, "d") == "vd");
+			assert(Get(1, "e") == "ve");
+			assert(CountEntries(0) == 2);
+			assert(CountEntries(1) == 3);
+		}
+	}
+
+	// A log is deleted once the last member that holds data in it has
+	// flushed, and not while a member that may need it is closed.
+	void LogsOutliveTheirMembers() {
+		Open();
+		const uint64_t first = log->GetLogNumber();
+		assert(dbs[0]->Put(WriteOptions(), "a", "va").ok());
+		assert(dbs[1]->Put(WriteOptions(), "b", "vb").ok());
+
+		assert(dbs[0]->TESTCompactMemTable().ok());
+		assert(log->GetLogNumber() > first);
+		assert(LogExists(first));
+
+		assert(dbs[1]->TESTCompactMemTable().ok());
+		assert(!LogExists(first));
+
+		// Member 1 writes to the current log and stops, member 0 has
+		// nothing in it.  Reopened alone, member 0 must not delete it.
+		const uint64_t second = log->GetLogNumber();
+		assert(dbs[1]->Put(WriteOptions(), "c", "vc").ok());
+		Open(1);
+		assert(Get(0, "a") == "va");
+		assert(LogExists(second));
+
+		OpenMember(1);
+		assert(Get(1, "b") == "vb");
+		assert(Get(1, "c") == "vc");
+		assert(!LogExists(second));
+	}
+
+private:
+	std::string LogDir() const { return dbname + "/wal"; }
+
+	std::string MemberDir(int i) const { return dbname + "/db" + std::to_string(i); }
+
+	void DestroyDir(const std::string& dirname) {
+		std::vector<std::string> filenames;
+		if (!options.env->GetChildren(dirname, &filenames).ok()) {
+			return;
+		}
+
+		for (size_t i = 0; i < filenames.size(); i++) {
+			if (filenames[i] != "." && filenames[i] != "..") {
+				options.env->DeleteFile(dirname + "/" + filenames[i]);
+			}
+		}
+		options.env->DeleteDir(dirname);
+	}
+
+	Options options;
+	const std::string dbname;
+	std::shared_ptr<SharedLog> log;
+	std::shared_ptr<DB> dbs[kNumMembers];
+};
+
+int main() {
+	{
+		SharedLogTest test;
+		test.AtomicWriteRecovery();
+	}
+	{
+		SharedLogTest test;
+		test.LogsOutliveTheirMembers();
+	}
+	printf("PASS\n");
+	return 0;
+}